@@ -31,11 +31,13 @@
 #define ADBLOCK_PLUS_ADBLOCK_PLUS_H
 
 #include <AdblockPlus/AppInfo.h>
+#include <AdblockPlus/CompiledFilterListMatcher.h>
 #include <AdblockPlus/FilterEngine.h>
 #include <AdblockPlus/LogSystem.h>
 #include <AdblockPlus/JsEngine.h>
 #include <AdblockPlus/JsValue.h>
 #include <AdblockPlus/ReferrerMapping.h>
+#include <AdblockPlus/SharedFilterList.h>
 #include "AdblockPlus/Notification.h"
 
 #endif
@@ -15,10 +15,11 @@
  * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
-#include <list>
+#include <memory>
 #include <thread>
 #include <functional>
-#include "SynchronizedCollection.h"
+#include <type_traits>
+#include "MpscQueue.h"
 
 namespace AdblockPlus
 {
@@ -45,16 +46,76 @@ namespace AdblockPlus
     ~ActiveObject();
     /**
      * Adds the `call`, which should be executed in the worker thread to the
-     * end of the internally held list.
-     * @param call object.
+     * end of the internally held queue. The caller is never blocked by the
+     * worker thread.
+     * @param call object, it can be move-only. There is no effect if `call` is
+     *        an empty `Call`.
      */
-    void Post(const Call& call);
-    void Post(Call&& call);
+    template<typename Callable>
+    void Post(Callable&& call)
+    {
+      if (IsEmpty(call))
+        return;
+      calls.Push(Task(std::forward<Callable>(call)));
+    }
   private:
+    // Type erased move-only callable object.
+    class Task
+    {
+    public:
+      Task()
+      {
+      }
+      template<typename Callable>
+      explicit Task(Callable&& call)
+        : impl(new Impl<typename std::decay<Callable>::type>(std::forward<Callable>(call)))
+      {
+      }
+      void operator()()
+      {
+        impl->Run();
+      }
+    private:
+      struct ImplBase
+      {
+        virtual ~ImplBase()
+        {
+        }
+        virtual void Run() = 0;
+      };
+      template<typename Callable>
+      struct Impl : ImplBase
+      {
+        explicit Impl(Callable&& call)
+          : call(std::move(call))
+        {
+        }
+        explicit Impl(const Callable& call)
+          : call(call)
+        {
+        }
+        void Run() override
+        {
+          call();
+        }
+        Callable call;
+      };
+      std::unique_ptr<ImplBase> impl;
+    };
+
+    template<typename Callable>
+    static bool IsEmpty(const Callable&)
+    {
+      return false;
+    }
+    static bool IsEmpty(const Call& call)
+    {
+      return !call;
+    }
     void ThreadFunc();
   private:
     bool isRunning;
-    SynchronizedCollection<std::list<Call>> calls;
+    MpscQueue<Task> calls;
     std::thread thread;
   };
 }
\ No newline at end of file
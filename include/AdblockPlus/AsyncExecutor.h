@@ -15,7 +15,12 @@
  * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
 #include "ActiveObject.h"
+#include "ThreadPool.h"
 
 namespace AdblockPlus
 {
@@ -64,10 +69,20 @@ namespace AdblockPlus
   };
 
   /**
-   * This class provides the same interface as `AsyncExecutor` but allows in
-   * a thread-safe manner invalidate internally held implementation of
-   * `AsyncExecutor`. Any subsequent calls of `Dispatch` have no effect,
-   * what allows to safely share `AsyncExecutor` but control it's operability.
+   * Lanes of `OptionalAsyncExecutor`. Each lane has its own threads, so that
+   * e.g. blocking network requests can not delay file system operations.
+   */
+  enum class AsyncExecutorLane
+  {
+    Default,
+    WebRequest
+  };
+
+  /**
+   * This class executes tasks in a `ThreadPool` per lane and allows in a
+   * thread-safe manner to invalidate the internally held pools. Any subsequent
+   * calls of `Dispatch` have no effect, what allows to safely share the
+   * executor but control it's operability.
    */
   class OptionalAsyncExecutor
   {
@@ -75,41 +90,74 @@ namespace AdblockPlus
     /**
      * Contructor.
      *
-     * Initially constructed the class behaves as `AsyncExecutor`.
+     * Initially constructed the class dispatches tasks to the thread pools.
+     * @param defaultLaneThreadsNumber Number of threads of the
+     *        `AsyncExecutorLane::Default` lane, zero selects a number based
+     *        on the number of CPU cores.
+     * @param webRequestLaneThreadsNumber Number of threads of the
+     *        `AsyncExecutorLane::WebRequest` lane.
      */
-    OptionalAsyncExecutor()
-      : executor(new AsyncExecutor())
+    explicit OptionalAsyncExecutor(size_t defaultLaneThreadsNumber = 0,
+                                   size_t webRequestLaneThreadsNumber = 4)
     {
+      if (defaultLaneThreadsNumber == 0)
+      {
+        defaultLaneThreadsNumber = std::min<size_t>(
+          std::max(2u, std::thread::hardware_concurrency()), 4);
+      }
+      lanes[static_cast<size_t>(AsyncExecutorLane::Default)].reset(
+        new ThreadPool(defaultLaneThreadsNumber));
+      lanes[static_cast<size_t>(AsyncExecutorLane::WebRequest)].reset(
+        new ThreadPool(webRequestLaneThreadsNumber));
     }
 
     /**
-     * Creates a new thread in which the `call` will be executed.
+     * Executes the `call` in a worker thread of the lane.
      * @param call is a function object which is called within a worker thread,
      *        different from the caller thread. There is no effect if `call` is
      *        empty or if `Invalidate` had been already called.
+     * @param lane The lane to execute the `call` in.
      */
-    void Dispatch(const std::function<void()>& call)
+    void Dispatch(const std::function<void()>& call,
+                  AsyncExecutorLane lane = AsyncExecutorLane::Default)
     {
       std::lock_guard<std::mutex> lock(asyncExecutorMutex);
-      if (!executor)
+      auto& pool = lanes[static_cast<size_t>(lane)];
+      if (!pool)
         return;
-      executor->Dispatch(call);
+      pool->Dispatch(call);
+    }
+
+    /**
+     * Returns the statistics of the lane, e.g. to monitor the queue depth.
+     * After `Invalidate` all values are zero.
+     */
+    ThreadPool::Metrics GetMetrics(AsyncExecutorLane lane) const
+    {
+      std::lock_guard<std::mutex> lock(asyncExecutorMutex);
+      auto& pool = lanes[static_cast<size_t>(lane)];
+      if (!pool)
+        return ThreadPool::Metrics();
+      return pool->GetMetrics();
     }
 
     /**
-     * Destroys internally held `AsyncExecutor`, any subsequent calls of
-     * `Dispatch` have no effect.
+     * Destroys internally held thread pools, any subsequent calls of
+     * `Dispatch` have no effect. It waits for finishing of all already
+     * dispatched tasks.
      */
     void Invalidate()
     {
-      std::unique_ptr<AsyncExecutor> tmp;
+      std::unique_ptr<ThreadPool> tmp[lanesNumber];
       {
         std::lock_guard<std::mutex> lock(asyncExecutorMutex);
-        tmp = move(executor);
+        for (size_t i = 0; i < lanesNumber; ++i)
+          tmp[i] = move(lanes[i]);
       }
     }
   private:
-    std::mutex asyncExecutorMutex;
-    std::unique_ptr<AsyncExecutor> executor;
+    static const size_t lanesNumber = 2;
+    mutable std::mutex asyncExecutorMutex;
+    std::unique_ptr<ThreadPool> lanes[lanesNumber];
   };
 }
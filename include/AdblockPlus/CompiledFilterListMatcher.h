@@ -0,0 +1,88 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_COMPILED_FILTER_LIST_MATCHER_H
+#define ADBLOCK_PLUS_COMPILED_FILTER_LIST_MATCHER_H
+
+#include <memory>
+#include <string>
+#include <AdblockPlus/FilterEngine.h>
+#include <AdblockPlus/IFileSystem.h>
+
+namespace AdblockPlus
+{
+  /**
+   * Matches requests against a filter list compiled by
+   * `FilterEngine::CompileFilterList()` or
+   * `FilterEngine::CompileActiveFilters()`, without `JsEngine`. The
+   * compiled filter list is matched in place, e.g. a memory mapped file
+   * returned by `IFileSystem::ReadBuffer()`, so it's usable right away
+   * while `FilterEngine::CreateAsync()` is still loading the filter lists.
+   *
+   * The matcher only knows the filters which were compiled:
+   * - The output of `CompileFilterList()` has neither the filters of the
+   *   user nor the state of disabled subscriptions and filters, so user
+   *   exceptions don't apply and filters of disabled subscriptions do.
+   *   `CompileActiveFilters()` includes them, e.g. when it's called at
+   *   shutdown for the next start.
+   * - Filters which are added, removed or disabled afterwards aren't
+   *   reflected.
+   * - Only request filters are covered, not element hiding.
+   * Callers should switch to `FilterEngine::Matches()` once the filter
+   * engine is created.
+   *
+   * Filters which can't be matched natively make the result `UNKNOWN`.
+   * All methods are thread-safe.
+   */
+  class CompiledFilterListMatcher
+  {
+  public:
+    enum MatchResult {NO_MATCH, MATCH, UNKNOWN};
+
+    /**
+     * Checks the compiled filter list, which is referenced as long as the
+     * matcher exists. It's copied if it isn't 8 byte aligned.
+     * Throws `std::invalid_argument` if it isn't a compiled filter list of
+     * the supported format version or is corrupted.
+     * @param compiledFilterList Compiled filter list.
+     */
+    explicit CompiledFilterListMatcher(const IFileSystem::ReadOnlyBufferPtr& compiledFilterList);
+    ~CompiledFilterListMatcher();
+    CompiledFilterListMatcher(const CompiledFilterListMatcher&) = delete;
+    CompiledFilterListMatcher& operator=(const CompiledFilterListMatcher&) = delete;
+
+    /**
+     * Matches a request like `FilterEngine::Matches()` does.
+     * @param url URL to match.
+     * @param contentTypeMask Content type mask of the requested resource.
+     * @param documentUrl URL of the document requesting the resource.
+     * @param filterText Text of the matching filter, it's set if the result
+     *        is `MATCH`. Exception filters start with `@@` and take
+     *        precedence over blocking filters.
+     * @return Whether a filter matches.
+     */
+    MatchResult Matches(const std::string& url,
+                        FilterEngine::ContentTypeMask contentTypeMask,
+                        const std::string& documentUrl,
+                        std::string& filterText) const;
+  private:
+    struct Image;
+    std::unique_ptr<const Image> image;
+  };
+}
+
+#endif
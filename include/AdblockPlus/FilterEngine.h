@@ -18,6 +18,7 @@
 #ifndef ADBLOCK_PLUS_FILTER_ENGINE_H
 #define ADBLOCK_PLUS_FILTER_ENGINE_H
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <string>
@@ -29,6 +30,7 @@
 namespace AdblockPlus
 {
   class FilterEngine;
+  class FilterIndex;
   typedef std::shared_ptr<FilterEngine> FilterEnginePtr;
 
   /**
@@ -182,6 +184,65 @@ namespace AdblockPlus
    */
   typedef std::unique_ptr<Filter> FilterPtr;
 
+  /**
+   * Summary of the filter changes made by one JavaScript task, see
+   * `FilterEngine::SetFilterChangeBatchCallback()`.
+   */
+  class FilterChangeBatch
+  {
+    friend class FilterEngine;
+  public:
+    /**
+     * Number of changes per action event code, e.g. "filter.added".
+     */
+    typedef std::map<std::string, uint32_t> ActionCounts;
+
+    /**
+     * Returns the number of changes per action event code.
+     * @return Action counts.
+     */
+    const ActionCounts& GetActionCounts() const
+    {
+      return actionCounts;
+    }
+
+    /**
+     * Returns URLs of the subscriptions which were changed or whose filters
+     * were changed.
+     * @return Subscription URLs.
+     */
+    const std::vector<std::string>& GetSubscriptionUrls() const
+    {
+      return subscriptionUrls;
+    }
+
+    /**
+     * Returns the generation of filters after the changes, see
+     * `FilterEngine::GetFiltersGeneration()`.
+     * @return Generation of filters.
+     */
+    uint64_t GetGeneration() const
+    {
+      return generation;
+    }
+
+    /**
+     * Retrieves the individual changes in the order they were made, the
+     * affected filter/subscription objects are only created by this call.
+     * @return Action event codes with the affected objects, if any.
+     */
+    std::vector<std::pair<std::string, JsValue>> GetChanges() const;
+
+  private:
+    FilterChangeBatch(JsValue&& actions, JsValue&& items);
+
+    ActionCounts actionCounts;
+    std::vector<std::string> subscriptionUrls;
+    uint64_t generation;
+    JsValue actions;
+    JsValue items;
+  };
+
   /**
    * Main component of libadblockplus.
    * It handles:
@@ -246,6 +307,12 @@ namespace AdblockPlus
      */
     typedef std::function<void(const std::string&, JsValue&&)> FilterChangeCallback;
 
+    /**
+     * Callback type invoked once for all filter changes made by one
+     * JavaScript task.
+     */
+    typedef std::function<void(FilterChangeBatch&&)> FilterChangeBatchCallback;
+
     /**
      * Container of name-value pairs representing a set of preferences.
      */
@@ -280,6 +347,12 @@ namespace AdblockPlus
        * on the current connection.
        */
       IsConnectionAllowedAsyncCallback isSubscriptionDownloadAllowedCallback;
+      /**
+       * Maximum number of automaton states of a wildcard or regular
+       * expression filter which is matched natively. More complex filters
+       * are matched by the JavaScript matcher, 0 leaves all of them to it.
+       */
+      size_t patternStatesBudget = 512;
     };
 
     /**
@@ -293,11 +366,22 @@ namespace AdblockPlus
      *        internally.
      * @param onCreated A callback which is called when FilterEngine is ready
      *        for use.
-     * @param parameters optional creation parameters.
+     * @param parameters creation parameters.
      */
     static void CreateAsync(const JsEnginePtr& jsEngine,
       const OnCreatedCallback& onCreated,
-      const CreationParameters& parameters = CreationParameters());
+      const CreationParameters& parameters);
+
+    /**
+     * Asynchronously constructs FilterEngine with the default
+     * `CreationParameters`.
+     * @param jsEngine `JsEngine` instance used to run JavaScript code
+     *        internally.
+     * @param onCreated A callback which is called when FilterEngine is ready
+     *        for use.
+     */
+    static void CreateAsync(const JsEnginePtr& jsEngine,
+      const OnCreatedCallback& onCreated);
 
     /**
      * Retrieves the `JsEngine` instance associated with this `FilterEngine`
@@ -513,6 +597,67 @@ namespace AdblockPlus
      */
     void RemoveFilterChangeCallback();
 
+    /**
+     * Sets the callback invoked with a summary of the filter changes once
+     * the JavaScript task which made them is finished. It's an alternative
+     * to `SetFilterChangeCallback()` for embedders which would otherwise be
+     * flooded with events, e.g. when a subscription is updated. Changes are
+     * only collected while the callback is set.
+     * @param callback Callback to invoke.
+     */
+    void SetFilterChangeBatchCallback(const FilterChangeBatchCallback& callback);
+
+    /**
+     * Removes the callback set by `SetFilterChangeBatchCallback()`.
+     */
+    void RemoveFilterChangeBatchCallback();
+
+    /**
+     * Returns the generation of filters. It's incremented whenever the
+     * content of the matcher or of element hiding changes, so it allows to
+     * invalidate cached results of e.g. `Matches()` and
+     * `GetElementHidingSelectors()` with one atomic load. Changes made by one
+     * JavaScript task increment it once after all of them are applied.
+     * The method is thread-safe and does not lock `JsEngine`.
+     * @return Generation of filters.
+     */
+    uint64_t GetFiltersGeneration() const;
+
+    /**
+     * Retrieves the number of bytes used by the native filter index, i.e. by
+     * the keyword Bloom filters and the native filter automata which answer
+     * `Matches()` without locking `JsEngine` where possible.
+     * The method is thread-safe and does not lock `JsEngine`.
+     * @return Memory usage in bytes.
+     */
+    size_t GetFilterIndexMemoryUsage() const;
+
+    /**
+     * Compiles the request filters of a filter list ahead of time, e.g. by
+     * the `abpcompile` tool. Other filters are skipped.
+     * @param filterListContent Content of one or more filter lists.
+     * @return Compiled filter list for `CompiledFilterListMatcher`.
+     */
+    IFileSystem::IOBuffer CompileFilterList(const std::string& filterListContent) const;
+
+    /**
+     * Compiles the currently active request filters, e.g. for publishing
+     * them with `SharedFilterListPublisher`.
+     * @return Compiled filter list in the format of `CompileFilterList()`.
+     */
+    IFileSystem::IOBuffer CompileActiveFilters() const;
+
+    /**
+     * Waits until the generation of filters differs from `generation`.
+     * The method is thread-safe and does not lock `JsEngine`.
+     * @param generation Generation known to the caller.
+     * @param timeout Maximum time to wait.
+     * @return Current generation of filters, it's equal to `generation` if
+     *         the timeout has expired.
+     */
+    uint64_t WaitForFiltersChange(uint64_t generation,
+      const std::chrono::milliseconds& timeout) const;
+
     /**
      * Stores the value indicating what connection types are allowed, it is
      * passed to CreateParameters::isConnectionAllowed callback.
@@ -556,17 +701,25 @@ namespace AdblockPlus
     static std::string ContentTypeToString(ContentType contentType);
 
   private:
+    class FiltersGeneration;
+
     JsEnginePtr jsEngine;
     bool firstRun;
     int updateCheckId;
+    std::shared_ptr<FiltersGeneration> filtersGeneration;
+    std::shared_ptr<FilterIndex> filterIndex;
+    // Accessed only while holding the isolate lock.
+    std::map<int, UpdateCheckDoneCallback> updateCheckDoneCallbacks;
     static const std::map<ContentType, std::string> contentTypes;
 
-    explicit FilterEngine(const JsEnginePtr& jsEngine);
+    FilterEngine(const JsEnginePtr& jsEngine, size_t patternStatesBudget);
 
     FilterPtr CheckFilterMatch(const std::string& url,
                                ContentTypeMask contentTypeMask,
                                const std::string& documentUrl) const;
     void FilterChanged(const FilterChangeCallback& callback, JsValueList&& params) const;
+    void FilterChangeBatchReceived(const FilterChangeBatchCallback& callback, JsValueList&& params);
+    void UpdateCheckDone(JsValueList&& params);
     FilterPtr GetWhitelistingFilter(const std::string& url,
       ContentTypeMask contentTypeMask, const std::string& documentUrl) const;
     FilterPtr GetWhitelistingFilter(const std::string& url,
@@ -84,6 +84,120 @@ namespace AdblockPlus
                       const ReadCallback& doneCallback,
                       const Callback& errorCallback) const = 0;
 
+    /**
+     * Immutable content of a file. Implementations may e.g. reference a
+     * memory mapped file instead of holding a copy of the content.
+     */
+    struct IReadOnlyBuffer
+    {
+      virtual ~IReadOnlyBuffer() {}
+
+      /**
+       * Returns a pointer to the content, it is valid as long as the buffer
+       * object is alive.
+       */
+      virtual const uint8_t* Data() const = 0;
+
+      /**
+       * Returns the size of the content in bytes.
+       */
+      virtual size_t Size() const = 0;
+    };
+
+    /**
+     * Shared smart pointer to an `IReadOnlyBuffer` instance.
+     */
+    typedef std::shared_ptr<const IReadOnlyBuffer> ReadOnlyBufferPtr;
+
+    /**
+     * `IReadOnlyBuffer` holding an `IOBuffer`.
+     */
+    class ReadOnlyIOBuffer : public IReadOnlyBuffer
+    {
+    public:
+      explicit ReadOnlyIOBuffer(IOBuffer&& buffer)
+        : buffer(std::move(buffer))
+      {
+      }
+
+      const uint8_t* Data() const override
+      {
+        return buffer.data();
+      }
+
+      size_t Size() const override
+      {
+        return buffer.size();
+      }
+    private:
+      IOBuffer buffer;
+    };
+
+    /**
+     * Callback type for the asynchronous ReadBuffer call.
+     * @param Immutable file content.
+     */
+    typedef std::function<void(const ReadOnlyBufferPtr&)> ReadBufferCallback;
+
+    /**
+     * Reads from a file without requiring the content to be copied into an
+     * `IOBuffer`.
+     * The default implementation calls `Read` and takes over the read data.
+     * @param fileName File name.
+     * @param doneCallback The function called on completion with the input
+     *   data. If this function throws then the implementation should call
+     *   `errorCallback`.
+     * @param errorCallback The function called if an error occured.
+     */
+    virtual void ReadBuffer(const std::string& fileName,
+                            const ReadBufferCallback& doneCallback,
+                            const Callback& errorCallback) const
+    {
+      Read(fileName, [doneCallback](IOBuffer&& content)
+        {
+          doneCallback(std::make_shared<ReadOnlyIOBuffer>(std::move(content)));
+        }, errorCallback);
+    }
+
+    /**
+     * Callback type receiving a chunk of file content, the data is only valid
+     * during the call.
+     * @param data Pointer to the chunk.
+     * @param size Size of the chunk in bytes.
+     */
+    typedef std::function<void(const uint8_t* data, size_t size)> ReadChunkCallback;
+
+    /**
+     * Callback type invoked after the last chunk of a file has been read.
+     */
+    typedef std::function<void()> ReadEndCallback;
+
+    /**
+     * Reads a file in chunks, what allows to process large files without
+     * holding the whole content in memory.
+     * The default implementation calls `ReadBuffer` and passes the whole
+     * content as a single chunk.
+     * @param fileName File name.
+     * @param chunkCallback The function called sequentially for each read
+     *   chunk. If this function throws then the implementation should stop
+     *   reading and call `errorCallback`.
+     * @param endCallback The function called after the last chunk. If this
+     *   function throws then the implementation should call `errorCallback`.
+     * @param errorCallback The function called if an error occured.
+     */
+    virtual void ReadChunks(const std::string& fileName,
+                            const ReadChunkCallback& chunkCallback,
+                            const ReadEndCallback& endCallback,
+                            const Callback& errorCallback) const
+    {
+      ReadBuffer(fileName, [chunkCallback, endCallback](const ReadOnlyBufferPtr& content)
+        {
+          if (content->Size() > 0)
+            chunkCallback(content->Data(), content->Size());
+          endCallback();
+        }, errorCallback);
+    }
+
     /**
      * Writes to a file.
      * @param fileName File name.
@@ -94,6 +208,112 @@ namespace AdblockPlus
                        const IOBuffer& data,
                        const Callback& callback) = 0;
 
+    /**
+     * Appends to a file, the file is created if it does not exist.
+     * The default implementation reads the file and writes it back with the
+     * data appended.
+     * @param fileName File name.
+     * @param data The data to append.
+     * @param callback The function called on completion.
+     */
+    virtual void Append(const std::string& fileName,
+                        const IOBuffer& data,
+                        const Callback& callback)
+    {
+      Stat(fileName, [this, fileName, data, callback](const StatResult& result, const std::string& error)
+        {
+          if (!error.empty())
+            return callback(error);
+          if (!result.exists)
+            return Write(fileName, data, callback);
+          Read(fileName, [this, fileName, data, callback](IOBuffer&& content)
+            {
+              content.insert(content.end(), data.begin(), data.end());
+              Write(fileName, content, callback);
+            }, callback);
+        });
+    }
+
+    /**
+     * Writer of a file opened by `OpenForWrite`.
+     * Calls must be made one after another, the next call is only allowed
+     * after the callback of the previous one has been called.
+     */
+    class IFileWriter
+    {
+    public:
+      virtual ~IFileWriter() {}
+
+      /**
+       * Appends data to the file.
+       * @param data The data to append.
+       * @param callback The function called on completion.
+       */
+      virtual void Append(const IOBuffer& data, const Callback& callback) = 0;
+
+      /**
+       * Replaces the file by the written content. If the writer is
+       * destroyed without calling `Commit` then the file stays unchanged.
+       * @param callback The function called on completion.
+       */
+      virtual void Commit(const Callback& callback) = 0;
+    };
+
+    /**
+     * Shared smart pointer to an `IFileWriter` instance.
+     */
+    typedef std::shared_ptr<IFileWriter> FileWriterPtr;
+
+    /**
+     * Callback type for the asynchronous OpenForWrite call.
+     * @param The writer, `nullptr` if an error occured.
+     * @param An error string. Empty is success.
+     */
+    typedef std::function<void(const FileWriterPtr&, const std::string&)> OpenForWriteCallback;
+
+    /**
+     * `IFileWriter` collecting the content in memory and passing it to
+     * `IFileSystem::Write` on `Commit`.
+     */
+    class BufferedFileWriter : public IFileWriter
+    {
+    public:
+      BufferedFileWriter(IFileSystem& fileSystem, const std::string& fileName)
+        : fileSystem(fileSystem), fileName(fileName)
+      {
+      }
+
+      void Append(const IOBuffer& data, const Callback& callback) override
+      {
+        content.insert(content.end(), data.begin(), data.end());
+        callback("");
+      }
+
+      void Commit(const Callback& callback) override
+      {
+        IOBuffer committedContent;
+        committedContent.swap(content);
+        fileSystem.Write(fileName, committedContent, callback);
+      }
+    private:
+      IFileSystem& fileSystem;
+      std::string fileName;
+      IOBuffer content;
+    };
+
+    /**
+     * Opens a file for writing its content piece by piece, what allows to
+     * write large files without holding the whole content in memory.
+     * The default implementation returns a `BufferedFileWriter`.
+     * @param fileName File name.
+     * @param callback The function called on completion.
+     */
+    virtual void OpenForWrite(const std::string& fileName,
+                              const OpenForWriteCallback& callback)
+    {
+      callback(std::make_shared<BufferedFileWriter>(*this, fileName), "");
+    }
+
     /**
      * Moves a file (i.e.\ renames it).
      * @param fromFileName Current file name.
@@ -21,6 +21,7 @@
 #include <functional>
 #include <chrono>
 #include <memory>
+#include <mutex>
 
 namespace AdblockPlus
 {
@@ -33,6 +34,14 @@ namespace AdblockPlus
     * Callback type invoked after elapsing of timer timeout.
     */
     typedef std::function<void()> TimerCallback;
+
+    /**
+     * Cancels the timer it is returned for by `SetCancelableTimer` and
+     * releases the timer callback. It has no effect if the timer has already
+     * fired or has been cancelled.
+     */
+    typedef std::function<void()> CancelTimerCallback;
+
     virtual ~ITimer() {};
 
     /**
@@ -41,6 +50,42 @@ namespace AdblockPlus
      * @param timeCallback The callback which is called after timeout.
      */
     virtual void SetTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback) = 0;
+
+    /**
+     * Sets a timer which can be cancelled before it fires.
+     * The default implementation uses `SetTimer`, a cancelled timer releases
+     * `timerCallback` immediately but the timer itself still elapses.
+     * @param timeout A timer callback will be called after that interval.
+     * @param timeCallback The callback which is called after timeout.
+     * @return The function cancelling the timer, it can be called from any
+     *         thread, also after the destruction of the timer.
+     */
+    virtual CancelTimerCallback SetCancelableTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback)
+    {
+      struct PendingTimer
+      {
+        std::mutex mutex;
+        TimerCallback callback;
+      };
+      auto pendingTimer = std::make_shared<PendingTimer>();
+      pendingTimer->callback = timerCallback;
+      SetTimer(timeout, [pendingTimer]
+      {
+        TimerCallback callback;
+        {
+          std::lock_guard<std::mutex> lock(pendingTimer->mutex);
+          callback.swap(pendingTimer->callback);
+        }
+        if (callback)
+          callback();
+      });
+      return [pendingTimer]
+      {
+        TimerCallback callback;
+        std::lock_guard<std::mutex> lock(pendingTimer->mutex);
+        callback.swap(pendingTimer->callback);
+      };
+    }
   };
 
   /**
@@ -18,13 +18,15 @@
 #ifndef ADBLOCK_PLUS_JS_ENGINE_H
 #define ADBLOCK_PLUS_JS_ENGINE_H
 
+#include <deque>
 #include <functional>
 #include <map>
-#include <list>
+#include <memory>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
 #include <mutex>
+#include <utility>
 #include <AdblockPlus/AppInfo.h>
 #include <AdblockPlus/LogSystem.h>
 #include <AdblockPlus/IFileSystem.h>
@@ -45,6 +47,7 @@ namespace v8
 namespace AdblockPlus
 {
   class JsEngine;
+  class JsEventLoop;
   class Platform;
 
   /**
@@ -75,12 +78,8 @@ namespace AdblockPlus
     friend class JsValue;
     friend class JsContext;
 
-    struct JsWeakValuesList
-    {
-      ~JsWeakValuesList();
-      std::vector<v8::Global<v8::Value>> values;
-    };
-    typedef std::list<JsWeakValuesList> JsWeakValuesLists;
+    class JsWeakValuesSlots;
+    class EventCallbacks;
   public:
     /**
      * Event callback function.
@@ -89,16 +88,31 @@ namespace AdblockPlus
 
     /**
      * Maps events to callback functions.
+     * @deprecated Not used by the engine any longer, callbacks are kept by
+     *             event ID, see `GetEventID()`.
      */
     typedef std::map<std::string, EventCallback> EventMap;
 
+    /**
+     * Interned event name, see `GetEventID()`.
+     */
+    typedef uint32_t EventID;
+
     /**
      * An opaque structure representing ID of stored JsValueList.
      */
     class JsWeakValuesID
     {
       friend class JsEngine;
-      JsWeakValuesLists::const_iterator iterator;
+    public:
+      JsWeakValuesID()
+        : index(0), generation(0)
+      {
+      }
+    private:
+      uint32_t index;
+      // Odd while the values are stored, it changes when they are taken.
+      uint32_t generation;
     };
 
     /**
@@ -109,11 +123,23 @@ namespace AdblockPlus
      *        dependencies.
      * @param isolate A provider of v8::Isolate, if the value is nullptr then
      *        a default implementation is used.
+     * @param useEventLoop If `true` then timers, file system and web request
+     *        callbacks as well as `Evaluate` and `JsValue::Call` are executed
+     *        in a dedicated thread of the engine, otherwise they are executed
+     *        in the thread where they come from.
      * @return New `JsEngine` instance.
      */
-    static JsEnginePtr New(const AppInfo& appInfo, Platform& platform, std::unique_ptr<IV8IsolateProvider> isolate = nullptr);
+    static JsEnginePtr New(const AppInfo& appInfo, Platform& platform,
+      std::unique_ptr<IV8IsolateProvider> isolate = nullptr, bool useEventLoop = false);
+
+    /**
+     * Destructor.
+     */
+    ~JsEngine();
     /**
      * Registers the callback function for an event.
+     * The name is interned, see `GetEventID()`. Looking it up takes a lock,
+     * frequently used events are better handled by their ID.
      * @param eventName Event name. Note that this can be any string - it's a
      *        general purpose event handling mechanism.
      * @param callback Event callback function.
@@ -122,17 +148,47 @@ namespace AdblockPlus
 
     /**
      * Removes the callback function for an event.
+     * Looking the name up takes a lock, an unknown name is not interned.
      * @param eventName Event name.
      */
     void RemoveEventCallback(const std::string& eventName);
 
     /**
      * Triggers an event.
+     * Looking the name up takes a lock, an unknown name is not interned.
      * @param eventName Event name.
      * @param params Event parameters.
      */
     void TriggerEvent(const std::string& eventName, JsValueList&& params);
 
+    /**
+     * Returns the ID of an event, the same name always results in the same
+     * ID. Unlike the name the ID does not need to be looked up when the event
+     * is triggered. JS can retrieve it using the global `_getEventID(name)`
+     * and pass it to `_triggerEvent` instead of the name.
+     * Interned names are kept for the lifetime of the engine, so IDs are
+     * meant for a fixed set of event names rather than generated ones.
+     * The method is thread-safe.
+     * @param eventName Event name.
+     * @return ID of the event.
+     */
+    EventID GetEventID(const std::string& eventName);
+
+    /**
+     * Same as above but the event is identified by `GetEventID()`.
+     */
+    void SetEventCallback(EventID eventID, const EventCallback& callback);
+    void RemoveEventCallback(EventID eventID);
+
+    /**
+     * Triggers an event. The callback is looked up in a snapshot of the
+     * callbacks without locking, so a callback can modify event callbacks,
+     * including its own.
+     * @param eventID ID of the event, see `GetEventID()`.
+     * @param params Event parameters.
+     */
+    void TriggerEvent(EventID eventID, JsValueList&& params);
+
     /**
      * Evaluates a JavaScript expression.
      * @param source JavaScript expression to evaluate.
@@ -179,14 +235,26 @@ namespace AdblockPlus
      */
     JsValue NewObject();
 
+    /**
+     * Wraps a v8 value, e.g. an argument received by a callback created via
+     * `NewCallback()`.
+     * @param value v8 value.
+     * @return New `JsValue` instance.
+     */
+    JsValue NewValue(const v8::Local<v8::Value>& value);
+
     /**
      * Creates a JavaScript function that invokes a C++ callback.
+     * The function template is created once per callback and name and is
+     * reused by the subsequent calls.
      * @param callback C++ callback to invoke. The callback receives a
      *        `v8::FunctionCallbackInfo` object and can use `FromArguments()` to retrieve
      *        the current `JsEngine`.
+     * @param name Name of the function, the callback can retrieve it using
+     *        `GetCallbackName()`, e.g. for error messages.
      * @return New `JsValue` instance.
      */
-    JsValue NewCallback(const v8::FunctionCallback& callback);
+    JsValue NewCallback(const v8::FunctionCallback& callback, const std::string& name = std::string());
 
     /**
      * Returns a `JsEngine` instance contained in a `v8::FunctionCallbackInfo` object.
@@ -198,6 +266,13 @@ namespace AdblockPlus
      */
     static JsEnginePtr FromArguments(const v8::FunctionCallbackInfo<v8::Value>& arguments);
 
+    /**
+     * Returns the name passed to `NewCallback()` for the called function.
+     * @param arguments `v8::FunctionCallbackInfo` received by the callback.
+     * @return Name of the function.
+     */
+    static const std::string& GetCallbackName(const v8::FunctionCallbackInfo<v8::Value>& arguments);
+
     /**
      * Stores `JsValue`s in a way they don't keep a strong reference to
      * `JsEngine` and which are destroyed when `JsEngine` is destroyed. These
@@ -213,7 +288,8 @@ namespace AdblockPlus
     /**
      * Extracts and removes from `JsEngine` earlier stored `JsValue`s.
      * The method is thread-safe.
-     * @param id `JsWeakValuesID` of values.
+     * @param id `JsWeakValuesID` of values. If the values are already taken
+     *        then `std::runtime_error` is thrown.
      * @return `JsValueList` of stored values.
      */
     JsValueList TakeJsValues(const JsWeakValuesID& id);
@@ -221,7 +297,8 @@ namespace AdblockPlus
     /**
      * Extracts earlier stored `JsValue`s from `JsEgnine` but does not remove
      * them, one still must call `TakeJsValues`.
-     * @param id `JsWeakValuesID` of values.
+     * @param id `JsWeakValuesID` of values. If the values are already taken
+     *        then `std::runtime_error` is thrown.
      * @return `JsValueList` of stored values.
      */
     JsValueList GetJsValues(const JsWeakValuesID& id);
@@ -229,16 +306,24 @@ namespace AdblockPlus
     /*
      * Private functionality required to implement timers.
      * @param arguments `v8::FunctionCallbackInfo` is the arguments received in C++
-     * callback associated for global setTimeout method.
+     * callback associated for global setTimeout or setInterval method.
+     * @param isRepeating `true` for setInterval.
+     */
+    static void ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments, bool isRepeating = false);
+
+    /*
+     * Private functionality required to implement timers.
+     * @param arguments `v8::FunctionCallbackInfo` is the arguments received in C++
+     * callback associated for global clearTimeout or clearInterval method.
      */
-    static void ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments);
+    static void CancelTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments);
 
     /*
-     * Private functionality required to implement web requests.
+     * Private functionality required to implement setImmediate.
      * @param arguments `v8::FunctionCallbackInfo` is the arguments received in C++
-     * callback associated for global GET method.
+     * callback associated for global setImmediate method.
      */
-    static void ScheduleWebRequest(const v8::FunctionCallbackInfo<v8::Value>& arguments);
+    static void ScheduleImmediate(const v8::FunctionCallbackInfo<v8::Value>& arguments);
 
     /**
      * Converts v8 arguments to `JsValue` objects.
@@ -276,8 +361,80 @@ namespace AdblockPlus
     {
       return platform;
     }
+
+    /**
+     * Private functionality, the equivalent of `Platform::WithFileSystem`
+     * which takes the event loop into account.
+     */
+    void WithFileSystem(const std::function<void(IFileSystem&)>& callback);
+
+    /**
+     * Private functionality, the equivalent of `Platform::WithWebRequest`
+     * which takes the event loop into account.
+     */
+    void WithWebRequest(const std::function<void(IWebRequest&)>& callback);
+
+    /**
+     * Private functionality. If the event loop is used and the current thread
+     * neither is the event loop thread nor holds the isolate lock, then
+     * executes `task` in the event loop thread and waits for its finishing.
+     * @param task The function to execute, exceptions thrown by it are
+     *        rethrown.
+     * @return `false` if `task` is not executed and the caller should do the
+     *         work itself.
+     */
+    bool InvokeInEventLoop(const std::function<void()>& task);
+
+    /**
+     * Private functionality. Executes `call` by `InvokeInEventLoop`, or in
+     * the current thread if the caller should do the work itself.
+     * @param call The function to execute, exceptions thrown by it are
+     *        rethrown.
+     * @return The result of `call`.
+     */
+    template<typename T>
+    T RunInEventLoop(const std::function<T()>& call)
+    {
+      std::unique_ptr<T> eventLoopResult;
+      if (InvokeInEventLoop([&eventLoopResult, &call]
+        {
+          eventLoopResult.reset(new T(call()));
+        }))
+      {
+        return std::move(*eventLoopResult);
+      }
+      return call();
+    }
   private:
-    void CallTimerTask(const JsWeakValuesID& timerParamsID);
+    struct CallbackData;
+    typedef std::map<std::pair<v8::FunctionCallback, std::string>,
+      std::unique_ptr<CallbackData>> CallbackTemplates;
+
+    struct Timer
+    {
+      Timer()
+        : interval(0), armsNumber(0)
+      {
+      }
+      JsWeakValuesID paramsID;
+      // zero for setTimeout
+      std::chrono::milliseconds interval;
+      ITimer::CancelTimerCallback cancel;
+      uint32_t armsNumber;
+    };
+
+    void ArmTimer(uint32_t timerID, const std::chrono::milliseconds& timeout);
+    void CallTimerTask(uint32_t timerID);
+    // Called by the entry points into JS through the outermost JsContext.
+    void RunImmediateTasks();
+    // Called by the outermost JsContext before releasing the lock, runs the
+    // left immediate tasks in a new context. It doesn't throw.
+    void ScheduleImmediateTasks();
+    // Posts the task to the event loop if it's used, otherwise executes it
+    // right away.
+    void RunAsyncTask(const std::function<void()>& task);
+    // The caller must hold the lock of jsWeakValuesSlotsMutex.
+    JsValueList GetJsValuesLocked(const JsWeakValuesID& id);
 
     explicit JsEngine(Platform& platform, std::unique_ptr<IV8IsolateProvider> isolate);
 
@@ -289,10 +446,20 @@ namespace AdblockPlus
     std::unique_ptr<IV8IsolateProvider> isolate;
 
     std::unique_ptr<v8::Global<v8::Context>> context;
-    EventMap eventCallbacks;
-    std::mutex eventCallbacksMutex;
-    JsWeakValuesLists jsWeakValuesLists;
-    std::mutex jsWeakValuesListsMutex;
+    std::unique_ptr<EventCallbacks> eventCallbacks;
+    // Accessed only while holding the isolate lock.
+    CallbackTemplates callbackTemplates;
+    std::unique_ptr<JsWeakValuesSlots> jsWeakValuesSlots;
+    std::mutex jsWeakValuesSlotsMutex;
+    std::map<uint32_t, Timer> timers;
+    std::mutex timersMutex;
+    uint32_t lastTimerID;
+    // These are accessed only while holding the isolate lock.
+    std::deque<JsWeakValuesID> immediateTasks;
+    bool areImmediateTasksScheduled;
+    uint32_t jsContextDepth;
+    // It's the last member because it uses everything else.
+    std::unique_ptr<JsEventLoop> eventLoop;
   };
 }
 
@@ -0,0 +1,147 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace AdblockPlus
+{
+  /**
+   * Lock-free queue for multiple producers and a single consumer.
+   * `Push` can be called from any thread, it never waits for the consumer
+   * while the latter is busy. All other methods have to be called only from
+   * the consumer thread.
+   * `T` has to be default constructible and movable.
+   */
+  template<typename T>
+  class MpscQueue
+  {
+  public:
+    /**
+     * The `value_type` represents the type of stored values.
+     */
+    typedef T value_type;
+
+    MpscQueue()
+      : head(new Node()), tail(head.load()), isConsumerWaiting(false)
+    {
+    }
+
+    ~MpscQueue()
+    {
+      while (tail)
+      {
+        Node* next = tail->next.load();
+        delete tail;
+        tail = next;
+      }
+    }
+
+    /**
+     * Adds `value` to the end.
+     * @param value which is stored.
+     */
+    void Push(const value_type& value)
+    {
+      PushNode(new Node(value));
+    }
+    void Push(value_type&& value)
+    {
+      PushNode(new Node(std::move(value)));
+    }
+
+    /**
+     * Extracts the first stored element if there is any.
+     * @param value receives the extracted element.
+     * @return `false` if the queue is empty.
+     */
+    bool TryPop(value_type& value)
+    {
+      Node* next = tail->next.load();
+      if (!next)
+        return false;
+      // `next` becomes the new sentinel, only its value is taken.
+      value = std::move(next->value);
+      next->value = value_type();
+      delete tail;
+      tail = next;
+      return true;
+    }
+
+    /**
+     * Blocks the execution until there is at least one element in the queue.
+     */
+    void Wait()
+    {
+      if (tail->next.load())
+        return;
+      std::unique_lock<std::mutex> lock(mutex);
+      isConsumerWaiting.store(true);
+      conditionVar.wait(lock, [this]()->bool
+      {
+        return tail->next.load() != nullptr;
+      });
+      isConsumerWaiting.store(false);
+    }
+  private:
+    struct Node
+    {
+      Node()
+        : next(nullptr)
+      {
+      }
+      template<typename U>
+      explicit Node(U&& value)
+        : next(nullptr), value(std::forward<U>(value))
+      {
+      }
+      std::atomic<Node*> next;
+      value_type value;
+    };
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void PushNode(Node* node)
+    {
+      Node* prev = head.exchange(node);
+      // Until the next line the consumer does not see `node` and the nodes
+      // pushed after it, it's fine because the consumer is notified only
+      // afterwards.
+      prev->next.store(node);
+      // Both stores and loads are sequentially consistent, so either the
+      // consumer sees the new node before going to sleep or the producer sees
+      // that the consumer is waiting.
+      if (isConsumerWaiting.load())
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        conditionVar.notify_one();
+      }
+    }
+  private:
+    // The last pushed node, producers exchange it.
+    std::atomic<Node*> head;
+    // The sentinel node, the first stored element is in the next node. It is
+    // accessed only by the consumer.
+    Node* tail;
+    std::atomic<bool> isConsumerWaiting;
+    std::mutex mutex;
+    std::condition_variable conditionVar;
+  };
+}
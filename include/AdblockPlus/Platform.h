@@ -25,6 +25,7 @@
 #include "AppInfo.h"
 #include "Scheduler.h"
 #include "FilterEngine.h"
+#include <chrono>
 #include <mutex>
 #include <future>
 
@@ -81,8 +82,11 @@ namespace AdblockPlus
      * @param appInfo Information about the app, 
      * @param isolate A provider of v8::Isolate, if the value is nullptr then
      *        a default implementation is used.
+     * @param useEventLoop Whether JsEngine executes JS in a dedicated thread,
+     *        see `JsEngine::New`.
      */
-    void SetUpJsEngine(const AppInfo& appInfo = AppInfo(), std::unique_ptr<IV8IsolateProvider> isolate = nullptr);
+    void SetUpJsEngine(const AppInfo& appInfo = AppInfo(), std::unique_ptr<IV8IsolateProvider> isolate = nullptr,
+      bool useEventLoop = false);
 
     /**
      * Retrieves the `JsEngine` instance. It calls SetUpJsEngine if JsEngine is
@@ -154,6 +158,13 @@ namespace AdblockPlus
      */
     Scheduler GetDefaultAsyncExecutor();
 
+    /**
+     * Returns the executor behind the default Scheduler, e.g. to monitor
+     * its queue depth. It has to be called before `CreatePlatform()`.
+     * @return The executor shared with the Platform.
+     */
+    AsyncExecutorPtr GetSharedAsyncExecutor();
+
     /**
      * Constructs default implementation of `ITimer`.
      */
@@ -162,8 +173,19 @@ namespace AdblockPlus
     /**
      * Constructs default implementation of `IFileSystem`.
      * @param basePath A working directory for file system operations.
+     * @param writeCoalescingWindow Writes to a file are delayed by this time,
+     *   all writes to the same file within it are collapsed into a single
+     *   write of the latest content. This includes files written piece
+     *   by piece through `IFileSystem::OpenForWrite`, their content is then
+     *   held in memory until it is written. Zero, the default, disables the
+     *   delaying. A non-zero default would keep a full copy of the filter
+     *   storage in memory for the window after each save, run a flush
+     *   thread and lose the pending writes if the process is killed before
+     *   they are flushed. Callbacks of writes which are still pending when
+     *   the platform is destroyed are not called.
      */
-    void CreateDefaultFileSystem(const std::string& basePath = std::string());
+    void CreateDefaultFileSystem(const std::string& basePath = std::string(),
+      const std::chrono::milliseconds& writeCoalescingWindow = std::chrono::milliseconds::zero());
 
     /**
      * Constructs default implementation of `IWebRequest`.
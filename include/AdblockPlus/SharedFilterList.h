@@ -0,0 +1,158 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_SHARED_FILTER_LIST_H
+#define ADBLOCK_PLUS_SHARED_FILTER_LIST_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <AdblockPlus/FilterEngine.h>
+#include <AdblockPlus/IFileSystem.h>
+
+namespace AdblockPlus
+{
+  struct SharedFilterListControlBlock;
+
+  /**
+   * Publishes compiled filter lists to `SharedFilterListMatcher` instances
+   * in other processes through named shared memory. Every filter list gets
+   * a new segment, a small control segment holds the generation of the
+   * current one. There should be only one publisher per name.
+   * Shared memory is supported on POSIX systems except Android, the
+   * constructors throw `std::runtime_error` on other systems. macOS limits
+   * the names of segments to 31 characters, so names should be short.
+   */
+  class SharedFilterListPublisher
+  {
+  public:
+    /**
+     * Opens or creates the control segment.
+     * @param name Name of the shared filter list, it must not contain `/`.
+     * @param mode Permissions of the shared memory segments which are
+     *        created, like the mode of `shm_open()`. The umask applies.
+     */
+    explicit SharedFilterListPublisher(const std::string& name,
+                                       unsigned int mode = 0644);
+    ~SharedFilterListPublisher();
+    SharedFilterListPublisher(const SharedFilterListPublisher&) = delete;
+    SharedFilterListPublisher& operator=(const SharedFilterListPublisher&) = delete;
+
+    /**
+     * Publishes a filter list compiled by `FilterEngine::CompileFilterList()`
+     * or `FilterEngine::CompileActiveFilters()`. Matchers switch to it once
+     * they have loaded it.
+     * @param compiledFilterList Compiled filter list.
+     * @return Generation of the published filter list.
+     */
+    uint32_t Publish(const IFileSystem::IOBuffer& compiledFilterList);
+
+    /**
+     * Removes the shared memory segments of a shared filter list. Matchers
+     * keep the filter list they have loaded, new ones can't be created.
+     * @param name Name of the shared filter list.
+     */
+    static void Remove(const std::string& name);
+  private:
+    std::string name;
+    unsigned int mode;
+    SharedFilterListControlBlock* controlBlock;
+  };
+
+  /**
+   * Matches requests against the filter list published by a
+   * `SharedFilterListPublisher` in another process, without `JsEngine`.
+   * Filters which can't be matched natively make the result `UNKNOWN`,
+   * such requests have to be passed to a process with a `FilterEngine`.
+   * All methods are thread-safe.
+   * Published filter lists are mapped read-only and matched in place, so
+   * all processes share the same memory. Each matcher checks a new filter
+   * list once on its own loader thread: `Matches()` notices that a new one
+   * is published and keeps matching against the previous one until it's
+   * loaded.
+   */
+  class SharedFilterListMatcher
+  {
+  public:
+    enum MatchResult {NO_MATCH, MATCH, UNKNOWN};
+
+    /**
+     * Opens the control segment of a shared filter list and loads the
+     * current filter list. It throws `std::runtime_error` if the publisher
+     * hasn't created it yet.
+     * @param name Name of the shared filter list.
+     */
+    explicit SharedFilterListMatcher(const std::string& name);
+    ~SharedFilterListMatcher();
+    SharedFilterListMatcher(const SharedFilterListMatcher&) = delete;
+    SharedFilterListMatcher& operator=(const SharedFilterListMatcher&) = delete;
+
+    /**
+     * Matches a request like `FilterEngine::Matches()` does.
+     * @param url URL to match.
+     * @param contentTypeMask Content type mask of the requested resource.
+     * @param documentUrl URL of the document requesting the resource.
+     * @param filterText Text of the matching filter, it's set if the result
+     *        is `MATCH`. Exception filters start with `@@` and take
+     *        precedence over blocking filters.
+     * @return Whether a filter matches.
+     */
+    MatchResult Matches(const std::string& url,
+                        FilterEngine::ContentTypeMask contentTypeMask,
+                        const std::string& documentUrl,
+                        std::string& filterText) const;
+
+    /**
+     * Retrieves the generation of the loaded filter list, 0 if none is
+     * loaded yet.
+     */
+    uint32_t GetGeneration() const;
+
+    /**
+     * Waits until the filter list which is currently published is loaded.
+     * @param timeout Maximum time to wait.
+     * @return Generation of the loaded filter list.
+     */
+    uint32_t WaitForFilterList(const std::chrono::milliseconds& timeout) const;
+  private:
+    struct LoadedFilterList;
+    typedef std::shared_ptr<const LoadedFilterList> LoadedFilterListPtr;
+
+    std::string name;
+    const SharedFilterListControlBlock* controlBlock;
+    // Accessed only with std::atomic_load and std::atomic_store.
+    LoadedFilterListPtr loadedFilterList;
+    mutable std::mutex loaderMutex;
+    // Wakes the loader thread and threads waiting for a filter list.
+    mutable std::condition_variable conditionVariable;
+    mutable std::atomic<bool> isLoadRequested;
+    bool isStopping;
+    std::thread loaderThread;
+
+    bool IsLoaded() const;
+    void RequestLoad() const;
+    void RunLoader();
+    void LoadFilterList();
+  };
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AdblockPlus
+{
+  /**
+   * Executes tasks in a fixed number of worker threads.
+   * Each worker has its own queue, dispatched tasks are distributed among the
+   * queues and a worker running out of tasks steals them from the queues of
+   * other workers. Idle workers wait on their own condition variable, a task
+   * dispatched to a busy worker wakes one of them to steal it.
+   * In the destructor it waits for finishing of all already dispatched tasks.
+   */
+  class ThreadPool
+  {
+  public:
+    /**
+     * Statistics of the pool.
+     */
+    struct Metrics
+    {
+      Metrics()
+        : queueDepth(0), maxQueueDepth(0), executedTasks(0), stolenTasks(0)
+      {
+      }
+
+      /**
+       * Number of dispatched tasks which are not started yet.
+       */
+      size_t queueDepth;
+
+      /**
+       * The highest observed value of `queueDepth`.
+       */
+      size_t maxQueueDepth;
+
+      /**
+       * Number of finished tasks.
+       */
+      uint64_t executedTasks;
+
+      /**
+       * Number of tasks taken from the queue of another worker.
+       */
+      uint64_t stolenTasks;
+    };
+
+    /**
+     * Constructor, the worker threads are started after finishing this call.
+     * @param threadsNumber Number of worker threads, at least one thread is
+     *        started.
+     */
+    explicit ThreadPool(size_t threadsNumber);
+
+    /**
+     * Destructor, it waits for finishing of all already dispatched tasks.
+     */
+    ~ThreadPool();
+
+    /**
+     * Adds the `call` to be executed in one of the worker threads.
+     * @param call is a function object, there is no effect if `call` is empty.
+     */
+    void Dispatch(const std::function<void()>& call);
+
+    /**
+     * Returns the current statistics.
+     */
+    Metrics GetMetrics() const;
+  private:
+    struct Worker
+    {
+      Worker()
+        : isParked(false), isNotified(false)
+      {
+      }
+
+      std::mutex mutex;
+      std::condition_variable conditionVariable;
+      std::deque<std::function<void()>> tasks;
+      // The worker waits for tasks, it's notified if a task is dispatched to
+      // another worker for stealing it.
+      bool isParked;
+      bool isNotified;
+      std::thread thread;
+    };
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // Takes a task from the front of the own queue or from the back of the
+    // queue of another worker, returns an empty function if there is none.
+    std::function<void()> TakeTask(size_t workerIndex);
+    // Wakes a parked worker other than the busy one.
+    void NotifyParkedWorker(size_t busyWorkerIndex);
+    void ThreadFunc(size_t workerIndex);
+  private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorkerIndex;
+    std::atomic<size_t> parkedWorkers;
+    std::atomic<bool> shouldThreadsStop;
+    // Number of tasks which are not yet taken by a worker.
+    std::atomic<size_t> queueDepth;
+    std::atomic<size_t> maxQueueDepth;
+    std::atomic<uint64_t> executedTasks;
+    std::atomic<uint64_t> stolenTasks;
+  };
+}
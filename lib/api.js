@@ -30,6 +30,9 @@ let API = (() =>
   const {Prefs} = require("prefs");
   const {checkForUpdates} = require("updater");
   const {Notification} = require("notification");
+  const {setFilterChangeBatching, getRequestFilters,
+         getActiveRequestFilters} = require("filterUpdateRegistration");
+  const updateCheckDoneEventID = _getEventID("_updateCheckDone");
 
   return {
     getFilterFromText(text)
@@ -213,9 +216,24 @@ let API = (() =>
       Prefs[pref] = value;
     },
 
-    forceUpdateCheck(eventName)
+    setFilterChangeBatching(enabled)
     {
-      checkForUpdates(eventName ? _triggerEvent.bind(null, eventName) : null);
+      setFilterChangeBatching(enabled);
+    },
+
+    getRequestFilters(content)
+    {
+      return getRequestFilters(content);
+    },
+
+    getActiveRequestFilters()
+    {
+      return getActiveRequestFilters();
+    },
+
+    forceUpdateCheck(checkID)
+    {
+      checkForUpdates(checkID ? _triggerEvent.bind(null, updateCheckDoneEventID, checkID) : null);
     },
 
     getHostFromUrl(url)
@@ -178,15 +178,13 @@ FakeTimer.prototype =
 {
   delay: 0,
   callback: null,
+  _intervalID: null,
   initWithCallback(callback, delay)
   {
+    this.cancel();
     this.callback = callback;
     this.delay = delay;
-    this.scheduleTimeout();
-  },
-  scheduleTimeout()
-  {
-    setTimeout(() =>
+    this._intervalID = setInterval(() =>
     {
       try
       {
@@ -196,8 +194,15 @@ FakeTimer.prototype =
       {
         Cu.reportError(e);
       }
-      this.scheduleTimeout();
     }, this.delay);
+  },
+  cancel()
+  {
+    if (this._intervalID != null)
+    {
+      clearInterval(this._intervalID);
+      this._intervalID = null;
+    }
   }
 };
 
@@ -18,8 +18,317 @@
 "use strict";
 
 let {FilterNotifier} = require("filterNotifier");
+let {FilterStorage} = require("filterStorage");
+let {Filter, RegExpFilter, WhitelistFilter} = require("filterClasses");
+let {CombinedMatcher, defaultMatcher} = require("matcher");
 
-FilterNotifier.addListener((action, item) =>
+// The events fire for each changed filter, so their IDs are looked up only
+// once.
+let filterChangeEventID = _getEventID("filterChange");
+let filterChangeBatchEventID = _getEventID("filterChangeBatch");
+let filtersChangedEventID = _getEventID("_filtersChanged");
+
+// Actions which change the content of the matcher or of element hiding.
+let contentActions = new Set([
+  "load",
+  "elemhideupdate",
+  "filter.added",
+  "filter.removed",
+  "filter.disabled",
+  "subscription.added",
+  "subscription.removed",
+  "subscription.disabled",
+  "subscription.updated"
+]);
+
+// Texts of the request filters which are known to the native filter index.
+let indexedFilters = new Set();
+// Request filters whose state may have changed since the index was last
+// updated, by their texts. Only these are checked, unless all filters have to
+// be compared once more after the storage was (re)loaded.
+let changedFilters = new Map();
+let isFullScanNeeded = true;
+
+let isBatching = false;
+let hasContentChanges = false;
+let batch = null;
+let isFlushScheduled = false;
+
+// Immediate tasks run once the current JS task is finished, so all changes
+// made by the task are sent together.
+function scheduleFlush()
+{
+  if (isFlushScheduled)
+    return;
+  isFlushScheduled = true;
+  setImmediate(flush);
+}
+
+function getActiveRequestFilters()
+{
+  let activeFilters = new Map();
+  for (let subscription of FilterStorage.subscriptions)
+  {
+    if (subscription.disabled)
+      continue;
+    for (let filter of subscription.filters)
+    {
+      if (filter instanceof RegExpFilter && !filter.disabled)
+        activeFilters.set(filter.text, filter);
+    }
+  }
+  return activeFilters;
+}
+
+function isActiveRequestFilter(filter)
+{
+  if (!(filter instanceof RegExpFilter) || filter.disabled)
+    return false;
+  for (let subscription of filter.subscriptions)
+  {
+    if (!subscription.disabled)
+      return true;
+  }
+  return false;
+}
+
+function addChangedFilters(filters)
+{
+  for (let filter of filters)
+  {
+    if (filter instanceof RegExpFilter)
+      changedFilters.set(filter.text, filter);
+  }
+}
+
+// Records the filters affected by a notification, the index is updated with
+// them once the current task is finished.
+function addFilterChanges(action, item)
+{
+  switch (action)
+  {
+    case "load":
+      isFullScanNeeded = true;
+      changedFilters.clear();
+      break;
+    case "filter.added":
+    case "filter.removed":
+    case "filter.disabled":
+      addChangedFilters([item]);
+      break;
+    case "subscription.added":
+    case "subscription.removed":
+    case "subscription.disabled":
+      addChangedFilters(item.filters);
+      break;
+    case "subscription.updated":
+      addChangedFilters(item.filters);
+      // Without the previous filters the removed ones are unknown.
+      if (item.oldFilters)
+        addChangedFilters(item.oldFilters);
+      else
+        isFullScanNeeded = true;
+      break;
+  }
+}
+
+// Compares all active request filters with the ones known to the native
+// filter index.
+function getAllFilterIndexChanges(changes)
+{
+  let activeFilters = getActiveRequestFilters();
+  for (let [text, filter] of activeFilters)
+  {
+    if (!indexedFilters.has(text))
+      addIndexedFilter(changes, filter, defaultMatcher);
+  }
+  for (let text of indexedFilters)
+  {
+    if (!activeFilters.has(text))
+      changes.removedTexts.push(text);
+  }
+  indexedFilters = new Set(activeFilters.keys());
+}
+
+// Collects the changes of the native filter index since its last update. The
+// index is updated with the result at once, so it never contains a partially
+// applied filter list.
+function getFilterIndexChanges()
+{
+  let changes = {
+    texts: [],
+    keywords: [],
+    contentTypes: [],
+    exceptions: [],
+    removedTexts: []
+  };
+  if (isFullScanNeeded)
+  {
+    isFullScanNeeded = false;
+    getAllFilterIndexChanges(changes);
+  }
+  else
+  {
+    for (let [text, filter] of changedFilters)
+    {
+      let isIndexed = indexedFilters.has(text);
+      if (isActiveRequestFilter(filter))
+      {
+        if (!isIndexed)
+        {
+          addIndexedFilter(changes, filter, defaultMatcher);
+          indexedFilters.add(text);
+        }
+      }
+      else if (isIndexed)
+      {
+        changes.removedTexts.push(text);
+        indexedFilters.delete(text);
+      }
+    }
+  }
+  changedFilters.clear();
+  return changes;
+}
+
+function addIndexedFilter(changes, filter, combinedMatcher)
+{
+  let isException = filter instanceof WhitelistFilter;
+  let matcher = isException ? combinedMatcher.whitelist :
+                              combinedMatcher.blacklist;
+  changes.texts.push(filter.text);
+  changes.keywords.push(matcher.findKeyword(filter));
+  changes.contentTypes.push(filter.contentType);
+  changes.exceptions.push(isException);
+}
+
+function flush()
+{
+  isFlushScheduled = false;
+  if (hasContentChanges)
+  {
+    hasContentChanges = false;
+    let {texts, keywords, contentTypes, exceptions, removedTexts} =
+      getFilterIndexChanges();
+    _triggerEvent(filtersChangedEventID, texts, keywords, contentTypes,
+                  exceptions, removedTexts);
+  }
+  if (batch)
+  {
+    let {actionCounts, subscriptionUrls, actions, items} = batch;
+    batch = null;
+    _triggerEvent(filterChangeBatchEventID, actionCounts,
+                  Array.from(subscriptionUrls), actions, items);
+  }
+}
+
+function addToBatch(action, item, param)
 {
-  _triggerEvent("filterChange", action, item);
+  if (!batch)
+  {
+    batch = {
+      actionCounts: Object.create(null),
+      subscriptionUrls: new Set(),
+      actions: [],
+      items: []
+    };
+  }
+  batch.actionCounts[action] = (batch.actionCounts[action] || 0) + 1;
+  // The item is either a subscription or a filter, in the latter case the
+  // subscription is passed as the next parameter.
+  for (let subscription of [item, param])
+  {
+    if (subscription && typeof subscription.url == "string")
+      batch.subscriptionUrls.add(subscription.url);
+  }
+  batch.actions.push(action);
+  batch.items.push(item);
+}
+
+FilterNotifier.addListener((action, item, param) =>
+{
+  _triggerEvent(filterChangeEventID, action, item);
+  if (contentActions.has(action))
+  {
+    addFilterChanges(action, item);
+    hasContentChanges = true;
+    scheduleFlush();
+  }
+  if (isBatching)
+  {
+    addToBatch(action, item, param);
+    scheduleFlush();
+  }
 });
+
+exports.setFilterChangeBatching = enabled =>
+{
+  isBatching = enabled;
+};
+
+// Filter.fromText() keeps every filter it creates in Filter.knownFilters,
+// which is a Map or an object depending on the version of adblockpluscore.
+function isKnownFilter(text)
+{
+  let {knownFilters} = Filter;
+  return knownFilters instanceof Map ? knownFilters.has(text) :
+                                       text in knownFilters;
+}
+
+function forgetFilter(text)
+{
+  let {knownFilters} = Filter;
+  if (knownFilters instanceof Map)
+    knownFilters.delete(text);
+  else
+    delete knownFilters[text];
+}
+
+// Request filters of a filter list in the format of the `_filtersChanged`
+// event, for compiling filter lists ahead of time. The keywords are chosen
+// by a separate matcher, so they are balanced within the list. Filters which
+// weren't known before aren't kept, compiling doesn't change the filters of
+// the engine.
+exports.getRequestFilters = content =>
+{
+  let matcher = new CombinedMatcher();
+  let filters = {
+    texts: [],
+    keywords: [],
+    contentTypes: [],
+    exceptions: []
+  };
+  let texts = new Set();
+  for (let line of content.split(/[\r\n]+/))
+  {
+    let text = Filter.normalize(line);
+    // The header isn't a filter, the subscription parser drops it as well.
+    if (!text || /^\[Adblock/i.test(text) || texts.has(text))
+      continue;
+    let isKnown = isKnownFilter(text);
+    let filter = Filter.fromText(text);
+    if (!isKnown)
+      forgetFilter(text);
+    if (!(filter instanceof RegExpFilter))
+      continue;
+    texts.add(text);
+    addIndexedFilter(filters, filter, matcher);
+    matcher.add(filter);
+  }
+  return filters;
+};
+
+// Active request filters with the keywords of the running matcher, for
+// sharing them with processes which don't run JavaScript.
+exports.getActiveRequestFilters = () =>
+{
+  let filters = {
+    texts: [],
+    keywords: [],
+    contentTypes: [],
+    exceptions: []
+  };
+  for (let filter of getActiveRequestFilters().values())
+    addIndexedFilter(filters, filter, defaultMatcher);
+  return filters;
+};
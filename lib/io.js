@@ -17,6 +17,94 @@
 
 "use strict";
 
+// Number of lines passed at once from the native side to the readFromFile
+// listener, calling into JS for every single line is comparatively expensive.
+const READ_FROM_FILE_BATCH_SIZE = 1000;
+
+// Number of lines joined into a single chunk by writeToFile, the chunks are
+// written one after another, so the whole file is never built in memory.
+const WRITE_TO_FILE_CHUNK_SIZE = 1000;
+
+// Files written by writeToFile are saved as a snapshot and a journal of line
+// changes next to it, so that a small change does not rewrite the whole
+// file. Once the journal exceeds one of these limits the file is compacted
+// in the background after the write, i.e. the snapshot is replaced and the
+// journal removed. Changes of more than MAX_RECORD_SIZE are not kept in
+// memory, they are streamed into the journal instead and the file is
+// compacted after them as well.
+const JOURNAL_FILE_SUFFIX = ".journal";
+const MAX_JOURNAL_SIZE = 256 * 1024;
+const MAX_JOURNAL_RECORDS = 100;
+const MAX_RECORD_SIZE = 64 * 1024;
+const RESYNC_WINDOW = 256;
+
+// The state of files written by writeToFile or read by readFromFile as they
+// are on the disk, see JournaledFile.
+let journaledFiles = new Map();
+
+// Running compactions by file name, other operations on the file wait for
+// them.
+let compactions = new Map();
+
+/**
+ * @typedef {Object} JournaledFile
+ * @property {LineHashes} lineHashes Hashes of the non-empty lines of the file
+ *   with the journal applied, empty lines are never passed to readFromFile
+ *   listeners. The lines themselves are not kept.
+ * @property {number} journalRecords Number of records in the journal.
+ * @property {number} journalSize Approximate size of the journal.
+ * @property {boolean} needsCompaction The journal can not be appended to,
+ *   e.g. because it is incomplete or ends with a streamed record.
+ */
+
+// Two independent 32 bit hashes of every line, so comparing the lines of a
+// file with the ones written before takes 8 bytes per line.
+class LineHashes
+{
+  constructor()
+  {
+    this.length = 0;
+    this.hashes = new Uint32Array(2048);
+  }
+
+  push(line)
+  {
+    if (this.length * 2 == this.hashes.length)
+    {
+      let hashes = new Uint32Array(this.hashes.length * 2);
+      hashes.set(this.hashes);
+      this.hashes = hashes;
+    }
+    let first = 0x811c9dc5;
+    let second = 0x9747b28c;
+    for (let i = 0; i < line.length; i++)
+    {
+      let code = line.charCodeAt(i);
+      first = Math.imul(first ^ code, 0x01000193);
+      second = Math.imul(second ^ code, 0x5bd1e995);
+      second ^= second >>> 15;
+    }
+    this.hashes[this.length * 2] = first;
+    this.hashes[this.length * 2 + 1] = second;
+    this.length++;
+  }
+
+  equals(index, other, otherIndex)
+  {
+    return this.hashes[index * 2] == other.hashes[otherIndex * 2] &&
+           this.hashes[index * 2 + 1] == other.hashes[otherIndex * 2 + 1];
+  }
+
+  // Hash of all lines, identifies the snapshot a journal was written for.
+  digest()
+  {
+    let hash = INITIAL_CHANGE_HASH;
+    for (let i = 0; i < this.length * 2; i++)
+      hash = Math.imul(hash ^ this.hashes[i], 0x01000193);
+    return formatChangeHash(hash);
+  }
+}
+
 function readFileAsync(fileName)
 {
   return new Promise((resolve, reject) =>
@@ -38,66 +126,733 @@ function writeFileAsync(fileName, content)
   });
 }
 
+function appendFileAsync(fileName, content)
+{
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.append(fileName, content, (error) =>
+    {
+      if (error)
+        return reject(error);
+      resolve();
+    });
+  });
+}
+
+function moveFileAsync(fromFileName, toFileName)
+{
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.move(fromFileName, toFileName, (error) =>
+    {
+      if (error)
+        return reject(error);
+      resolve();
+    });
+  });
+}
+
+function removeFileAsync(fileName)
+{
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.remove(fileName, (error) =>
+    {
+      if (error)
+        return reject(error);
+      resolve();
+    });
+  });
+}
+
+function statFileAsync(fileName)
+{
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.stat(fileName, (result) =>
+    {
+      if (result.error)
+        return reject(result.error);
+      resolve(result);
+    });
+  });
+}
+
+function readLinesAsync(fileName, listener)
+{
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.readFromFile(fileName, lines =>
+    {
+      for (let i = 0; i < lines.length; i++)
+        listener(lines[i]);
+    }, resolve, reject, READ_FROM_FILE_BATCH_SIZE);
+  });
+}
+
+function nextLinesChunk(lines)
+{
+  let chunk = [];
+  while (chunk.length < WRITE_TO_FILE_CHUNK_SIZE)
+  {
+    let {value, done} = lines.next();
+    if (done)
+      break;
+    chunk.push(value);
+  }
+  return chunk;
+}
+
+function writeLinesAsync(fileName, lines, lineBreak)
+{
+  let isFirstChunk = true;
+  let readChunk = () =>
+  {
+    let chunk = nextLinesChunk(lines);
+    // An empty file still consists of a single line break.
+    if (chunk.length == 0 && !isFirstChunk)
+      return null;
+    isFirstChunk = false;
+    return chunk.join(lineBreak) + lineBreak;
+  };
+
+  return new Promise((resolve, reject) =>
+  {
+    _fileSystem.writeChunks(fileName, readChunk, (error) =>
+    {
+      if (error)
+        return reject(error);
+      resolve();
+    });
+  });
+}
+
+function appendLinesAsync(fileName, lines, lineBreak)
+{
+  let appendNextChunk = () =>
+  {
+    let chunk = nextLinesChunk(lines);
+    if (chunk.length == 0)
+      return Promise.resolve();
+    return appendFileAsync(fileName, chunk.join(lineBreak) + lineBreak)
+      .then(appendNextChunk);
+  };
+  return appendNextChunk();
+}
+
+// FNV-1a over the lines written to the journal by one write, detects
+// incompletely written changes.
+const INITIAL_CHANGE_HASH = 0x811c9dc5;
+
+function hashChangeLine(hash, line)
+{
+  for (let i = 0; i < line.length; i++)
+    hash = Math.imul(hash ^ line.charCodeAt(i), 0x01000193);
+  return Math.imul(hash ^ 10, 0x01000193);
+}
+
+function formatChangeHash(hash)
+{
+  return (hash >>> 0).toString(16);
+}
+
+// A journal consists of a header line with the number and the digest of the
+// non-empty lines of the snapshot followed by the changes of each write. A
+// change consists of records, each a line with the replaced range followed
+// by the inserted lines prefixed with "+", and ends with a line with the
+// number and the hash of its lines. That line is written last, so a change which is written only
+// partially, e.g. because the process was killed, is detected and dropped
+// as a whole. The range line of a record which was streamed into the journal
+// ends with " streamed", it is always the last record.
+// The journal is removed only after a new snapshot is in place, a journal
+// left next to a newer snapshot doesn't match its header and is dropped.
+function* journalChangeLines(records)
+{
+  let hash = INITIAL_CHANGE_HASH;
+  let lineCount = 0;
+  let emit = line =>
+  {
+    hash = hashChangeLine(hash, line);
+    lineCount++;
+    return line;
+  };
+  for (let record of records)
+  {
+    yield emit("@" + record.start + " " + record.deleteCount +
+               (record.isStreamed ? " streamed" : ""));
+    for (let line of record.lines)
+      yield emit("+" + line);
+  }
+  yield "=" + lineCount + " " + formatChangeHash(hash);
+}
+
+// Parses a journal line by line, keeps the inserted lines of all records but
+// a streamed one, its lines are read again when they are needed.
+class JournalParser
+{
+  constructor()
+  {
+    this.journal = null;
+    this.isHeaderRead = false;
+    this.change = null;
+    this.isBroken = false;
+  }
+
+  process(line)
+  {
+    if (this.isBroken || !line)
+      return;
+
+    if (!this.isHeaderRead)
+    {
+      this.isHeaderRead = true;
+      let header = /^\[journal\] (\d+) ([0-9a-f]+)$/.exec(line);
+      if (!header)
+      {
+        this.isBroken = true;
+        return;
+      }
+      this.journal = {
+        snapshotLineCount: parseInt(header[1], 10),
+        snapshotDigest: header[2],
+        records: [],
+        changeCount: 0,
+        size: line.length + 1,
+        isComplete: true,
+        hasStreamedRecord: false
+      };
+      return;
+    }
+
+    let {journal} = this;
+    if (!this.change)
+    {
+      this.change = {
+        records: [],
+        lineCount: 0,
+        size: 0,
+        hash: INITIAL_CHANGE_HASH
+      };
+    }
+
+    let {change} = this;
+    let record = change.records[change.records.length - 1];
+    let trailer = /^=(\d+) ([0-9a-f]+)$/.exec(line);
+    if (trailer)
+    {
+      if (parseInt(trailer[1], 10) != change.lineCount ||
+          trailer[2] != formatChangeHash(change.hash))
+      {
+        this.isBroken = true;
+        return;
+      }
+      for (let changeRecord of change.records)
+        journal.records.push(changeRecord);
+      journal.changeCount++;
+      journal.size += change.size + line.length + 1;
+      if (record && !record.lines)
+        journal.hasStreamedRecord = true;
+      this.change = null;
+      return;
+    }
+
+    change.hash = hashChangeLine(change.hash, line);
+    change.lineCount++;
+    change.size += line.length + 1;
+    if (line[0] == "+" && record)
+    {
+      if (record.lines)
+        record.lines.push(line.substr(1));
+      return;
+    }
+
+    let match = /^@(\d+) (\d+)( streamed)?$/.exec(line);
+    if (!match || journal.hasStreamedRecord || (record && !record.lines))
+    {
+      this.isBroken = true;
+      return;
+    }
+    change.records.push({
+      start: parseInt(match[1], 10),
+      deleteCount: parseInt(match[2], 10),
+      lines: match[3] ? null : []
+    });
+  }
+
+  // Returns null if the lines are not a journal, otherwise the records of
+  // all complete changes. Changes after an incomplete one are dropped.
+  finish()
+  {
+    let {journal} = this;
+    if (journal && (this.isBroken || this.change))
+      journal.isComplete = false;
+    return journal;
+  }
+}
+
+function readJournalAsync(fileName)
+{
+  let parser = new JournalParser();
+  return readLinesAsync(fileName, line => parser.process(line)).then(
+    () => parser.finish(),
+    // There is no journal.
+    () => undefined
+  );
+}
+
+// Returns the content of the file with the journal applied as a list of
+// snapshot line ranges and inserted lines, or null if the records don't fit
+// the snapshot. A streamed record has to replace the end of the content, its
+// lines follow the returned segments.
+function planJournal(journal)
+{
+  let segments = [];
+  if (journal.snapshotLineCount > 0)
+    segments.push({start: 0, end: journal.snapshotLineCount});
+  let length = journal.snapshotLineCount;
+  let getSize = segment =>
+    segment.lines ? segment.lines.length : segment.end - segment.start;
+  let slice = (segment, from, to) => segment.lines ?
+    {lines: segment.lines.slice(from, to)} :
+    {start: segment.start + from, end: segment.start + to};
+
+  for (let record of journal.records)
+  {
+    let recordEnd = record.start + record.deleteCount;
+    if (recordEnd > length || (!record.lines && recordEnd != length))
+      return null;
+
+    let result = [];
+    let isInserted = false;
+    let insert = () =>
+    {
+      if (record.lines && record.lines.length > 0)
+        result.push({lines: record.lines});
+      isInserted = true;
+    };
+    let position = 0;
+    for (let segment of segments)
+    {
+      let size = getSize(segment);
+      let before = Math.min(size, Math.max(0, record.start - position));
+      let after = Math.min(size, Math.max(0, recordEnd - position));
+      if (before > 0)
+        result.push(slice(segment, 0, before));
+      if (!isInserted && record.start <= position + size)
+        insert();
+      if (after < size)
+        result.push(slice(segment, after, size));
+      position += size;
+    }
+    if (!isInserted)
+      insert();
+    segments = result;
+    length += (record.lines ? record.lines.length : 0) - record.deleteCount;
+  }
+  return segments;
+}
+
+// The snapshot lines are kept until the snapshot is known to be the one the
+// journal was written for. Otherwise the journal is dropped and the snapshot
+// is passed on as it is.
+function readSnapshotWithJournal(fileName, journal, segments, listener)
+{
+  let lineHashes = new LineHashes();
+  let emit = line =>
+  {
+    lineHashes.push(line);
+    listener(line);
+  };
+  let snapshotLines = [];
+  let snapshotHashes = new LineHashes();
+  return readLinesAsync(fileName, line =>
+  {
+    if (!line)
+      return;
+    snapshotLines.push(line);
+    snapshotHashes.push(line);
+  }).then(() =>
+  {
+    if (snapshotHashes.length != journal.snapshotLineCount ||
+        snapshotHashes.digest() != journal.snapshotDigest)
+    {
+      for (let line of snapshotLines)
+        emit(line);
+      return false;
+    }
+
+    for (let segment of segments)
+    {
+      if (segment.lines)
+      {
+        for (let line of segment.lines)
+          emit(line);
+      }
+      else
+      {
+        for (let i = segment.start; i < segment.end; i++)
+          emit(snapshotLines[i]);
+      }
+    }
+    snapshotLines = null;
+    if (!journal.hasStreamedRecord)
+      return true;
+
+    let streamedRecordIndex = journal.records.length - 1;
+    let recordIndex = -1;
+    return readLinesAsync(fileName + JOURNAL_FILE_SUFFIX, line =>
+    {
+      if (line[0] == "@")
+        recordIndex++;
+      else if (line[0] == "+" && recordIndex == streamedRecordIndex)
+        emit(line.substr(1));
+    }).then(() => true);
+  }).then(isJournalApplied =>
+  {
+    if (lineHashes.length == 0)
+      listener("");
+    if (!isJournalApplied)
+    {
+      return {
+        lineHashes,
+        journalRecords: 0,
+        journalSize: 0,
+        needsCompaction: true
+      };
+    }
+    return {
+      lineHashes,
+      journalRecords: journal.records.length,
+      journalSize: journal.size,
+      needsCompaction: !journal.isComplete || journal.hasStreamedRecord
+    };
+  });
+}
+
+// Reads the file with its journal applied, resolves with its JournaledFile
+// state.
+function readJournaledFile(fileName, listener)
+{
+  return readJournalAsync(fileName + JOURNAL_FILE_SUFFIX).then(journal =>
+  {
+    let segments = journal ? planJournal(journal) : null;
+    if (segments)
+      return readSnapshotWithJournal(fileName, journal, segments, listener);
+
+    let lineHashes = new LineHashes();
+    return readLinesAsync(fileName, line =>
+    {
+      if (line)
+        lineHashes.push(line);
+      listener(line);
+    }).then(() => ({
+      lineHashes,
+      journalRecords: 0,
+      journalSize: 0,
+      // An unusable journal is removed by the next write.
+      needsCompaction: journal !== undefined
+    }));
+  });
+}
+
+function* hashLines(lines, lineHashes)
+{
+  for (let line of lines)
+  {
+    if (line)
+      lineHashes.push(line);
+    yield line;
+  }
+}
+
+function removeJournalAsync(fileName)
+{
+  let journalFileName = fileName + JOURNAL_FILE_SUFFIX;
+  return statFileAsync(journalFileName).then(
+    result => result.exists ? removeFileAsync(journalFileName) : null);
+}
+
+// The snapshot is replaced before the journal is removed. If removing the
+// journal fails then it is dropped when the file is read, since it doesn't
+// match the new snapshot.
+function writeSnapshot(fileName, lines, lineBreak)
+{
+  journaledFiles.delete(fileName);
+  let lineHashes = new LineHashes();
+  return writeLinesAsync(fileName, hashLines(lines, lineHashes), lineBreak).then(
+    () => removeJournalAsync(fileName)
+  ).then(() =>
+  {
+    journaledFiles.set(fileName, {
+      lineHashes,
+      journalRecords: 0,
+      journalSize: 0,
+      needsCompaction: false
+    });
+  });
+}
+
+// Appends the changes from the journaled file to the new lines as records
+// of replaced ranges. Unchanged lines are only compared by their hashes, a
+// range of changed lines ends once a line matches one of the next
+// RESYNC_WINDOW lines of the journaled file. If the changed lines get too
+// many the rest of the file is streamed into a single last record.
+function writeJournalRecords(fileName, file, lines, lineBreak)
+{
+  let oldHashes = file.lineHashes;
+  let lineHashes = new LineHashes();
+  let records = [];
+  let recordsSize = 0;
+  let oldIndex = 0;
+  let hunk = null;
+  let isStreamed = false;
+  for (;;)
+  {
+    let {value: line, done} = lines.next();
+    if (done)
+      break;
+    if (!line)
+      continue;
+    lineHashes.push(line);
+    let index = lineHashes.length - 1;
+    if (!hunk)
+    {
+      if (oldIndex < oldHashes.length &&
+          lineHashes.equals(index, oldHashes, oldIndex))
+      {
+        oldIndex++;
+        continue;
+      }
+      hunk = {start: index, oldStart: oldIndex, lines: []};
+    }
+
+    let resyncEnd = Math.min(oldHashes.length, hunk.oldStart + RESYNC_WINDOW);
+    let resyncIndex = hunk.oldStart;
+    while (resyncIndex < resyncEnd &&
+           !lineHashes.equals(index, oldHashes, resyncIndex))
+      resyncIndex++;
+    if (resyncIndex < resyncEnd)
+    {
+      records.push({
+        start: hunk.start,
+        deleteCount: resyncIndex - hunk.oldStart,
+        lines: hunk.lines
+      });
+      hunk = null;
+      oldIndex = resyncIndex + 1;
+      continue;
+    }
+
+    hunk.lines.push(line);
+    recordsSize += line.length + 1;
+    if (recordsSize > MAX_RECORD_SIZE)
+    {
+      isStreamed = true;
+      break;
+    }
+  }
+
+  if (isStreamed)
+  {
+    let changedLines = hunk.lines;
+    records.push({
+      start: hunk.start,
+      deleteCount: oldHashes.length - hunk.oldStart,
+      isStreamed: true,
+      lines: (function*()
+      {
+        yield* changedLines;
+        for (let line of hashLines(lines, lineHashes))
+        {
+          if (line)
+            yield line;
+        }
+      })()
+    });
+  }
+  else if (hunk)
+  {
+    records.push({
+      start: hunk.start,
+      deleteCount: oldHashes.length - hunk.oldStart,
+      lines: hunk.lines
+    });
+  }
+  else if (oldIndex < oldHashes.length)
+  {
+    records.push({
+      start: lineHashes.length,
+      deleteCount: oldHashes.length - oldIndex,
+      lines: []
+    });
+  }
+  if (records.length == 0)
+    return Promise.resolve();
+
+  let journalSize = 0;
+  let journalLines = (function*()
+  {
+    let count = line =>
+    {
+      journalSize += line.length + 1;
+      return line;
+    };
+    if (file.journalRecords == 0)
+      yield count("[journal] " + oldHashes.length + " " + oldHashes.digest());
+    for (let line of journalChangeLines(records))
+      yield count(line);
+  })();
+
+  // A new journal replaces a possibly left over one.
+  let journalFileName = fileName + JOURNAL_FILE_SUFFIX;
+  let written = file.journalRecords == 0 ?
+    writeLinesAsync(journalFileName, journalLines, lineBreak) :
+    appendLinesAsync(journalFileName, journalLines, lineBreak);
+  return written.then(
+    () =>
+    {
+      file.lineHashes = lineHashes;
+      file.journalRecords += records.length;
+      file.journalSize += journalSize;
+      // Nothing can follow a streamed record.
+      if (isStreamed)
+        file.needsCompaction = true;
+    },
+    error =>
+    {
+      // The change may be written partially.
+      file.needsCompaction = true;
+      throw error;
+    });
+}
+
+// Runs the operation once a running compaction of the file is finished.
+function afterCompaction(fileName, operation)
+{
+  let compaction = compactions.get(fileName);
+  return compaction ? compaction.then(operation) : operation();
+}
+
+// Replaces the snapshot by the content with the journal applied, which is
+// read back from the disk. It runs after the write which filled the
+// journal, so that write stays an append. If it fails the journal is kept
+// and the next write which exceeds the limits starts another compaction.
+function compactFile(fileName, lineBreak)
+{
+  if (compactions.has(fileName))
+    return;
+  let lines = [];
+  let compaction = readJournaledFile(fileName, line =>
+  {
+    if (line)
+      lines.push(line);
+  }).then(
+    () => writeSnapshot(fileName, lines[Symbol.iterator](), lineBreak)
+  ).catch(() =>
+  {
+  }).then(() =>
+  {
+    compactions.delete(fileName);
+  });
+  compactions.set(fileName, compaction);
+}
+
 exports.IO =
 {
   lineBreak: "\n",
 
   readFromFile(fileName, listener)
   {
-    return new Promise((resolve, reject) =>
+    return afterCompaction(fileName, () =>
     {
-      _fileSystem.readFromFile(fileName, listener, resolve, reject);
+      journaledFiles.delete(fileName);
+      return readJournaledFile(fileName, listener).then(file =>
+      {
+        journaledFiles.set(fileName, file);
+      });
     });
   },
 
   writeToFile(fileName, generator)
   {
-    let content = Array.from(generator).join(this.lineBreak) + this.lineBreak;
-    return writeFileAsync(fileName, content);
+    let {lineBreak} = this;
+    return afterCompaction(fileName, () =>
+    {
+      let lines = generator[Symbol.iterator]();
+      let file = journaledFiles.get(fileName);
+      if (!file || file.needsCompaction)
+        return writeSnapshot(fileName, lines, lineBreak);
+      return writeJournalRecords(fileName, file, lines, lineBreak).then(() =>
+      {
+        if (file.needsCompaction ||
+            file.journalRecords >= MAX_JOURNAL_RECORDS ||
+            file.journalSize >= MAX_JOURNAL_SIZE)
+          compactFile(fileName, lineBreak);
+      });
+    });
   },
 
+  // The journal is copied along with the file, so the copy has the same
+  // content when it is read.
   copyFile(fromFileName, toFileName)
   {
-    return readFileAsync(fromFileName).then(
-      content => writeFileAsync(toFileName, content));
+    return afterCompaction(fromFileName, () => afterCompaction(toFileName, () =>
+    {
+      journaledFiles.delete(toFileName);
+      let fromJournal = fromFileName + JOURNAL_FILE_SUFFIX;
+      let toJournal = toFileName + JOURNAL_FILE_SUFFIX;
+      return removeJournalAsync(toFileName).then(
+        () => readFileAsync(fromFileName)
+      ).then(
+        result => writeFileAsync(toFileName, result.content)
+      ).then(
+        () => statFileAsync(fromJournal)
+      ).then(result =>
+      {
+        if (result.exists)
+        {
+          return readFileAsync(fromJournal).then(
+            journal => writeFileAsync(toJournal, journal.content));
+        }
+      });
+    }));
   },
 
   renameFile(fromFileName, newNameFile)
   {
-    return new Promise((resolve, reject) =>
+    return afterCompaction(fromFileName, () => afterCompaction(newNameFile, () =>
     {
-      _fileSystem.move(fromFileName, newNameFile, (error) =>
+      let file = journaledFiles.get(fromFileName);
+      journaledFiles.delete(fromFileName);
+      journaledFiles.delete(newNameFile);
+      let fromJournal = fromFileName + JOURNAL_FILE_SUFFIX;
+      let toJournal = newNameFile + JOURNAL_FILE_SUFFIX;
+      return removeJournalAsync(newNameFile).then(
+        () => moveFileAsync(fromFileName, newNameFile)
+      ).then(
+        () => statFileAsync(fromJournal)
+      ).then(
+        result => result.exists ? moveFileAsync(fromJournal, toJournal) : null
+      ).then(() =>
       {
-        if (error)
-          return reject(error);
-        resolve();
+        if (file)
+          journaledFiles.set(newNameFile, file);
       });
-    });
+    }));
   },
 
   removeFile(fileName)
   {
-    return new Promise((resolve, reject) =>
+    return afterCompaction(fileName, () =>
     {
-      _fileSystem.remove(fileName, (error) =>
-      {
-        if (error)
-          return reject(error);
-        resolve();
-      });
+      journaledFiles.delete(fileName);
+      return removeFileAsync(fileName).then(
+        () => removeJournalAsync(fileName));
     });
   },
 
   statFile(fileName, callback)
   {
-    return new Promise((resolve, reject) =>
-    {
-      _fileSystem.stat(fileName, (result) =>
-      {
-        if (result.error)
-          return reject(result.error);
-        resolve(result);
-      });
-    });
+    return statFileAsync(fileName);
   }
 };
@@ -25,10 +25,10 @@ let Utils = {
   },
   runAsync(callback, thisPtr, ...params)
   {
-    setTimeout(() =>
+    setImmediate(() =>
     {
       callback.apply(thisPtr, params);
-    }, 0);
+    });
   },
   get appLocale()
   {
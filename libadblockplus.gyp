@@ -25,15 +25,22 @@
     'sources': [
       'include/AdblockPlus/ActiveObject.h',
       'include/AdblockPlus/AsyncExecutor.h',
+      'include/AdblockPlus/CompiledFilterListMatcher.h',
       'include/AdblockPlus/ITimer.h',
       'include/AdblockPlus/IWebRequest.h',
       'include/AdblockPlus/IFileSystem.h',
+      'include/AdblockPlus/MpscQueue.h',
       'include/AdblockPlus/Scheduler.h',
+      'include/AdblockPlus/SharedFilterList.h',
       'include/AdblockPlus/Platform.h',
       'include/AdblockPlus/SynchronizedCollection.h',
+      'include/AdblockPlus/ThreadPool.h',
       'src/ActiveObject.cpp',
       'src/AsyncExecutor.cpp',
       'src/AppInfoJsObject.cpp',
+      'src/CompiledFilterList.h',
+      'src/CompiledFilterList.cpp',
+      'src/CompiledFilterListMatcher.cpp',
       'src/ConsoleJsObject.cpp',
       'src/DefaultLogSystem.cpp',
       'src/DefaultFileSystem.h',
@@ -44,15 +51,28 @@
       'src/DefaultWebRequest.cpp',
       'src/FileSystemJsObject.cpp',
       'src/FilterEngine.cpp',
+      'src/FilterIndex.h',
+      'src/FilterIndex.cpp',
       'src/GlobalJsObject.cpp',
+      'src/JsBinding.h',
+      'src/JsBinding.cpp',
       'src/JsContext.cpp',
       'src/JsEngine.cpp',
       'src/JsError.cpp',
+      'src/JsEventLoop.h',
+      'src/JsEventLoop.cpp',
       'src/JsValue.cpp',
+      'src/NativeMatcher.h',
+      'src/NativeMatcher.cpp',
       'src/Notification.cpp',
+      'src/PatternAutomaton.h',
+      'src/PatternAutomaton.cpp',
       'src/Platform.cpp',
       'src/ReferrerMapping.cpp',
+      'src/SharedFilterList.cpp',
       'src/Thread.cpp',
+      'src/ThreadPool.cpp',
+      'src/UrlTokenizer.h',
       'src/Utils.cpp',
       'src/WebRequestJsObject.cpp',
       '<(INTERMEDIATE_DIR)/adblockplus.js.cpp'
@@ -80,6 +100,14 @@
           ]
         }
       }],
+      ['OS=="linux"', {
+        'link_settings': {
+          'libraries': [
+            # shm_open() for shared filter lists
+            '-lrt'
+          ]
+        }
+      }],
       ['OS=="win"', {
         'link_settings': {
           'libraries': [
@@ -196,17 +224,25 @@
       'test/BaseJsTest.h',
       'test/BaseJsTest.cpp',
       'test/AppInfoJsObject.cpp',
+      'test/CompiledFilterList.cpp',
       'test/ConsoleJsObject.cpp',
       'test/DefaultFileSystem.cpp',
+      'test/DefaultTimer.cpp',
       'test/FileSystemJsObject.cpp',
       'test/FilterEngine.cpp',
+      'test/FilterIndex.cpp',
       'test/GlobalJsObject.cpp',
+      'test/IO.cpp',
       'test/JsEngine.cpp',
       'test/JsValue.cpp',
+      'test/MpscQueue.cpp',
       'test/Notification.cpp',
+      'test/PatternAutomaton.cpp',
       'test/Prefs.cpp',
       'test/ReferrerMapping.cpp',
+      'test/SharedFilterList.cpp',
       'test/UpdateCheck.cpp',
+      'test/UrlTokenizer.cpp',
       'test/WebRequest.cpp'
     ],
     'msvs_settings': {
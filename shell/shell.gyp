@@ -23,5 +23,23 @@
     'xcode_settings': {
       'OTHER_LDFLAGS': ['-stdlib=libstdc++'],
     },
+  },
+  {
+    'target_name': 'abpcompile',
+    'type': 'executable',
+    'dependencies': [
+      'libadblockplus.gyp:libadblockplus'
+    ],
+    'sources': [
+      'src/Compiler.cpp'
+    ],
+    'msvs_settings': {
+      'VCLinkerTool': {
+        'SubSystem': '1',   # Console
+      }
+    },
+    'xcode_settings': {
+      'OTHER_LDFLAGS': ['-stdlib=libstdc++'],
+    },
   }]
 }
@@ -0,0 +1,146 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus.h>
+#include <AdblockPlus/Platform.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+  // FilterEngine starts without data and nothing it saves is kept, so the
+  // tool doesn't touch the current directory. Callbacks are asynchronous
+  // like the ones of the default file system.
+  class NoFilesFileSystem : public AdblockPlus::IFileSystem
+  {
+  public:
+    explicit NoFilesFileSystem(const AdblockPlus::Scheduler& scheduler)
+      : scheduler(scheduler)
+    {
+    }
+
+    void Read(const std::string& fileName, const ReadCallback& callback,
+              const Callback& errorCallback) const override
+    {
+      scheduler([fileName, errorCallback]
+      {
+        errorCallback("File not found, " + fileName);
+      });
+    }
+
+    void Write(const std::string& fileName, const IOBuffer& data,
+               const Callback& callback) override
+    {
+      Succeed(callback);
+    }
+
+    void Move(const std::string& fromFileName, const std::string& toFileName,
+              const Callback& callback) override
+    {
+      Succeed(callback);
+    }
+
+    void Remove(const std::string& fileName, const Callback& callback) override
+    {
+      Succeed(callback);
+    }
+
+    void Stat(const std::string& fileName, const StatCallback& callback) const override
+    {
+      scheduler([callback]
+      {
+        callback(StatResult(), "");
+      });
+    }
+  private:
+    AdblockPlus::Scheduler scheduler;
+
+    void Succeed(const Callback& callback) const
+    {
+      scheduler([callback]
+      {
+        callback("");
+      });
+    }
+  };
+}
+
+// Compiles filter lists into a binary filter list which
+// CompiledFilterListMatcher matches in place, without parsing them.
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <output file> <filter list>..." << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    std::string filterListContent;
+    for (int i = 2; i < argc; ++i)
+    {
+      std::ifstream input(argv[i], std::ios_base::binary);
+      if (!input)
+      {
+        std::cerr << "Cannot read " << argv[i] << std::endl;
+        return 1;
+      }
+      std::ostringstream content;
+      content << input.rdbuf();
+      filterListContent += content.str();
+      filterListContent += '\n';
+    }
+
+    AdblockPlus::AppInfo appInfo;
+    appInfo.version = "1.0";
+    appInfo.name = "abpcompile";
+    appInfo.application = "standalone";
+    appInfo.applicationVersion = "1.0";
+    appInfo.locale = "en-US";
+
+    AdblockPlus::DefaultPlatformBuilder platformBuilder;
+    platformBuilder.fileSystem.reset(
+      new NoFilesFileSystem(platformBuilder.GetDefaultAsyncExecutor()));
+    auto platform = platformBuilder.CreatePlatform();
+    platform->SetUpJsEngine(appInfo);
+    auto& jsEngine = platform->GetJsEngine();
+    // Only the filter parser is needed, nothing is downloaded.
+    AdblockPlus::FilterEngine::CreationParameters parameters;
+    parameters.preconfiguredPrefs.emplace("first_run_subscription_auto_select", jsEngine.NewValue(false));
+    parameters.preconfiguredPrefs.emplace("subscriptions_autoupdate", jsEngine.NewValue(false));
+    platform->CreateFilterEngineAsync(parameters);
+    auto& filterEngine = platform->GetFilterEngine();
+
+    auto compiledFilterList = filterEngine.CompileFilterList(filterListContent);
+    std::ofstream output(argv[1], std::ios_base::binary | std::ios_base::trunc);
+    output.write(reinterpret_cast<const char*>(compiledFilterList.data()),
+                 compiledFilterList.size());
+    if (!output.flush())
+    {
+      std::cerr << "Cannot write " << argv[1] << std::endl;
+      return 1;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
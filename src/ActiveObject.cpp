@@ -36,32 +36,24 @@ ActiveObject::~ActiveObject()
   thread.join();
 }
 
-void ActiveObject::Post(const Call& call)
-{
-  if (!call)
-    return;
-  calls.push_back(call);
-}
-
-void ActiveObject::Post(Call&& call)
-{
-  if (!call)
-    return;
-  calls.push_back(std::move(call));
-}
-
 void ActiveObject::ThreadFunc()
 {
+  Task call;
   while (isRunning)
   {
-    Call call = calls.pop_front();
-    try
-    {
-      call();
-    }
-    catch (...)
+    calls.Wait();
+    // Execute all already posted calls without waiting in between.
+    while (isRunning && calls.TryPop(call))
     {
-      // do nothing, but the thread will be alive.
+      try
+      {
+        call();
+      }
+      catch (...)
+      {
+        // do nothing, but the thread will be alive.
+      }
+      call = Task();
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,606 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "CompiledFilterList.h"
+#include "UrlTokenizer.h"
+
+using namespace AdblockPlus;
+using namespace AdblockPlus::CompiledFilterList;
+
+namespace
+{
+  typedef AhoCorasickAutomaton::State LiteralState;
+  typedef AhoCorasickAutomaton::Transition LiteralTransition;
+  typedef PatternAutomaton::Instruction Instruction;
+  typedef PatternAutomaton::CharacterSet CharacterSet;
+
+  // Records are read in place, so their layout must not depend on the
+  // compiler beyond the byte order.
+  static_assert(sizeof(FilterRecord) == 40, "Unexpected size of FilterRecord");
+  static_assert(sizeof(DomainRecord) == 12, "Unexpected size of DomainRecord");
+  static_assert(sizeof(LiteralState) == 24, "Unexpected size of State");
+  static_assert(sizeof(LiteralTransition) == 8, "Unexpected size of Transition");
+  static_assert(sizeof(Instruction) == 12, "Unexpected size of Instruction");
+  static_assert(sizeof(CharacterSet) == 16, "Unexpected size of CharacterSet");
+  static_assert(sizeof(PatternKeywordRecord) == 16, "Unexpected size of PatternKeywordRecord");
+
+  const size_t SECTION_ALIGNMENT = 8;
+
+  const size_t RECORD_SIZES[SECTIONS_NUMBER] = {
+    sizeof(FilterRecord),
+    sizeof(DomainRecord),
+    sizeof(LiteralState),
+    sizeof(LiteralTransition),
+    sizeof(uint32_t),
+    sizeof(Instruction),
+    sizeof(CharacterSet),
+    sizeof(PatternKeywordRecord),
+    sizeof(uint32_t),
+    sizeof(uint64_t),
+    sizeof(char)
+  };
+
+  size_t Align(size_t offset)
+  {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+  }
+
+  bool IsValid(const StringReference& reference, size_t stringsSize)
+  {
+    return reference.offset <= stringsSize &&
+      reference.length <= stringsSize - reference.offset;
+  }
+
+  bool IsValidRange(uint32_t first, uint32_t number, size_t count)
+  {
+    return first <= count && number <= count - first;
+  }
+
+  // Checks that every successor lies within the program, so the simulation
+  // never leaves it.
+  bool IsValidProgram(const Instruction* program, uint32_t programSize,
+                      size_t characterSetsNumber)
+  {
+    for (uint32_t i = 0; i < programSize; ++i)
+    {
+      // The type is read as an integer, other values aren't valid
+      // enumerators.
+      uint32_t type;
+      std::memcpy(&type, &program[i].type, sizeof(type));
+      switch (type)
+      {
+      case Instruction::CHARACTER:
+        if (program[i].first >= characterSetsNumber)
+          return false;
+        // Fall through, the next instruction follows a character.
+      case Instruction::ASSERT_START:
+      case Instruction::ASSERT_END:
+      case Instruction::ASSERT_NO_SLASH_AHEAD:
+        if (i + 1 >= programSize)
+          return false;
+        break;
+      case Instruction::SPLIT:
+        if (program[i].first >= programSize || program[i].second >= programSize)
+          return false;
+        break;
+      case Instruction::JUMP:
+        if (program[i].first >= programSize)
+          return false;
+        break;
+      case Instruction::MATCH:
+        break;
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Checks that the transitions form a tree and that failure and dictionary
+  // suffix links lead to shallower states, so following them terminates.
+  bool IsValidAutomaton(const AhoCorasickAutomaton::Tables& tables, size_t filtersNumber)
+  {
+    if (tables.statesNumber == 0)
+      return false;
+    for (size_t i = 0; i < AhoCorasickAutomaton::ALPHABET_SIZE; ++i)
+    {
+      if (tables.rootTransitions[i] >= tables.statesNumber)
+        return false;
+    }
+    const uint32_t unvisited = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> depths(tables.statesNumber, unvisited);
+    std::vector<uint32_t> queue;
+    queue.reserve(tables.statesNumber);
+    depths[0] = 0;
+    queue.push_back(0);
+    for (size_t next = 0; next < queue.size(); ++next)
+    {
+      const LiteralState& state = tables.states[queue[next]];
+      if (!IsValidRange(state.firstTransition, state.transitionsNumber, tables.transitionsNumber) ||
+          !IsValidRange(state.firstOutput, state.outputsNumber, tables.outputsNumber))
+        return false;
+      for (uint32_t i = state.firstTransition;
+           i < state.firstTransition + state.transitionsNumber; ++i)
+      {
+        uint32_t target = tables.transitions[i].target;
+        if (target >= tables.statesNumber || depths[target] != unvisited)
+          return false;
+        depths[target] = depths[queue[next]] + 1;
+        queue.push_back(target);
+      }
+    }
+    if (queue.size() != tables.statesNumber)
+      return false;
+    for (size_t i = 0; i < tables.statesNumber; ++i)
+    {
+      const LiteralState& state = tables.states[i];
+      if (state.failure >= tables.statesNumber ||
+          state.dictionarySuffix >= tables.statesNumber)
+        return false;
+      if (i == 0 ? state.failure || state.dictionarySuffix :
+          depths[state.failure] >= depths[i] || depths[state.dictionarySuffix] >= depths[i])
+        return false;
+    }
+    for (size_t i = 0; i < tables.outputsNumber; ++i)
+    {
+      if (tables.outputs[i] >= filtersNumber)
+        return false;
+    }
+    return true;
+  }
+
+  class StringTable
+  {
+  public:
+    StringReference Add(const std::string& value)
+    {
+      StringReference reference = {static_cast<uint32_t>(strings.size()),
+                                   static_cast<uint32_t>(value.size())};
+      strings += value;
+      return reference;
+    }
+
+    const std::string& GetStrings() const
+    {
+      return strings;
+    }
+  private:
+    std::string strings;
+  };
+
+  template<typename T>
+  std::pair<const void*, size_t> GetSectionData(const std::vector<T>& records)
+  {
+    return std::make_pair(static_cast<const void*>(records.data()), records.size());
+  }
+}
+
+IFileSystem::IOBuffer CompiledFilterList::Write(const Filters& filters,
+                                                size_t patternStatesBudget)
+{
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.byteOrderMark = BYTE_ORDER_MARK;
+  header.formatVersion = FORMAT_VERSION;
+
+  std::unordered_set<std::string> texts;
+  std::vector<NativeFilter> nativeFilters;
+  std::array<std::unordered_set<uint64_t>, FilterIndex::CONTENT_TYPES_NUMBER> keywordHashes;
+  for (const auto& filter : filters)
+  {
+    if (!texts.insert(filter.first).second)
+      continue;
+    uint32_t contentTypeMask = static_cast<uint32_t>(filter.second.contentTypeMask);
+    NativeFilter nativeFilter;
+    if (NativeFilter::Parse(filter.first, contentTypeMask, filter.second.isException,
+                            filter.second.keyword, patternStatesBudget, nativeFilter))
+    {
+      nativeFilters.push_back(std::move(nativeFilter));
+      continue;
+    }
+    header.jsContentTypeMask |= contentTypeMask;
+    if (filter.second.keyword.empty())
+    {
+      header.unconditionalJsContentTypeMask |= contentTypeMask;
+      continue;
+    }
+    uint64_t keywordHash = UrlTokenizer::HashKeyword(filter.second.keyword);
+    for (uint32_t rest = contentTypeMask; rest; rest &= rest - 1)
+      keywordHashes[UrlTokenizer::CountTrailingZeros(rest)].insert(keywordHash);
+  }
+
+  StringTable strings;
+  std::vector<FilterRecord> filterRecords;
+  std::vector<DomainRecord> domainRecords;
+  std::vector<Instruction> instructions;
+  std::vector<CharacterSet> characterSets;
+  std::vector<PatternKeywordRecord> patternKeywords;
+  std::vector<uint32_t> unconditionalPatternFilters;
+  std::vector<uint32_t> literalFilterIndexes;
+  std::vector<std::string> literals;
+  for (const auto& filter : nativeFilters)
+  {
+    uint32_t filterIndex = static_cast<uint32_t>(filterRecords.size());
+    FilterRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.text = strings.Add(filter.text);
+    record.contentTypeMask = filter.contentTypeMask;
+    record.flags = filter.isException ? FILTER_IS_EXCEPTION : 0;
+    header.nativeContentTypeMask |= filter.contentTypeMask;
+
+    // The entry for "" holds the default, the others are sorted already.
+    record.firstDomain = static_cast<uint32_t>(domainRecords.size());
+    for (const auto& domain : filter.domains)
+    {
+      if (domain.first.empty())
+      {
+        if (domain.second)
+          record.flags |= FILTER_IS_ACTIVE_BY_DEFAULT;
+        continue;
+      }
+      DomainRecord domainRecord = {strings.Add(domain.first), domain.second ? 1u : 0u};
+      domainRecords.push_back(domainRecord);
+    }
+    record.domainsNumber = static_cast<uint32_t>(domainRecords.size()) - record.firstDomain;
+    // Literal filters get an empty program at the current position, so the
+    // programs of all filters follow each other.
+    record.firstInstruction = static_cast<uint32_t>(instructions.size());
+
+    if (!filter.pattern)
+    {
+      record.anchors = filter.anchors;
+      record.literalLength = static_cast<uint32_t>(filter.literal.size());
+      literalFilterIndexes.push_back(filterIndex);
+      literals.push_back(filter.literal);
+    }
+    else
+    {
+      header.patternContentTypeMask |= filter.contentTypeMask;
+      // Character sets of all programs share one section.
+      uint32_t firstCharacterSet = static_cast<uint32_t>(characterSets.size());
+      const auto& program = filter.pattern->GetProgram();
+      record.instructionsNumber = static_cast<uint32_t>(program.size());
+      for (auto instruction : program)
+      {
+        if (instruction.type == Instruction::CHARACTER)
+          instruction.first += firstCharacterSet;
+        instructions.push_back(instruction);
+      }
+      const auto& patternCharacterSets = filter.pattern->GetCharacterSets();
+      characterSets.insert(characterSets.end(), patternCharacterSets.begin(),
+                           patternCharacterSets.end());
+      if (filter.hasKeyword)
+        patternKeywords.push_back(PatternKeywordRecord{filter.keywordHash, filterIndex, 0});
+      else
+        unconditionalPatternFilters.push_back(filterIndex);
+    }
+    filterRecords.push_back(record);
+  }
+  std::stable_sort(patternKeywords.begin(), patternKeywords.end(),
+    [](const PatternKeywordRecord& a, const PatternKeywordRecord& b)
+    {
+      return a.keywordHash < b.keywordHash;
+    });
+
+  AhoCorasickAutomaton automaton(literals);
+  auto tables = automaton.GetTables();
+  std::copy(tables.rootTransitions, tables.rootTransitions + AhoCorasickAutomaton::ALPHABET_SIZE,
+            header.literalRootTransitions);
+  std::vector<LiteralState> literalStates(tables.states, tables.states + tables.statesNumber);
+  std::vector<LiteralTransition> literalTransitions(tables.transitionsNumber);
+  // The padding after the character is zeroed, so images are reproducible.
+  std::memset(literalTransitions.data(), 0, literalTransitions.size() * sizeof(LiteralTransition));
+  for (size_t i = 0; i < tables.transitionsNumber; ++i)
+  {
+    literalTransitions[i].character = tables.transitions[i].character;
+    literalTransitions[i].target = tables.transitions[i].target;
+  }
+  std::vector<uint32_t> literalOutputs;
+  literalOutputs.reserve(tables.outputsNumber);
+  for (size_t i = 0; i < tables.outputsNumber; ++i)
+    literalOutputs.push_back(literalFilterIndexes[tables.outputs[i]]);
+
+  std::vector<uint64_t> bloomFilterWords;
+  for (size_t contentType = 0; contentType < FilterIndex::CONTENT_TYPES_NUMBER; ++contentType)
+  {
+    const auto& hashes = keywordHashes[contentType];
+    if (hashes.empty())
+      continue;
+    FilterIndex::KeywordBloomFilter bloomFilter(
+      FilterIndex::KeywordBloomFilter::GetBitsNumberForKeywords(hashes.size()));
+    for (uint64_t hash : hashes)
+      bloomFilter.Add(hash);
+    header.bloomFilters[contentType].firstWord = static_cast<uint32_t>(bloomFilterWords.size());
+    header.bloomFilters[contentType].bitsNumber = static_cast<uint32_t>(bloomFilter.GetBitsNumber());
+    bloomFilterWords.insert(bloomFilterWords.end(), bloomFilter.GetBits().begin(),
+                            bloomFilter.GetBits().end());
+  }
+
+  const std::string& stringData = strings.GetStrings();
+  std::pair<const void*, size_t> sectionData[SECTIONS_NUMBER] = {
+    GetSectionData(filterRecords),
+    GetSectionData(domainRecords),
+    GetSectionData(literalStates),
+    GetSectionData(literalTransitions),
+    GetSectionData(literalOutputs),
+    GetSectionData(instructions),
+    GetSectionData(characterSets),
+    GetSectionData(patternKeywords),
+    GetSectionData(unconditionalPatternFilters),
+    GetSectionData(bloomFilterWords),
+    std::make_pair(static_cast<const void*>(stringData.data()), stringData.size())
+  };
+  size_t size = Align(sizeof(Header));
+  for (size_t section = 0; section < SECTIONS_NUMBER; ++section)
+  {
+    size_t sectionSize = sectionData[section].second * RECORD_SIZES[section];
+    if (size + sectionSize > std::numeric_limits<uint32_t>::max())
+      throw std::runtime_error("The compiled filter list exceeds 4 GiB");
+    header.sections[section].offset = static_cast<uint32_t>(size);
+    header.sections[section].count = static_cast<uint32_t>(sectionData[section].second);
+    size = Align(size + sectionSize);
+  }
+
+  IFileSystem::IOBuffer buffer(size, 0);
+  std::memcpy(buffer.data(), &header, sizeof(header));
+  for (size_t section = 0; section < SECTIONS_NUMBER; ++section)
+  {
+    if (sectionData[section].second)
+      std::memcpy(buffer.data() + header.sections[section].offset, sectionData[section].first,
+                  sectionData[section].second * RECORD_SIZES[section]);
+  }
+  return buffer;
+}
+
+CompiledFilterList::View::View()
+  : header(nullptr), filters(nullptr), domains(nullptr), literalTables()
+  , instructions(nullptr), characterSets(nullptr), patternKeywords(nullptr)
+  , unconditionalPatternFilters(nullptr), bloomFilterWords(nullptr), strings(nullptr)
+{
+}
+
+bool CompiledFilterList::View::Open(const uint8_t* data, size_t size, View& view)
+{
+  if (reinterpret_cast<uintptr_t>(data) % SECTION_ALIGNMENT || size < sizeof(Header))
+    return false;
+  const Header* header = reinterpret_cast<const Header*>(data);
+  if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->byteOrderMark != BYTE_ORDER_MARK ||
+      header->formatVersion != FORMAT_VERSION)
+    return false;
+  for (size_t section = 0; section < SECTIONS_NUMBER; ++section)
+  {
+    const SectionReference& reference = header->sections[section];
+    // Computed with 64 bits, so corrupted numbers can't overflow.
+    if (reference.offset % SECTION_ALIGNMENT || reference.offset < sizeof(Header) ||
+        reference.offset > size ||
+        uint64_t(reference.count) * RECORD_SIZES[section] > size - reference.offset)
+      return false;
+  }
+
+  View result;
+  result.header = header;
+  auto getSection = [data, header](Section section)
+  {
+    return data + header->sections[section].offset;
+  };
+  auto getCount = [header](Section section)
+  {
+    return header->sections[section].count;
+  };
+  result.filters = reinterpret_cast<const FilterRecord*>(getSection(FILTERS));
+  result.domains = reinterpret_cast<const DomainRecord*>(getSection(DOMAINS));
+  result.literalTables.states = reinterpret_cast<const LiteralState*>(getSection(LITERAL_STATES));
+  result.literalTables.statesNumber = getCount(LITERAL_STATES);
+  result.literalTables.transitions =
+    reinterpret_cast<const LiteralTransition*>(getSection(LITERAL_TRANSITIONS));
+  result.literalTables.transitionsNumber = getCount(LITERAL_TRANSITIONS);
+  result.literalTables.outputs = reinterpret_cast<const uint32_t*>(getSection(LITERAL_OUTPUTS));
+  result.literalTables.outputsNumber = getCount(LITERAL_OUTPUTS);
+  result.literalTables.rootTransitions = header->literalRootTransitions;
+  result.instructions = reinterpret_cast<const Instruction*>(getSection(INSTRUCTIONS));
+  result.characterSets = reinterpret_cast<const CharacterSet*>(getSection(CHARACTER_SETS));
+  result.patternKeywords =
+    reinterpret_cast<const PatternKeywordRecord*>(getSection(PATTERN_KEYWORDS));
+  result.unconditionalPatternFilters =
+    reinterpret_cast<const uint32_t*>(getSection(UNCONDITIONAL_PATTERN_FILTERS));
+  result.bloomFilterWords = reinterpret_cast<const uint64_t*>(getSection(BLOOM_FILTER_WORDS));
+  result.strings = reinterpret_cast<const char*>(getSection(STRINGS));
+
+  size_t stringsSize = getCount(STRINGS);
+  size_t filtersNumber = getCount(FILTERS);
+  // Domains and programs of the filters follow each other, so every record
+  // is checked once.
+  uint32_t nextDomain = 0;
+  uint32_t nextInstruction = 0;
+  for (size_t i = 0; i < filtersNumber; ++i)
+  {
+    const FilterRecord& filter = result.filters[i];
+    if (!IsValid(filter.text, stringsSize) ||
+        filter.firstDomain < nextDomain ||
+        !IsValidRange(filter.firstDomain, filter.domainsNumber, getCount(DOMAINS)) ||
+        filter.firstInstruction < nextInstruction ||
+        !IsValidRange(filter.firstInstruction, filter.instructionsNumber, getCount(INSTRUCTIONS)))
+      return false;
+    for (uint32_t domain = filter.firstDomain;
+         domain < filter.firstDomain + filter.domainsNumber; ++domain)
+    {
+      if (!IsValid(result.domains[domain].domain, stringsSize))
+        return false;
+    }
+    if (!IsValidProgram(result.instructions + filter.firstInstruction,
+                        filter.instructionsNumber, getCount(CHARACTER_SETS)))
+      return false;
+    nextDomain = filter.firstDomain + filter.domainsNumber;
+    nextInstruction = filter.firstInstruction + filter.instructionsNumber;
+  }
+  if (!IsValidAutomaton(result.literalTables, filtersNumber))
+    return false;
+
+  // Pattern filters need a program, an empty one has no start state.
+  auto isPatternFilter = [&result, filtersNumber](uint32_t filter)
+  {
+    return filter < filtersNumber && result.filters[filter].instructionsNumber > 0;
+  };
+  for (size_t i = 0; i < getCount(PATTERN_KEYWORDS); ++i)
+  {
+    if (!isPatternFilter(result.patternKeywords[i].filter))
+      return false;
+  }
+  for (size_t i = 0; i < getCount(UNCONDITIONAL_PATTERN_FILTERS); ++i)
+  {
+    if (!isPatternFilter(result.unconditionalPatternFilters[i]))
+      return false;
+  }
+  for (const auto& bloomFilter : header->bloomFilters)
+  {
+    uint32_t bitsNumber = bloomFilter.bitsNumber;
+    if (bitsNumber && (bitsNumber < 64 || (bitsNumber & (bitsNumber - 1)) ||
+        !IsValidRange(bloomFilter.firstWord, bitsNumber / 64, getCount(BLOOM_FILTER_WORDS))))
+      return false;
+  }
+  view = result;
+  return true;
+}
+
+FilterIndex::MatchResult CompiledFilterList::View::Match(const std::string& url,
+  uint32_t contentTypes, const std::string& documentUrl, std::string& filterText) const
+{
+  if (MayMatchInJs(url, contentTypes))
+    return FilterIndex::UNKNOWN;
+  contentTypes &= header->nativeContentTypeMask;
+  if (!contentTypes)
+    return FilterIndex::NO_MATCH;
+  // JavaScript lower-cases some non-ASCII characters to ASCII ones.
+  if (!IsAscii(url))
+    return FilterIndex::UNKNOWN;
+
+  NativeMatchSelector<FilterRecord> selector(contentTypes, documentUrl);
+  auto checkFilter = [this, &selector](const FilterRecord& filter)
+  {
+    return selector.Check(filter, filter.contentTypeMask,
+      (filter.flags & FILTER_IS_EXCEPTION) != 0, filter.domainsNumber > 0,
+      [this, &filter](const std::string& documentHost)
+      {
+        return IsActiveOnDomain(filter, documentHost);
+      });
+  };
+
+  literalTables.ForEachMatch(url, [&](uint32_t filterIndex, size_t end)
+  {
+    const FilterRecord& filter = filters[filterIndex];
+    if (!(filter.contentTypeMask & contentTypes) || filter.literalLength > end ||
+        !LiteralMatchesAt(url, end - filter.literalLength, end, filter.anchors))
+      return true;
+    return checkFilter(filter);
+  });
+
+  // Automata are only run once the cheaper checks passed.
+  if (!selector.IsDecided() && (header->patternContentTypeMask & contentTypes))
+  {
+    auto checkPatternFilter = [&](uint32_t filterIndex)
+    {
+      const FilterRecord& filter = filters[filterIndex];
+      if (!(filter.contentTypeMask & contentTypes) || !PatternMatches(filter, url))
+        return true;
+      return checkFilter(filter);
+    };
+    bool isStopped = false;
+    for (uint32_t i = 0; i < GetSection(UNCONDITIONAL_PATTERN_FILTERS).count && !isStopped; ++i)
+      isStopped = !checkPatternFilter(unconditionalPatternFilters[i]);
+    const PatternKeywordRecord* keywordsEnd =
+      patternKeywords + GetSection(PATTERN_KEYWORDS).count;
+    if (!isStopped && patternKeywords != keywordsEnd)
+    {
+      UrlTokenizer::ForEachKeywordHash(url, [&](uint64_t keywordHash)
+      {
+        auto record = std::lower_bound(patternKeywords, keywordsEnd, keywordHash,
+          [](const PatternKeywordRecord& record, uint64_t keywordHash)
+          {
+            return record.keywordHash < keywordHash;
+          });
+        for (; record != keywordsEnd && record->keywordHash == keywordHash; ++record)
+        {
+          if (!checkPatternFilter(record->filter))
+            return false;
+        }
+        return true;
+      });
+    }
+  }
+
+  if (selector.IsUnknown())
+    return FilterIndex::UNKNOWN;
+  const FilterRecord* filter = selector.GetFilter();
+  if (!filter)
+    return FilterIndex::NO_MATCH;
+  filterText = GetString(filter->text);
+  return FilterIndex::MATCH;
+}
+
+bool CompiledFilterList::View::MayMatchInJs(const std::string& url,
+                                            uint32_t contentTypes) const
+{
+  return FilterIndex::MayMatchInJs(url, contentTypes, header->jsContentTypeMask,
+    header->unconditionalJsContentTypeMask, [this](size_t contentType, uint64_t keywordHash)
+    {
+      const BloomFilterReference& bloomFilter = header->bloomFilters[contentType];
+      return bloomFilter.bitsNumber &&
+        FilterIndex::KeywordBloomFilter::MayContain(bloomFilterWords + bloomFilter.firstWord,
+                                                    bloomFilter.bitsNumber, keywordHash);
+    });
+}
+
+bool CompiledFilterList::View::IsActiveOnDomain(const FilterRecord& filter,
+                                                const std::string& documentHost) const
+{
+  const DomainRecord* begin = domains + filter.firstDomain;
+  const DomainRecord* end = begin + filter.domainsNumber;
+  return AdblockPlus::IsActiveOnDomain(documentHost,
+    (filter.flags & FILTER_IS_ACTIVE_BY_DEFAULT) != 0,
+    [this, begin, end](const std::string& domain, bool& isIncluded)
+    {
+      auto compare = [this](const DomainRecord& record, const std::string& domain)
+      {
+        return domain.compare(0, std::string::npos, strings + record.domain.offset,
+                              record.domain.length) > 0;
+      };
+      auto record = std::lower_bound(begin, end, domain, compare);
+      if (record == end ||
+          domain.compare(0, std::string::npos, strings + record->domain.offset,
+                         record->domain.length) != 0)
+        return false;
+      isIncluded = record->isIncluded != 0;
+      return true;
+    });
+}
+
+bool CompiledFilterList::View::PatternMatches(const FilterRecord& filter,
+                                              const std::string& url) const
+{
+  thread_local PatternAutomaton::MatchBuffers buffers;
+  return PatternAutomaton::Matches(instructions + filter.firstInstruction,
+    filter.instructionsNumber, characterSets, url, buffers);
+}
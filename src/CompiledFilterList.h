@@ -0,0 +1,222 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_COMPILED_FILTER_LIST_H
+#define ADBLOCK_PLUS_COMPILED_FILTER_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <AdblockPlus/IFileSystem.h>
+
+#include "FilterIndex.h"
+#include "NativeMatcher.h"
+#include "PatternAutomaton.h"
+
+namespace AdblockPlus
+{
+  /*
+   * Binary image of request filters compiled ahead of time. It's matched in
+   * place, e.g. straight from a memory mapped file, nothing is parsed or
+   * copied when it's opened:
+   *
+   *   Header                  masks, Bloom filter and section references
+   *   FilterRecord[]          native filters
+   *   DomainRecord[]          `domain` options, sorted by domain per filter
+   *   State[]                 Aho-Corasick automaton of the literals
+   *   Transition[]
+   *   uint32_t[]              automaton outputs, i.e. filter indexes
+   *   Instruction[]           programs of the pattern filters
+   *   CharacterSet[]          character sets of all programs
+   *   PatternKeywordRecord[]  pattern filters, sorted by keyword hash
+   *   uint32_t[]              pattern filters without keyword
+   *   uint64_t[]              Bloom filter bits
+   *   char[]                  filter texts and domains
+   *
+   * Native filters (see NativeFilter) are matched like FilterIndex does,
+   * only the keywords of the other filters are kept in one Bloom filter per
+   * content type. Sections start at multiples of 8 bytes, so the image has
+   * to be 8 byte aligned. All integers are in the byte order of the
+   * compiling machine, the byte order mark tells readers with a different
+   * one to reject the image.
+   */
+  namespace CompiledFilterList
+  {
+    typedef std::vector<std::pair<std::string, FilterIndex::IndexedFilter>> Filters;
+
+    const char MAGIC[4] = {'A', 'B', 'P', 'F'};
+    const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    // Has to change with every change of the layout, of the meaning of
+    // keywords and content types or of the native matching rules.
+    const uint32_t FORMAT_VERSION = 2;
+
+    enum Section
+    {
+      FILTERS,
+      DOMAINS,
+      LITERAL_STATES,
+      LITERAL_TRANSITIONS,
+      LITERAL_OUTPUTS,
+      INSTRUCTIONS,
+      CHARACTER_SETS,
+      PATTERN_KEYWORDS,
+      UNCONDITIONAL_PATTERN_FILTERS,
+      BLOOM_FILTER_WORDS,
+      STRINGS,
+      SECTIONS_NUMBER
+    };
+
+    struct SectionReference
+    {
+      uint32_t offset;
+      // Number of records, of bytes for STRINGS.
+      uint32_t count;
+    };
+
+    struct BloomFilterReference
+    {
+      uint32_t firstWord;
+      // A power of two and at least 64, 0 if the content type has no
+      // keywords.
+      uint32_t bitsNumber;
+    };
+
+    struct Header
+    {
+      char magic[4];
+      uint32_t byteOrderMark;
+      uint32_t formatVersion;
+      // Content types with filters which aren't matched natively, and the
+      // ones of them with such filters which are checked for every URL.
+      uint32_t jsContentTypeMask;
+      uint32_t unconditionalJsContentTypeMask;
+      // Content types of the native filters, and of the pattern filters
+      // among them.
+      uint32_t nativeContentTypeMask;
+      uint32_t patternContentTypeMask;
+      BloomFilterReference bloomFilters[FilterIndex::CONTENT_TYPES_NUMBER];
+      uint32_t literalRootTransitions[AhoCorasickAutomaton::ALPHABET_SIZE];
+      SectionReference sections[SECTIONS_NUMBER];
+    };
+
+    struct StringReference
+    {
+      uint32_t offset;
+      uint32_t length;
+    };
+
+    const uint32_t FILTER_IS_EXCEPTION = 1;
+    // The filter is active on domains which aren't listed in its `domain`
+    // option.
+    const uint32_t FILTER_IS_ACTIVE_BY_DEFAULT = 2;
+
+    struct FilterRecord
+    {
+      StringReference text;
+      uint32_t contentTypeMask;
+      uint32_t flags;
+      // ANCHOR_* flags and length of the literal of a literal filter.
+      uint32_t anchors;
+      uint32_t literalLength;
+      // Entries of the `domain` option, none if there is no such option.
+      uint32_t firstDomain;
+      uint32_t domainsNumber;
+      // Program of a pattern filter, it's empty for literal filters.
+      uint32_t firstInstruction;
+      uint32_t instructionsNumber;
+    };
+
+    struct DomainRecord
+    {
+      StringReference domain;
+      uint32_t isIncluded;
+    };
+
+    struct PatternKeywordRecord
+    {
+      uint64_t keywordHash;
+      uint32_t filter;
+      uint32_t reserved;
+    };
+
+    /*
+     * Compiles filters into an image, filters which can't be matched
+     * natively only contribute their keywords. Of filters with the same
+     * text the first one is kept.
+     * @param patternStatesBudget See `FilterIndex::FilterIndex()`.
+     */
+    IFileSystem::IOBuffer Write(const Filters& filters, size_t patternStatesBudget);
+
+    /*
+     * Matcher reading an image in place, it doesn't own the image. It's
+     * immutable, so it's thread-safe.
+     */
+    class View
+    {
+    public:
+      View();
+
+      /*
+       * Checks the whole image, so matching never reads outside of it and
+       * always terminates, in time linear in its size. Returns `false` if
+       * `data` isn't an 8 byte aligned image of the current format version
+       * or is truncated or corrupted.
+       */
+      static bool Open(const uint8_t* data, size_t size, View& view);
+
+      /*
+       * Matches a request like `FilterIndex::Snapshot::Match()`, `UNKNOWN`
+       * means that filters which aren't in the image can match.
+       */
+      FilterIndex::MatchResult Match(const std::string& url,
+                                     uint32_t contentTypes,
+                                     const std::string& documentUrl,
+                                     std::string& filterText) const;
+    private:
+      const Header* header;
+      const FilterRecord* filters;
+      const DomainRecord* domains;
+      AhoCorasickAutomaton::Tables literalTables;
+      const PatternAutomaton::Instruction* instructions;
+      const PatternAutomaton::CharacterSet* characterSets;
+      const PatternKeywordRecord* patternKeywords;
+      const uint32_t* unconditionalPatternFilters;
+      const uint64_t* bloomFilterWords;
+      const char* strings;
+
+      const SectionReference& GetSection(Section section) const
+      {
+        return header->sections[section];
+      }
+
+      std::string GetString(const StringReference& reference) const
+      {
+        return std::string(strings + reference.offset, reference.length);
+      }
+
+      bool MayMatchInJs(const std::string& url, uint32_t contentTypes) const;
+      bool IsActiveOnDomain(const FilterRecord& filter,
+                            const std::string& documentHost) const;
+      bool PatternMatches(const FilterRecord& filter, const std::string& url) const;
+    };
+  }
+}
+
+#endif
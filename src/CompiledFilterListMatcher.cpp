@@ -0,0 +1,73 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/CompiledFilterListMatcher.h>
+
+#include <stdexcept>
+
+#include "CompiledFilterList.h"
+
+using namespace AdblockPlus;
+
+struct CompiledFilterListMatcher::Image
+{
+  IFileSystem::ReadOnlyBufferPtr buffer;
+  // Holds the data if the buffer isn't aligned, vectors allocate with the
+  // alignment of any fundamental type.
+  IFileSystem::IOBuffer alignedCopy;
+  CompiledFilterList::View view;
+};
+
+CompiledFilterListMatcher::CompiledFilterListMatcher(
+  const IFileSystem::ReadOnlyBufferPtr& compiledFilterList)
+{
+  if (!compiledFilterList)
+    throw std::invalid_argument("No compiled filter list");
+  std::unique_ptr<Image> newImage(new Image());
+  newImage->buffer = compiledFilterList;
+  const uint8_t* data = compiledFilterList->Data();
+  size_t size = compiledFilterList->Size();
+  if (reinterpret_cast<uintptr_t>(data) % alignof(uint64_t))
+  {
+    newImage->alignedCopy.assign(data, data + size);
+    data = newImage->alignedCopy.data();
+  }
+  if (!CompiledFilterList::View::Open(data, size, newImage->view))
+    throw std::invalid_argument("Invalid compiled filter list");
+  image = std::move(newImage);
+}
+
+CompiledFilterListMatcher::~CompiledFilterListMatcher()
+{
+}
+
+CompiledFilterListMatcher::MatchResult CompiledFilterListMatcher::Matches(
+  const std::string& url, FilterEngine::ContentTypeMask contentTypeMask,
+  const std::string& documentUrl, std::string& filterText) const
+{
+  switch (image->view.Match(url, static_cast<uint32_t>(contentTypeMask),
+                            documentUrl, filterText))
+  {
+  case FilterIndex::NO_MATCH:
+    return NO_MATCH;
+  case FilterIndex::MATCH:
+    return MATCH;
+  case FilterIndex::UNKNOWN:
+    break;
+  }
+  return UNKNOWN;
+}
@@ -20,88 +20,89 @@
 #include <sstream>
 
 #include "ConsoleJsObject.h"
+#include "JsBinding.h"
 #include "JsContext.h"
 #include "Utils.h"
 #include <AdblockPlus/Platform.h>
 
 namespace
 {
+  using AdblockPlus::JsBinding::RestArguments;
+
   void DoLog(AdblockPlus::LogSystem::LogLevel logLevel,
-    const v8::FunctionCallbackInfo<v8::Value>& arguments)
+    AdblockPlus::JsEngine& jsEngine, const RestArguments& arguments)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    const AdblockPlus::JsContext context(*jsEngine);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+    const AdblockPlus::JsContext context(jsEngine);
+    v8::Isolate* isolate = jsEngine.GetIsolate();
 
     std::stringstream message;
-    for (size_t i = 0; i < converted.size(); i++)
+    for (int i = 0; i < arguments.Length(); i++)
     {
       if (i > 0)
         message << " ";
-      message << converted[i].AsString();
+      message << AdblockPlus::Utils::FromV8String(isolate, arguments[i]);
     }
 
     std::stringstream source;
-    v8::Local<v8::StackFrame> frame = v8::StackTrace::CurrentStackTrace(arguments.GetIsolate(), 1)->GetFrame(0);
-    source << AdblockPlus::Utils::FromV8String(arguments.GetIsolate(), frame->GetScriptName());
+    v8::Local<v8::StackFrame> frame = v8::StackTrace::CurrentStackTrace(isolate, 1)->GetFrame(0);
+    source << AdblockPlus::Utils::FromV8String(isolate, frame->GetScriptName());
     source << ":" << frame->GetLineNumber();
 
-    jsEngine->GetPlatform().WithLogSystem(
+    jsEngine.GetPlatform().WithLogSystem(
       [logLevel, &message, &source](AdblockPlus::LogSystem& callback)
       {
         callback(logLevel, message.str(), source.str());
       });
   }
 
-  void LogCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void LogCallback(AdblockPlus::JsEngine& jsEngine, RestArguments arguments)
   {
-    return DoLog(AdblockPlus::LogSystem::LOG_LEVEL_LOG, arguments);
+    return DoLog(AdblockPlus::LogSystem::LOG_LEVEL_LOG, jsEngine, arguments);
   }
 
-  void DebugCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void DebugCallback(AdblockPlus::JsEngine& jsEngine, RestArguments arguments)
   {
-    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_LOG, arguments);
+    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_LOG, jsEngine, arguments);
   }
 
-  void InfoCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void InfoCallback(AdblockPlus::JsEngine& jsEngine, RestArguments arguments)
   {
-    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_INFO, arguments);
+    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_INFO, jsEngine, arguments);
   }
 
-  void WarnCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void WarnCallback(AdblockPlus::JsEngine& jsEngine, RestArguments arguments)
   {
-    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_WARN, arguments);
+    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_WARN, jsEngine, arguments);
   }
 
-  void ErrorCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void ErrorCallback(AdblockPlus::JsEngine& jsEngine, RestArguments arguments)
   {
-    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_ERROR, arguments);
+    DoLog(AdblockPlus::LogSystem::LOG_LEVEL_ERROR, jsEngine, arguments);
   }
 
-  void TraceCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void TraceCallback(AdblockPlus::JsEngine& jsEngine, RestArguments)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    const AdblockPlus::JsContext context(*jsEngine);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
+    const AdblockPlus::JsContext context(jsEngine);
+    v8::Isolate* isolate = jsEngine.GetIsolate();
 
     std::stringstream traceback;
-    v8::Local<v8::StackTrace> frames = v8::StackTrace::CurrentStackTrace(arguments.GetIsolate(), 100);
+    v8::Local<v8::StackTrace> frames = v8::StackTrace::CurrentStackTrace(isolate, 100);
     for (int i = 0, l = frames->GetFrameCount(); i < l; i++)
     {
       v8::Local<v8::StackFrame> frame = frames->GetFrame(i);
       traceback << (i + 1) << ": ";
-      std::string name = AdblockPlus::Utils::FromV8String(arguments.GetIsolate(), frame->GetFunctionName());
+      std::string name = AdblockPlus::Utils::FromV8String(isolate, frame->GetFunctionName());
       if (name.size())
         traceback << name;
       else
         traceback << "/* anonymous */";
       traceback << "() at ";
-      traceback << AdblockPlus::Utils::FromV8String(arguments.GetIsolate(), frame->GetScriptName());
+      traceback << AdblockPlus::Utils::FromV8String(isolate, frame->GetScriptName());
       traceback << ":" << frame->GetLineNumber();
       traceback << std::endl;
     }
 
-    jsEngine->GetPlatform().WithLogSystem(
+    jsEngine.GetPlatform().WithLogSystem(
       [&traceback](AdblockPlus::LogSystem& callback)
       {
         callback(AdblockPlus::LogSystem::LOG_LEVEL_TRACE, traceback.str(), "");
@@ -112,11 +113,11 @@ namespace
 AdblockPlus::JsValue& AdblockPlus::ConsoleJsObject::Setup(
     AdblockPlus::JsEngine& jsEngine, AdblockPlus::JsValue& obj)
 {
-  obj.SetProperty("log", jsEngine.NewCallback(::LogCallback));
-  obj.SetProperty("debug", jsEngine.NewCallback(::DebugCallback));
-  obj.SetProperty("info", jsEngine.NewCallback(::InfoCallback));
-  obj.SetProperty("warn", jsEngine.NewCallback(::WarnCallback));
-  obj.SetProperty("error", jsEngine.NewCallback(::ErrorCallback));
-  obj.SetProperty("trace", jsEngine.NewCallback(::TraceCallback));
+  obj.SetProperty("log", jsEngine.NewCallback(JS_BINDING(::LogCallback), "console.log"));
+  obj.SetProperty("debug", jsEngine.NewCallback(JS_BINDING(::DebugCallback), "console.debug"));
+  obj.SetProperty("info", jsEngine.NewCallback(JS_BINDING(::InfoCallback), "console.info"));
+  obj.SetProperty("warn", jsEngine.NewCallback(JS_BINDING(::WarnCallback), "console.warn"));
+  obj.SetProperty("error", jsEngine.NewCallback(JS_BINDING(::ErrorCallback), "console.error"));
+  obj.SetProperty("trace", jsEngine.NewCallback(JS_BINDING(::TraceCallback), "console.trace"));
   return obj;
 }
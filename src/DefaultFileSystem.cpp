@@ -16,7 +16,10 @@
  */
 
 #include "DefaultFileSystem.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <sstream>
@@ -31,6 +34,9 @@
 #include <Shlwapi.h>
 #else
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cerrno>
 #endif
 
@@ -58,6 +64,23 @@ namespace
 
   #define rename _wrename
   #define remove _wremove
+
+  class RuntimeErrorWithLastError : public std::runtime_error
+  {
+  public:
+    explicit RuntimeErrorWithLastError(const std::string& message)
+      : std::runtime_error(message + " (error " + std::to_string(GetLastError()) + ")")
+    {
+    }
+  };
+
+  // Concurrent writers of the same file must not share a temporary file.
+  std::string GetTemporaryPath(const std::string& path)
+  {
+    static std::atomic<uint32_t> counter(0);
+    return path + "." + std::to_string(GetCurrentProcessId()) + "-" +
+      std::to_string(counter++) + ".tmp";
+  }
 #else
   // POSIX systems: assume that file system encoding is UTF-8 and just use the
   // file paths as they are.
@@ -65,11 +88,146 @@ namespace
   {
     return path;
   }
+
+  class MappedFile : public IFileSystem::IReadOnlyBuffer
+  {
+  public:
+    MappedFile(void* data, size_t size)
+      : data(data), size(size)
+    {
+    }
+
+    ~MappedFile()
+    {
+      munmap(data, size);
+    }
+
+    const uint8_t* Data() const override
+    {
+      return static_cast<const uint8_t*>(data);
+    }
+
+    size_t Size() const override
+    {
+      return size;
+    }
+  private:
+    void* data;
+    size_t size;
+  };
+
+  void WriteAll(int fd, const uint8_t* data, size_t size, const std::string& path)
+  {
+    while (size > 0)
+    {
+      ssize_t written = write(fd, data, size);
+      if (written < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw RuntimeErrorWithErrno("Failed to write to " + path);
+      }
+      data += written;
+      size -= written;
+    }
+  }
+
+  // Symbolic links are written through, the temporary file has to be in the
+  // directory of the file they point to then.
+  std::string ResolveSymlinks(const std::string& path)
+  {
+    struct stat nativeStat;
+    if (lstat(path.c_str(), &nativeStat) || !S_ISLNK(nativeStat.st_mode))
+      return path;
+    char* resolvedPath = realpath(path.c_str(), nullptr);
+    if (!resolvedPath)
+      return path;
+    std::string result(resolvedPath);
+    free(resolvedPath);
+    return result;
+  }
+
+  // Unlike mkstemp(), which always uses the mode 0600, this lets the process
+  // umask apply to new files.
+  int CreateTemporaryFile(const std::string& path, std::string& tmpPath)
+  {
+    static std::atomic<uint32_t> counter(0);
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+      tmpPath = path + "." + std::to_string(getpid()) + "-" +
+        std::to_string(counter++) + ".tmp";
+      int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+      if (fd >= 0 || errno != EEXIST)
+        return fd;
+    }
+    return -1;
+  }
 #endif
+
+  class DefaultFileWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    DefaultFileWriter(const Scheduler& scheduler,
+      std::unique_ptr<DefaultFileWriterSync> syncImpl)
+      : scheduler(scheduler), syncImpl(std::move(syncImpl))
+    {
+    }
+
+    void Append(const IFileSystem::IOBuffer& data,
+                const IFileSystem::Callback& callback) override
+    {
+      auto syncImpl = this->syncImpl;
+      scheduler([syncImpl, data, callback]
+      {
+        std::string error;
+        try
+        {
+          syncImpl->Append(data.data(), data.size());
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while writing";
+        }
+        callback(error);
+      });
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      auto syncImpl = this->syncImpl;
+      scheduler([syncImpl, callback]
+      {
+        std::string error;
+        try
+        {
+          syncImpl->Commit();
+        }
+        catch (std::exception& e)
+        {
+          error = e.what();
+        }
+        catch (...)
+        {
+          error = "Unknown error while writing";
+        }
+        callback(error);
+      });
+    }
+  private:
+    Scheduler scheduler;
+    // Shared with the scheduled tasks, the temporary file is removed once
+    // neither the writer nor a pending task refers to it.
+    std::shared_ptr<DefaultFileWriterSync> syncImpl;
+  };
 }
 
-DefaultFileSystemSync::DefaultFileSystemSync(const std::string& path)
-  : basePath(path)
+DefaultFileSystemSync::DefaultFileSystemSync(const std::string& path,
+  size_t minMappedFileSize)
+  : basePath(path), minMappedFileSize(minMappedFileSize)
 {
   if (basePath.size() > 1 && *basePath.rbegin() == PATH_SEPARATOR)
   {
@@ -94,14 +252,172 @@ DefaultFileSystemSync::Read(const std::string& path) const
   return data;
 }
 
+IFileSystem::ReadOnlyBufferPtr
+DefaultFileSystemSync::ReadBuffer(const std::string& path) const
+{
+#ifndef _WIN32
+  int fd = open(NormalizePath(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw RuntimeErrorWithErrno("Failed to open " + path);
+
+  struct stat nativeStat;
+  void* data = MAP_FAILED;
+  size_t size = 0;
+  if (!fstat(fd, &nativeStat) && S_ISREG(nativeStat.st_mode) &&
+      static_cast<uint64_t>(nativeStat.st_size) >= minMappedFileSize)
+  {
+    size = static_cast<size_t>(nativeStat.st_size);
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // the mapping stays valid after closing the descriptor.
+  close(fd);
+  if (data != MAP_FAILED)
+  {
+    madvise(data, size, MADV_SEQUENTIAL);
+    return std::make_shared<MappedFile>(data, size);
+  }
+#endif
+  // Small files are not worth mapping, and mapping can fail, e.g. on some
+  // network file systems, then just read the file.
+  return std::make_shared<IFileSystem::ReadOnlyIOBuffer>(Read(path));
+}
+
+void DefaultFileSystemSync::ReadChunks(const std::string& path,
+  const IFileSystem::ReadChunkCallback& chunkCallback) const
+{
+  std::ifstream file(NormalizePath(path).c_str(), std::ios_base::binary);
+  if (file.fail())
+    throw RuntimeErrorWithErrno("Failed to open " + path);
+
+  IFileSystem::IOBuffer chunk(readChunkSize);
+  while (file)
+  {
+    file.read(reinterpret_cast<std::ifstream::char_type*>(chunk.data()),
+              chunk.size());
+    if (file.bad())
+      throw RuntimeErrorWithErrno("Failed to read from " + path);
+    auto chunkSize = static_cast<size_t>(file.gcount());
+    if (chunkSize > 0)
+      chunkCallback(chunk.data(), chunkSize);
+  }
+}
+
 void DefaultFileSystemSync::Write(const std::string& path,
                               const IFileSystem::IOBuffer& data)
 {
-  std::ofstream file(NormalizePath(path).c_str(), std::ios_base::out | std::ios_base::binary);
+  DefaultFileWriterSync writer(path);
+  writer.Append(data.data(), data.size());
+  writer.Commit();
+}
+
+void DefaultFileSystemSync::Append(const std::string& path,
+                                   const IFileSystem::IOBuffer& data)
+{
+#ifdef _WIN32
+  std::ofstream file(NormalizePath(path).c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::app);
   file.write(reinterpret_cast<const std::ofstream::char_type*>(data.data()),
              data.size());
+  if (file.fail())
+    throw RuntimeErrorWithErrno("Failed to append to " + path);
+#else
+  int fd = open(NormalizePath(path).c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw RuntimeErrorWithErrno("Failed to open " + path);
+  try
+  {
+    WriteAll(fd, data.data(), data.size(), path);
+  }
+  catch (...)
+  {
+    close(fd);
+    throw;
+  }
+  if (close(fd))
+    throw RuntimeErrorWithErrno("Failed to append to " + path);
+#endif
+}
+
+std::unique_ptr<DefaultFileWriterSync>
+DefaultFileSystemSync::OpenForWrite(const std::string& path)
+{
+  return std::unique_ptr<DefaultFileWriterSync>(new DefaultFileWriterSync(path));
+}
+
+#ifdef _WIN32
+DefaultFileWriterSync::DefaultFileWriterSync(const std::string& path)
+  : path(path), tmpPath(GetTemporaryPath(path))
+  , file(NormalizePath(tmpPath).c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc)
+{
+  if (file.fail())
+    throw RuntimeErrorWithErrno("Failed to create a temporary file for " + path);
+}
+
+DefaultFileWriterSync::~DefaultFileWriterSync()
+{
+  if (tmpPath.empty())
+    return;
+  file.close();
+  remove(NormalizePath(tmpPath).c_str());
 }
 
+void DefaultFileWriterSync::Append(const uint8_t* data, size_t size)
+{
+  file.write(reinterpret_cast<const std::ofstream::char_type*>(data), size);
+  if (file.fail())
+    throw RuntimeErrorWithErrno("Failed to write to " + path);
+}
+
+void DefaultFileWriterSync::Commit()
+{
+  file.close();
+  if (file.fail())
+    throw RuntimeErrorWithErrno("Failed to write to " + path);
+  if (!MoveFileExW(NormalizePath(tmpPath).c_str(), NormalizePath(path).c_str(),
+                   MOVEFILE_REPLACE_EXISTING))
+    throw RuntimeErrorWithLastError("Failed to write to " + path);
+  tmpPath.clear();
+}
+#else
+// Never truncate the file in place, it can be memory mapped by ReadBuffer and
+// accessing a truncated mapping raises SIGBUS. Instead the data is written
+// into a temporary file which then atomically replaces the target.
+DefaultFileWriterSync::DefaultFileWriterSync(const std::string& path)
+  : path(path), targetPath(ResolveSymlinks(NormalizePath(path)))
+  , fd(CreateTemporaryFile(targetPath, tmpPath))
+{
+  if (fd < 0)
+    throw RuntimeErrorWithErrno("Failed to create a temporary file for " + path);
+  // New files get the default mode, existing ones keep theirs.
+  struct stat nativeStat;
+  if (!stat(targetPath.c_str(), &nativeStat))
+    fchmod(fd, nativeStat.st_mode & 07777);
+}
+
+DefaultFileWriterSync::~DefaultFileWriterSync()
+{
+  if (fd >= 0)
+    close(fd);
+  if (!tmpPath.empty())
+    unlink(tmpPath.c_str());
+}
+
+void DefaultFileWriterSync::Append(const uint8_t* data, size_t size)
+{
+  WriteAll(fd, data, size, path);
+}
+
+void DefaultFileWriterSync::Commit()
+{
+  int result = close(fd);
+  fd = -1;
+  if (result)
+    throw RuntimeErrorWithErrno("Failed to write to " + path);
+  if (rename(tmpPath.c_str(), targetPath.c_str()))
+    throw RuntimeErrorWithErrno("Failed to write to " + path);
+  tmpPath.clear();
+}
+#endif
+
 void DefaultFileSystemSync::Move(const std::string& fromPath,
                                  const std::string& toPath)
 {
@@ -195,9 +511,39 @@ std::string DefaultFileSystemSync::Resolve(const std::string& path) const
   }
 }
 
-DefaultFileSystem::DefaultFileSystem(const Scheduler& scheduler, std::unique_ptr<DefaultFileSystemSync> syncImpl)
+DefaultFileSystem::DefaultFileSystem(const Scheduler& scheduler, std::unique_ptr<DefaultFileSystemSync> syncImpl,
+  const std::chrono::milliseconds& writeCoalescingWindow)
   : scheduler(scheduler), syncImpl(std::move(syncImpl))
+  , writeCoalescingWindow(writeCoalescingWindow)
+  , shouldFlushThreadStop(false)
 {
+  if (writeCoalescingWindow > std::chrono::milliseconds::zero())
+  {
+    flushThread = std::thread([this]
+    {
+      FlushThreadFunc();
+    });
+  }
+}
+
+DefaultFileSystem::~DefaultFileSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(pendingWritesMutex);
+    shouldFlushThreadStop = true;
+  }
+  pendingWritesConditionVariable.notify_one();
+  if (flushThread.joinable())
+    flushThread.join();
+
+  std::vector<std::string> paths;
+  {
+    std::lock_guard<std::mutex> lock(pendingWritesMutex);
+    for (const auto& pendingWrite : pendingWrites)
+      paths.push_back(pendingWrite.first);
+  }
+  for (const auto& path : paths)
+    FlushPendingWrite(path);
 }
 
 void DefaultFileSystem::Read(const std::string& fileName,
@@ -209,7 +555,85 @@ void DefaultFileSystem::Read(const std::string& fileName,
     std::string error;
     try
     {
-      doneCallback(syncImpl->Read(Resolve(fileName)));
+      IOBuffer pendingData;
+      if (ReadPendingWrite(Resolve(fileName), pendingData))
+        doneCallback(std::move(pendingData));
+      else
+        doneCallback(syncImpl->Read(Resolve(fileName)));
+      return;
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error =  "Unknown error while reading from " + fileName + " as " + Resolve(fileName);
+    }
+
+    try
+    {
+      errorCallback(error);
+    }
+    catch (...)
+    {
+      // there is no way to catch an exception thrown from the error callback.
+    }
+  });
+}
+
+void DefaultFileSystem::ReadBuffer(const std::string& fileName,
+                                   const ReadBufferCallback& doneCallback,
+                                   const Callback& errorCallback) const
+{
+  scheduler([this, fileName, doneCallback, errorCallback]
+  {
+    std::string error;
+    try
+    {
+      IOBuffer pendingData;
+      if (ReadPendingWrite(Resolve(fileName), pendingData))
+        doneCallback(std::make_shared<ReadOnlyIOBuffer>(std::move(pendingData)));
+      else
+        doneCallback(syncImpl->ReadBuffer(Resolve(fileName)));
+      return;
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error =  "Unknown error while reading from " + fileName + " as " + Resolve(fileName);
+    }
+
+    try
+    {
+      errorCallback(error);
+    }
+    catch (...)
+    {
+      // there is no way to catch an exception thrown from the error callback.
+    }
+  });
+}
+
+void DefaultFileSystem::ReadChunks(const std::string& fileName,
+                                   const ReadChunkCallback& chunkCallback,
+                                   const ReadEndCallback& endCallback,
+                                   const Callback& errorCallback) const
+{
+  scheduler([this, fileName, chunkCallback, endCallback, errorCallback]
+  {
+    std::string error;
+    try
+    {
+      IOBuffer pendingData;
+      if (!ReadPendingWrite(Resolve(fileName), pendingData))
+        syncImpl->ReadChunks(Resolve(fileName), chunkCallback);
+      else if (!pendingData.empty())
+        chunkCallback(pendingData.data(), pendingData.size());
+      endCallback();
       return;
     }
     catch (std::exception& e)
@@ -236,6 +660,23 @@ void DefaultFileSystem::Write(const std::string& fileName,
                               const IOBuffer& data,
                               const Callback& callback)
 {
+  if (writeCoalescingWindow > std::chrono::milliseconds::zero())
+  {
+    {
+      std::lock_guard<std::mutex> lock(pendingWritesMutex);
+      auto inserted = pendingWrites.emplace(Resolve(fileName), PendingWrite());
+      auto& pendingWrite = inserted.first->second;
+      if (inserted.second)
+        pendingWrite.flushAt = std::chrono::steady_clock::now() + writeCoalescingWindow;
+      pendingWrite.data = data;
+      pendingWrite.callbacks.push_back(callback);
+      pendingWrite.lastModified = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    pendingWritesConditionVariable.notify_one();
+    return;
+  }
+
   scheduler([this, fileName, data, callback]
   {
     std::string error;
@@ -255,6 +696,67 @@ void DefaultFileSystem::Write(const std::string& fileName,
   });
 }
 
+void DefaultFileSystem::Append(const std::string& fileName,
+                               const IOBuffer& data,
+                               const Callback& callback)
+{
+  scheduler([this, fileName, data, callback]
+  {
+    std::string error;
+    try
+    {
+      FlushPendingWrite(Resolve(fileName));
+      syncImpl->Append(Resolve(fileName), data);
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "Unknown error while appending to " + fileName + " as " + Resolve(fileName);
+    }
+    callback(error);
+  });
+}
+
+void DefaultFileSystem::OpenForWrite(const std::string& fileName,
+                                     const OpenForWriteCallback& callback)
+{
+  if (writeCoalescingWindow > std::chrono::milliseconds::zero())
+  {
+    // The content is collected in memory and committed by `Write()`, so it
+    // is coalesced like any other write.
+    scheduler([this, fileName, callback]
+    {
+      callback(std::make_shared<BufferedFileWriter>(*this, fileName), "");
+    });
+    return;
+  }
+
+  scheduler([this, fileName, callback]
+  {
+    IFileSystem::FileWriterPtr writer;
+    std::string error;
+    try
+    {
+      // the committed content must not be overwritten by an older write.
+      FlushPendingWrite(Resolve(fileName));
+      writer = std::make_shared<DefaultFileWriter>(scheduler,
+        syncImpl->OpenForWrite(Resolve(fileName)));
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "Unknown error while opening " + fileName + " as " + Resolve(fileName);
+    }
+    callback(writer, error);
+  });
+}
+
 void DefaultFileSystem::Move(const std::string& fromFileName,
                              const std::string& toFileName,
                              const Callback& callback)
@@ -264,6 +766,8 @@ void DefaultFileSystem::Move(const std::string& fromFileName,
     std::string error;
     try
     {
+      FlushPendingWrite(Resolve(fromFileName));
+      FlushPendingWrite(Resolve(toFileName));
       syncImpl->Move(Resolve(fromFileName), Resolve(toFileName));
     }
     catch (std::exception& e)
@@ -286,6 +790,7 @@ void DefaultFileSystem::Remove(const std::string& fileName,
     std::string error;
     try
     {
+      FlushPendingWrite(Resolve(fileName));
       syncImpl->Remove(Resolve(fileName));
     }
     catch (std::exception& e)
@@ -308,7 +813,9 @@ void DefaultFileSystem::Stat(const std::string& fileName,
     std::string error;
     try
     {
-      auto result = syncImpl->Stat(Resolve(fileName));
+      StatResult result;
+      if (!StatPendingWrite(Resolve(fileName), result))
+        result = syncImpl->Stat(Resolve(fileName));
       callback(result, error);
       return;
     }
@@ -328,3 +835,107 @@ std::string DefaultFileSystem::Resolve(const std::string& fileName) const
 {
   return syncImpl->Resolve(fileName);
 }
+
+bool DefaultFileSystem::ReadPendingWrite(const std::string& path, IOBuffer& data) const
+{
+  std::lock_guard<std::mutex> flushLock(flushMutex);
+  std::lock_guard<std::mutex> lock(pendingWritesMutex);
+  auto pendingWrite = pendingWrites.find(path);
+  if (pendingWrite == pendingWrites.end())
+    return false;
+  data = pendingWrite->second.data;
+  return true;
+}
+
+bool DefaultFileSystem::StatPendingWrite(const std::string& path, StatResult& result) const
+{
+  std::lock_guard<std::mutex> flushLock(flushMutex);
+  std::lock_guard<std::mutex> lock(pendingWritesMutex);
+  auto pendingWrite = pendingWrites.find(path);
+  if (pendingWrite == pendingWrites.end())
+    return false;
+  result.exists = true;
+  result.lastModified = pendingWrite->second.lastModified;
+  return true;
+}
+
+void DefaultFileSystem::FlushPendingWrite(const std::string& path)
+{
+  PendingWrite pendingWrite;
+  std::string error;
+  {
+    std::lock_guard<std::mutex> flushLock(flushMutex);
+    {
+      std::lock_guard<std::mutex> lock(pendingWritesMutex);
+      auto ii = pendingWrites.find(path);
+      if (ii == pendingWrites.end())
+        return;
+      pendingWrite = std::move(ii->second);
+      pendingWrites.erase(ii);
+    }
+    try
+    {
+      syncImpl->Write(path, pendingWrite.data);
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "Unknown error while writing to " + path;
+    }
+  }
+  // Callbacks are scheduled like the ones of other operations, rather than
+  // called on the flush thread or in the destructor. So they are dropped
+  // once the scheduler is invalidated, e.g. while the platform is torn down.
+  auto callbacks = std::move(pendingWrite.callbacks);
+  scheduler([callbacks, error]
+  {
+    for (const auto& callback : callbacks)
+    {
+      try
+      {
+        callback(error);
+      }
+      catch (...)
+      {
+        // a throwing callback must not prevent calling the other ones.
+      }
+    }
+  });
+}
+
+void DefaultFileSystem::FlushThreadFunc()
+{
+  std::unique_lock<std::mutex> lock(pendingWritesMutex);
+  while (!shouldFlushThreadStop)
+  {
+    if (pendingWrites.empty())
+    {
+      pendingWritesConditionVariable.wait(lock);
+      continue;
+    }
+    auto flushAt = pendingWrites.begin()->second.flushAt;
+    for (const auto& pendingWrite : pendingWrites)
+      flushAt = std::min(flushAt, pendingWrite.second.flushAt);
+    if (std::chrono::steady_clock::now() < flushAt)
+    {
+      pendingWritesConditionVariable.wait_until(lock, flushAt);
+      continue;
+    }
+
+    std::vector<std::string> paths;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& pendingWrite : pendingWrites)
+    {
+      if (pendingWrite.second.flushAt <= now)
+        paths.push_back(pendingWrite.first);
+    }
+    // allow to add new writes while the expired ones are being written.
+    lock.unlock();
+    for (const auto& path : paths)
+      FlushPendingWrite(path);
+    lock.lock();
+  }
+}
@@ -20,6 +20,14 @@
 
 #include <AdblockPlus/IFileSystem.h>
 #include <AdblockPlus/Scheduler.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <fstream>
+#endif
 
 #ifdef _WIN32
 #define PATH_SEPARATOR '\\'
@@ -29,6 +37,35 @@
 
 namespace AdblockPlus
 {
+  /**
+   * Writes a file through a temporary file, which atomically replaces the
+   * target file on `Commit()`. The temporary file is removed if the writer
+   * is destroyed before `Commit()`.
+   * An existing target file keeps its mode, new files are created with the
+   * mode 0666 restricted by the process umask. If the target is a symbolic
+   * link the file it points to is replaced, a dangling link is replaced by
+   * the file itself.
+   */
+  class DefaultFileWriterSync
+  {
+  public:
+    explicit DefaultFileWriterSync(const std::string& path);
+    ~DefaultFileWriterSync();
+    void Append(const uint8_t* data, size_t size);
+    void Commit();
+  private:
+    DefaultFileWriterSync(const DefaultFileWriterSync&) = delete;
+    DefaultFileWriterSync& operator=(const DefaultFileWriterSync&) = delete;
+    std::string path;
+    std::string tmpPath;
+#ifdef _WIN32
+    std::ofstream file;
+#else
+    std::string targetPath;
+    int fd;
+#endif
+  };
+
   /**
    * File system implementation that interacts directly with the operating
    * system's file system.
@@ -38,27 +75,73 @@ namespace AdblockPlus
   class DefaultFileSystemSync
   {
   public:
-    explicit DefaultFileSystemSync(const std::string& basePath);
+    /**
+     * Files of at least this size are memory mapped by `ReadBuffer` where
+     * it is supported.
+     */
+    static const size_t defaultMinMappedFileSize = 64 * 1024;
+
+    /**
+     * Size of the buffer used by `ReadChunks`.
+     */
+    static const size_t readChunkSize = 64 * 1024;
+
+    explicit DefaultFileSystemSync(const std::string& basePath,
+      size_t minMappedFileSize = defaultMinMappedFileSize);
     IFileSystem::IOBuffer Read(const std::string& path) const;
+    IFileSystem::ReadOnlyBufferPtr ReadBuffer(const std::string& path) const;
+    void ReadChunks(const std::string& path,
+      const IFileSystem::ReadChunkCallback& chunkCallback) const;
     void Write(const std::string& path, const IFileSystem::IOBuffer& data);
+    void Append(const std::string& path, const IFileSystem::IOBuffer& data);
+    std::unique_ptr<DefaultFileWriterSync> OpenForWrite(const std::string& path);
     void Move(const std::string& fromPath, const std::string& toPath);
     void Remove(const std::string& path);
     IFileSystem::StatResult Stat(const std::string& path) const;
     std::string Resolve(const std::string& fileName) const;
   protected:
     std::string basePath;
+    size_t minMappedFileSize;
   };
 
+  /**
+   * Asynchronous `IFileSystem` running `DefaultFileSystemSync` operations
+   * on the scheduler.
+   * If a write coalescing window is set then writes are kept in memory for
+   * that time and all writes to the same file within it are collapsed into
+   * a single write of the latest content. Files opened by `OpenForWrite()`
+   * are then collected in memory and passed to `Write()` on commit, so
+   * streamed writes are coalesced as well. Write callbacks are scheduled once
+   * the content is actually written, so the scheduler has to accept tasks
+   * from other threads. Reads and stats are served from the pending content,
+   * other operations on the file write it first. Pending writes are flushed
+   * on destruction, their callbacks are dropped if the scheduler doesn't run
+   * tasks anymore by then.
+   */
   class DefaultFileSystem : public IFileSystem
   {
   public:
-    explicit DefaultFileSystem(const Scheduler& scheduler, std::unique_ptr<DefaultFileSystemSync> syncImpl);
+    explicit DefaultFileSystem(const Scheduler& scheduler, std::unique_ptr<DefaultFileSystemSync> syncImpl,
+      const std::chrono::milliseconds& writeCoalescingWindow = std::chrono::milliseconds::zero());
+    ~DefaultFileSystem();
     void Read(const std::string& fileName,
               const ReadCallback& doneCallback,
               const Callback& errorCallback) const override;
+    void ReadBuffer(const std::string& fileName,
+                    const ReadBufferCallback& doneCallback,
+                    const Callback& errorCallback) const override;
+    void ReadChunks(const std::string& fileName,
+                    const ReadChunkCallback& chunkCallback,
+                    const ReadEndCallback& endCallback,
+                    const Callback& errorCallback) const override;
     void Write(const std::string& fileName,
                const IOBuffer& data,
                const Callback& callback) override;
+    void Append(const std::string& fileName,
+                const IOBuffer& data,
+                const Callback& callback) override;
+    void OpenForWrite(const std::string& fileName,
+                      const OpenForWriteCallback& callback) override;
     void Move(const std::string& fromFileName,
               const std::string& toFileName,
               const Callback& callback) override;
@@ -67,10 +150,37 @@ namespace AdblockPlus
               const StatCallback& callback) const override;
 
   private:
+    struct PendingWrite
+    {
+      IOBuffer data;
+      std::vector<Callback> callbacks;
+      std::chrono::steady_clock::time_point flushAt;
+      int64_t lastModified;
+    };
+
     // Returns the absolute path to a file.
     std::string Resolve(const std::string& fileName) const;
+    // Copies the pending content of the file at the resolved path, returns
+    // false if there is no pending write.
+    bool ReadPendingWrite(const std::string& path, IOBuffer& data) const;
+    // Stats the file at the resolved path from its pending write, returns
+    // false if there is no pending write.
+    bool StatPendingWrite(const std::string& path, StatResult& result) const;
+    // Writes the pending content of the file at the resolved path, if any,
+    // and schedules the callbacks of all collapsed writes.
+    void FlushPendingWrite(const std::string& path);
+    void FlushThreadFunc();
     Scheduler scheduler;
     std::unique_ptr<DefaultFileSystemSync> syncImpl;
+    std::chrono::milliseconds writeCoalescingWindow;
+    // Serializes flushing, a file is not read from the disk while its latest
+    // pending content is being written.
+    mutable std::mutex flushMutex;
+    mutable std::mutex pendingWritesMutex;
+    std::condition_variable pendingWritesConditionVariable;
+    std::map<std::string, PendingWrite> pendingWrites;
+    bool shouldFlushThreadStop;
+    std::thread flushThread;
   };
 }
 
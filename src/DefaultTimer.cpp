@@ -16,11 +16,15 @@
 */
 
 #include "DefaultTimer.h"
+#include <algorithm>
+#include <iterator>
 
 using AdblockPlus::DefaultTimer;
 
-DefaultTimer::DefaultTimer()
-  : shouldThreadStop(false)
+DefaultTimer::DefaultTimer(const std::chrono::milliseconds& tickDuration)
+  : tickDuration(std::max(tickDuration, std::chrono::milliseconds(1)))
+  , startTime(std::chrono::steady_clock::now())
+  , currentTick(0), timersNumber(0), shouldThreadStop(false)
 {
   m_thread = std::thread([this]
   {
@@ -40,52 +44,163 @@ DefaultTimer::~DefaultTimer()
 }
 
 void DefaultTimer::SetTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback)
+{
+  AddTimer(timeout, timerCallback);
+}
+
+AdblockPlus::ITimer::CancelTimerCallback DefaultTimer::SetCancelableTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback)
+{
+  std::weak_ptr<TimerUnit> weakTimer = AddTimer(timeout, timerCallback);
+  return [weakTimer]
+  {
+    if (auto timer = weakTimer.lock())
+    {
+      // The unit stays in the wheel until its slot is processed, but the
+      // callback and everything captured by it is released right now.
+      std::unique_ptr<TimerCallback> callback(timer->callback.exchange(nullptr));
+    }
+  };
+}
+
+uint64_t DefaultTimer::ToTick(const std::chrono::steady_clock::time_point& time) const
+{
+  if (time <= startTime)
+    return 0;
+  return (time - startTime) / tickDuration;
+}
+
+std::chrono::steady_clock::time_point DefaultTimer::ToTime(uint64_t tick) const
+{
+  return startTime + static_cast<std::chrono::steady_clock::rep>(tick) * tickDuration;
+}
+
+DefaultTimer::TimerUnitPtr DefaultTimer::AddTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback)
 {
   if (!timerCallback)
-    return;
+    return TimerUnitPtr();
+  auto timer = std::make_shared<TimerUnit>();
+  auto now = std::chrono::steady_clock::now();
+  timer->fireAt = now + timeout;
+  timer->callback = new TimerCallback(timerCallback);
   {
     std::lock_guard<std::mutex> lock(mutex);
-    TimerUnit timer = { std::chrono::steady_clock::now() + timeout, timerCallback };
-    timers.push(timer);
+    // Nothing has to be processed in between, so don't make the thread go
+    // through all the ticks since the wheel became empty.
+    if (timersNumber == 0)
+      currentTick = std::max(currentTick, ToTick(now));
+    // Round up, the timer should not fire earlier than requested.
+    uint64_t fireAtTick = ToTick(timer->fireAt);
+    if (ToTime(fireAtTick) < timer->fireAt)
+      ++fireAtTick;
+    timer->fireAtTick = std::max(fireAtTick, currentTick + 1);
+    Insert(TimerUnitPtr(timer));
+    ++timersNumber;
   }
   conditionVariable.notify_one();
+  return timer;
+}
+
+void DefaultTimer::Insert(TimerUnitPtr&& timer)
+{
+  uint64_t tick = timer->fireAtTick;
+  uint64_t delta = tick - currentTick;
+  size_t level = 0;
+  while (level + 1 < levelsNumber && delta >= (uint64_t(1) << (levelBits * (level + 1))))
+    ++level;
+  // The timer is too far away, it is re-inserted after the cascading of the
+  // farthest slot of the last level.
+  if (delta >= (uint64_t(1) << (levelBits * levelsNumber)))
+    tick = currentTick + (uint64_t(1) << (levelBits * levelsNumber)) - 1;
+  slots[level][(tick >> (levelBits * level)) & (levelSlotsNumber - 1)].push_back(std::move(timer));
+}
+
+void DefaultTimer::AdvanceTick(TimerUnits& expired)
+{
+  ++currentTick;
+  // When a level completes a round, the timers of the next slot of the upper
+  // level are redistributed among the lower levels.
+  for (size_t level = 1; level < levelsNumber; ++level)
+  {
+    if (currentTick & ((uint64_t(1) << (levelBits * level)) - 1))
+      break;
+    TimerUnits cascaded;
+    cascaded.swap(slots[level][(currentTick >> (levelBits * level)) & (levelSlotsNumber - 1)]);
+    for (auto& timer : cascaded)
+    {
+      if (!timer->callback.load())
+      {
+        --timersNumber;
+        continue;
+      }
+      Insert(std::move(timer));
+    }
+  }
+  auto& slot = slots[0][currentTick & (levelSlotsNumber - 1)];
+  timersNumber -= slot.size();
+  std::move(slot.begin(), slot.end(), std::back_inserter(expired));
+  slot.clear();
+}
+
+uint64_t DefaultTimer::GetNextTick() const
+{
+  // Cascading happens at the end of the round of the first level.
+  uint64_t roundEnd = (currentTick | (levelSlotsNumber - 1)) + 1;
+  for (uint64_t tick = currentTick + 1; tick < roundEnd; ++tick)
+  {
+    if (!slots[0][tick & (levelSlotsNumber - 1)].empty())
+      return tick;
+  }
+  return roundEnd;
 }
 
 void DefaultTimer::ThreadFunc()
 {
-  while (true)
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!shouldThreadStop)
   {
-    std::unique_lock<std::mutex> lock(mutex);
-    if (timers.empty())
+    if (timersNumber == 0)
     {
       conditionVariable.wait(lock, [this]()->bool
       {
-        return shouldThreadStop || !timers.empty();
+        return shouldThreadStop || timersNumber > 0;
       });
+      continue;
+    }
+    uint64_t nowTick = ToTick(std::chrono::steady_clock::now());
+    if (nowTick <= currentTick)
+    {
+      conditionVariable.wait_until(lock, ToTime(GetNextTick()));
+      continue;
     }
-    else
+    TimerUnits expired;
+    while (currentTick < nowTick)
     {
-      auto fireAt = timers.top().fireAt;
-      conditionVariable.wait_until(lock, fireAt);
+      // skip the ticks without anything to do
+      currentTick = std::min(GetNextTick(), nowTick) - 1;
+      AdvanceTick(expired);
     }
-    // execute all expired timers and remove them
-    while (!shouldThreadStop && !timers.empty() && timers.top().fireAt <= std::chrono::steady_clock::now())
+    // allow to put new timers while these timers are being processed
+    lock.unlock();
+    // The order of timers within a tick depends on how they got there.
+    std::stable_sort(expired.begin(), expired.end(), [](const TimerUnitPtr& t1, const TimerUnitPtr& t2)
+    {
+      return t1->fireAt < t2->fireAt;
+    });
+    for (auto& timer : expired)
     {
-      auto callback = timers.top().callback;
-      timers.pop();
-      // allow to put new timers while this timer is being processed
-      lock.unlock();
+      std::unique_ptr<TimerCallback> callback(timer->callback.exchange(nullptr));
+      if (!callback)
+        continue;
       try
       {
-        callback();
+        (*callback)();
       }
       catch (...)
       {
         // do nothing, but the thread will be alive.
       }
-      lock.lock();
     }
-    if (shouldThreadStop)
-      return;
+    expired.clear();
+    lock.lock();
   }
 }
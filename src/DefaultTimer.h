@@ -19,42 +19,76 @@
 #define ADBLOCK_PLUS_DEFAULT_TIMER_H
 
 #include <AdblockPlus/ITimer.h>
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
 #include <thread>
+#include <vector>
 
 namespace AdblockPlus
 {
+  /**
+   * Executes timers in a background thread. The timers are kept in a
+   * hierarchical timing wheel, so setting and cancelling of a timer take
+   * constant time. Timers firing within the same tick are executed together.
+   */
   class DefaultTimer : public ITimer
   {
     struct TimerUnit
     {
-      std::chrono::steady_clock::time_point fireAt;
-      TimerCallback callback;
-    };
-    struct TimerUnitComparator
-    {
-      bool operator()(const TimerUnit& t1, const TimerUnit& t2) const
+      TimerUnit()
+        : fireAtTick(0), callback(nullptr)
       {
-        // pay attention 2 < 1 because we need the smallest time at the top.
-        return t2.fireAt < t1.fireAt;
       }
+      ~TimerUnit()
+      {
+        delete callback.load();
+      }
+      std::chrono::steady_clock::time_point fireAt;
+      uint64_t fireAtTick;
+      // Owned, it is taken out either by firing or by cancelling.
+      std::atomic<TimerCallback*> callback;
     };
-    typedef std::priority_queue<TimerUnit, std::vector<TimerUnit>, TimerUnitComparator> TimerUnits;
+    typedef std::shared_ptr<TimerUnit> TimerUnitPtr;
+    typedef std::vector<TimerUnitPtr> TimerUnits;
   public:
-    DefaultTimer();
+    /**
+     * Constructor.
+     * @param tickDuration The resolution of the timer, timers firing within
+     *        the same tick are coalesced. The timers never fire earlier than
+     *        requested.
+     */
+    explicit DefaultTimer(const std::chrono::milliseconds& tickDuration = std::chrono::milliseconds(4));
     ~DefaultTimer();
     void SetTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback) override;
+    CancelTimerCallback SetCancelableTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback) override;
   private:
+    static const int levelBits = 8;
+    static const size_t levelSlotsNumber = 1 << levelBits;
+    static const size_t levelsNumber = 4;
+
+    uint64_t ToTick(const std::chrono::steady_clock::time_point& time) const;
+    std::chrono::steady_clock::time_point ToTime(uint64_t tick) const;
+    TimerUnitPtr AddTimer(const std::chrono::milliseconds& timeout, const TimerCallback& timerCallback);
+    void Insert(TimerUnitPtr&& timer);
+    // Advances the current tick by one and moves timers of it into `expired`.
+    void AdvanceTick(TimerUnits& expired);
+    // Returns the next tick at which there can be something to do.
+    uint64_t GetNextTick() const;
     void ThreadFunc();
   private:
+    const std::chrono::steady_clock::duration tickDuration;
+    const std::chrono::steady_clock::time_point startTime;
     std::mutex mutex;
     std::condition_variable conditionVariable;
-    TimerUnits timers;
+    TimerUnits slots[levelsNumber][levelSlotsNumber];
+    // All ticks up to and including currentTick are processed.
+    uint64_t currentTick;
+    size_t timersNumber;
     bool shouldThreadStop;
     std::thread m_thread;
   };
 }
 
-#endif
\ No newline at end of file
+#endif
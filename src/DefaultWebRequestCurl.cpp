@@ -73,8 +73,8 @@ namespace
 
   size_t ReceiveData(char* ptr, size_t size, size_t nmemb, void* userdata)
   {
-    std::stringstream* stream = static_cast<std::stringstream*>(userdata);
-    stream->write(ptr, size * nmemb);
+    std::string* responseText = static_cast<std::string*>(userdata);
+    responseText->append(ptr, size * nmemb);
     return nmemb;
   }
 
@@ -132,7 +132,7 @@ AdblockPlus::ServerResponse AdblockPlus::DefaultWebRequestSync::GET(
   CURL *curl = curl_easy_init();
   if (curl)
   {
-    std::stringstream responseText;
+    std::string responseText;
     HeaderData headerData;
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
@@ -153,7 +153,7 @@ AdblockPlus::ServerResponse AdblockPlus::DefaultWebRequestSync::GET(
 
     result.status = ConvertErrorCode(curl_easy_perform(curl));
     result.responseStatus = headerData.status;
-    result.responseText = responseText.str();
+    result.responseText = std::move(responseText);
     for (const auto& header : headerData.headers)
     {
       // Parse header name and value out of something like "Foo: bar"
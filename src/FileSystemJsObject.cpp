@@ -22,13 +22,22 @@
 
 #include <AdblockPlus/JsValue.h>
 #include "FileSystemJsObject.h"
+#include "JsBinding.h"
 #include "JsContext.h"
 #include "Utils.h"
 #include "JsError.h"
 #include <AdblockPlus/Platform.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ADBLOCK_PLUS_LINE_SPLITTER_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 using namespace AdblockPlus;
-using AdblockPlus::Utils::ThrowExceptionInJS;
 
 namespace
 {
@@ -58,35 +67,31 @@ namespace
       JsEngine::JsWeakValuesID weakRejectCallback;
     };
 
-    static void V8Callback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+    void Read(JsEngine& jsEngine, std::string fileName,
+      v8::Local<v8::Function> resolveCallback, v8::Local<v8::Function> rejectCallback)
     {
-      AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-      AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-      v8::Isolate* isolate = arguments.GetIsolate();
-      if (converted.size() != 3)
-        return ThrowExceptionInJS(isolate, "_fileSystem.read requires 3 parameters");
-      if (!converted[1].IsFunction())
-        return ThrowExceptionInJS(isolate, "Second argument to _fileSystem.read must be a function");
-      if (!converted[2].IsFunction())
-        return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.read must be a function");
-
-      auto weakResolveCallback = jsEngine->StoreJsValues({converted[1]});
-      auto weakRejectCallback = jsEngine->StoreJsValues({converted[2]});
-      auto weakData = std::make_shared<WeakData>(jsEngine, weakResolveCallback, weakRejectCallback);
-      auto fileName = converted[0].AsString();
-      jsEngine->GetPlatform().WithFileSystem(
+      auto weakResolveCallback = jsEngine.StoreJsValues({jsEngine.NewValue(resolveCallback)});
+      auto weakRejectCallback = jsEngine.StoreJsValues({jsEngine.NewValue(rejectCallback)});
+      auto weakData = std::make_shared<WeakData>(jsEngine.shared_from_this(),
+        weakResolveCallback, weakRejectCallback);
+      jsEngine.WithFileSystem(
         [weakData, fileName](IFileSystem& fileSystem)
         {
-          fileSystem.Read(fileName, [weakData](IFileSystem::IOBuffer&& content)
+          fileSystem.ReadBuffer(fileName, [weakData](const IFileSystem::ReadOnlyBufferPtr& content)
             {
               auto jsEngine = weakData->weakJsEngine.lock();
               if (!jsEngine)
                 return;
-              const JsContext context(*jsEngine);
+              JsContext context(*jsEngine);
+              auto isolate = jsEngine->GetIsolate();
               auto result = jsEngine->NewObject();
-              result.SetStringBufferProperty("content", content);
+              // Large files are not copied into the JS heap, the string
+              // references the buffer, which can be a memory mapped file.
+              result.UnwrapValue().As<v8::Object>()->Set(
+                Utils::ToV8String(isolate, "content"),
+                Utils::ReadOnlyBufferToV8String(isolate, content));
               jsEngine->GetJsValues(weakData->weakResolveCallback)[0].Call(result);
+              context.RunImmediateTasks();
             },
             [weakData](const std::string& error)
             {
@@ -95,11 +100,12 @@ namespace
               auto jsEngine = weakData->weakJsEngine.lock();
               if (!jsEngine)
                 return;
-              const JsContext context(*jsEngine);
+              JsContext context(*jsEngine);
               jsEngine->GetJsValues(weakData->weakRejectCallback)[0].Call(jsEngine->NewValue(error));
+              context.RunImmediateTasks();
             });
         });
-    } // V8Callback
+    } // Read
   } // namespace ReadCallback
 
   namespace ReadFromFileCallback
@@ -109,15 +115,45 @@ namespace
       return c == 10 || c == 13;
     }
 
-    inline StringBuffer::const_iterator SkipEndOfLine(StringBuffer::const_iterator ii, StringBuffer::const_iterator end)
+    inline const char* SkipEndOfLine(const char* ii, const char* end)
     {
       while (ii != end && IsEndOfLine(*ii))
         ++ii;
       return ii;
     }
 
-    inline StringBuffer::const_iterator AdvanceToEndOfLine(StringBuffer::const_iterator ii, StringBuffer::const_iterator end)
+#if defined(ADBLOCK_PLUS_LINE_SPLITTER_SSE2)
+    const size_t BLOCK_SIZE = 16;
+
+    inline size_t CountTrailingZeros(uint32_t value)
+    {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, value);
+      return index;
+#else
+      return __builtin_ctz(value);
+#endif
+    }
+#endif
+
+    inline const char* AdvanceToEndOfLine(const char* ii, const char* end)
     {
+      // A single pass for both bytes, searching for \n first would scan the
+      // rest of the chunk for every line of a file with \r line breaks.
+#if defined(ADBLOCK_PLUS_LINE_SPLITTER_SSE2)
+      const __m128i lineFeed = _mm_set1_epi8(10);
+      const __m128i carriageReturn = _mm_set1_epi8(13);
+      while (static_cast<size_t>(end - ii) >= BLOCK_SIZE)
+      {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ii));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(
+          _mm_cmpeq_epi8(block, lineFeed), _mm_cmpeq_epi8(block, carriageReturn)));
+        if (mask != 0)
+          return ii + CountTrailingZeros(static_cast<uint32_t>(mask));
+        ii += BLOCK_SIZE;
+      }
+#endif
       while (ii != end && !IsEndOfLine(*ii))
         ++ii;
       return ii;
@@ -129,9 +165,12 @@ namespace
       WeakData(const JsEnginePtr& jsEngine,
         JsEngine::JsWeakValuesID weakResolveCallback,
         JsEngine::JsWeakValuesID weakRejectCallback,
-        JsEngine::JsWeakValuesID weakProcessFunc)
+        JsEngine::JsWeakValuesID weakProcessFunc,
+        uint32_t maxBatchSize)
         : ReadCallback::WeakData(jsEngine, weakResolveCallback, weakRejectCallback)
         , weakProcessFunc(weakProcessFunc)
+        , maxBatchSize(maxBatchSize)
+        , hasProcessedLines(false)
       {
       }
       ~WeakData()
@@ -142,57 +181,147 @@ namespace
         jsEngine->TakeJsValues(weakProcessFunc);
       }
       JsEngine::JsWeakValuesID weakProcessFunc;
+      // If not zero then the listener receives arrays of at most this number
+      // of lines instead of single lines.
+      uint32_t maxBatchSize;
+      // The beginning of a line which is continued in the next chunk.
+      std::string incompleteLine;
+      bool hasProcessedLines;
     };
 
-    void V8Callback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+    class LineProcessor
     {
-      AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-      AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-      v8::Isolate* isolate = arguments.GetIsolate();
-      if (converted.size() != 4)
-        return ThrowExceptionInJS(isolate, "_fileSystem.readFromFile requires 4 parameters");
-      if (!converted[1].IsFunction())
-        return ThrowExceptionInJS(isolate, "Second argument to _fileSystem.readFromFile must be a function (listener callback)");
-      if (!converted[2].IsFunction())
-        return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.readFromFile must be a function (done callback)");
-      if (!converted[3].IsFunction())
-        return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.readFromFile must be a function (error callback)");
-
-      auto weakProcessFunc = jsEngine->StoreJsValues({converted[1]});
-      auto weakResolveCallback = jsEngine->StoreJsValues({converted[2]});
-      auto weakRejectCallback = jsEngine->StoreJsValues({converted[3]});
-      auto weakData = std::make_shared<WeakData>(jsEngine, weakResolveCallback, weakRejectCallback, weakProcessFunc);
-      auto fileName = converted[0].AsString();
-      jsEngine->GetPlatform().WithFileSystem([weakData, fileName](IFileSystem& fileSystem)
+    public:
+      LineProcessor(JsEngine& jsEngine, WeakData& weakData)
+        : context(jsEngine), weakData(weakData)
+        , isolate(jsEngine.GetIsolate())
+        , tryCatch(isolate)
+        , batchLength(0)
+      {
+        auto jsValues = jsEngine.GetJsValues(weakData.weakProcessFunc);
+        processFunc = jsValues[0].UnwrapValue().As<v8::Function>();
+        globalContext = context.GetV8Context()->Global();
+        if (!globalContext->IsObject())
+          throw std::runtime_error("`this` pointer has to be an object");
+      }
+
+      // Passes complete lines of the chunk to the listener and keeps the
+      // trailing incomplete line until the next chunk or the end of file.
+      void ProcessChunk(const char* chunkBegin, const char* chunkEnd)
+      {
+        SplitChunk(chunkBegin, chunkEnd);
+        FlushBatch();
+        context.RunImmediateTasks();
+      }
+
+      void Finish()
+      {
+        // The listener is called at least once, even for an empty file.
+        auto& incompleteLine = weakData.incompleteLine;
+        if (!incompleteLine.empty() || !weakData.hasProcessedLines)
+          ProcessLine(incompleteLine.data(), incompleteLine.size());
+        incompleteLine.clear();
+        FlushBatch();
+        context.RunImmediateTasks();
+      }
+    private:
+      void SplitChunk(const char* chunkBegin, const char* chunkEnd)
+      {
+        auto& incompleteLine = weakData.incompleteLine;
+        auto stringBegin = chunkBegin;
+        if (!incompleteLine.empty())
+        {
+          auto stringEnd = AdvanceToEndOfLine(stringBegin, chunkEnd);
+          incompleteLine.append(stringBegin, stringEnd);
+          if (stringEnd == chunkEnd)
+            return;
+          ProcessLine(incompleteLine.data(), incompleteLine.size());
+          incompleteLine.clear();
+          stringBegin = stringEnd;
+        }
+        stringBegin = SkipEndOfLine(stringBegin, chunkEnd);
+        while (stringBegin != chunkEnd)
         {
-          fileSystem.Read(fileName, [weakData](IFileSystem::IOBuffer&& content)
+          auto stringEnd = AdvanceToEndOfLine(stringBegin, chunkEnd);
+          if (stringEnd == chunkEnd)
+          {
+            incompleteLine.assign(stringBegin, stringEnd);
+            return;
+          }
+          ProcessLine(stringBegin, stringEnd - stringBegin);
+          stringBegin = SkipEndOfLine(stringEnd, chunkEnd);
+        }
+      }
+
+      void ProcessLine(const char* data, size_t size)
+      {
+        auto jsLine = v8::String::NewFromUtf8(isolate, data,
+          v8::String::NewStringType::kNormalString, size).As<v8::Value>();
+        weakData.hasProcessedLines = true;
+        if (weakData.maxBatchSize == 0)
+          return CallProcessFunc(jsLine);
+
+        if (batch.IsEmpty())
+          batch = v8::Array::New(isolate);
+        batch->Set(batchLength++, jsLine);
+        if (batchLength == weakData.maxBatchSize)
+          FlushBatch();
+      }
+
+      void FlushBatch()
+      {
+        if (batchLength == 0)
+          return;
+        auto jsBatch = batch.As<v8::Value>();
+        batch.Clear();
+        batchLength = 0;
+        CallProcessFunc(jsBatch);
+      }
+
+      void CallProcessFunc(v8::Local<v8::Value> arg)
+      {
+        processFunc->Call(isolate->GetCurrentContext(), globalContext, 1, &arg);
+        if (tryCatch.HasCaught())
+          throw JsError(isolate, tryCatch.Exception(), tryCatch.Message());
+      }
+
+      JsContext context;
+      WeakData& weakData;
+      v8::Isolate* isolate;
+      const v8::TryCatch tryCatch;
+      v8::Local<v8::Function> processFunc;
+      v8::Local<v8::Object> globalContext;
+      v8::Local<v8::Array> batch;
+      uint32_t batchLength;
+    };
+
+    void ReadFromFile(JsEngine& jsEngine, std::string fileName,
+      v8::Local<v8::Function> processFunc, v8::Local<v8::Function> resolveCallback,
+      v8::Local<v8::Function> rejectCallback, JsBinding::Optional<uint32_t> maxBatchSize)
+    {
+      auto weakProcessFunc = jsEngine.StoreJsValues({jsEngine.NewValue(processFunc)});
+      auto weakResolveCallback = jsEngine.StoreJsValues({jsEngine.NewValue(resolveCallback)});
+      auto weakRejectCallback = jsEngine.StoreJsValues({jsEngine.NewValue(rejectCallback)});
+      auto weakData = std::make_shared<WeakData>(jsEngine.shared_from_this(),
+        weakResolveCallback, weakRejectCallback, weakProcessFunc, maxBatchSize.value);
+      jsEngine.WithFileSystem([weakData, fileName](IFileSystem& fileSystem)
+        {
+          // The file is processed chunk by chunk, so only the current chunk
+          // and at most one incomplete line are held in memory. Lines are
+          // created directly from the chunk without copying the content.
+          fileSystem.ReadChunks(fileName, [weakData](const uint8_t* data, size_t size)
             {
               auto jsEngine = weakData->weakJsEngine.lock();
               if (!jsEngine)
                 return;
-
-              const JsContext context(*jsEngine);
-              auto jsValues = jsEngine->GetJsValues(weakData->weakProcessFunc);
-              auto processFunc = jsValues[0].UnwrapValue().As<v8::Function>();
-              auto globalContext = context.GetV8Context()->Global();
-              if (!globalContext->IsObject())
-                throw std::runtime_error("`this` pointer has to be an object");
-
-              auto isolate = jsEngine->GetIsolate();
-              const v8::TryCatch tryCatch(isolate);
-              const auto contentEnd = content.cend();
-              auto stringBegin = SkipEndOfLine(content.begin(), contentEnd);
-              auto v8Context = isolate->GetCurrentContext();
-              do
-              {
-                auto stringEnd = AdvanceToEndOfLine(stringBegin, contentEnd);
-                auto jsLine = Utils::StringBufferToV8String(isolate, StringBuffer(stringBegin, stringEnd)).As<v8::Value>();
-                processFunc->Call(v8Context, globalContext, 1, &jsLine);
-                if (tryCatch.HasCaught())
-                  throw JsError(isolate, tryCatch.Exception(), tryCatch.Message());
-                stringBegin = SkipEndOfLine(stringEnd, contentEnd);
-              } while (stringBegin != contentEnd);
+              auto chunkBegin = reinterpret_cast<const char*>(data);
+              LineProcessor(*jsEngine, *weakData).ProcessChunk(chunkBegin, chunkBegin + size);
+            }, [weakData]
+            {
+              auto jsEngine = weakData->weakJsEngine.lock();
+              if (!jsEngine)
+                return;
+              LineProcessor(*jsEngine, *weakData).Finish();
               jsEngine->GetJsValues(weakData->weakResolveCallback)[0].Call();
             }, [weakData](const std::string& error)
             {
@@ -204,27 +333,15 @@ namespace
               jsEngine->GetJsValues(weakData->weakRejectCallback)[0].Call(jsEngine->NewValue(error));
             });
         });
-    } // V8Callback
+    } // ReadFromFile
   } // namespace ReadFromFileCallback
 
-  void WriteCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void WriteCallback(JsEngine& jsEngine, std::string fileName,
+    StringBuffer content, v8::Local<v8::Function> callback)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-    v8::Isolate* isolate = arguments.GetIsolate();
-    if (converted.size() != 3)
-      return ThrowExceptionInJS(isolate, "_fileSystem.write requires 3 parameters");
-    if (!converted[2].IsFunction())
-      return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.write must be a function");
-
-    JsValueList values;
-    values.push_back(converted[2]);
-    auto weakCallback = jsEngine->StoreJsValues(values);
-    std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-    auto content = converted[1].AsStringBuffer();
-    auto fileName = converted[0].AsString();
-    jsEngine->GetPlatform().WithFileSystem(
+    auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    jsEngine.WithFileSystem(
       [weakJsEngine, weakCallback, fileName, content](IFileSystem& fileSystem)
       {
         fileSystem.Write(fileName, content,
@@ -234,33 +351,152 @@ namespace
             if (!jsEngine)
               return;
 
-            const JsContext context(*jsEngine);
+            JsContext context(*jsEngine);
+            JsValueList params;
+            if (!error.empty())
+              params.push_back(jsEngine->NewValue(error));
+            jsEngine->TakeJsValues(weakCallback)[0].Call(params);
+            context.RunImmediateTasks();
+          });
+      });
+  }
+
+  void AppendCallback(JsEngine& jsEngine, std::string fileName,
+    StringBuffer content, v8::Local<v8::Function> callback)
+  {
+    auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    jsEngine.WithFileSystem(
+      [weakJsEngine, weakCallback, fileName, content](IFileSystem& fileSystem)
+      {
+        fileSystem.Append(fileName, content,
+          [weakJsEngine, weakCallback](const std::string& error)
+          {
+            auto jsEngine = weakJsEngine.lock();
+            if (!jsEngine)
+              return;
+
+            JsContext context(*jsEngine);
             JsValueList params;
             if (!error.empty())
               params.push_back(jsEngine->NewValue(error));
             jsEngine->TakeJsValues(weakCallback)[0].Call(params);
+            context.RunImmediateTasks();
           });
       });
   }
 
-  void MoveCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  namespace WriteChunksCallback
+  {
+    struct WeakData
+    {
+    public:
+      WeakData(const JsEnginePtr& jsEngine,
+        JsEngine::JsWeakValuesID weakReadChunk,
+        JsEngine::JsWeakValuesID weakCallback)
+        : weakJsEngine(jsEngine)
+        , weakReadChunk(weakReadChunk)
+        , weakCallback(weakCallback)
+      {
+      }
+      ~WeakData()
+      {
+        auto jsEngine = weakJsEngine.lock();
+        if (!jsEngine)
+          return;
+        jsEngine->TakeJsValues(weakReadChunk);
+        jsEngine->TakeJsValues(weakCallback);
+      }
+      std::weak_ptr<JsEngine> weakJsEngine;
+      JsEngine::JsWeakValuesID weakReadChunk;
+      JsEngine::JsWeakValuesID weakCallback;
+    };
+    typedef std::shared_ptr<WeakData> WeakDataPtr;
+
+    void Done(const WeakDataPtr& weakData, const std::string& error)
+    {
+      auto jsEngine = weakData->weakJsEngine.lock();
+      if (!jsEngine)
+        return;
+
+      JsContext context(*jsEngine);
+      JsValueList params;
+      if (!error.empty())
+        params.push_back(jsEngine->NewValue(error));
+      jsEngine->GetJsValues(weakData->weakCallback)[0].Call(params);
+      context.RunImmediateTasks();
+    }
+
+    // Pulls the next chunk from JS and appends it to the file, only one chunk
+    // is held in memory at a time. Once JS returns null or undefined the
+    // file is committed. If pulling or writing fails then the writer is
+    // released without committing and the file stays unchanged.
+    void AppendNextChunk(const WeakDataPtr& weakData,
+      const IFileSystem::FileWriterPtr& writer)
+    {
+      auto jsEngine = weakData->weakJsEngine.lock();
+      if (!jsEngine)
+        return;
+
+      IFileSystem::IOBuffer chunk;
+      bool isEnd = false;
+      try
+      {
+        JsContext context(*jsEngine);
+        auto jsChunk = jsEngine->GetJsValues(weakData->weakReadChunk)[0].Call();
+        context.RunImmediateTasks();
+        if (jsChunk.IsNull() || jsChunk.IsUndefined())
+          isEnd = true;
+        else
+          chunk = jsChunk.AsStringBuffer();
+      }
+      catch (const std::exception& e)
+      {
+        return Done(weakData, e.what());
+      }
+
+      if (isEnd)
+      {
+        writer->Commit([weakData](const std::string& error)
+          {
+            Done(weakData, error);
+          });
+        return;
+      }
+      writer->Append(chunk, [weakData, writer](const std::string& error)
+        {
+          if (!error.empty())
+            return Done(weakData, error);
+          AppendNextChunk(weakData, writer);
+        });
+    }
+
+    void WriteChunks(JsEngine& jsEngine, std::string fileName,
+      v8::Local<v8::Function> readChunk, v8::Local<v8::Function> callback)
+    {
+      auto weakReadChunk = jsEngine.StoreJsValues({jsEngine.NewValue(readChunk)});
+      auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+      auto weakData = std::make_shared<WeakData>(jsEngine.shared_from_this(),
+        weakReadChunk, weakCallback);
+      jsEngine.WithFileSystem([weakData, fileName](IFileSystem& fileSystem)
+        {
+          fileSystem.OpenForWrite(fileName,
+            [weakData](const IFileSystem::FileWriterPtr& writer, const std::string& error)
+            {
+              if (!error.empty())
+                return Done(weakData, error);
+              AppendNextChunk(weakData, writer);
+            });
+        });
+    } // WriteChunks
+  } // namespace WriteChunksCallback
+
+  void MoveCallback(JsEngine& jsEngine, std::string from, std::string to,
+    v8::Local<v8::Function> callback)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-    v8::Isolate* isolate = arguments.GetIsolate();
-    if (converted.size() != 3)
-      return ThrowExceptionInJS(isolate, "_fileSystem.move requires 3 parameters");
-    if (!converted[2].IsFunction())
-      return ThrowExceptionInJS(isolate, "Third argument to _fileSystem.move must be a function");
-
-    JsValueList values;
-    values.push_back(converted[2]);
-    auto weakCallback = jsEngine->StoreJsValues(values);
-    std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-    auto from = converted[0].AsString();
-    auto to = converted[1].AsString();
-    jsEngine->GetPlatform().WithFileSystem(
+    auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    jsEngine.WithFileSystem(
       [weakJsEngine, weakCallback, from, to](IFileSystem& fileSystem)
       {
         fileSystem.Move(from, to,
@@ -270,32 +506,22 @@ namespace
             if (!jsEngine)
               return;
 
-            const JsContext context(*jsEngine);
+            JsContext context(*jsEngine);
             JsValueList params;
             if (!error.empty())
               params.push_back(jsEngine->NewValue(error));
             jsEngine->TakeJsValues(weakCallback)[0].Call(params);
+            context.RunImmediateTasks();
           });
       });
   }
 
-  void RemoveCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void RemoveCallback(JsEngine& jsEngine, std::string fileName,
+    v8::Local<v8::Function> callback)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-    v8::Isolate* isolate = arguments.GetIsolate();
-    if (converted.size() != 2)
-      return ThrowExceptionInJS(isolate, "_fileSystem.remove requires 2 parameters");
-    if (!converted[1].IsFunction())
-      return ThrowExceptionInJS(isolate, "Second argument to _fileSystem.remove must be a function");
-
-    JsValueList values;
-    values.push_back(converted[1]);
-    auto weakCallback = jsEngine->StoreJsValues(values);
-    std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-    auto fileName = converted[0].AsString();
-    jsEngine->GetPlatform().WithFileSystem(
+    auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    jsEngine.WithFileSystem(
       [weakJsEngine, weakCallback, fileName](IFileSystem& fileSystem)
       {
         fileSystem.Remove(fileName,
@@ -305,32 +531,22 @@ namespace
             if (!jsEngine)
               return;
 
-            const JsContext context(*jsEngine);
+            JsContext context(*jsEngine);
             JsValueList params;
             if (!error.empty())
               params.push_back(jsEngine->NewValue(error));
             jsEngine->TakeJsValues(weakCallback)[0].Call(params);
+            context.RunImmediateTasks();
           });
       });
   }
 
-  void StatCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void StatCallback(JsEngine& jsEngine, std::string fileName,
+    v8::Local<v8::Function> callback)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-
-    v8::Isolate* isolate = arguments.GetIsolate();
-    if (converted.size() != 2)
-      return ThrowExceptionInJS(isolate, "_fileSystem.stat requires 2 parameters");
-    if (!converted[1].IsFunction())
-      return ThrowExceptionInJS(isolate, "Second argument to _fileSystem.stat must be a function");
-
-    JsValueList values;
-    values.push_back(converted[1]);
-    auto weakCallback = jsEngine->StoreJsValues(values);
-    std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-    auto fileName = converted[0].AsString();
-    jsEngine->GetPlatform().WithFileSystem(
+    auto weakCallback = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    jsEngine.WithFileSystem(
       [weakJsEngine, weakCallback, fileName](IFileSystem& fileSystem)
       {
         fileSystem.Stat(fileName,
@@ -341,7 +557,7 @@ namespace
              if (!jsEngine)
                return;
 
-             const JsContext context(*jsEngine);
+             JsContext context(*jsEngine);
              auto result = jsEngine->NewObject();
 
              result.SetProperty("exists", statResult.exists);
@@ -352,6 +568,7 @@ namespace
              JsValueList params;
              params.push_back(result);
              jsEngine->TakeJsValues(weakCallback)[0].Call(params);
+             context.RunImmediateTasks();
            });
       });
   }
@@ -360,11 +577,21 @@ namespace
 
 JsValue& FileSystemJsObject::Setup(JsEngine& jsEngine, JsValue& obj)
 {
-  obj.SetProperty("read", jsEngine.NewCallback(::ReadCallback::V8Callback));
-  obj.SetProperty("readFromFile", jsEngine.NewCallback(::ReadFromFileCallback::V8Callback));
-  obj.SetProperty("write", jsEngine.NewCallback(::WriteCallback));
-  obj.SetProperty("move", jsEngine.NewCallback(::MoveCallback));
-  obj.SetProperty("remove", jsEngine.NewCallback(::RemoveCallback));
-  obj.SetProperty("stat", jsEngine.NewCallback(::StatCallback));
+  obj.SetProperty("read", jsEngine.NewCallback(
+    JS_BINDING(::ReadCallback::Read), "_fileSystem.read"));
+  obj.SetProperty("readFromFile", jsEngine.NewCallback(
+    JS_BINDING(::ReadFromFileCallback::ReadFromFile), "_fileSystem.readFromFile"));
+  obj.SetProperty("write", jsEngine.NewCallback(
+    JS_BINDING(::WriteCallback), "_fileSystem.write"));
+  obj.SetProperty("append", jsEngine.NewCallback(
+    JS_BINDING(::AppendCallback), "_fileSystem.append"));
+  obj.SetProperty("writeChunks", jsEngine.NewCallback(
+    JS_BINDING(::WriteChunksCallback::WriteChunks), "_fileSystem.writeChunks"));
+  obj.SetProperty("move", jsEngine.NewCallback(
+    JS_BINDING(::MoveCallback), "_fileSystem.move"));
+  obj.SetProperty("remove", jsEngine.NewCallback(
+    JS_BINDING(::RemoveCallback), "_fileSystem.remove"));
+  obj.SetProperty("stat", jsEngine.NewCallback(
+    JS_BINDING(::StatCallback), "_fileSystem.stat"));
   return obj;
 }
@@ -21,8 +21,11 @@
 #include <string>
 #include <cassert>
 #include <thread>
+#include <atomic>
 
 #include <AdblockPlus.h>
+#include "CompiledFilterList.h"
+#include "FilterIndex.h"
 #include "JsContext.h"
 #include "Thread.h"
 #include <mutex>
@@ -32,6 +35,47 @@ using namespace AdblockPlus;
 
 extern std::string jsSources[];
 
+namespace
+{
+  typedef std::vector<std::pair<std::string, FilterIndex::IndexedFilter>> IndexedFilters;
+
+  IndexedFilters IndexedFiltersFromJs(const JsValue& textsValue,
+    const JsValue& keywordsValue, const JsValue& contentTypesValue,
+    const JsValue& exceptionsValue)
+  {
+    IndexedFilters filters;
+    JsValueList texts = textsValue.AsList();
+    JsValueList keywords = keywordsValue.AsList();
+    JsValueList contentTypes = contentTypesValue.AsList();
+    JsValueList exceptions = exceptionsValue.AsList();
+    for (size_t i = 0; i < texts.size() && i < keywords.size() &&
+         i < contentTypes.size() && i < exceptions.size(); ++i)
+    {
+      FilterIndex::IndexedFilter filter;
+      filter.keyword = keywords[i].AsString();
+      filter.contentTypeMask =
+        static_cast<FilterEngine::ContentTypeMask>(contentTypes[i].AsInt());
+      filter.isException = exceptions[i].AsBool();
+      filters.emplace_back(texts[i].AsString(), std::move(filter));
+    }
+    return filters;
+  }
+
+  // Parameters of the `_filtersChanged` event: texts, keywords, content types
+  // and exception flags of the added filters and texts of the removed
+  // filters.
+  FilterIndex::Changes FilterIndexChangesFromJs(const JsValueList& params)
+  {
+    FilterIndex::Changes changes;
+    if (params.size() < 5)
+      return changes;
+    changes.added = IndexedFiltersFromJs(params[0], params[1], params[2], params[3]);
+    for (const auto& text : params[4].AsList())
+      changes.removed.push_back(text.AsString());
+    return changes;
+  }
+}
+
 Filter::Filter(JsValue&& value)
     : JsValue(std::move(value))
 {
@@ -182,16 +226,78 @@ bool Subscription::operator==(const Subscription& subscription) const
   return GetProperty("url").AsString() == subscription.GetProperty("url").AsString();
 }
 
-FilterEngine::FilterEngine(const JsEnginePtr& jsEngine)
+class FilterEngine::FiltersGeneration
+{
+public:
+  FiltersGeneration()
+    : generation(0)
+  {
+  }
+
+  uint64_t Get() const
+  {
+    return generation.load(std::memory_order_acquire);
+  }
+
+  void Increment()
+  {
+    {
+      // The lock prevents a waiter from missing the notification between
+      // checking the generation and starting to wait.
+      std::lock_guard<std::mutex> lock(mutex);
+      generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+    changed.notify_all();
+  }
+
+  uint64_t WaitForChange(uint64_t knownGeneration, const std::chrono::milliseconds& timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [this, knownGeneration]
+    {
+      return Get() != knownGeneration;
+    });
+    return Get();
+  }
+private:
+  std::atomic<uint64_t> generation;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+FilterChangeBatch::FilterChangeBatch(JsValue&& actions, JsValue&& items)
+  : generation(0), actions(std::move(actions)), items(std::move(items))
+{
+}
+
+std::vector<std::pair<std::string, JsValue>> FilterChangeBatch::GetChanges() const
+{
+  JsValueList actionList = actions.AsList();
+  JsValueList itemList = items.AsList();
+  std::vector<std::pair<std::string, JsValue>> changes;
+  for (size_t i = 0; i < actionList.size() && i < itemList.size(); ++i)
+    changes.emplace_back(actionList[i].AsString(), std::move(itemList[i]));
+  return changes;
+}
+
+FilterEngine::FilterEngine(const JsEnginePtr& jsEngine, size_t patternStatesBudget)
   : jsEngine(jsEngine), firstRun(false), updateCheckId(0)
+  , filtersGeneration(std::make_shared<FiltersGeneration>())
+  , filterIndex(std::make_shared<FilterIndex>(patternStatesBudget))
 {
 }
 
+void FilterEngine::CreateAsync(const JsEnginePtr& jsEngine,
+  const FilterEngine::OnCreatedCallback& onCreated)
+{
+  CreateAsync(jsEngine, onCreated, CreationParameters());
+}
+
 void FilterEngine::CreateAsync(const JsEnginePtr& jsEngine,
   const FilterEngine::OnCreatedCallback& onCreated,
   const FilterEngine::CreationParameters& params)
 {
-  FilterEnginePtr filterEngine(new FilterEngine(jsEngine));
+  FilterEnginePtr filterEngine(new FilterEngine(jsEngine, params.patternStatesBudget));
   {
     // TODO: replace weakFilterEngine by this when it's possible to control the
     // execution time of the asynchronous part below.
@@ -229,6 +335,31 @@ void FilterEngine::CreateAsync(const JsEnginePtr& jsEngine,
     });
   }
   
+  {
+    // The filter index is published before the generation changes, so the
+    // new generation is never observed together with the old index.
+    std::weak_ptr<FiltersGeneration> weakFiltersGeneration = filterEngine->filtersGeneration;
+    std::weak_ptr<FilterIndex> weakFilterIndex = filterEngine->filterIndex;
+    jsEngine->SetEventCallback("_filtersChanged", [weakFiltersGeneration, weakFilterIndex](JsValueList&& params)
+    {
+      if (auto filterIndex = weakFilterIndex.lock())
+        filterIndex->Update(FilterIndexChangesFromJs(params));
+      if (auto filtersGeneration = weakFiltersGeneration.lock())
+        filtersGeneration->Increment();
+    });
+  }
+
+  {
+    // All update checks use the same event, the callbacks are distinguished
+    // by the ID of the check.
+    std::weak_ptr<FilterEngine> weakFilterEngine = filterEngine;
+    jsEngine->SetEventCallback("_updateCheckDone", [weakFilterEngine](JsValueList&& params)
+    {
+      if (auto filterEngine = weakFilterEngine.lock())
+        filterEngine->UpdateCheckDone(move(params));
+    });
+  }
+
   jsEngine->SetEventCallback("_init", [jsEngine, filterEngine, onCreated](JsValueList&& params)
   {
     filterEngine->firstRun = params.size() && params[0].AsBool();
@@ -248,7 +379,7 @@ void FilterEngine::CreateAsync(const JsEnginePtr& jsEngine,
 
   // Lock the JS engine while we are loading scripts, no timeouts should fire
   // until we are done.
-  const JsContext context(*jsEngine);
+  JsContext context(*jsEngine);
   // Set the preconfigured prefs
   auto preconfiguredPrefsObject = jsEngine->NewObject();
   for (const auto& pref : params.preconfiguredPrefs)
@@ -259,6 +390,7 @@ void FilterEngine::CreateAsync(const JsEnginePtr& jsEngine,
   // Load adblockplus scripts
   for (int i = 0; !jsSources[i].empty(); i += 2)
     jsEngine->Evaluate(jsSources[i + 1], jsSources[i]);
+  context.RunImmediateTasks();
 }
 
 namespace
@@ -448,6 +580,20 @@ AdblockPlus::FilterPtr FilterEngine::CheckFilterMatch(const std::string& url,
     ContentTypeMask contentTypeMask,
     const std::string& documentUrl) const
 {
+  // Requests which only natively matched filters can match don't need to
+  // wait for JsEngine, e.g. while a downloaded filter list is being applied.
+  // For other filters the keyword Bloom filters tell when nothing can match.
+  std::string filterText;
+  switch (filterIndex->GetSnapshot()->Match(url, contentTypeMask, documentUrl, filterText))
+  {
+  case FilterIndex::NO_MATCH:
+    return FilterPtr();
+  case FilterIndex::MATCH:
+    return FilterPtr(new Filter(GetFilter(filterText)));
+  case FilterIndex::UNKNOWN:
+    break;
+  }
+
   JsValue func = jsEngine->Evaluate("API.checkFilterMatch");
   JsValueList params;
   params.push_back(jsEngine->NewValue(url));
@@ -513,18 +659,36 @@ void FilterEngine::ForceUpdateCheck(
   JsValueList params;
   if (callback)
   {
-    std::string eventName = "_updateCheckDone" + std::to_string(++updateCheckId);
-    jsEngine->SetEventCallback(eventName, [this, eventName, callback](JsValueList&& params)
+    int checkID;
     {
-      std::string error(params.size() >= 1 && !params[0].IsNull() ? params[0].AsString() : "");
-      callback(error);
-      jsEngine->RemoveEventCallback(eventName);
-    });
-    params.push_back(jsEngine->NewValue(eventName));
+      const JsContext context(*jsEngine);
+      do
+      {
+        checkID = ++updateCheckId;
+      } while (checkID <= 0 || updateCheckDoneCallbacks.count(checkID));
+      updateCheckDoneCallbacks[checkID] = callback;
+    }
+    params.push_back(jsEngine->NewValue(checkID));
   }
   func.Call(params);
 }
 
+void FilterEngine::UpdateCheckDone(JsValueList&& params)
+{
+  // params[0] - ID of the check passed to API.forceUpdateCheck
+  // params[1] - nullable string error
+  if (params.size() < 1)
+    return;
+  // Events are triggered by JS, so the isolate is already locked.
+  auto it = updateCheckDoneCallbacks.find(static_cast<int>(params[0].AsInt()));
+  if (it == updateCheckDoneCallbacks.end())
+    return;
+  UpdateCheckDoneCallback callback = it->second;
+  updateCheckDoneCallbacks.erase(it);
+  std::string error(params.size() >= 2 && !params[1].IsNull() ? params[1].AsString() : "");
+  callback(error);
+}
+
 void FilterEngine::SetFilterChangeCallback(const FilterChangeCallback& callback)
 {
   jsEngine->SetEventCallback("filterChange", [this, callback](JsValueList&& params)
@@ -538,6 +702,24 @@ void FilterEngine::RemoveFilterChangeCallback()
   jsEngine->RemoveEventCallback("filterChange");
 }
 
+void FilterEngine::SetFilterChangeBatchCallback(const FilterChangeBatchCallback& callback)
+{
+  if (!callback)
+    return RemoveFilterChangeBatchCallback();
+
+  jsEngine->SetEventCallback("filterChangeBatch", [this, callback](JsValueList&& params)
+  {
+    this->FilterChangeBatchReceived(callback, move(params));
+  });
+  jsEngine->Evaluate("API.setFilterChangeBatching").Call(jsEngine->NewValue(true));
+}
+
+void FilterEngine::RemoveFilterChangeBatchCallback()
+{
+  jsEngine->Evaluate("API.setFilterChangeBatching").Call(jsEngine->NewValue(false));
+  jsEngine->RemoveEventCallback("filterChangeBatch");
+}
+
 void FilterEngine::SetAllowedConnectionType(const std::string* value)
 {
   SetPref("allowed_connection_type", value ? jsEngine->NewValue(*value) : jsEngine->NewValue(""));
@@ -558,6 +740,55 @@ void FilterEngine::FilterChanged(const FilterEngine::FilterChangeCallback& callb
   callback(action, std::move(item));
 }
 
+void FilterEngine::FilterChangeBatchReceived(const FilterEngine::FilterChangeBatchCallback& callback, JsValueList&& params)
+{
+  // params[0] - object with numbers of changes per action
+  // params[1] - array of affected subscription URLs
+  // params[2] - array of actions of all changes
+  // params[3] - array of items of all changes
+  if (params.size() < 4)
+    return;
+  FilterChangeBatch batch(std::move(params[2]), std::move(params[3]));
+  for (const auto& action : params[0].GetOwnPropertyNames())
+    batch.actionCounts[action] = static_cast<uint32_t>(params[0].GetProperty(action).AsInt());
+  for (const auto& url : params[1].AsList())
+    batch.subscriptionUrls.push_back(url.AsString());
+  batch.generation = GetFiltersGeneration();
+  callback(std::move(batch));
+}
+
+IFileSystem::IOBuffer FilterEngine::CompileFilterList(const std::string& filterListContent) const
+{
+  JsValue filters = jsEngine->Evaluate("API.getRequestFilters").Call(jsEngine->NewValue(filterListContent));
+  return CompiledFilterList::Write(IndexedFiltersFromJs(filters.GetProperty("texts"),
+    filters.GetProperty("keywords"), filters.GetProperty("contentTypes"),
+    filters.GetProperty("exceptions")), filterIndex->GetPatternStatesBudget());
+}
+
+IFileSystem::IOBuffer FilterEngine::CompileActiveFilters() const
+{
+  JsValue filters = jsEngine->Evaluate("API.getActiveRequestFilters").Call();
+  return CompiledFilterList::Write(IndexedFiltersFromJs(filters.GetProperty("texts"),
+    filters.GetProperty("keywords"), filters.GetProperty("contentTypes"),
+    filters.GetProperty("exceptions")), filterIndex->GetPatternStatesBudget());
+}
+
+size_t FilterEngine::GetFilterIndexMemoryUsage() const
+{
+  return filterIndex->GetSnapshot()->GetMemoryUsage();
+}
+
+uint64_t FilterEngine::GetFiltersGeneration() const
+{
+  return filtersGeneration->Get();
+}
+
+uint64_t FilterEngine::WaitForFiltersChange(uint64_t generation,
+  const std::chrono::milliseconds& timeout) const
+{
+  return filtersGeneration->WaitForChange(generation, timeout);
+}
+
 int FilterEngine::CompareVersions(const std::string& v1, const std::string& v2) const
 {
   JsValueList params;
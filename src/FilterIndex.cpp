@@ -0,0 +1,443 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "FilterIndex.h"
+#include "UrlTokenizer.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  const size_t HASHES_NUMBER = 4;
+  const size_t MIN_BITS_NUMBER = 1024;
+  // With four hashes this keeps false positives below 1% per token.
+  const size_t BITS_PER_KEYWORD = 12;
+  // The delta native filter matcher is merged into the base one when it
+  // has more filters than this plus an eighth of the base matcher.
+  const size_t MIN_NATIVE_FILTERS_DELTA = 256;
+
+  // Double hashing, the second hash is odd and so coprime to bitsNumber.
+  size_t GetBloomFilterBit(uint64_t keywordHash, size_t index, size_t bitsNumber)
+  {
+    uint32_t hash1 = static_cast<uint32_t>(keywordHash);
+    uint32_t hash2 = static_cast<uint32_t>(keywordHash >> 32) | 1;
+    return (hash1 + static_cast<uint32_t>(index) * hash2) & (bitsNumber - 1);
+  }
+
+  size_t GetLowestBitIndex(uint32_t mask)
+  {
+    return UrlTokenizer::CountTrailingZeros(mask);
+  }
+}
+
+FilterIndex::KeywordBloomFilter::KeywordBloomFilter(size_t bitsNumber)
+  : bits(std::max<size_t>(bitsNumber / 64, 1))
+{
+}
+
+void FilterIndex::KeywordBloomFilter::Add(uint64_t keywordHash)
+{
+  for (size_t i = 0; i < HASHES_NUMBER; ++i)
+  {
+    size_t bit = GetBloomFilterBit(keywordHash, i, GetBitsNumber());
+    bits[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+}
+
+bool FilterIndex::KeywordBloomFilter::MayContain(uint64_t keywordHash) const
+{
+  return MayContain(bits.data(), GetBitsNumber(), keywordHash);
+}
+
+size_t FilterIndex::KeywordBloomFilter::GetBitsNumberForKeywords(size_t keywordsNumber)
+{
+  size_t bitsNumber = MIN_BITS_NUMBER;
+  while (bitsNumber < keywordsNumber * BITS_PER_KEYWORD)
+    bitsNumber <<= 1;
+  return bitsNumber;
+}
+
+bool FilterIndex::KeywordBloomFilter::MayContain(const uint64_t* bits, size_t bitsNumber,
+                                                 uint64_t keywordHash)
+{
+  for (size_t i = 0; i < HASHES_NUMBER; ++i)
+  {
+    size_t bit = GetBloomFilterBit(keywordHash, i, bitsNumber);
+    if (!(bits[bit / 64] & (uint64_t(1) << (bit % 64))))
+      return false;
+  }
+  return true;
+}
+
+FilterIndex::Snapshot::Snapshot()
+  : contentTypeMask(0), unconditionalContentTypeMask(0),
+    baseNativeFilters(std::make_shared<NativeFilterMatcher>(std::vector<NativeFilter>())),
+    deltaNativeFilters(baseNativeFilters),
+    removedBaseNativeFilters(std::make_shared<std::vector<bool>>())
+{
+  auto emptyFilter = std::make_shared<KeywordBloomFilter>(MIN_BITS_NUMBER);
+  keywordFilters.fill(emptyFilter);
+}
+
+FilterIndex::MatchResult FilterIndex::Snapshot::Match(const std::string& url,
+  FilterEngine::ContentTypeMask contentTypeMask, const std::string& documentUrl,
+  std::string& filterText) const
+{
+  uint32_t contentTypes = static_cast<uint32_t>(contentTypeMask);
+  if (MayMatchInJs(url, contentTypes))
+    return UNKNOWN;
+  return MatchNativeFilters(url, contentTypes, documentUrl, filterText);
+}
+
+bool FilterIndex::Snapshot::MayMatchInJs(const std::string& url, uint32_t contentTypes) const
+{
+  return FilterIndex::MayMatchInJs(url, contentTypes, contentTypeMask,
+    unconditionalContentTypeMask, [this](size_t contentType, uint64_t hash)
+    {
+      return keywordFilters[contentType]->MayContain(hash);
+    });
+}
+
+FilterIndex::MatchResult FilterIndex::Snapshot::MatchNativeFilters(
+  const std::string& url, uint32_t contentTypes, const std::string& documentUrl,
+  std::string& filterText) const
+{
+  contentTypes &= baseNativeFilters->GetContentTypeMask() |
+    deltaNativeFilters->GetContentTypeMask();
+  if (!contentTypes)
+    return NO_MATCH;
+  // JavaScript lower-cases some non-ASCII characters to ASCII ones.
+  if (!IsAscii(url))
+    return UNKNOWN;
+
+  NativeMatchSelector<NativeFilter> selector(contentTypes, documentUrl);
+  auto checkFilter = [&selector](const NativeFilter& filter)
+  {
+    return selector.Check(filter, filter.contentTypeMask, filter.isException,
+      !filter.domains.empty(), [&filter](const std::string& documentHost)
+      {
+        return filter.IsActiveOnDomain(documentHost);
+      });
+  };
+
+  const auto& removedBaseFilters = *removedBaseNativeFilters;
+  baseNativeFilters->ForEachMatch(url, contentTypes,
+    [&removedBaseFilters, &checkFilter](uint32_t filterIndex, const NativeFilter& filter)
+    {
+      if (filterIndex < removedBaseFilters.size() && removedBaseFilters[filterIndex])
+        return true;
+      return checkFilter(filter);
+    });
+  if (!selector.IsDecided())
+  {
+    deltaNativeFilters->ForEachMatch(url, contentTypes,
+      [&checkFilter](uint32_t, const NativeFilter& filter)
+      {
+        return checkFilter(filter);
+      });
+  }
+
+  if (selector.IsUnknown())
+    return UNKNOWN;
+  const NativeFilter* filter = selector.GetFilter();
+  if (!filter)
+    return NO_MATCH;
+  filterText = filter->text;
+  return MATCH;
+}
+
+size_t FilterIndex::Snapshot::GetMemoryUsage() const
+{
+  size_t memoryUsage = sizeof(*this);
+  // Bloom filters are shared by content types which never had keywords.
+  std::unordered_set<const KeywordBloomFilter*> countedFilters;
+  for (const auto& keywordFilter : keywordFilters)
+  {
+    if (countedFilters.insert(keywordFilter.get()).second)
+      memoryUsage += sizeof(KeywordBloomFilter) + keywordFilter->GetBitsNumber() / 8;
+  }
+  memoryUsage += baseNativeFilters->GetMemoryUsage();
+  if (deltaNativeFilters != baseNativeFilters)
+    memoryUsage += deltaNativeFilters->GetMemoryUsage();
+  memoryUsage += removedBaseNativeFilters->capacity() / 8;
+  return memoryUsage;
+}
+
+FilterIndex::FilterIndex(size_t patternStatesBudget)
+  : patternStatesBudget(patternStatesBudget)
+  , removedBaseNativeFiltersNumber(0)
+  , snapshot(std::make_shared<Snapshot>())
+{
+  keywordsNumbers.fill(0);
+  unconditionalFiltersNumbers.fill(0);
+}
+
+FilterIndex::SnapshotPtr FilterIndex::GetSnapshot() const
+{
+  return std::atomic_load(&snapshot);
+}
+
+void FilterIndex::UpdateKeywordsNumbers(uint32_t oldContentTypeMask,
+                                        uint32_t newContentTypeMask)
+{
+  for (size_t contentType = 0; contentType < CONTENT_TYPES_NUMBER; ++contentType)
+  {
+    uint32_t bit = uint32_t(1) << contentType;
+    if ((newContentTypeMask & bit) && !(oldContentTypeMask & bit))
+      ++keywordsNumbers[contentType];
+    else if (!(newContentTypeMask & bit) && (oldContentTypeMask & bit))
+      --keywordsNumbers[contentType];
+  }
+}
+
+uint32_t FilterIndex::AddFilter(const IndexedFilter& filter)
+{
+  uint32_t contentTypeMask = static_cast<uint32_t>(filter.contentTypeMask);
+  if (filter.keyword.empty())
+  {
+    for (size_t contentType = 0; contentType < CONTENT_TYPES_NUMBER; ++contentType)
+    {
+      if (contentTypeMask & (uint32_t(1) << contentType))
+        ++unconditionalFiltersNumbers[contentType];
+    }
+    return 0;
+  }
+
+  auto& keyword = keywords[UrlTokenizer::HashKeyword(filter.keyword)];
+  auto filtersNumber = std::find_if(keyword.filtersNumbers.begin(),
+    keyword.filtersNumbers.end(), [contentTypeMask](const std::pair<uint32_t, uint32_t>& entry)
+    {
+      return entry.first == contentTypeMask;
+    });
+  if (filtersNumber == keyword.filtersNumbers.end())
+    keyword.filtersNumbers.emplace_back(contentTypeMask, 1);
+  else
+    ++filtersNumber->second;
+
+  uint32_t oldContentTypeMask = keyword.contentTypeMask;
+  keyword.contentTypeMask |= contentTypeMask;
+  UpdateKeywordsNumbers(oldContentTypeMask, keyword.contentTypeMask);
+  return keyword.contentTypeMask & ~oldContentTypeMask;
+}
+
+uint32_t FilterIndex::RemoveFilter(const IndexedFilter& filter)
+{
+  uint32_t contentTypeMask = static_cast<uint32_t>(filter.contentTypeMask);
+  if (filter.keyword.empty())
+  {
+    for (size_t contentType = 0; contentType < CONTENT_TYPES_NUMBER; ++contentType)
+    {
+      if (contentTypeMask & (uint32_t(1) << contentType))
+        --unconditionalFiltersNumbers[contentType];
+    }
+    return 0;
+  }
+
+  auto keyword = keywords.find(UrlTokenizer::HashKeyword(filter.keyword));
+  if (keyword == keywords.end())
+    return 0;
+  auto& filtersNumbers = keyword->second.filtersNumbers;
+  auto filtersNumber = std::find_if(filtersNumbers.begin(), filtersNumbers.end(),
+    [contentTypeMask](const std::pair<uint32_t, uint32_t>& entry)
+    {
+      return entry.first == contentTypeMask;
+    });
+  if (filtersNumber == filtersNumbers.end())
+    return 0;
+  if (--filtersNumber->second == 0)
+    filtersNumbers.erase(filtersNumber);
+
+  uint32_t oldContentTypeMask = keyword->second.contentTypeMask;
+  uint32_t newContentTypeMask = 0;
+  for (const auto& entry : filtersNumbers)
+    newContentTypeMask |= entry.first;
+  UpdateKeywordsNumbers(oldContentTypeMask, newContentTypeMask);
+  if (filtersNumbers.empty())
+    keywords.erase(keyword);
+  else
+    keyword->second.contentTypeMask = newContentTypeMask;
+  return oldContentTypeMask & ~newContentTypeMask;
+}
+
+bool FilterIndex::RemoveNativeFilter(const std::string& text,
+  bool& isDeltaChanged, bool& areRemovedFiltersChanged)
+{
+  if (!nativeFilters.erase(text))
+    return false;
+  if (deltaNativeFilterTexts.erase(text))
+  {
+    isDeltaChanged = true;
+    return true;
+  }
+  auto baseFilterIndex = baseNativeFilterIndexes.find(text);
+  if (baseFilterIndex != baseNativeFilterIndexes.end())
+  {
+    removedBaseNativeFilters[baseFilterIndex->second] = true;
+    ++removedBaseNativeFiltersNumber;
+    baseNativeFilterIndexes.erase(baseFilterIndex);
+    areRemovedFiltersChanged = true;
+  }
+  return true;
+}
+
+void FilterIndex::Update(Changes&& changes)
+{
+  std::lock_guard<std::mutex> lock(updateMutex);
+  // Changes of element hiding filters only keep the current snapshot.
+  if (changes.added.empty() && changes.removed.empty())
+    return;
+
+  // Readers keep using the current snapshot while the shadow copy is built,
+  // the copy shares all Bloom filters and matchers with it so far.
+  auto shadow = std::make_shared<Snapshot>(*std::atomic_load(&snapshot));
+
+  // Keywords can't be removed from a Bloom filter, so the ones of content
+  // types which lost keywords are rebuilt, others get the new keywords only.
+  uint32_t rebuiltContentTypes = 0;
+  std::vector<std::pair<uint64_t, uint32_t>> addedKeywords;
+  bool isDeltaChanged = false;
+  bool areRemovedFiltersChanged = false;
+  auto removeFilter = [&](const std::string& text)
+  {
+    if (RemoveNativeFilter(text, isDeltaChanged, areRemovedFiltersChanged))
+      return;
+    auto filter = filters.find(text);
+    if (filter == filters.end())
+      return;
+    rebuiltContentTypes |= RemoveFilter(filter->second);
+    filters.erase(filter);
+  };
+
+  for (const auto& text : changes.removed)
+    removeFilter(text);
+  for (auto& added : changes.added)
+  {
+    removeFilter(added.first);
+    NativeFilter nativeFilter;
+    if (NativeFilter::Parse(added.first, static_cast<uint32_t>(added.second.contentTypeMask),
+                            added.second.isException, added.second.keyword,
+                            patternStatesBudget, nativeFilter))
+    {
+      deltaNativeFilterTexts.insert(added.first);
+      nativeFilters.emplace(added.first, std::move(nativeFilter));
+      isDeltaChanged = true;
+      continue;
+    }
+    uint32_t contentTypes = AddFilter(added.second);
+    if (contentTypes)
+      addedKeywords.emplace_back(UrlTokenizer::HashKeyword(added.second.keyword), contentTypes);
+    filters.emplace(std::move(added.first), std::move(added.second));
+  }
+
+  UpdateBloomFilters(*shadow, rebuiltContentTypes, addedKeywords);
+  UpdateNativeFilters(*shadow, isDeltaChanged, areRemovedFiltersChanged);
+  std::atomic_store(&snapshot, SnapshotPtr(std::move(shadow)));
+}
+
+void FilterIndex::UpdateBloomFilters(Snapshot& shadow, uint32_t rebuiltContentTypes,
+  const std::vector<std::pair<uint64_t, uint32_t>>& addedKeywords)
+{
+  shadow.contentTypeMask = 0;
+  shadow.unconditionalContentTypeMask = 0;
+  for (size_t contentType = 0; contentType < CONTENT_TYPES_NUMBER; ++contentType)
+  {
+    uint32_t bit = uint32_t(1) << contentType;
+    if (keywordsNumbers[contentType] || unconditionalFiltersNumbers[contentType])
+      shadow.contentTypeMask |= bit;
+    if (unconditionalFiltersNumbers[contentType])
+      shadow.unconditionalContentTypeMask |= bit;
+    // Growing Bloom filters are rebuilt with more bits.
+    size_t bitsNumber = shadow.keywordFilters[contentType]->GetBitsNumber();
+    if (keywordsNumbers[contentType] * BITS_PER_KEYWORD > bitsNumber)
+      rebuiltContentTypes |= bit;
+  }
+
+  std::array<std::shared_ptr<KeywordBloomFilter>, CONTENT_TYPES_NUMBER> changedFilters;
+  auto getChangedFilter = [&](size_t contentType) -> KeywordBloomFilter&
+  {
+    auto& changedFilter = changedFilters[contentType];
+    if (!changedFilter)
+    {
+      if (rebuiltContentTypes & (uint32_t(1) << contentType))
+        changedFilter = std::make_shared<KeywordBloomFilter>(
+          KeywordBloomFilter::GetBitsNumberForKeywords(keywordsNumbers[contentType]));
+      else
+        changedFilter = std::make_shared<KeywordBloomFilter>(
+          *shadow.keywordFilters[contentType]);
+      shadow.keywordFilters[contentType] = changedFilter;
+    }
+    return *changedFilter;
+  };
+
+  if (rebuiltContentTypes)
+  {
+    for (size_t contentType = 0; contentType < CONTENT_TYPES_NUMBER; ++contentType)
+    {
+      if (rebuiltContentTypes & (uint32_t(1) << contentType))
+        getChangedFilter(contentType);
+    }
+    for (const auto& keyword : keywords)
+    {
+      for (uint32_t rest = keyword.second.contentTypeMask & rebuiltContentTypes;
+           rest; rest &= rest - 1)
+        getChangedFilter(GetLowestBitIndex(rest)).Add(keyword.first);
+    }
+  }
+  for (const auto& keyword : addedKeywords)
+  {
+    for (uint32_t rest = keyword.second & ~rebuiltContentTypes; rest; rest &= rest - 1)
+      getChangedFilter(GetLowestBitIndex(rest)).Add(keyword.first);
+  }
+}
+
+void FilterIndex::UpdateNativeFilters(Snapshot& shadow, bool isDeltaChanged,
+                                       bool areRemovedFiltersChanged)
+{
+  size_t changesNumber = deltaNativeFilterTexts.size() + removedBaseNativeFiltersNumber;
+  if (changesNumber > MIN_NATIVE_FILTERS_DELTA + baseNativeFilterIndexes.size() / 8)
+  {
+    std::vector<NativeFilter> baseFilters;
+    baseFilters.reserve(nativeFilters.size());
+    baseNativeFilterIndexes.clear();
+    for (const auto& filter : nativeFilters)
+    {
+      baseNativeFilterIndexes.emplace(filter.first, static_cast<uint32_t>(baseFilters.size()));
+      baseFilters.push_back(filter.second);
+    }
+    deltaNativeFilterTexts.clear();
+    removedBaseNativeFilters.assign(baseFilters.size(), false);
+    removedBaseNativeFiltersNumber = 0;
+
+    shadow.baseNativeFilters = std::make_shared<NativeFilterMatcher>(std::move(baseFilters));
+    shadow.deltaNativeFilters = std::make_shared<NativeFilterMatcher>(std::vector<NativeFilter>());
+    shadow.removedBaseNativeFilters = std::make_shared<std::vector<bool>>(removedBaseNativeFilters);
+    return;
+  }
+
+  if (isDeltaChanged)
+  {
+    std::vector<NativeFilter> deltaFilters;
+    deltaFilters.reserve(deltaNativeFilterTexts.size());
+    for (const auto& text : deltaNativeFilterTexts)
+      deltaFilters.push_back(nativeFilters.at(text));
+    shadow.deltaNativeFilters = std::make_shared<NativeFilterMatcher>(std::move(deltaFilters));
+  }
+  if (areRemovedFiltersChanged)
+    shadow.removedBaseNativeFilters = std::make_shared<std::vector<bool>>(removedBaseNativeFilters);
+}
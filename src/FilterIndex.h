@@ -0,0 +1,257 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_FILTER_INDEX_H
+#define ADBLOCK_PLUS_FILTER_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "AdblockPlus/FilterEngine.h"
+
+#include "NativeMatcher.h"
+
+namespace AdblockPlus
+{
+  /*
+   * Native index of the request filters (blocking and exception filters)
+   * which are active in the JavaScript matcher. Literal, wildcard and
+   * regular expression filters with simple options are matched natively
+   * (see NativeFilter), the keywords of the others are kept in Bloom filters
+   * to tell when the JavaScript matcher can't find anything.
+   * Readers get an immutable snapshot without locking JsEngine. Changes are
+   * applied to a shadow copy which is published with an atomic swap once it
+   * is complete, so readers never see a partially applied filter list.
+   */
+  class FilterIndex
+  {
+  public:
+    struct IndexedFilter
+    {
+      // Keyword under which the JavaScript matcher can find the filter, it's
+      // empty if the filter is checked for every URL.
+      std::string keyword;
+      FilterEngine::ContentTypeMask contentTypeMask;
+      bool isException;
+    };
+
+    struct Changes
+    {
+      std::vector<std::pair<std::string, IndexedFilter>> added;
+      std::vector<std::string> removed;
+    };
+
+    /*
+     * Bloom filter over the hashes of keywords, it's immutable once
+     * published.
+     */
+    class KeywordBloomFilter
+    {
+    public:
+      // The number of bits is a power of two.
+      explicit KeywordBloomFilter(size_t bitsNumber);
+
+      void Add(uint64_t keywordHash);
+      bool MayContain(uint64_t keywordHash) const;
+
+      size_t GetBitsNumber() const
+      {
+        return bits.size() * 64;
+      }
+
+      const std::vector<uint64_t>& GetBits() const
+      {
+        return bits;
+      }
+
+      // Number of bits for `keywordsNumber` keywords, a power of two.
+      static size_t GetBitsNumberForKeywords(size_t keywordsNumber);
+
+      // Checks bits which aren't owned by a Bloom filter, e.g. ones stored
+      // in a compiled filter list.
+      static bool MayContain(const uint64_t* bits, size_t bitsNumber,
+                             uint64_t keywordHash);
+    private:
+      std::vector<uint64_t> bits;
+    };
+    typedef std::shared_ptr<const KeywordBloomFilter> KeywordBloomFilterPtr;
+
+    // One entry for every bit of FilterEngine::ContentTypeMask.
+    static const size_t CONTENT_TYPES_NUMBER = 32;
+
+    typedef std::shared_ptr<const NativeFilterMatcher> NativeFilterMatcherPtr;
+
+    enum MatchResult {NO_MATCH, MATCH, UNKNOWN};
+
+    /*
+     * Checks whether filters which aren't matched natively may match `url`,
+     * given the content types with such filters and the ones of them with
+     * filters which are checked for every URL.
+     * `mayContain(contentType, keywordHash)` checks the Bloom filter of
+     * a content type.
+     */
+    template<typename MayContain>
+    static bool MayMatchInJs(const std::string& url, uint32_t contentTypes,
+                             uint32_t contentTypeMask, uint32_t unconditionalContentTypeMask,
+                             MayContain&& mayContain)
+    {
+      contentTypes &= contentTypeMask;
+      if (!contentTypes)
+        return false;
+      if (contentTypes & unconditionalContentTypeMask)
+        return true;
+
+      bool mayMatch = false;
+      bool isExact = UrlTokenizer::ForEachKeywordHash(url, [&](uint64_t hash)
+      {
+        for (uint32_t rest = contentTypes; rest; rest &= rest - 1)
+        {
+          if (mayContain(UrlTokenizer::CountTrailingZeros(rest), hash))
+          {
+            mayMatch = true;
+            return false;
+          }
+        }
+        return true;
+      });
+      return mayMatch || !isExact;
+    }
+
+    class Snapshot
+    {
+    public:
+      Snapshot();
+
+      /*
+       * Matches a request against the indexed filters. The result is
+       * `UNKNOWN` if filters which aren't matched natively can match, the
+       * request has to be passed to the JavaScript matcher then.
+       * @param filterText Text of the matching filter, it's set if the result
+       *        is `MATCH`. Exception filters take precedence.
+       */
+      MatchResult Match(const std::string& url,
+                        FilterEngine::ContentTypeMask contentTypeMask,
+                        const std::string& documentUrl,
+                        std::string& filterText) const;
+
+      /*
+       * Retrieves the number of bytes used by the Bloom filters and the
+       * native filter automata.
+       */
+      size_t GetMemoryUsage() const;
+    private:
+      friend class FilterIndex;
+      // Content types with at least one filter which isn't matched
+      // natively.
+      uint32_t contentTypeMask;
+      // Content types with such filters which are checked for every URL.
+      uint32_t unconditionalContentTypeMask;
+      // Keywords of such filters of every content type. Unchanged Bloom
+      // filters are shared with the previous snapshot.
+      std::array<KeywordBloomFilterPtr, CONTENT_TYPES_NUMBER> keywordFilters;
+      // Native filters are added to the small delta matcher, which is
+      // merged into the base matcher once it grows. Removed filters of the
+      // base matcher are skipped until then.
+      NativeFilterMatcherPtr baseNativeFilters;
+      NativeFilterMatcherPtr deltaNativeFilters;
+      std::shared_ptr<const std::vector<bool>> removedBaseNativeFilters;
+
+      bool MayMatchInJs(const std::string& url, uint32_t contentTypes) const;
+      MatchResult MatchNativeFilters(const std::string& url,
+        uint32_t contentTypes, const std::string& documentUrl,
+        std::string& filterText) const;
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    /*
+     * @param patternStatesBudget Maximum number of states of the automaton
+     *        of a wildcard or regular expression filter, more complex
+     *        filters are left to the JavaScript matcher.
+     */
+    explicit FilterIndex(size_t patternStatesBudget);
+
+    /*
+     * Retrieves the latest published snapshot, it's thread-safe.
+     */
+    SnapshotPtr GetSnapshot() const;
+
+    /*
+     * Applies `changes` to a copy of the latest snapshot and publishes it.
+     * Keywords of added filters are added to copies of the affected Bloom
+     * filters, the Bloom filters of content types which lost keywords are
+     * rebuilt. Only the delta native filter matcher is rebuilt until it's
+     * merged. Empty changes keep the latest snapshot.
+     */
+    void Update(Changes&& changes);
+
+    size_t GetPatternStatesBudget() const
+    {
+      return patternStatesBudget;
+    }
+  private:
+    struct KeywordState
+    {
+      // Union of the content types of the filters with the keyword.
+      uint32_t contentTypeMask;
+      // Numbers of filters with the keyword by their content types.
+      std::vector<std::pair<uint32_t, uint32_t>> filtersNumbers;
+    };
+
+    typedef std::unordered_map<std::string, IndexedFilter> Filters;
+    typedef std::unordered_map<uint64_t, KeywordState> Keywords;
+    typedef std::unordered_map<std::string, NativeFilter> NativeFilters;
+    typedef std::array<uint32_t, CONTENT_TYPES_NUMBER> ContentTypeCounters;
+
+    const size_t patternStatesBudget;
+    // Serializes writers, readers don't lock it.
+    std::mutex updateMutex;
+    // Writer state, accessed only while holding updateMutex.
+    Filters filters;
+    Keywords keywords;
+    ContentTypeCounters keywordsNumbers;
+    ContentTypeCounters unconditionalFiltersNumbers;
+    NativeFilters nativeFilters;
+    std::unordered_map<std::string, uint32_t> baseNativeFilterIndexes;
+    std::unordered_set<std::string> deltaNativeFilterTexts;
+    std::vector<bool> removedBaseNativeFilters;
+    size_t removedBaseNativeFiltersNumber;
+    // Accessed only with std::atomic_load and std::atomic_store.
+    SnapshotPtr snapshot;
+
+    // Both return the content types which gained or lost the keyword.
+    uint32_t AddFilter(const IndexedFilter& filter);
+    uint32_t RemoveFilter(const IndexedFilter& filter);
+    void UpdateKeywordsNumbers(uint32_t oldContentTypeMask,
+                               uint32_t newContentTypeMask);
+    void UpdateBloomFilters(Snapshot& shadow, uint32_t rebuiltContentTypes,
+      const std::vector<std::pair<uint64_t, uint32_t>>& addedKeywords);
+    // Returns `false` if there is no such native filter.
+    bool RemoveNativeFilter(const std::string& text, bool& isDeltaChanged,
+                             bool& areRemovedFiltersChanged);
+    void UpdateNativeFilters(Snapshot& shadow, bool isDeltaChanged,
+                              bool areRemovedFiltersChanged);
+  };
+}
+
+#endif
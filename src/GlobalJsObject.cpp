@@ -24,6 +24,7 @@
 #include "ConsoleJsObject.h"
 #include "FileSystemJsObject.h"
 #include "GlobalJsObject.h"
+#include "JsBinding.h"
 #include "ConsoleJsObject.h"
 #include "WebRequestJsObject.h"
 #include "Thread.h"
@@ -33,43 +34,74 @@ using namespace AdblockPlus;
 
 namespace
 {
-  void SetTimeoutCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  template<bool isRepeating>
+  void SetTimerCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
   {
     try
     {
-      AdblockPlus::JsEngine::ScheduleTimer(arguments);
+      AdblockPlus::JsEngine::ScheduleTimer(arguments, isRepeating);
     }
     catch (const std::exception& e)
     {
       v8::Isolate* isolate = arguments.GetIsolate();
       return Utils::ThrowExceptionInJS(isolate, e.what());
     }
+  }
 
-    // We should actually return the timer ID here, which could be
-    // used via clearTimeout(). But since we don't seem to need
-    // clearTimeout(), we can save that for later.
+  void SetImmediateCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    try
+    {
+      AdblockPlus::JsEngine::ScheduleImmediate(arguments);
+    }
+    catch (const std::exception& e)
+    {
+      v8::Isolate* isolate = arguments.GetIsolate();
+      return Utils::ThrowExceptionInJS(isolate, e.what());
+    }
   }
 
-  void TriggerEventCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  void ClearTimerCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
   {
-    AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-    AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-    if (converted.size() < 1)
+    try
+    {
+      AdblockPlus::JsEngine::CancelTimer(arguments);
+    }
+    catch (const std::exception& e)
     {
       v8::Isolate* isolate = arguments.GetIsolate();
-      return Utils::ThrowExceptionInJS(isolate, "_triggerEvent expects at least one parameter");
+      return Utils::ThrowExceptionInJS(isolate, e.what());
     }
-    std::string eventName = converted.front().AsString();
-    converted.erase(converted.cbegin());
-    jsEngine->TriggerEvent(eventName, move(converted));
+  }
+
+  uint32_t GetEventIDCallback(JsEngine& jsEngine, std::string eventName)
+  {
+    return jsEngine.GetEventID(eventName);
+  }
+
+  // The event is either an ID returned by _getEventID or a name.
+  void TriggerEventCallback(JsEngine& jsEngine, v8::Local<v8::Value> event,
+    JsBinding::RestArguments arguments)
+  {
+    JsValueList params;
+    for (int i = 0; i < arguments.Length(); ++i)
+      params.push_back(jsEngine.NewValue(arguments[i]));
+    if (event->IsUint32())
+      return jsEngine.TriggerEvent(event->Uint32Value(), move(params));
+    jsEngine.TriggerEvent(Utils::FromV8String(jsEngine.GetIsolate(), event), move(params));
   }
 }
 
 JsValue& GlobalJsObject::Setup(JsEngine& jsEngine, const AppInfo& appInfo,
     JsValue& obj)
 {
-  obj.SetProperty("setTimeout", jsEngine.NewCallback(::SetTimeoutCallback));
-  obj.SetProperty("_triggerEvent", jsEngine.NewCallback(::TriggerEventCallback));
+  obj.SetProperty("setTimeout", jsEngine.NewCallback(::SetTimerCallback<false>, "setTimeout"));
+  obj.SetProperty("clearTimeout", jsEngine.NewCallback(::ClearTimerCallback, "clearTimeout"));
+  obj.SetProperty("setInterval", jsEngine.NewCallback(::SetTimerCallback<true>, "setInterval"));
+  obj.SetProperty("clearInterval", jsEngine.NewCallback(::ClearTimerCallback, "clearInterval"));
+  obj.SetProperty("setImmediate", jsEngine.NewCallback(::SetImmediateCallback, "setImmediate"));
+  obj.SetProperty("_getEventID", jsEngine.NewCallback(JS_BINDING(::GetEventIDCallback), "_getEventID"));
+  obj.SetProperty("_triggerEvent", jsEngine.NewCallback(JS_BINDING(::TriggerEventCallback), "_triggerEvent"));
   auto value = jsEngine.NewObject();
   obj.SetProperty("_fileSystem", FileSystemJsObject::Setup(jsEngine, value));
   value = jsEngine.NewObject();
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JsBinding.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  std::string ParametersNumber(int number)
+  {
+    return std::to_string(number) + (number == 1 ? " parameter" : " parameters");
+  }
+}
+
+std::string JsBinding::ArityError(const std::string& name, int required, int max)
+{
+  if (required == max)
+    return name + " requires " + ParametersNumber(required);
+  if (max == INT_MAX)
+    return name + " requires at least " + ParametersNumber(required);
+  if (max == required + 1)
+    return name + " requires " + std::to_string(required) + " or " + ParametersNumber(max);
+  return name + " requires from " + std::to_string(required) + " to " + ParametersNumber(max);
+}
+
+std::string JsBinding::ArgumentError(const std::string& name, int index, const char* description)
+{
+  static const char* ordinals[] = {"First", "Second", "Third", "Fourth", "Fifth"};
+  std::string argument = index < 5 ? std::string(ordinals[index]) + " argument" :
+    "Argument " + std::to_string(index + 1);
+  return argument + " to " + name + " must be " + description;
+}
@@ -0,0 +1,337 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_JS_BINDING_H
+#define ADBLOCK_PLUS_JS_BINDING_H
+
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <v8.h>
+#include <AdblockPlus/JsEngine.h>
+
+#include "Utils.h"
+
+namespace AdblockPlus
+{
+  /*
+   * Generates v8 callbacks for C++ functions at compile time. The arguments
+   * are converted directly from `v8::Local` according to the signature of
+   * the function, wrong arguments are reported as a JS exception, e.g.
+   *
+   *   void Move(JsEngine& jsEngine, std::string from, std::string to,
+   *     v8::Local<v8::Function> callback);
+   *   obj.SetProperty("move", jsEngine.NewCallback(JS_BINDING(Move), "_fileSystem.move"));
+   *
+   * The first parameter of the function is always the current `JsEngine`,
+   * a non-void result is returned to JS.
+   */
+  namespace JsBinding
+  {
+    typedef v8::FunctionCallbackInfo<v8::Value> CallbackInfo;
+
+    /*
+     * Argument which may be omitted, arguments following it must be
+     * optional too.
+     */
+    template<typename T>
+    struct Optional
+    {
+      Optional()
+        : isSet(false), value()
+      {
+      }
+      bool isSet;
+      T value;
+    };
+
+    /*
+     * Not converted arguments, it must be the last parameter of a function.
+     */
+    class RestArguments
+    {
+    public:
+      RestArguments()
+        : arguments(nullptr), begin(0)
+      {
+      }
+
+      RestArguments(const CallbackInfo& arguments, int begin)
+        : arguments(&arguments), begin(begin)
+      {
+      }
+
+      int Length() const
+      {
+        return arguments->Length() > begin ? arguments->Length() - begin : 0;
+      }
+
+      v8::Local<v8::Value> operator[](int i) const
+      {
+        return (*arguments)[begin + i];
+      }
+    private:
+      const CallbackInfo* arguments;
+      int begin;
+    };
+
+    /*
+     * Conversion of an argument to `T`, `Convert` returns false if the
+     * argument is not `Description()`.
+     */
+    template<typename T>
+    struct Argument;
+
+    struct RequiredArgument
+    {
+      static const bool isOptional = false;
+      static const bool isRest = false;
+    };
+
+    template<>
+    struct Argument<std::string> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, std::string& result)
+      {
+        result = Utils::FromV8String(arguments.GetIsolate(), arguments[index]);
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "a string";
+      }
+    };
+
+    template<>
+    struct Argument<StringBuffer> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, StringBuffer& result)
+      {
+        result = Utils::StringBufferFromV8String(arguments.GetIsolate(), arguments[index]);
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "a string";
+      }
+    };
+
+    template<>
+    struct Argument<uint32_t> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, uint32_t& result)
+      {
+        if (!arguments[index]->IsUint32())
+          return false;
+        result = arguments[index]->Uint32Value();
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "a non-negative number";
+      }
+    };
+
+    template<>
+    struct Argument<v8::Local<v8::Value>> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, v8::Local<v8::Value>& result)
+      {
+        result = arguments[index];
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "a value";
+      }
+    };
+
+    template<>
+    struct Argument<v8::Local<v8::Object>> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, v8::Local<v8::Object>& result)
+      {
+        if (!arguments[index]->IsObject())
+          return false;
+        result = arguments[index].As<v8::Object>();
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "an object";
+      }
+    };
+
+    template<>
+    struct Argument<v8::Local<v8::Function>> : RequiredArgument
+    {
+      static bool Convert(const CallbackInfo& arguments, int index, v8::Local<v8::Function>& result)
+      {
+        if (!arguments[index]->IsFunction())
+          return false;
+        result = arguments[index].As<v8::Function>();
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "a function";
+      }
+    };
+
+    template<typename T>
+    struct Argument<Optional<T>>
+    {
+      static const bool isOptional = true;
+      static const bool isRest = false;
+
+      static bool Convert(const CallbackInfo& arguments, int index, Optional<T>& result)
+      {
+        result.isSet = index < arguments.Length();
+        return !result.isSet || Argument<T>::Convert(arguments, index, result.value);
+      }
+
+      static const char* Description()
+      {
+        return Argument<T>::Description();
+      }
+    };
+
+    template<>
+    struct Argument<RestArguments>
+    {
+      static const bool isOptional = true;
+      static const bool isRest = true;
+
+      static bool Convert(const CallbackInfo& arguments, int index, RestArguments& result)
+      {
+        result = RestArguments(arguments, index);
+        return true;
+      }
+
+      static const char* Description()
+      {
+        return "any value";
+      }
+    };
+
+    template<typename... Args>
+    struct Arity;
+
+    template<>
+    struct Arity<>
+    {
+      static const int required = 0;
+      static const int max = 0;
+    };
+
+    template<typename T, typename... Args>
+    struct Arity<T, Args...>
+    {
+      static const int required = (Argument<T>::isOptional ? 0 : 1) + Arity<Args...>::required;
+      static const int max = Argument<T>::isRest || Arity<Args...>::max == INT_MAX ?
+        INT_MAX : 1 + Arity<Args...>::max;
+    };
+
+    std::string ArityError(const std::string& name, int required, int max);
+    std::string ArgumentError(const std::string& name, int index, const char* description);
+
+    template<typename Result>
+    struct ReturnValue
+    {
+      template<typename Call>
+      static void Set(const CallbackInfo& arguments, Call&& call)
+      {
+        arguments.GetReturnValue().Set(call());
+      }
+    };
+
+    template<>
+    struct ReturnValue<void>
+    {
+      template<typename Call>
+      static void Set(const CallbackInfo&, Call&& call)
+      {
+        call();
+      }
+    };
+
+    template<typename Signature, Signature function>
+    struct Function;
+
+    template<typename Result, typename... Args, Result (*function)(JsEngine&, Args...)>
+    struct Function<Result (*)(JsEngine&, Args...), function>
+    {
+      typedef std::tuple<typename std::decay<Args>::type...> Values;
+
+      static void Callback(const CallbackInfo& arguments)
+      {
+        try
+        {
+          typedef Arity<typename std::decay<Args>::type...> FunctionArity;
+          if (arguments.Length() < FunctionArity::required || arguments.Length() > FunctionArity::max)
+          {
+            throw std::runtime_error(ArityError(JsEngine::GetCallbackName(arguments),
+              FunctionArity::required, FunctionArity::max));
+          }
+          auto jsEngine = JsEngine::FromArguments(arguments);
+          Invoke(*jsEngine, arguments, std::index_sequence_for<Args...>());
+        }
+        catch (const std::exception& e)
+        {
+          return Utils::ThrowExceptionInJS(arguments.GetIsolate(), e.what());
+        }
+      }
+    private:
+      template<std::size_t... indices>
+      static void Invoke(JsEngine& jsEngine, const CallbackInfo& arguments,
+        std::index_sequence<indices...>)
+      {
+        // Braced initialization converts the arguments from left to right.
+        Values values{ConvertArgument<typename std::tuple_element<indices, Values>::type>(arguments, indices)...};
+        ReturnValue<Result>::Set(arguments, [&jsEngine, &values]
+          {
+            return function(jsEngine, std::move(std::get<indices>(values))...);
+          });
+      }
+
+      template<typename T>
+      static T ConvertArgument(const CallbackInfo& arguments, int index)
+      {
+        T result = T();
+        if (!Argument<T>::Convert(arguments, index, result))
+        {
+          throw std::runtime_error(ArgumentError(JsEngine::GetCallbackName(arguments),
+            index, Argument<T>::Description()));
+        }
+        return result;
+      }
+    };
+
+#define JS_BINDING(function) \
+    AdblockPlus::JsBinding::Function<decltype(&function), &function>::Callback
+  }
+}
+
+#endif
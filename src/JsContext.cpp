@@ -18,9 +18,26 @@
 #include "JsContext.h"
 
 AdblockPlus::JsContext::JsContext(JsEngine& jsEngine)
-    : locker(jsEngine.GetIsolate()), isolateScope(jsEngine.GetIsolate()),
+    : jsEngine(jsEngine), locker(jsEngine.GetIsolate()), isolateScope(jsEngine.GetIsolate()),
       handleScope(jsEngine.GetIsolate()),
       context(v8::Local<v8::Context>::New(jsEngine.GetIsolate(), *jsEngine.context)),
       contextScope(context)
 {
+  ++jsEngine.jsContextDepth;
+}
+
+AdblockPlus::JsContext::~JsContext()
+{
+  // No JS is run here, the stack can be unwinding. Callbacks deferred by
+  // setImmediate which are not run by the entry point, e.g. because it
+  // threw, are run once the lock is taken again.
+  if (jsEngine.jsContextDepth == 1)
+    jsEngine.ScheduleImmediateTasks();
+  --jsEngine.jsContextDepth;
+}
+
+void AdblockPlus::JsContext::RunImmediateTasks()
+{
+  if (jsEngine.jsContextDepth == 1)
+    jsEngine.RunImmediateTasks();
 }
@@ -27,13 +27,21 @@ namespace AdblockPlus
   {
   public:
     explicit JsContext(JsEngine& jsEngine);
+    ~JsContext();
 
     v8::Local<v8::Context> GetV8Context() const
     {
       return context;
     }
 
+    /*
+     * Runs the callbacks deferred by setImmediate if this is the outermost
+     * context. The entry points into JS call it once they are done.
+     */
+    void RunImmediateTasks();
+
   private:
+    JsEngine& jsEngine;
     const v8::Locker locker;
     const v8::Isolate::Scope isolateScope;
     const v8::HandleScope handleScope;
@@ -15,10 +15,12 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <AdblockPlus.h>
 #include "GlobalJsObject.h"
 #include "JsContext.h"
 #include "JsError.h"
+#include "JsEventLoop.h"
 #include "Utils.h"
 #include <libplatform/libplatform.h>
 #include <AdblockPlus/Platform.h>
@@ -102,9 +104,205 @@ namespace
 
 using namespace AdblockPlus;
 
-JsEngine::JsWeakValuesList::~JsWeakValuesList()
+/**
+ * Event callbacks indexed by event IDs. Triggering reads an immutable
+ * snapshot of the callbacks, modifications replace the snapshot. Replaced
+ * snapshots are deleted once no event is being triggered.
+ */
+class JsEngine::EventCallbacks
 {
-}
+  typedef std::vector<EventCallback> Snapshot;
+  typedef std::vector<std::unique_ptr<const Snapshot>> Snapshots;
+public:
+  EventCallbacks()
+    : snapshot(new Snapshot()), triggersNumber(0), hasReplacedSnapshots(false)
+  {
+  }
+
+  ~EventCallbacks()
+  {
+    delete snapshot.load();
+  }
+
+  EventID GetEventID(const std::string& eventName)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return eventIDs.emplace(eventName, static_cast<EventID>(eventIDs.size())).first->second;
+  }
+
+  // Unlike GetEventID does not intern an unknown name.
+  bool FindEventID(const std::string& eventName, EventID& eventID)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = eventIDs.find(eventName);
+    if (it == eventIDs.end())
+      return false;
+    eventID = it->second;
+    return true;
+  }
+
+  void Set(EventID eventID, const EventCallback& callback)
+  {
+    Snapshots deletedSnapshots;
+    std::lock_guard<std::mutex> lock(mutex);
+    const Snapshot& currentSnapshot = *snapshot.load();
+    if (!callback && eventID >= currentSnapshot.size())
+      return;
+    std::unique_ptr<Snapshot> newSnapshot(new Snapshot(currentSnapshot));
+    if (eventID >= newSnapshot->size())
+      newSnapshot->resize(eventID + 1);
+    (*newSnapshot)[eventID] = callback;
+    replacedSnapshots.emplace_back(snapshot.exchange(newSnapshot.release()));
+    hasReplacedSnapshots = true;
+    TakeReplacedSnapshots(deletedSnapshots);
+  }
+
+  void Trigger(EventID eventID, JsValueList&& params)
+  {
+    struct TriggerScope
+    {
+      explicit TriggerScope(EventCallbacks& eventCallbacks)
+        : eventCallbacks(eventCallbacks)
+      {
+        ++eventCallbacks.triggersNumber;
+      }
+      ~TriggerScope()
+      {
+        // Callbacks can hold references to JsEngine, so they must not stay
+        // in replaced snapshots until the next modification.
+        if (--eventCallbacks.triggersNumber == 0 && eventCallbacks.hasReplacedSnapshots)
+        {
+          Snapshots deletedSnapshots;
+          std::lock_guard<std::mutex> lock(eventCallbacks.mutex);
+          eventCallbacks.TakeReplacedSnapshots(deletedSnapshots);
+        }
+      }
+      EventCallbacks& eventCallbacks;
+    } triggerScope(*this);
+    const Snapshot& callbacks = *snapshot.load();
+    if (eventID < callbacks.size() && callbacks[eventID])
+      callbacks[eventID](move(params));
+  }
+private:
+  // Must be called with the locked mutex. The snapshots are deleted by the
+  // caller after unlocking because destroying of a callback can modify
+  // callbacks too.
+  void TakeReplacedSnapshots(Snapshots& snapshots)
+  {
+    // A trigger starting after this check reads the current snapshot.
+    if (triggersNumber != 0)
+      return;
+    snapshots.swap(replacedSnapshots);
+    hasReplacedSnapshots = false;
+  }
+
+  std::atomic<const Snapshot*> snapshot;
+  std::atomic<uint32_t> triggersNumber;
+  std::atomic<bool> hasReplacedSnapshots;
+  // Guards the rest, it's used only by modifications.
+  std::mutex mutex;
+  // Never shrinks, an ID stays valid for the lifetime of the engine.
+  std::map<std::string, EventID> eventIDs;
+  Snapshots replacedSnapshots;
+};
+
+struct JsEngine::CallbackData
+{
+  std::weak_ptr<JsEngine> jsEngine;
+  std::string name;
+  v8::Global<v8::FunctionTemplate> functionTemplate;
+};
+
+/**
+ * Generational slot map of stored values. Slots are reused, so storing of a
+ * few values does not allocate memory once the map has grown enough.
+ */
+class JsEngine::JsWeakValuesSlots
+{
+  typedef v8::Global<v8::Value> Value;
+public:
+  JsWeakValuesSlots()
+    : firstFreeIndex(noIndex)
+  {
+  }
+
+  JsWeakValuesID Store(v8::Isolate* isolate, const JsValueList& values)
+  {
+    uint32_t index = firstFreeIndex;
+    if (index == noIndex)
+    {
+      index = static_cast<uint32_t>(slots.size());
+      slots.emplace_back();
+    }
+    else
+      firstFreeIndex = slots[index].nextFreeIndex;
+    Slot& slot = slots[index];
+    slot.valuesNumber = values.size();
+    if (slot.valuesNumber > inlineValuesNumber)
+      slot.extraValues.resize(slot.valuesNumber - inlineValuesNumber);
+    for (size_t i = 0; i < values.size(); ++i)
+      slot[i].Reset(isolate, values[i].UnwrapValue());
+    JsWeakValuesID id;
+    id.index = index;
+    id.generation = ++slot.generation;
+    return id;
+  }
+
+  template<typename Visitor>
+  void Visit(const JsWeakValuesID& id, Visitor&& visitor)
+  {
+    Slot& slot = GetSlot(id);
+    for (size_t i = 0; i < slot.valuesNumber; ++i)
+      visitor(slot[i]);
+  }
+
+  void Remove(const JsWeakValuesID& id)
+  {
+    Slot& slot = GetSlot(id);
+    for (size_t i = 0; i < slot.valuesNumber; ++i)
+      slot[i].Reset();
+    // The capacity of extraValues is kept for the next use of the slot.
+    slot.extraValues.clear();
+    slot.valuesNumber = 0;
+    ++slot.generation;
+    slot.nextFreeIndex = firstFreeIndex;
+    firstFreeIndex = id.index;
+  }
+private:
+  static const uint32_t noIndex = UINT32_MAX;
+  static const size_t inlineValuesNumber = 3;
+
+  struct Slot
+  {
+    Slot()
+      : generation(0), valuesNumber(0), nextFreeIndex(noIndex)
+    {
+    }
+
+    Value& operator[](size_t i)
+    {
+      return i < inlineValuesNumber ? inlineValues[i] : extraValues[i - inlineValuesNumber];
+    }
+
+    uint32_t generation;
+    size_t valuesNumber;
+    uint32_t nextFreeIndex;
+    Value inlineValues[inlineValuesNumber];
+    std::vector<Value> extraValues;
+  };
+
+  Slot& GetSlot(const JsWeakValuesID& id)
+  {
+    if (id.index >= slots.size() || slots[id.index].generation != id.generation ||
+      id.generation % 2 == 0)
+      throw std::runtime_error("Stored values are not found, they are probably already taken");
+    return slots[id.index];
+  }
+
+  // std::deque does not move elements while growing.
+  std::deque<Slot> slots;
+  uint32_t firstFreeIndex;
+};
 
 void JsEngine::NotifyLowMemory()
 {
@@ -112,50 +310,217 @@ void JsEngine::NotifyLowMemory()
   GetIsolate()->MemoryPressureNotification(v8::MemoryPressureLevel::kCritical);
 }
 
-void JsEngine::ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+void JsEngine::ScheduleTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments, bool isRepeating)
 {
   auto jsEngine = FromArguments(arguments);
+  const std::string functionName = isRepeating ? "setInterval" : "setTimeout";
   if (arguments.Length() < 2)
-    throw std::runtime_error("setTimeout requires at least 2 parameters");
+    throw std::runtime_error(functionName + " requires at least 2 parameters");
 
   if (!arguments[0]->IsFunction())
-    throw std::runtime_error("First argument to setTimeout must be a function");
+    throw std::runtime_error("First argument to " + functionName + " must be a function");
 
+  std::chrono::milliseconds timeout(std::max<int64_t>(arguments[1]->IntegerValue(), 0));
   auto jsValueArguments = jsEngine->ConvertArguments(arguments);
-  auto timerParamsID = jsEngine->StoreJsValues(jsValueArguments);
+  Timer timer;
+  timer.paramsID = jsEngine->StoreJsValues(jsValueArguments);
+  // Don't let an interval occupy the timer thread.
+  if (isRepeating)
+    timer.interval = std::max(timeout, std::chrono::milliseconds(1));
+  uint32_t timerID;
+  {
+    std::lock_guard<std::mutex> lock(jsEngine->timersMutex);
+    do
+    {
+      timerID = ++jsEngine->lastTimerID;
+    } while (timerID == 0 || jsEngine->timers.count(timerID));
+    jsEngine->timers[timerID] = timer;
+  }
+  jsEngine->ArmTimer(timerID, timeout);
+  arguments.GetReturnValue().Set(v8::Integer::NewFromUnsigned(arguments.GetIsolate(), timerID));
+}
+
+void JsEngine::CancelTimer(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+{
+  auto jsEngine = FromArguments(arguments);
+  // Like in browsers invalid IDs are ignored.
+  if (arguments.Length() < 1 || !arguments[0]->IsUint32())
+    return;
+  uint32_t timerID = arguments[0]->Uint32Value();
+  Timer timer;
+  {
+    std::lock_guard<std::mutex> lock(jsEngine->timersMutex);
+    auto it = jsEngine->timers.find(timerID);
+    if (it == jsEngine->timers.end())
+      return;
+    timer = it->second;
+    jsEngine->timers.erase(it);
+  }
+  if (timer.cancel)
+    timer.cancel();
+  jsEngine->TakeJsValues(timer.paramsID);
+}
+
+void JsEngine::ScheduleImmediate(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+{
+  auto jsEngine = FromArguments(arguments);
+  if (arguments.Length() < 1)
+    throw std::runtime_error("setImmediate requires at least 1 parameter");
+
+  if (!arguments[0]->IsFunction())
+    throw std::runtime_error("First argument to setImmediate must be a function");
+
+  // The caller holds the lock, the task runs once the entry point into JS
+  // is done.
+  jsEngine->immediateTasks.push_back(jsEngine->StoreJsValues(jsEngine->ConvertArguments(arguments)));
+}
+
+void JsEngine::RunImmediateTasks()
+{
+  // Tasks added by these tasks are executed in the next batch, so that a
+  // task re-adding itself does not hold the lock forever.
+  std::deque<JsWeakValuesID> tasks;
+  tasks.swap(immediateTasks);
+  for (const auto& taskParamsID : tasks)
+  {
+    try
+    {
+      auto taskParams = TakeJsValues(taskParamsID);
+      JsValue callback = std::move(taskParams[0]);
+      taskParams.erase(taskParams.begin()); // remove callback placeholder
+      callback.Call(taskParams);
+    }
+    catch (...)
+    {
+      // an exception must not prevent running the other tasks.
+    }
+  }
+}
 
-  std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-  jsEngine->platform.WithTimer(
-    [arguments, weakJsEngine, timerParamsID](ITimer& timer)
+void JsEngine::ScheduleImmediateTasks()
+{
+  if (immediateTasks.empty() || areImmediateTasksScheduled)
+    return;
+  try
+  {
+    // Take and release the lock again as soon as possible.
+    std::weak_ptr<JsEngine> weakJsEngine = shared_from_this();
+    platform.WithTimer([weakJsEngine](ITimer& timer)
     {
-      timer.SetTimer(
-        std::chrono::milliseconds(
-          arguments[1]->IntegerValue()), [weakJsEngine, timerParamsID]
+      timer.SetTimer(std::chrono::milliseconds::zero(), [weakJsEngine]
+      {
+        if (auto jsEngine = weakJsEngine.lock())
+        {
+          jsEngine->RunAsyncTask([weakJsEngine]
           {
             if (auto jsEngine = weakJsEngine.lock())
-              jsEngine->CallTimerTask(timerParamsID);
+            {
+              JsContext context(*jsEngine);
+              jsEngine->areImmediateTasksScheduled = false;
+              context.RunImmediateTasks();
+            }
           });
+        }
+      });
     });
+    areImmediateTasksScheduled = true;
+  }
+  catch (...)
+  {
+    // it's called from a destructor, so nothing is allowed to escape.
+  }
 }
 
-void JsEngine::CallTimerTask(const JsWeakValuesID& timerParamsID)
+void JsEngine::ArmTimer(uint32_t timerID, const std::chrono::milliseconds& timeout)
 {
-  auto timerParams = TakeJsValues(timerParamsID);
+  uint32_t armsNumber;
+  {
+    std::lock_guard<std::mutex> lock(timersMutex);
+    auto it = timers.find(timerID);
+    if (it == timers.end())
+      return;
+    armsNumber = ++it->second.armsNumber;
+  }
+  ITimer::CancelTimerCallback cancel;
+  std::weak_ptr<JsEngine> weakJsEngine = shared_from_this();
+  platform.WithTimer(
+    [&cancel, &timeout, weakJsEngine, timerID](ITimer& timer)
+    {
+      cancel = timer.SetCancelableTimer(timeout, [weakJsEngine, timerID]
+      {
+        if (auto jsEngine = weakJsEngine.lock())
+        {
+          jsEngine->RunAsyncTask([weakJsEngine, timerID]
+          {
+            if (auto jsEngine = weakJsEngine.lock())
+              jsEngine->CallTimerTask(timerID);
+          });
+        }
+      });
+    });
+  {
+    std::lock_guard<std::mutex> lock(timersMutex);
+    auto it = timers.find(timerID);
+    if (it != timers.end())
+    {
+      // The timer can be re-armed meanwhile by firing in another thread.
+      if (it->second.armsNumber == armsNumber)
+        it->second.cancel = cancel;
+      return;
+    }
+  }
+  // The timer has been cleared meanwhile.
+  if (cancel)
+    cancel();
+}
+
+void JsEngine::CallTimerTask(uint32_t timerID)
+{
+  // Acquiring of the context first serializes it with clearTimeout.
+  JsContext context(*this);
+  Timer timer;
+  {
+    std::lock_guard<std::mutex> lock(timersMutex);
+    auto it = timers.find(timerID);
+    if (it == timers.end())
+      return;
+    timer = it->second;
+    if (timer.interval == std::chrono::milliseconds::zero())
+      timers.erase(it);
+  }
+  JsValueList timerParams;
+  if (timer.interval == std::chrono::milliseconds::zero())
+    timerParams = TakeJsValues(timer.paramsID);
+  else
+  {
+    timerParams = GetJsValues(timer.paramsID);
+    ArmTimer(timerID, timer.interval);
+  }
   JsValue callback = std::move(timerParams[0]);
 
   timerParams.erase(timerParams.begin()); // remove callback placeholder
   timerParams.erase(timerParams.begin()); // remove timeout param
   callback.Call(timerParams);
+  context.RunImmediateTasks();
 }
 
 AdblockPlus::JsEngine::JsEngine(Platform& platform, std::unique_ptr<IV8IsolateProvider> isolate)
   : platform(platform)
   , isolate(std::move(isolate))
+  , eventCallbacks(new EventCallbacks())
+  , jsWeakValuesSlots(new JsWeakValuesSlots())
+  , lastTimerID(0)
+  , areImmediateTasksScheduled(false)
+  , jsContextDepth(0)
+{
+}
+
+AdblockPlus::JsEngine::~JsEngine()
 {
 }
 
 AdblockPlus::JsEnginePtr AdblockPlus::JsEngine::New(const AppInfo& appInfo,
-  Platform& platform, std::unique_ptr<IV8IsolateProvider> isolate)
+  Platform& platform, std::unique_ptr<IV8IsolateProvider> isolate, bool useEventLoop)
 {
   if (!isolate)
   {
@@ -171,9 +536,63 @@ AdblockPlus::JsEnginePtr AdblockPlus::JsEngine::New(const AppInfo& appInfo,
     v8::Context::New(result->GetIsolate())));
   auto global = result->GetGlobalObject();
   AdblockPlus::GlobalJsObject::Setup(*result, appInfo, global);
+  if (useEventLoop)
+    result->eventLoop.reset(new JsEventLoop(result));
   return result;
 }
 
+void AdblockPlus::JsEngine::WithFileSystem(const std::function<void(IFileSystem&)>& callback)
+{
+  if (!eventLoop)
+    return platform.WithFileSystem(callback);
+  auto eventLoop = this->eventLoop.get();
+  platform.WithFileSystem([eventLoop, &callback](IFileSystem& fileSystem)
+  {
+    eventLoop->WithFileSystem(fileSystem, callback);
+  });
+}
+
+void AdblockPlus::JsEngine::WithWebRequest(const std::function<void(IWebRequest&)>& callback)
+{
+  if (!eventLoop)
+    return platform.WithWebRequest(callback);
+  auto eventLoop = this->eventLoop.get();
+  platform.WithWebRequest([eventLoop, &callback](IWebRequest& webRequest)
+  {
+    eventLoop->WithWebRequest(webRequest, callback);
+  });
+}
+
+bool AdblockPlus::JsEngine::InvokeInEventLoop(const std::function<void()>& task)
+{
+  // The lock is checked because the event loop cannot take it meanwhile.
+  if (!eventLoop || eventLoop->IsCurrentThread() || v8::Locker::IsLocked(GetIsolate()))
+    return false;
+  std::promise<void> promise;
+  eventLoop->Post([&task, &promise]
+  {
+    try
+    {
+      task();
+      promise.set_value();
+    }
+    catch (...)
+    {
+      promise.set_exception(std::current_exception());
+    }
+  });
+  promise.get_future().get();
+  return true;
+}
+
+void AdblockPlus::JsEngine::RunAsyncTask(const std::function<void()>& task)
+{
+  if (eventLoop)
+    eventLoop->Post(task);
+  else
+    task();
+}
+
 AdblockPlus::JsValue AdblockPlus::JsEngine::GetGlobalObject()
 {
   JsContext context(*this);
@@ -183,45 +602,60 @@ AdblockPlus::JsValue AdblockPlus::JsEngine::GetGlobalObject()
 AdblockPlus::JsValue AdblockPlus::JsEngine::Evaluate(const std::string& source,
     const std::string& filename)
 {
-  const JsContext context(*this);
-  auto isolate = GetIsolate();
-  const v8::TryCatch tryCatch(isolate);
-  auto script = CHECKED_TO_LOCAL(
-    isolate, CompileScript(isolate, source, filename), tryCatch);
-  auto result = CHECKED_TO_LOCAL(
-    isolate, script->Run(isolate->GetCurrentContext()), tryCatch);
-  return JsValue(shared_from_this(), result);
+  return RunInEventLoop<JsValue>([this, &source, &filename]
+  {
+    JsContext context(*this);
+    auto isolate = GetIsolate();
+    const v8::TryCatch tryCatch(isolate);
+    auto script = CHECKED_TO_LOCAL(
+      isolate, CompileScript(isolate, source, filename), tryCatch);
+    auto result = CHECKED_TO_LOCAL(
+      isolate, script->Run(isolate->GetCurrentContext()), tryCatch);
+    JsValue value(shared_from_this(), result);
+    context.RunImmediateTasks();
+    return value;
+  });
 }
 
 void AdblockPlus::JsEngine::SetEventCallback(const std::string& eventName,
     const AdblockPlus::JsEngine::EventCallback& callback)
 {
-  if (!callback)
-  {
-    RemoveEventCallback(eventName);
-    return;
-  }
-  std::lock_guard<std::mutex> lock(eventCallbacksMutex);
-  eventCallbacks[eventName] = callback;
+  SetEventCallback(GetEventID(eventName), callback);
 }
 
 void AdblockPlus::JsEngine::RemoveEventCallback(const std::string& eventName)
 {
-  std::lock_guard<std::mutex> lock(eventCallbacksMutex);
-  eventCallbacks.erase(eventName);
+  EventID eventID;
+  if (eventCallbacks->FindEventID(eventName, eventID))
+    RemoveEventCallback(eventID);
 }
 
 void AdblockPlus::JsEngine::TriggerEvent(const std::string& eventName, AdblockPlus::JsValueList&& params)
 {
-  EventCallback callback;
-  {
-    std::lock_guard<std::mutex> lock(eventCallbacksMutex);
-    auto it = eventCallbacks.find(eventName);
-    if (it == eventCallbacks.end())
-      return;
-    callback = it->second;
-  }
-  callback(move(params));
+  EventID eventID;
+  if (eventCallbacks->FindEventID(eventName, eventID))
+    TriggerEvent(eventID, move(params));
+}
+
+JsEngine::EventID AdblockPlus::JsEngine::GetEventID(const std::string& eventName)
+{
+  return eventCallbacks->GetEventID(eventName);
+}
+
+void AdblockPlus::JsEngine::SetEventCallback(EventID eventID,
+    const AdblockPlus::JsEngine::EventCallback& callback)
+{
+  eventCallbacks->Set(eventID, callback);
+}
+
+void AdblockPlus::JsEngine::RemoveEventCallback(EventID eventID)
+{
+  eventCallbacks->Set(eventID, EventCallback());
+}
+
+void AdblockPlus::JsEngine::TriggerEvent(EventID eventID, AdblockPlus::JsValueList&& params)
+{
+  eventCallbacks->Trigger(eventID, move(params));
 }
 
 void AdblockPlus::JsEngine::Gc()
@@ -253,76 +687,90 @@ AdblockPlus::JsValue AdblockPlus::JsEngine::NewObject()
   return JsValue(shared_from_this(), v8::Object::New(GetIsolate()));
 }
 
+AdblockPlus::JsValue AdblockPlus::JsEngine::NewValue(const v8::Local<v8::Value>& value)
+{
+  return JsValue(shared_from_this(), value);
+}
+
 AdblockPlus::JsValue AdblockPlus::JsEngine::NewCallback(
-    const v8::FunctionCallback& callback)
+    const v8::FunctionCallback& callback, const std::string& name)
 {
   const JsContext context(*this);
 
-  // Note: we are leaking this weak pointer, no obvious way to destroy it when
-  // it's no longer used
-  std::weak_ptr<JsEngine>* data =
-      new std::weak_ptr<JsEngine>(shared_from_this());
-  v8::Local<v8::FunctionTemplate> templ = v8::FunctionTemplate::New(GetIsolate(), callback,
-      v8::External::New(GetIsolate(), data));
+  auto& data = callbackTemplates[std::make_pair(callback, name)];
+  if (!data)
+  {
+    // The data is owned by JsEngine, so nothing is leaked and the same
+    // template is used for all functions with the same callback and name.
+    data.reset(new CallbackData());
+    data->jsEngine = shared_from_this();
+    data->name = name;
+    auto templ = v8::FunctionTemplate::New(GetIsolate(), callback,
+      v8::External::New(GetIsolate(), data.get()));
+    if (!name.empty())
+      templ->SetClassName(Utils::ToV8String(GetIsolate(), name));
+    data->functionTemplate.Reset(GetIsolate(), templ);
+  }
+  auto templ = v8::Local<v8::FunctionTemplate>::New(GetIsolate(), data->functionTemplate);
   return JsValue(shared_from_this(), templ->GetFunction());
 }
 
+namespace
+{
+  template<typename CallbackData>
+  const CallbackData& GetCallbackData(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+  {
+    const v8::Local<const v8::External> external =
+        v8::Local<const v8::External>::Cast(arguments.Data());
+    return *static_cast<const CallbackData*>(external->Value());
+  }
+}
+
 AdblockPlus::JsEnginePtr AdblockPlus::JsEngine::FromArguments(const v8::FunctionCallbackInfo<v8::Value>& arguments)
 {
-  const v8::Local<const v8::External> external =
-      v8::Local<const v8::External>::Cast(arguments.Data());
-  std::weak_ptr<JsEngine>* data =
-      static_cast<std::weak_ptr<JsEngine>*>(external->Value());
-  JsEnginePtr result = data->lock();
+  JsEnginePtr result = GetCallbackData<CallbackData>(arguments).jsEngine.lock();
   if (!result)
     throw std::runtime_error("Oops, our JsEngine is gone, how did that happen?");
   return result;
 }
 
+const std::string& AdblockPlus::JsEngine::GetCallbackName(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+{
+  return GetCallbackData<CallbackData>(arguments).name;
+}
+
 JsEngine::JsWeakValuesID JsEngine::StoreJsValues(const JsValueList& values)
 {
-  JsWeakValuesLists::iterator it;
-  {
-    std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex);
-    it = jsWeakValuesLists.emplace(jsWeakValuesLists.end());
-  }
-  {
-    JsContext context(*this);
-    for (const auto& value : values)
-    {
-      it->values.emplace_back(GetIsolate(), value.UnwrapValue());
-    }
-  }
-  JsWeakValuesID retValue;
-  retValue.iterator = it;
-  return retValue;
+  JsContext context(*this);
+  std::lock_guard<std::mutex> lock(jsWeakValuesSlotsMutex);
+  return jsWeakValuesSlots->Store(GetIsolate(), values);
 }
 
 JsValueList JsEngine::TakeJsValues(const JsWeakValuesID& id)
 {
-  JsValueList retValue;
-  {
-    JsContext context(*this);
-    for (const auto& v8Value : id.iterator->values)
-    {
-      retValue.emplace_back(JsValue(shared_from_this(), v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
-    }
-  }
-  {
-    std::lock_guard<std::mutex> lock(jsWeakValuesListsMutex);
-    jsWeakValuesLists.erase(id.iterator);
-  }
+  JsContext context(*this);
+  // The values are got and removed under one lock, so they are taken once.
+  std::lock_guard<std::mutex> lock(jsWeakValuesSlotsMutex);
+  JsValueList retValue = GetJsValuesLocked(id);
+  jsWeakValuesSlots->Remove(id);
   return retValue;
 }
 
 JsValueList JsEngine::GetJsValues(const JsWeakValuesID& id)
 {
-  JsValueList retValue;
   JsContext context(*this);
-  for (const auto& v8Value : id.iterator->values)
+  std::lock_guard<std::mutex> lock(jsWeakValuesSlotsMutex);
+  return GetJsValuesLocked(id);
+}
+
+JsValueList JsEngine::GetJsValuesLocked(const JsWeakValuesID& id)
+{
+  JsValueList retValue;
+  auto jsEngine = shared_from_this();
+  jsWeakValuesSlots->Visit(id, [this, &retValue, &jsEngine](const v8::Global<v8::Value>& v8Value)
   {
-    retValue.emplace_back(JsValue(shared_from_this(), v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
-  }
+    retValue.emplace_back(JsValue(jsEngine, v8::Local<v8::Value>::New(GetIsolate(), v8Value)));
+  });
   return retValue;
 }
 
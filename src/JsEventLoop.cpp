@@ -0,0 +1,412 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include "JsEventLoop.h"
+#include "JsContext.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef MpscQueue<JsEventLoop::Task> Tasks;
+  typedef std::shared_ptr<Tasks> TasksPtr;
+
+  // The reader of a file waits while the chunks passed by it to the event
+  // loop but not processed yet take more than this size.
+  const size_t MAX_QUEUED_CHUNKS_SIZE = 1024 * 1024;
+
+  // Shared by the thread reading a file and the tasks posted by it.
+  class ReadChunksState
+  {
+  public:
+    ReadChunksState(const std::weak_ptr<JsEngine>& jsEngine, std::thread::id loopThreadId)
+      : jsEngine(jsEngine), loopThreadId(loopThreadId), queuedSize(0), isFinished(false)
+    {
+    }
+
+    // Waits until the chunk fits into the queue, returns false if the
+    // reading should stop because it is finished or the event loop is gone.
+    bool Reserve(size_t size)
+    {
+      bool canWait = CanWait();
+      std::unique_lock<std::mutex> lock(mutex);
+      if (canWait)
+      {
+        condition.wait(lock, [this, size]
+        {
+          return isFinished || jsEngine.expired() || queuedSize == 0 ||
+            queuedSize + size <= MAX_QUEUED_CHUNKS_SIZE;
+        });
+      }
+      if (isFinished || jsEngine.expired())
+        return false;
+      queuedSize += size;
+      return true;
+    }
+
+    void Release(size_t size)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queuedSize -= size;
+      condition.notify_all();
+    }
+
+    // Returns false if it is already finished, so only the first end or
+    // error is reported.
+    bool Finish()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (isFinished)
+        return false;
+      isFinished = true;
+      condition.notify_all();
+      return true;
+    }
+
+    bool IsFinished()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return isFinished;
+    }
+  private:
+    // The event loop can't process chunks while the reader runs in its thread
+    // or holds the isolate lock, e.g. if the file system is synchronous.
+    bool CanWait() const
+    {
+      if (std::this_thread::get_id() == loopThreadId)
+        return false;
+      auto lockedJsEngine = jsEngine.lock();
+      return lockedJsEngine && !v8::Locker::IsLocked(lockedJsEngine->GetIsolate());
+    }
+
+    std::weak_ptr<JsEngine> jsEngine;
+    std::thread::id loopThreadId;
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t queuedSize;
+    bool isFinished;
+  };
+  typedef std::shared_ptr<ReadChunksState> ReadChunksStatePtr;
+
+  // A copy of a read chunk, the chunk passed to the callback is valid only
+  // during the call. Its size is released when the task holding it is
+  // executed or discarded.
+  struct QueuedChunk
+  {
+    QueuedChunk(const ReadChunksStatePtr& state, const uint8_t* data, size_t size)
+      : state(state), data(data, data + size)
+    {
+    }
+
+    ~QueuedChunk()
+    {
+      state->Release(data.size());
+    }
+
+    ReadChunksStatePtr state;
+    IFileSystem::IOBuffer data;
+  };
+
+  IFileSystem::Callback PostCallback(const TasksPtr& tasks, const IFileSystem::Callback& callback)
+  {
+    return [tasks, callback](const std::string& error)
+    {
+      tasks->Push([callback, error]
+      {
+        callback(error);
+      });
+    };
+  }
+
+  class EventLoopFileWriter : public IFileSystem::IFileWriter
+  {
+  public:
+    EventLoopFileWriter(const TasksPtr& tasks, const IFileSystem::FileWriterPtr& writer)
+      : tasks(tasks), writer(writer)
+    {
+    }
+
+    void Append(const IFileSystem::IOBuffer& data, const IFileSystem::Callback& callback) override
+    {
+      writer->Append(data, PostCallback(tasks, callback));
+    }
+
+    void Commit(const IFileSystem::Callback& callback) override
+    {
+      writer->Commit(PostCallback(tasks, callback));
+    }
+  private:
+    TasksPtr tasks;
+    IFileSystem::FileWriterPtr writer;
+  };
+
+  class EventLoopFileSystem : public IFileSystem
+  {
+  public:
+    EventLoopFileSystem(const TasksPtr& tasks, const std::weak_ptr<JsEngine>& jsEngine,
+                        std::thread::id loopThreadId, IFileSystem& fileSystem)
+      : tasks(tasks), jsEngine(jsEngine), loopThreadId(loopThreadId), fileSystem(fileSystem)
+    {
+    }
+
+    void Read(const std::string& fileName, const ReadCallback& doneCallback,
+              const Callback& errorCallback) const override
+    {
+      auto tasks = this->tasks;
+      fileSystem.Read(fileName, [tasks, doneCallback](IOBuffer&& content)
+        {
+          auto sharedContent = std::make_shared<IOBuffer>(std::move(content));
+          tasks->Push([doneCallback, sharedContent]
+          {
+            doneCallback(std::move(*sharedContent));
+          });
+        }, PostCallback(tasks, errorCallback));
+    }
+
+    void ReadBuffer(const std::string& fileName, const ReadBufferCallback& doneCallback,
+                    const Callback& errorCallback) const override
+    {
+      auto tasks = this->tasks;
+      fileSystem.ReadBuffer(fileName, [tasks, doneCallback](const ReadOnlyBufferPtr& content)
+        {
+          tasks->Push([doneCallback, content]
+          {
+            doneCallback(content);
+          });
+        }, PostCallback(tasks, errorCallback));
+    }
+
+    void ReadChunks(const std::string& fileName, const ReadChunkCallback& chunkCallback,
+                    const ReadEndCallback& endCallback, const Callback& errorCallback) const override
+    {
+      auto tasks = this->tasks;
+      auto state = std::make_shared<ReadChunksState>(jsEngine, loopThreadId);
+      // An exception thrown by the chunk or end callback is reported to
+      // errorCallback, the rest of the file is not read then.
+      auto reportError = [state, errorCallback](const std::string& error)
+      {
+        if (state->Finish())
+          errorCallback(error);
+      };
+      fileSystem.ReadChunks(fileName, [tasks, state, chunkCallback, reportError](const uint8_t* data, size_t size)
+        {
+          if (!state->Reserve(size))
+            throw std::runtime_error("Reading is stopped");
+          auto chunk = std::make_shared<QueuedChunk>(state, data, size);
+          tasks->Push([state, chunk, chunkCallback, reportError]
+          {
+            if (state->IsFinished())
+              return;
+            try
+            {
+              chunkCallback(chunk->data.data(), chunk->data.size());
+            }
+            catch (const std::exception& e)
+            {
+              reportError(e.what());
+            }
+          });
+        }, [tasks, state, endCallback, reportError]
+        {
+          tasks->Push([state, endCallback, reportError]
+          {
+            if (state->IsFinished())
+              return;
+            try
+            {
+              endCallback();
+              state->Finish();
+            }
+            catch (const std::exception& e)
+            {
+              reportError(e.what());
+            }
+          });
+        }, [tasks, reportError](const std::string& error)
+        {
+          tasks->Push([reportError, error]
+          {
+            reportError(error);
+          });
+        });
+    }
+
+    void Write(const std::string& fileName, const IOBuffer& data,
+               const Callback& callback) override
+    {
+      fileSystem.Write(fileName, data, PostCallback(tasks, callback));
+    }
+
+    void Append(const std::string& fileName, const IOBuffer& data,
+                const Callback& callback) override
+    {
+      fileSystem.Append(fileName, data, PostCallback(tasks, callback));
+    }
+
+    void OpenForWrite(const std::string& fileName,
+                      const OpenForWriteCallback& callback) override
+    {
+      auto tasks = this->tasks;
+      fileSystem.OpenForWrite(fileName, [tasks, callback](const FileWriterPtr& writer, const std::string& error)
+        {
+          FileWriterPtr wrappedWriter;
+          if (writer)
+            wrappedWriter = std::make_shared<EventLoopFileWriter>(tasks, writer);
+          tasks->Push([callback, wrappedWriter, error]
+          {
+            callback(wrappedWriter, error);
+          });
+        });
+    }
+
+    void Move(const std::string& fromFileName, const std::string& toFileName,
+              const Callback& callback) override
+    {
+      fileSystem.Move(fromFileName, toFileName, PostCallback(tasks, callback));
+    }
+
+    void Remove(const std::string& fileName, const Callback& callback) override
+    {
+      fileSystem.Remove(fileName, PostCallback(tasks, callback));
+    }
+
+    void Stat(const std::string& fileName, const StatCallback& callback) const override
+    {
+      auto tasks = this->tasks;
+      fileSystem.Stat(fileName, [tasks, callback](const StatResult& result, const std::string& error)
+        {
+          tasks->Push([callback, result, error]
+          {
+            callback(result, error);
+          });
+        });
+    }
+  private:
+    TasksPtr tasks;
+    std::weak_ptr<JsEngine> jsEngine;
+    std::thread::id loopThreadId;
+    IFileSystem& fileSystem;
+  };
+
+  class EventLoopWebRequest : public IWebRequest
+  {
+  public:
+    EventLoopWebRequest(const TasksPtr& tasks, IWebRequest& webRequest)
+      : tasks(tasks), webRequest(webRequest)
+    {
+    }
+
+    void GET(const std::string& url, const HeaderList& requestHeaders,
+             const GetCallback& getCallback) override
+    {
+      auto tasks = this->tasks;
+      webRequest.GET(url, requestHeaders, [tasks, getCallback](const ServerResponse& response)
+        {
+          tasks->Push([getCallback, response]
+          {
+            getCallback(response);
+          });
+        });
+    }
+  private:
+    TasksPtr tasks;
+    IWebRequest& webRequest;
+  };
+}
+
+JsEventLoop::JsEventLoop(const std::weak_ptr<JsEngine>& jsEngine)
+  : tasks(std::make_shared<Tasks>()), jsEngine(jsEngine)
+{
+  auto tasks = this->tasks;
+  thread = std::thread([tasks, jsEngine]
+  {
+    ThreadFunc(tasks, jsEngine);
+  });
+}
+
+JsEventLoop::~JsEventLoop()
+{
+  // an empty task stops the loop
+  tasks->Push(Task());
+  if (IsCurrentThread())
+    thread.detach();
+  else
+    thread.join();
+}
+
+void JsEventLoop::Post(const Task& task)
+{
+  if (task)
+    tasks->Push(task);
+}
+
+bool JsEventLoop::IsCurrentThread() const
+{
+  return std::this_thread::get_id() == thread.get_id();
+}
+
+void JsEventLoop::WithFileSystem(IFileSystem& fileSystem, const Platform::WithFileSystemCallback& callback)
+{
+  EventLoopFileSystem eventLoopFileSystem(tasks, jsEngine, thread.get_id(), fileSystem);
+  callback(eventLoopFileSystem);
+}
+
+void JsEventLoop::WithWebRequest(IWebRequest& webRequest, const Platform::WithWebRequestCallback& callback)
+{
+  EventLoopWebRequest eventLoopWebRequest(tasks, webRequest);
+  callback(eventLoopWebRequest);
+}
+
+void JsEventLoop::ThreadFunc(const std::shared_ptr<Tasks>& tasks, const std::weak_ptr<JsEngine>& weakJsEngine)
+{
+  Task task;
+  while (true)
+  {
+    tasks->Wait();
+    auto jsEngine = weakJsEngine.lock();
+    if (!jsEngine)
+      return DiscardTasks(*tasks);
+    // All already posted tasks are executed under one acquisition of the
+    // lock, the callbacks deferred by them run right before releasing it.
+    JsContext context(*jsEngine);
+    while (tasks->TryPop(task))
+    {
+      if (!task)
+        return DiscardTasks(*tasks);
+      try
+      {
+        task();
+      }
+      catch (...)
+      {
+        // do nothing, but the thread will be alive.
+      }
+      task = Task();
+    }
+    context.RunImmediateTasks();
+  }
+}
+
+void JsEventLoop::DiscardTasks(Tasks& tasks)
+{
+  // Releases what the tasks hold, e.g. read chunks a file reader waits for.
+  Task task;
+  while (tasks.TryPop(task))
+    task = Task();
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_JS_EVENT_LOOP_H
+#define ADBLOCK_PLUS_JS_EVENT_LOOP_H
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <AdblockPlus/MpscQueue.h>
+#include <AdblockPlus/Platform.h>
+
+namespace AdblockPlus
+{
+  class JsEngine;
+
+  /**
+   * The thread which executes all JS entering tasks of a `JsEngine`.
+   * Tasks posted in the meantime are executed in a batch under a single
+   * acquisition of the isolate lock.
+   */
+  class JsEventLoop
+  {
+  public:
+    typedef std::function<void()> Task;
+
+    explicit JsEventLoop(const std::weak_ptr<JsEngine>& jsEngine);
+
+    /**
+     * Destructor, the tasks which are not executed yet are discarded.
+     */
+    ~JsEventLoop();
+
+    /**
+     * Adds the `task` to the end of the queue, the caller is never blocked.
+     */
+    void Post(const Task& task);
+
+    /**
+     * Returns `true` if it's called from the event loop thread.
+     */
+    bool IsCurrentThread() const;
+
+    /**
+     * Calls `callback` with a wrapper of `fileSystem` which posts the
+     * completion callbacks to the event loop.
+     * A file reader waits while too many read chunks are not processed yet,
+     * unless it runs in the event loop thread or holds the isolate lock.
+     * If a chunk or end callback throws then the error callback is called
+     * with the error and the reading stops.
+     */
+    void WithFileSystem(IFileSystem& fileSystem, const Platform::WithFileSystemCallback& callback);
+
+    /**
+     * Calls `callback` with a wrapper of `webRequest` which posts the
+     * completion callbacks to the event loop.
+     */
+    void WithWebRequest(IWebRequest& webRequest, const Platform::WithWebRequestCallback& callback);
+  private:
+    typedef MpscQueue<Task> Tasks;
+
+    JsEventLoop(const JsEventLoop&) = delete;
+    JsEventLoop& operator=(const JsEventLoop&) = delete;
+    // It does not access the JsEventLoop instance because the JsEngine and
+    // consequently the event loop can be destroyed within the loop thread.
+    static void ThreadFunc(const std::shared_ptr<Tasks>& tasks, const std::weak_ptr<JsEngine>& weakJsEngine);
+    static void DiscardTasks(Tasks& tasks);
+  private:
+    std::shared_ptr<Tasks> tasks;
+    std::weak_ptr<JsEngine> jsEngine;
+    std::thread thread;
+  };
+}
+
+#endif
@@ -245,34 +245,49 @@ std::string AdblockPlus::JsValue::GetClass() const
 
 JsValue JsValue::Call(const JsValueList& params) const
 {
-  const JsContext context(*jsEngine);
-  std::vector<v8::Local<v8::Value>> argv;
-  for (const auto& param : params)
-    argv.push_back(param.UnwrapValue());
+  return jsEngine->RunInEventLoop<JsValue>([this, &params]
+  {
+    JsContext context(*jsEngine);
+    std::vector<v8::Local<v8::Value>> argv;
+    for (const auto& param : params)
+      argv.push_back(param.UnwrapValue());
 
-  return Call(argv, context.GetV8Context()->Global());
+    auto result = Call(argv, context.GetV8Context()->Global());
+    context.RunImmediateTasks();
+    return result;
+  });
 }
 
 JsValue JsValue::Call(const JsValueList& params, const JsValue& thisValue) const
 {
-  const JsContext context(*jsEngine);
-  v8::Local<v8::Object> thisObj = v8::Local<v8::Object>::Cast(thisValue.UnwrapValue());
+  return jsEngine->RunInEventLoop<JsValue>([this, &params, &thisValue]
+  {
+    JsContext context(*jsEngine);
+    v8::Local<v8::Object> thisObj = v8::Local<v8::Object>::Cast(thisValue.UnwrapValue());
 
-  std::vector<v8::Local<v8::Value>> argv;
-  for (const auto& param : params)
-    argv.push_back(param.UnwrapValue());
+    std::vector<v8::Local<v8::Value>> argv;
+    for (const auto& param : params)
+      argv.push_back(param.UnwrapValue());
 
-  return Call(argv, thisObj);
+    auto result = Call(argv, thisObj);
+    context.RunImmediateTasks();
+    return result;
+  });
 }
 
 JsValue JsValue::Call(const JsValue& arg) const
 {
-  const JsContext context(*jsEngine);
+  return jsEngine->RunInEventLoop<JsValue>([this, &arg]
+  {
+    JsContext context(*jsEngine);
 
-  std::vector<v8::Local<v8::Value>> argv;
-  argv.push_back(arg.UnwrapValue());
+    std::vector<v8::Local<v8::Value>> argv;
+    argv.push_back(arg.UnwrapValue());
 
-  return Call(argv, context.GetV8Context()->Global());
+    auto result = Call(argv, context.GetV8Context()->Global());
+    context.RunImmediateTasks();
+    return result;
+  });
 }
 
 JsValue JsValue::Call(std::vector<v8::Local<v8::Value>>& args, v8::Local<v8::Object> thisObj) const
@@ -282,7 +297,7 @@ JsValue JsValue::Call(std::vector<v8::Local<v8::Value>>& args, v8::Local<v8::Obj
   if (!thisObj->IsObject())
     throw std::runtime_error("`this` pointer has to be an object");
 
-  const JsContext context(*jsEngine);
+  JsContext context(*jsEngine);
 
   const v8::TryCatch tryCatch(jsEngine->GetIsolate());
   v8::Local<v8::Function> func = v8::Local<v8::Function>::Cast(UnwrapValue());
@@ -291,5 +306,7 @@ JsValue JsValue::Call(std::vector<v8::Local<v8::Value>>& args, v8::Local<v8::Obj
   if (tryCatch.HasCaught())
     throw JsError(jsEngine->GetIsolate(), tryCatch.Exception(), tryCatch.Message());
 
-  return JsValue(jsEngine, result);
+  JsValue value(jsEngine, result);
+  context.RunImmediateTasks();
+  return value;
 }
@@ -0,0 +1,509 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include "NativeMatcher.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Bytes allocated by a node based container for each element, besides the
+  // element, i.e. the links and the color or the cached hash.
+  const size_t NODE_OVERHEAD = 4 * sizeof(void*);
+
+  size_t GetStringMemoryUsage(const std::string& value)
+  {
+    // Short strings are stored in the object itself.
+    static const size_t inlineCapacity = std::string().capacity();
+    return value.capacity() > inlineCapacity ? value.capacity() + 1 : 0;
+  }
+
+  std::string ToLowerCase(std::string text)
+  {
+    for (auto& c : text)
+      c = ToLowerAscii(c);
+    return text;
+  }
+
+  bool EndsWith(const std::string& text, const std::string& suffix)
+  {
+    return text.size() >= suffix.size() &&
+      text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  bool IsWordCharacter(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') || c == '_';
+  }
+
+  // Matches the character class which `^` in filters is converted to.
+  bool IsSeparator(char c)
+  {
+    uint8_t code = static_cast<uint8_t>(c);
+    if (code >= 0x80)
+      return false;
+    return !(IsWordCharacter(c) || c == '%' || c == '-' || c == '.');
+  }
+
+  // Options which only change the content types of a filter, those are
+  // already part of the content type mask.
+  bool IsContentTypeOption(const std::string& option)
+  {
+    static const char* const options[] = {
+      "other", "script", "image", "stylesheet", "object", "subdocument",
+      "document", "websocket", "webrtc", "popup", "ping", "xmlhttprequest",
+      "object-subrequest", "object_subrequest", "media", "font", "elemhide",
+      "generichide", "genericblock", "background", "xbl", "dtd", "collapse"
+    };
+    return std::find(std::begin(options), std::end(options), option) != std::end(options);
+  }
+
+  bool ParseDomains(const std::string& value, std::map<std::string, bool>& domains)
+  {
+    bool hasIncludes = false;
+    size_t start = 0;
+    while (start <= value.size())
+    {
+      size_t end = std::min(value.find('|', start), value.size());
+      std::string domain = ToLowerCase(value.substr(start, end - start));
+      start = end + 1;
+      bool isIncluded = true;
+      if (!domain.empty() && domain[0] == '~')
+      {
+        isIncluded = false;
+        domain.erase(0, 1);
+      }
+      // Empty entries are treated differently by the JavaScript parser
+      // depending on the number of domains.
+      if (domain.empty() || !IsAscii(domain))
+        return false;
+      hasIncludes = hasIncludes || isIncluded;
+      domains[domain] = isIncluded;
+    }
+    domains[""] = !hasIncludes;
+    return true;
+  }
+
+  // Checks whether `text` is a list of options from `start` to its end, like
+  // `Filter.optionsRegExp` of the JavaScript parser expects it.
+  bool IsOptionList(const std::string& text, size_t start)
+  {
+    size_t position = start;
+    while (true)
+    {
+      if (position < text.size() && text[position] == '~')
+        ++position;
+      size_t nameStart = position;
+      while (position < text.size() &&
+             (IsWordCharacter(text[position]) || text[position] == '-'))
+        ++position;
+      if (position == nameStart)
+        return false;
+      if (position < text.size() && text[position] == '=')
+        position = std::min(text.find(',', position), text.size());
+      if (position == text.size())
+        return true;
+      if (text[position] != ',')
+        return false;
+      ++position;
+    }
+  }
+
+  bool ParseOptions(const std::string& options, NativeFilter& filter, bool& matchCase)
+  {
+    size_t start = 0;
+    while (start <= options.size())
+    {
+      size_t end = std::min(options.find(',', start), options.size());
+      std::string option = options.substr(start, end - start);
+      start = end + 1;
+
+      size_t valueStart = option.find('=');
+      std::string name = ToLowerCase(option.substr(0, valueStart));
+      if (valueStart != std::string::npos)
+      {
+        if (name != "domain" || !ParseDomains(option.substr(valueStart + 1), filter.domains))
+          return false;
+        continue;
+      }
+      bool isInverse = !name.empty() && name[0] == '~';
+      if (isInverse)
+        name.erase(0, 1);
+      if (name == "match-case")
+        matchCase = !isInverse;
+      else if (!IsContentTypeOption(name))
+        return false;
+    }
+    return true;
+  }
+}
+
+bool NativeFilter::Parse(const std::string& text, uint32_t contentTypeMask,
+                         bool isException, const std::string& keyword,
+                         size_t patternStatesBudget, NativeFilter& filter)
+{
+  filter.text = text;
+  filter.isException = isException;
+  filter.contentTypeMask = contentTypeMask;
+  filter.anchors = 0;
+  filter.domains.clear();
+  filter.literal.clear();
+  filter.pattern.reset();
+  filter.hasKeyword = !keyword.empty();
+  filter.keywordHash = filter.hasKeyword ? UrlTokenizer::HashKeyword(keyword) : 0;
+
+  std::string pattern = text;
+  if (pattern.compare(0, 2, "@@") == 0)
+    pattern.erase(0, 2);
+
+  // Options follow a `$` and run to the end of the filter, other `$` like
+  // the end anchor of a regular expression are part of the pattern. Option
+  // values can contain `$` as well, so filters where more than one `$`
+  // qualifies are left to the JavaScript parser.
+  bool matchCase = false;
+  size_t optionsStart = std::string::npos;
+  for (size_t position = pattern.find('$'); position != std::string::npos;
+       position = pattern.find('$', position + 1))
+  {
+    if (!IsOptionList(pattern, position + 1))
+      continue;
+    if (optionsStart != std::string::npos)
+      return false;
+    optionsStart = position;
+  }
+  if (optionsStart != std::string::npos)
+  {
+    if (!ParseOptions(pattern.substr(optionsStart + 1), filter, matchCase))
+      return false;
+    pattern.erase(optionsStart);
+  }
+
+  if (pattern.size() >= 2 && pattern.front() == '/' && pattern.back() == '/')
+  {
+    filter.pattern = PatternAutomaton::FromRegExp(
+      pattern.substr(1, pattern.size() - 2), matchCase, patternStatesBudget);
+    return filter.pattern != nullptr;
+  }
+  if (!IsAscii(pattern))
+    return false;
+  // The Aho-Corasick automaton is case-insensitive.
+  if (matchCase || !ParseLiteral(pattern, filter))
+  {
+    filter.anchors = 0;
+    filter.pattern = PatternAutomaton::FromFilterPattern(pattern, matchCase,
+                                                         patternStatesBudget);
+    return filter.pattern != nullptr;
+  }
+  return true;
+}
+
+bool NativeFilter::ParseLiteral(std::string pattern, NativeFilter& filter)
+{
+  if (pattern.compare(0, 2, "||") == 0)
+  {
+    filter.anchors |= ANCHOR_DOMAIN;
+    pattern.erase(0, 2);
+  }
+  else if (pattern.compare(0, 1, "|") == 0)
+  {
+    filter.anchors |= ANCHOR_START;
+    pattern.erase(0, 1);
+  }
+
+  // An end anchor after a separator is ignored.
+  if (EndsWith(pattern, "^|"))
+    pattern.erase(pattern.size() - 1);
+  else if (EndsWith(pattern, "|"))
+  {
+    filter.anchors |= ANCHOR_END;
+    pattern.erase(pattern.size() - 1);
+  }
+  if (EndsWith(pattern, "^"))
+  {
+    filter.anchors |= ANCHOR_SEPARATOR_AFTER;
+    pattern.erase(pattern.size() - 1);
+  }
+
+  if (pattern.empty() || pattern.find_first_of("*^|") != std::string::npos)
+    return false;
+  filter.literal = ToLowerCase(pattern);
+  return true;
+}
+
+bool AdblockPlus::LiteralMatchesAt(const std::string& url, size_t begin, size_t end,
+                                   uint32_t anchors)
+{
+  if ((anchors & ANCHOR_START) && begin != 0)
+    return false;
+  if ((anchors & ANCHOR_END) && end != url.size())
+    return false;
+  if ((anchors & ANCHOR_SEPARATOR_AFTER) && end != url.size() && !IsSeparator(url[end]))
+    return false;
+  if (anchors & ANCHOR_DOMAIN)
+  {
+    // ^[\w\-]+:\/+(?!\/)(?:[^\/]+\.)?
+    size_t schemeEnd = 0;
+    while (schemeEnd < url.size() && (IsWordCharacter(url[schemeEnd]) || url[schemeEnd] == '-'))
+      ++schemeEnd;
+    if (schemeEnd == 0 || schemeEnd >= url.size() || url[schemeEnd] != ':')
+      return false;
+    size_t hostStart = schemeEnd + 1;
+    while (hostStart < url.size() && url[hostStart] == '/')
+      ++hostStart;
+    if (hostStart == schemeEnd + 1)
+      return false;
+    if (begin == hostStart)
+      return true;
+    return begin > hostStart + 1 && url[begin - 1] == '.' &&
+      url.find('/', hostStart) >= begin - 1;
+  }
+  return true;
+}
+
+bool NativeFilter::IsActiveOnDomain(const std::string& documentHost) const
+{
+  if (domains.empty())
+    return true;
+  return AdblockPlus::IsActiveOnDomain(documentHost, domains.at(""),
+    [this](const std::string& domain, bool& isIncluded)
+    {
+      auto entry = domains.find(domain);
+      if (entry == domains.end())
+        return false;
+      isIncluded = entry->second;
+      return true;
+    });
+}
+
+AhoCorasickAutomaton::AhoCorasickAutomaton(const std::vector<std::string>& keywords)
+{
+  // The trie is built with ordered children first, then flattened.
+  std::vector<std::map<char, uint32_t>> children(1);
+  std::vector<std::vector<uint32_t>> keywordIndexes(1);
+  for (size_t i = 0; i < keywords.size(); ++i)
+  {
+    uint32_t state = 0;
+    for (char c : keywords[i])
+    {
+      auto child = children[state].find(c);
+      if (child == children[state].end())
+      {
+        uint32_t newState = static_cast<uint32_t>(children.size());
+        children[state][c] = newState;
+        children.emplace_back();
+        keywordIndexes.emplace_back();
+        state = newState;
+      }
+      else
+        state = child->second;
+    }
+    keywordIndexes[state].push_back(static_cast<uint32_t>(i));
+  }
+
+  states.resize(children.size());
+  for (size_t state = 0; state < children.size(); ++state)
+  {
+    State& current = states[state];
+    current.firstTransition = static_cast<uint32_t>(transitions.size());
+    current.transitionsNumber = static_cast<uint32_t>(children[state].size());
+    for (const auto& child : children[state])
+      transitions.push_back(Transition{child.first, child.second});
+    current.firstOutput = static_cast<uint32_t>(outputs.size());
+    current.outputsNumber = static_cast<uint32_t>(keywordIndexes[state].size());
+    outputs.insert(outputs.end(), keywordIndexes[state].begin(), keywordIndexes[state].end());
+    current.failure = 0;
+    current.dictionarySuffix = 0;
+  }
+
+  rootTransitions.fill(0);
+  for (const auto& child : children[0])
+  {
+    if (static_cast<uint8_t>(child.first) < ALPHABET_SIZE)
+      rootTransitions[static_cast<uint8_t>(child.first)] = child.second;
+  }
+
+  // Failure links are computed breadth-first, so the ones of shorter
+  // prefixes are already known.
+  Tables tables = GetTables();
+  std::deque<uint32_t> queue;
+  for (const auto& child : children[0])
+    queue.push_back(child.second);
+  while (!queue.empty())
+  {
+    uint32_t state = queue.front();
+    queue.pop_front();
+    for (const auto& child : children[state])
+    {
+      uint32_t failure = tables.Next(states[state].failure, child.first);
+      states[child.second].failure = failure;
+      states[child.second].dictionarySuffix = states[failure].outputsNumber ?
+        failure : states[failure].dictionarySuffix;
+      queue.push_back(child.second);
+    }
+  }
+}
+
+AhoCorasickAutomaton::Tables AhoCorasickAutomaton::GetTables() const
+{
+  Tables tables;
+  tables.states = states.data();
+  tables.statesNumber = states.size();
+  tables.transitions = transitions.data();
+  tables.transitionsNumber = transitions.size();
+  tables.outputs = outputs.data();
+  tables.outputsNumber = outputs.size();
+  tables.rootTransitions = rootTransitions.data();
+  return tables;
+}
+
+uint32_t AhoCorasickAutomaton::Tables::Next(uint32_t state, char character) const
+{
+  if (static_cast<uint8_t>(character) >= ALPHABET_SIZE)
+    return 0;
+  while (state)
+  {
+    const State& current = states[state];
+    auto begin = transitions + current.firstTransition;
+    auto end = begin + current.transitionsNumber;
+    auto transition = std::lower_bound(begin, end, character,
+      [](const Transition& transition, char character)
+      {
+        return transition.character < character;
+      });
+    if (transition != end && transition->character == character)
+      return transition->target;
+    state = current.failure;
+  }
+  return rootTransitions[static_cast<uint8_t>(character)];
+}
+
+size_t NativeFilter::GetMemoryUsage() const
+{
+  size_t memoryUsage = GetStringMemoryUsage(text) + GetStringMemoryUsage(literal);
+  for (const auto& domain : domains)
+    memoryUsage += NODE_OVERHEAD + sizeof(domain) + GetStringMemoryUsage(domain.first);
+  if (pattern)
+    memoryUsage += pattern->GetMemoryUsage();
+  return memoryUsage;
+}
+
+size_t AhoCorasickAutomaton::GetMemoryUsage() const
+{
+  return sizeof(*this) + states.capacity() * sizeof(State) +
+    transitions.capacity() * sizeof(Transition) +
+    outputs.capacity() * sizeof(uint32_t);
+}
+
+namespace
+{
+  std::vector<uint32_t> GetLiteralFilterIndexes(const std::vector<NativeFilter>& filters)
+  {
+    std::vector<uint32_t> filterIndexes;
+    for (size_t i = 0; i < filters.size(); ++i)
+    {
+      if (!filters[i].pattern)
+        filterIndexes.push_back(static_cast<uint32_t>(i));
+    }
+    return filterIndexes;
+  }
+
+  std::vector<std::string> GetLiterals(const std::vector<NativeFilter>& filters,
+                                       const std::vector<uint32_t>& filterIndexes)
+  {
+    std::vector<std::string> literals;
+    literals.reserve(filterIndexes.size());
+    for (uint32_t filterIndex : filterIndexes)
+      literals.push_back(filters[filterIndex].literal);
+    return literals;
+  }
+}
+
+NativeFilterMatcher::NativeFilterMatcher(std::vector<NativeFilter>&& filters)
+  : filters(std::move(filters)), contentTypeMask(0),
+    literalFilterIndexes(GetLiteralFilterIndexes(this->filters)),
+    automaton(GetLiterals(this->filters, literalFilterIndexes)),
+    patternContentTypeMask(0)
+{
+  for (size_t i = 0; i < this->filters.size(); ++i)
+  {
+    const NativeFilter& filter = this->filters[i];
+    contentTypeMask |= filter.contentTypeMask;
+    if (!filter.pattern)
+      continue;
+    patternContentTypeMask |= filter.contentTypeMask;
+    if (filter.hasKeyword)
+      patternFilterIndexes[filter.keywordHash].push_back(static_cast<uint32_t>(i));
+    else
+      unconditionalPatternFilterIndexes.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+size_t NativeFilterMatcher::GetMemoryUsage() const
+{
+  size_t memoryUsage = sizeof(*this) - sizeof(automaton) + automaton.GetMemoryUsage() +
+    filters.capacity() * sizeof(NativeFilter) +
+    literalFilterIndexes.capacity() * sizeof(uint32_t) +
+    unconditionalPatternFilterIndexes.capacity() * sizeof(uint32_t) +
+    patternFilterIndexes.bucket_count() * sizeof(void*);
+  for (const auto& entry : patternFilterIndexes)
+  {
+    memoryUsage += NODE_OVERHEAD + sizeof(entry) +
+      entry.second.capacity() * sizeof(uint32_t);
+  }
+  for (const auto& filter : filters)
+    memoryUsage += filter.GetMemoryUsage();
+  return memoryUsage;
+}
+
+std::string AdblockPlus::ExtractHostFromUrl(const std::string& url)
+{
+  size_t schemeEnd = url.find(':');
+  if (schemeEnd == std::string::npos || url.compare(schemeEnd + 1, 2, "//") != 0)
+    return std::string();
+  size_t hostPortStart = schemeEnd + 3;
+  if (hostPortStart == url.size())
+    return std::string();
+
+  size_t hostPortEnd = url.find('/', hostPortStart);
+  if (hostPortEnd == std::string::npos)
+    hostPortEnd = std::min(url.find_first_of("?#", hostPortStart), url.size());
+
+  size_t authEnd = url.find('@', hostPortStart);
+  if (authEnd != std::string::npos && authEnd < hostPortEnd)
+    hostPortStart = authEnd + 1;
+
+  size_t hostStart = hostPortStart;
+  size_t hostEnd = url.find(']', hostPortStart + 1);
+  if (hostPortStart < url.size() && url[hostPortStart] == '[' &&
+      hostEnd != std::string::npos && hostEnd < hostPortEnd)
+  {
+    // The host is an IPv6 literal.
+    hostStart = hostPortStart + 1;
+  }
+  else
+  {
+    hostEnd = url.find(':', hostStart);
+    if (hostEnd == std::string::npos || hostEnd >= hostPortEnd)
+      hostEnd = hostPortEnd;
+  }
+  return url.substr(hostStart, hostEnd - hostStart);
+}
@@ -0,0 +1,418 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_NATIVE_MATCHER_H
+#define ADBLOCK_PLUS_NATIVE_MATCHER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "PatternAutomaton.h"
+#include "UrlTokenizer.h"
+
+namespace AdblockPlus
+{
+  // Anchors of a literal pattern, see `LiteralMatchesAt()`.
+  const uint32_t ANCHOR_START = 1;
+  const uint32_t ANCHOR_DOMAIN = 2;
+  const uint32_t ANCHOR_END = 4;
+  const uint32_t ANCHOR_SEPARATOR_AFTER = 8;
+
+  /*
+   * Request filter whose pattern and options can be matched without the
+   * JavaScript matcher. Literal patterns with optional `|`, `||` and
+   * trailing `^` anchors are found with an Aho-Corasick automaton, other
+   * wildcard and regular expression patterns get a PatternAutomaton.
+   * Options are content types, `match-case` and `domain`.
+   */
+  struct NativeFilter
+  {
+    std::string text;
+    bool isException;
+    uint32_t contentTypeMask;
+    // Lower-cased literal part of the pattern, empty for pattern filters.
+    std::string literal;
+    // ANCHOR_* flags of the literal.
+    uint32_t anchors;
+    // Lower-cased domains with the value `true` if the filter is active on
+    // them, the entry for "" applies to all other domains. It's empty if the
+    // filter is active everywhere.
+    std::map<std::string, bool> domains;
+    // Automaton of a wildcard or regular expression pattern, nullptr for
+    // literal patterns.
+    PatternAutomatonPtr pattern;
+    // Pattern filters are only checked for URLs containing the keyword the
+    // JavaScript matcher files them under, like the JavaScript matcher does.
+    bool hasKeyword;
+    uint64_t keywordHash;
+
+    /*
+     * Parses the filter text, returns `false` if the filter has to be
+     * matched by the JavaScript matcher.
+     * @param keyword Keyword of the filter in the JavaScript matcher.
+     * @param patternStatesBudget Maximum number of states of the automaton
+     *        of a wildcard or regular expression pattern.
+     */
+    static bool Parse(const std::string& text, uint32_t contentTypeMask,
+                      bool isException, const std::string& keyword,
+                      size_t patternStatesBudget, NativeFilter& filter);
+
+    /*
+     * Parses a pattern without options as a literal with anchors, returns
+     * `false` if it has wildcards.
+     */
+    static bool ParseLiteral(std::string pattern, NativeFilter& filter);
+
+    /*
+     * Checks the `domain` option, `documentHost` is lower-cased ASCII.
+     */
+    bool IsActiveOnDomain(const std::string& documentHost) const;
+
+    /*
+     * Retrieves the number of heap bytes used by the strings, the domains
+     * and the automaton of the filter, the struct itself isn't included.
+     */
+    size_t GetMemoryUsage() const;
+  };
+
+  /*
+   * Aho-Corasick automaton finding all occurrences of lower-cased ASCII
+   * keywords in one pass over a text, it's immutable once built.
+   */
+  class AhoCorasickAutomaton
+  {
+  public:
+    struct State
+    {
+      uint32_t firstTransition;
+      uint32_t transitionsNumber;
+      uint32_t failure;
+      uint32_t firstOutput;
+      uint32_t outputsNumber;
+      // Nearest state on the failure chain which has outputs, 0 if none.
+      uint32_t dictionarySuffix;
+    };
+
+    struct Transition
+    {
+      char character;
+      uint32_t target;
+    };
+
+    static const size_t ALPHABET_SIZE = 128;
+
+    /*
+     * Arrays of an automaton, which don't need to be owned by one, e.g.
+     * ones stored in a compiled filter list.
+     */
+    struct Tables
+    {
+      const State* states;
+      size_t statesNumber;
+      // Sorted by character for every state.
+      const Transition* transitions;
+      size_t transitionsNumber;
+      const uint32_t* outputs;
+      size_t outputsNumber;
+      // ALPHABET_SIZE transitions of the root state.
+      const uint32_t* rootTransitions;
+
+      uint32_t Next(uint32_t state, char character) const;
+
+      /*
+       * Calls `callback(output, end)` for every occurrence of a keyword
+       * ending before `end` of `text`, the text is lower-cased on the fly.
+       * Stops early if `callback` returns `false`.
+       */
+      template<typename Callback>
+      void ForEachMatch(const std::string& text, Callback&& callback) const;
+    };
+
+    explicit AhoCorasickAutomaton(const std::vector<std::string>& keywords);
+
+    /*
+     * Calls `callback(keywordIndex, end)` like `Tables::ForEachMatch()`.
+     */
+    template<typename Callback>
+    void ForEachMatch(const std::string& text, Callback&& callback) const
+    {
+      GetTables().ForEachMatch(text, std::forward<Callback>(callback));
+    }
+
+    Tables GetTables() const;
+
+    size_t GetMemoryUsage() const;
+  private:
+    std::vector<State> states;
+    std::vector<Transition> transitions;
+    std::vector<uint32_t> outputs;
+    std::array<uint32_t, ALPHABET_SIZE> rootTransitions;
+  };
+
+  /*
+   * Native filters, literal ones with the automaton built from their
+   * literals and pattern filters by their keywords.
+   */
+  class NativeFilterMatcher
+  {
+  public:
+    explicit NativeFilterMatcher(std::vector<NativeFilter>&& filters);
+
+    /*
+     * Calls `callback(filterIndex, filter)` for every filter of
+     * `contentTypes` whose pattern matches `url`, which has to be ASCII.
+     * Other options aren't checked. Stops early if `callback` returns
+     * `false`.
+     */
+    template<typename Callback>
+    void ForEachMatch(const std::string& url, uint32_t contentTypes,
+                      Callback&& callback) const;
+
+    const std::vector<NativeFilter>& GetFilters() const
+    {
+      return filters;
+    }
+
+    // Union of the content types of the filters.
+    uint32_t GetContentTypeMask() const
+    {
+      return contentTypeMask;
+    }
+
+    size_t GetMemoryUsage() const;
+  private:
+    std::vector<NativeFilter> filters;
+    uint32_t contentTypeMask;
+    // Filter indexes by the keyword indexes of the automaton.
+    std::vector<uint32_t> literalFilterIndexes;
+    AhoCorasickAutomaton automaton;
+    // Content types of the pattern filters.
+    uint32_t patternContentTypeMask;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> patternFilterIndexes;
+    std::vector<uint32_t> unconditionalPatternFilterIndexes;
+  };
+
+  /*
+   * Extracts the host like `extractHostFromURL()` of lib/basedomain.js.
+   */
+  std::string ExtractHostFromUrl(const std::string& url);
+
+  inline char ToLowerAscii(char c)
+  {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  inline bool IsAscii(const std::string& text)
+  {
+    return std::all_of(text.begin(), text.end(), [](char c)
+    {
+      return static_cast<uint8_t>(c) < 0x80;
+    });
+  }
+
+  /*
+   * Checks the ANCHOR_* flags of a literal found at [begin, end) of `url`.
+   */
+  bool LiteralMatchesAt(const std::string& url, size_t begin, size_t end,
+                        uint32_t anchors);
+
+  /*
+   * Checks the `domain` option like `ActiveFilter.isActiveOnDomain()`, the
+   * entry of the longest suffix of `documentHost` applies.
+   * `findDomain(domain, isIncluded)` returns `false` if there is no entry
+   * for `domain`, `isActiveByDefault` applies then.
+   */
+  template<typename FindDomain>
+  bool IsActiveOnDomain(const std::string& documentHost, bool isActiveByDefault,
+                        FindDomain&& findDomain)
+  {
+    std::string domain = documentHost;
+    while (!domain.empty() && domain.back() == '.')
+      domain.pop_back();
+    while (!domain.empty())
+    {
+      bool isIncluded;
+      if (findDomain(domain, isIncluded))
+        return isIncluded;
+      size_t nextDot = domain.find('.');
+      if (nextDot == std::string::npos)
+        break;
+      domain.erase(0, nextDot + 1);
+    }
+    return isActiveByDefault;
+  }
+
+  /*
+   * Picks the native filter which decides a request among the ones whose
+   * pattern matches, like the JavaScript matcher does: an exception filter
+   * takes precedence, otherwise the first blocking filter applies. The
+   * document host is only extracted once a filter with the `domain` option
+   * is checked.
+   */
+  template<typename Filter>
+  class NativeMatchSelector
+  {
+  public:
+    NativeMatchSelector(uint32_t contentTypes, const std::string& documentUrl)
+      : contentTypes(contentTypes), documentUrl(documentUrl)
+      , isDocumentHostKnown(false), isUnknown(false)
+      , blockingFilter(nullptr), exceptionFilter(nullptr)
+    {
+    }
+
+    /*
+     * Checks the content types and the domains of a filter whose pattern
+     * matches, `isActiveOnDomain(documentHost)` is only called for filters
+     * with domains. Returns `false` once the result is decided.
+     */
+    template<typename IsActiveOnDomain>
+    bool Check(const Filter& filter, uint32_t contentTypeMask, bool isException,
+               bool hasDomains, IsActiveOnDomain&& isActiveOnDomain)
+    {
+      if (!(contentTypeMask & contentTypes))
+        return true;
+      if (hasDomains)
+      {
+        if (!isDocumentHostKnown)
+        {
+          documentHost = ExtractHostFromUrl(documentUrl);
+          for (auto& c : documentHost)
+            c = ToLowerAscii(c);
+          isDocumentHostKnown = true;
+        }
+        if (!IsAscii(documentHost))
+        {
+          isUnknown = true;
+          return false;
+        }
+        if (!isActiveOnDomain(documentHost))
+          return true;
+      }
+      if (isException)
+      {
+        exceptionFilter = &filter;
+        return false;
+      }
+      if (!blockingFilter)
+        blockingFilter = &filter;
+      return true;
+    }
+
+    bool IsDecided() const
+    {
+      return exceptionFilter || isUnknown;
+    }
+
+    // The document host isn't ASCII, so the JavaScript matcher has to
+    // decide.
+    bool IsUnknown() const
+    {
+      return isUnknown;
+    }
+
+    // Returns nullptr if no filter applies.
+    const Filter* GetFilter() const
+    {
+      return exceptionFilter ? exceptionFilter : blockingFilter;
+    }
+  private:
+    uint32_t contentTypes;
+    const std::string& documentUrl;
+    std::string documentHost;
+    bool isDocumentHostKnown;
+    bool isUnknown;
+    const Filter* blockingFilter;
+    const Filter* exceptionFilter;
+  };
+
+  template<typename Callback>
+  void AhoCorasickAutomaton::Tables::ForEachMatch(const std::string& text,
+                                                  Callback&& callback) const
+  {
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+      state = Next(state, ToLowerAscii(text[i]));
+      uint32_t outputState = states[state].outputsNumber ? state : states[state].dictionarySuffix;
+      for (; outputState; outputState = states[outputState].dictionarySuffix)
+      {
+        const State& current = states[outputState];
+        for (uint32_t output = current.firstOutput;
+             output < current.firstOutput + current.outputsNumber; ++output)
+        {
+          if (!callback(outputs[output], i + 1))
+            return;
+        }
+      }
+    }
+  }
+
+  template<typename Callback>
+  void NativeFilterMatcher::ForEachMatch(const std::string& url,
+    uint32_t contentTypes, Callback&& callback) const
+  {
+    bool isStopped = false;
+    automaton.ForEachMatch(url, [&](uint32_t keywordIndex, size_t end)
+    {
+      uint32_t filterIndex = literalFilterIndexes[keywordIndex];
+      const NativeFilter& filter = filters[filterIndex];
+      if (!(filter.contentTypeMask & contentTypes) ||
+          !LiteralMatchesAt(url, end - filter.literal.size(), end, filter.anchors))
+        return true;
+      isStopped = !callback(filterIndex, filter);
+      return !isStopped;
+    });
+    if (isStopped || !(patternContentTypeMask & contentTypes))
+      return;
+
+    // Automata are only run once the cheaper checks passed.
+    auto checkPatternFilter = [&](uint32_t filterIndex)
+    {
+      const NativeFilter& filter = filters[filterIndex];
+      if (!(filter.contentTypeMask & contentTypes) || !filter.pattern->Matches(url))
+        return true;
+      return static_cast<bool>(callback(filterIndex, filter));
+    };
+    for (uint32_t filterIndex : unconditionalPatternFilterIndexes)
+    {
+      if (!checkPatternFilter(filterIndex))
+        return;
+    }
+    if (patternFilterIndexes.empty())
+      return;
+    UrlTokenizer::ForEachKeywordHash(url, [&](uint64_t keywordHash)
+    {
+      auto entry = patternFilterIndexes.find(keywordHash);
+      if (entry == patternFilterIndexes.end())
+        return true;
+      for (uint32_t filterIndex : entry->second)
+      {
+        if (!checkPatternFilter(filterIndex))
+          return false;
+      }
+      return true;
+    });
+  }
+}
+
+#endif
@@ -0,0 +1,870 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "PatternAutomaton.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef PatternAutomaton::CharacterSet CharacterSet;
+  typedef PatternAutomaton::Instruction Instruction;
+
+  const uint32_t UNBOUNDED = std::numeric_limits<uint32_t>::max();
+  // Larger repetition counts can't fit into any sensible budget anyway.
+  const uint32_t MAX_REPETITIONS = 0xFFFF;
+
+  CharacterSet EmptySet()
+  {
+    return CharacterSet{{0, 0}};
+  }
+
+  void Add(CharacterSet& set, uint8_t first, uint8_t last)
+  {
+    for (unsigned code = first; code <= last && code < 128; ++code)
+      set.bits[code / 64] |= uint64_t(1) << (code % 64);
+  }
+
+  CharacterSet Single(char c)
+  {
+    CharacterSet set = EmptySet();
+    Add(set, static_cast<uint8_t>(c), static_cast<uint8_t>(c));
+    return set;
+  }
+
+  CharacterSet Invert(CharacterSet set)
+  {
+    set.bits[0] = ~set.bits[0];
+    set.bits[1] = ~set.bits[1];
+    return set;
+  }
+
+  void Merge(CharacterSet& set, const CharacterSet& other)
+  {
+    set.bits[0] |= other.bits[0];
+    set.bits[1] |= other.bits[1];
+  }
+
+  // Adds the other case of all letters, like the `i` flag does.
+  CharacterSet FoldCase(CharacterSet set)
+  {
+    CharacterSet result = set;
+    for (char c = 'a'; c <= 'z'; ++c)
+    {
+      char upper = static_cast<char>(c - 'a' + 'A');
+      if (set.Contains(c) || set.Contains(upper))
+      {
+        Add(result, c, c);
+        Add(result, upper, upper);
+      }
+    }
+    return result;
+  }
+
+  CharacterSet WordCharacters()
+  {
+    CharacterSet set = EmptySet();
+    Add(set, 'a', 'z');
+    Add(set, 'A', 'Z');
+    Add(set, '0', '9');
+    Add(set, '_', '_');
+    return set;
+  }
+
+  CharacterSet Digits()
+  {
+    CharacterSet set = EmptySet();
+    Add(set, '0', '9');
+    return set;
+  }
+
+  CharacterSet Whitespace()
+  {
+    CharacterSet set = EmptySet();
+    Add(set, '\t', '\r');
+    Add(set, ' ', ' ');
+    return set;
+  }
+
+  // `.` and the `*` wildcard of filters.
+  CharacterSet AnyButLineTerminators()
+  {
+    CharacterSet set = EmptySet();
+    Add(set, '\n', '\n');
+    Add(set, '\r', '\r');
+    return Invert(set);
+  }
+
+  // The class `^` in filters is converted to: [\x00-\x24\x26-\x2C\x2F\x3A-\x40\x5B-\x5E\x60\x7B-\x7F]
+  CharacterSet Separators()
+  {
+    CharacterSet set = WordCharacters();
+    Add(set, '%', '%');
+    Add(set, '-', '-');
+    Add(set, '.', '.');
+    return Invert(set);
+  }
+
+  struct Node
+  {
+    enum Type
+    {
+      CHARACTERS,
+      SEQUENCE,
+      ALTERNATIVES,
+      REPETITION,
+      ASSERTION
+    };
+
+    Type type;
+    CharacterSet characters;
+    Instruction::Type assertion;
+    uint32_t min;
+    uint32_t max;
+    std::vector<Node> children;
+
+    static Node Characters(const CharacterSet& characters)
+    {
+      Node node = Make(CHARACTERS);
+      node.characters = characters;
+      return node;
+    }
+
+    static Node Assertion(Instruction::Type assertion)
+    {
+      Node node = Make(ASSERTION);
+      node.assertion = assertion;
+      return node;
+    }
+
+    static Node Repetition(Node&& child, uint32_t min, uint32_t max)
+    {
+      Node node = Make(REPETITION);
+      node.min = min;
+      node.max = max;
+      node.children.push_back(std::move(child));
+      return node;
+    }
+
+    static Node Make(Type type)
+    {
+      Node node;
+      node.type = type;
+      node.characters = EmptySet();
+      node.assertion = Instruction::MATCH;
+      node.min = node.max = 0;
+      return node;
+    }
+  };
+
+  class Compiler
+  {
+  public:
+    explicit Compiler(size_t statesBudget)
+      : statesBudget(statesBudget)
+    {
+    }
+
+    PatternAutomatonPtr Compile(const Node& root)
+    {
+      if (!Emit(root) || !Append(Instruction::MATCH))
+        return PatternAutomatonPtr();
+      return std::make_shared<PatternAutomaton>(std::move(program), std::move(characterSets));
+    }
+  private:
+    size_t statesBudget;
+    std::vector<Instruction> program;
+    std::vector<CharacterSet> characterSets;
+
+    uint32_t Position() const
+    {
+      return static_cast<uint32_t>(program.size());
+    }
+
+    bool Append(Instruction::Type type, uint32_t first = 0, uint32_t second = 0)
+    {
+      if (program.size() >= statesBudget)
+        return false;
+      program.push_back(Instruction{type, first, second});
+      return true;
+    }
+
+    bool Emit(const Node& node)
+    {
+      switch (node.type)
+      {
+      case Node::CHARACTERS:
+        characterSets.push_back(node.characters);
+        return Append(Instruction::CHARACTER, static_cast<uint32_t>(characterSets.size() - 1));
+      case Node::ASSERTION:
+        return Append(node.assertion);
+      case Node::SEQUENCE:
+        for (const auto& child : node.children)
+        {
+          if (!Emit(child))
+            return false;
+        }
+        return true;
+      case Node::ALTERNATIVES:
+        return EmitAlternatives(node);
+      case Node::REPETITION:
+        return EmitRepetition(node);
+      }
+      return false;
+    }
+
+    bool EmitAlternatives(const Node& node)
+    {
+      // split(a, next), a, jump(end), split(b, next), b, jump(end), ..., z
+      std::vector<uint32_t> jumps;
+      for (size_t i = 0; i + 1 < node.children.size(); ++i)
+      {
+        uint32_t split = Position();
+        if (!Append(Instruction::SPLIT, split + 1) || !Emit(node.children[i]))
+          return false;
+        jumps.push_back(Position());
+        if (!Append(Instruction::JUMP))
+          return false;
+        program[split].second = Position();
+      }
+      if (!node.children.empty() && !Emit(node.children.back()))
+        return false;
+      for (uint32_t jump : jumps)
+        program[jump].first = Position();
+      return true;
+    }
+
+    bool EmitRepetition(const Node& node)
+    {
+      const Node& child = node.children.front();
+      for (uint32_t i = 0; i < node.min; ++i)
+      {
+        if (!Emit(child))
+          return false;
+      }
+      if (node.max == UNBOUNDED)
+      {
+        // loop: split(body, end), body, jump(loop)
+        uint32_t split = Position();
+        if (!Append(Instruction::SPLIT, split + 1) || !Emit(child) ||
+            !Append(Instruction::JUMP, split))
+          return false;
+        program[split].second = Position();
+        return true;
+      }
+      // split(body, end), body, split(body, end), body, ...
+      std::vector<uint32_t> splits;
+      for (uint32_t i = node.min; i < node.max; ++i)
+      {
+        splits.push_back(Position());
+        if (!Append(Instruction::SPLIT, Position() + 1) || !Emit(child))
+          return false;
+      }
+      for (uint32_t split : splits)
+        program[split].second = Position();
+      return true;
+    }
+  };
+
+  /*
+   * Parser for the subset of the JavaScript regular expression syntax which
+   * doesn't need backtracking.
+   */
+  class RegExpParser
+  {
+  public:
+    RegExpParser(const std::string& source, bool matchCase)
+      : source(source), position(0), matchCase(matchCase), isValid(true)
+    {
+    }
+
+    bool Parse(Node& root)
+    {
+      root = ParseAlternatives();
+      return isValid && position == source.size();
+    }
+  private:
+    const std::string& source;
+    size_t position;
+    bool matchCase;
+    bool isValid;
+
+    bool AtEnd() const
+    {
+      return position >= source.size();
+    }
+
+    char Peek(size_t offset = 0) const
+    {
+      return position + offset < source.size() ? source[position + offset] : '\0';
+    }
+
+    Node Fail()
+    {
+      isValid = false;
+      position = source.size();
+      return Node::Make(Node::SEQUENCE);
+    }
+
+    Node CharactersNode(CharacterSet set, bool isNegated = false)
+    {
+      if (!matchCase)
+        set = FoldCase(set);
+      return Node::Characters(isNegated ? Invert(set) : set);
+    }
+
+    Node ParseAlternatives()
+    {
+      Node alternatives = Node::Make(Node::ALTERNATIVES);
+      alternatives.children.push_back(ParseSequence());
+      while (isValid && Peek() == '|')
+      {
+        ++position;
+        alternatives.children.push_back(ParseSequence());
+      }
+      if (alternatives.children.size() == 1)
+        return std::move(alternatives.children.front());
+      return alternatives;
+    }
+
+    Node ParseSequence()
+    {
+      Node sequence = Node::Make(Node::SEQUENCE);
+      while (isValid && !AtEnd() && Peek() != '|' && Peek() != ')')
+      {
+        Node term = ParseTerm();
+        if (isValid)
+          sequence.children.push_back(std::move(term));
+      }
+      return sequence;
+    }
+
+    Node ParseTerm()
+    {
+      char c = Peek();
+      if (c == '^' || c == '$')
+      {
+        ++position;
+        return Node::Assertion(c == '^' ? Instruction::ASSERT_START : Instruction::ASSERT_END);
+      }
+      if (c == '*' || c == '+' || c == '?' || ParseBraceQuantifier(nullptr, nullptr))
+        return Fail();
+
+      Node atom = ParseAtom();
+      uint32_t min = 0;
+      uint32_t max = 0;
+      if (!isValid || !ParseQuantifier(min, max))
+        return atom;
+      if (min > max)
+        return Fail();
+      // Lazy quantifiers only change which match is reported.
+      if (Peek() == '?')
+        ++position;
+      return Node::Repetition(std::move(atom), min, max);
+    }
+
+    bool ParseQuantifier(uint32_t& min, uint32_t& max)
+    {
+      switch (Peek())
+      {
+      case '*':
+        ++position;
+        min = 0;
+        max = UNBOUNDED;
+        return true;
+      case '+':
+        ++position;
+        min = 1;
+        max = UNBOUNDED;
+        return true;
+      case '?':
+        ++position;
+        min = 0;
+        max = 1;
+        return true;
+      default:
+        return ParseBraceQuantifier(&min, &max);
+      }
+    }
+
+    // Parses {n}, {n,} or {n,m}. Braces not forming a quantifier are
+    // literals, so the position is only advanced for valid quantifiers.
+    bool ParseBraceQuantifier(uint32_t* min, uint32_t* max)
+    {
+      size_t end = position;
+      if (Peek() != '{')
+        return false;
+      ++end;
+      uint32_t from = 0;
+      uint32_t to = 0;
+      if (!ParseNumber(end, from))
+        return false;
+      to = from;
+      if (end < source.size() && source[end] == ',')
+      {
+        ++end;
+        if (!ParseNumber(end, to))
+          to = UNBOUNDED;
+      }
+      if (end >= source.size() || source[end] != '}')
+        return false;
+      if (min && max)
+      {
+        *min = from;
+        *max = to;
+        position = end + 1;
+      }
+      return true;
+    }
+
+    bool ParseNumber(size_t& offset, uint32_t& number) const
+    {
+      size_t start = offset;
+      number = 0;
+      for (; offset < source.size() && source[offset] >= '0' && source[offset] <= '9'; ++offset)
+        number = std::min(number * 10 + (source[offset] - '0'), MAX_REPETITIONS);
+      return offset > start;
+    }
+
+    Node ParseAtom()
+    {
+      char c = Peek();
+      ++position;
+      switch (c)
+      {
+      case '.':
+        return Node::Characters(AnyButLineTerminators());
+      case '(':
+        return ParseGroup();
+      case ')':
+        return Fail();
+      case '[':
+        return ParseClass();
+      case '\\':
+        return ParseAtomEscape();
+      default:
+        if (static_cast<uint8_t>(c) >= 0x80)
+          return Fail();
+        return CharactersNode(Single(c));
+      }
+    }
+
+    Node ParseGroup()
+    {
+      if (Peek() == '?')
+      {
+        // Lookarounds and named groups aren't supported.
+        if (Peek(1) != ':')
+          return Fail();
+        position += 2;
+      }
+      Node group = ParseAlternatives();
+      if (!isValid || Peek() != ')')
+        return Fail();
+      ++position;
+      return group;
+    }
+
+    Node ParseAtomEscape()
+    {
+      if (AtEnd())
+        return Fail();
+      char c = Peek();
+      // Word boundaries and backreferences.
+      if (c == 'b' || c == 'B' || (c >= '1' && c <= '9'))
+        return Fail();
+      CharacterSet set = EmptySet();
+      bool isNegated = false;
+      if (!ParseCharacterEscape(set, isNegated))
+        return Fail();
+      return CharactersNode(set, isNegated);
+    }
+
+    // Parses the escape after the backslash into a set, class escapes like
+    // \D are returned as their positive set with `isNegated`.
+    bool ParseCharacterEscape(CharacterSet& set, bool& isNegated)
+    {
+      char c = Peek();
+      ++position;
+      isNegated = false;
+      switch (c)
+      {
+      case 'd': case 'D':
+        set = Digits();
+        isNegated = c == 'D';
+        return true;
+      case 'w': case 'W':
+        set = WordCharacters();
+        isNegated = c == 'W';
+        return true;
+      case 's': case 'S':
+        set = Whitespace();
+        isNegated = c == 'S';
+        return true;
+      case 'n':
+        set = Single('\n');
+        return true;
+      case 'r':
+        set = Single('\r');
+        return true;
+      case 't':
+        set = Single('\t');
+        return true;
+      case 'v':
+        set = Single('\v');
+        return true;
+      case 'f':
+        set = Single('\f');
+        return true;
+      case '0':
+        if (Peek() >= '0' && Peek() <= '9')
+          return false;
+        set = Single('\0');
+        return true;
+      case 'x':
+        return ParseHexEscape(2, set);
+      case 'u':
+        return ParseHexEscape(4, set);
+      case 'c':
+        return false;
+      default:
+        if (static_cast<uint8_t>(c) >= 0x80)
+          return false;
+        set = Single(c);
+        return true;
+      }
+    }
+
+    // \xHH and \uHHHH, an incomplete escape is the letter itself.
+    bool ParseHexEscape(size_t digits, CharacterSet& set)
+    {
+      uint32_t code = 0;
+      for (size_t i = 0; i < digits; ++i)
+      {
+        char c = Peek(i);
+        int digit = c >= '0' && c <= '9' ? c - '0' :
+                    c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                    c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0)
+        {
+          set = Single(digits == 2 ? 'x' : 'u');
+          return true;
+        }
+        code = code * 16 + digit;
+      }
+      if (code >= 0x80)
+        return false;
+      position += digits;
+      set = Single(static_cast<char>(code));
+      return true;
+    }
+
+    Node ParseClass()
+    {
+      bool isNegated = false;
+      if (Peek() == '^')
+      {
+        isNegated = true;
+        ++position;
+      }
+      CharacterSet set = EmptySet();
+      // Negated class escapes like \D can't be case-folded after inverting,
+      // so they are collected separately.
+      CharacterSet negatedEscapes = EmptySet();
+      while (isValid && !AtEnd() && Peek() != ']')
+      {
+        CharacterSet first = EmptySet();
+        bool isFirstClass = false;
+        if (!ParseClassAtom(first, isFirstClass, negatedEscapes))
+          return Fail();
+        if (Peek() != '-' || Peek(1) == ']' || Peek(1) == '\0')
+        {
+          Merge(set, first);
+          continue;
+        }
+        ++position;
+        CharacterSet last = EmptySet();
+        bool isLastClass = false;
+        if (!ParseClassAtom(last, isLastClass, negatedEscapes))
+          return Fail();
+        if (isFirstClass || isLastClass)
+        {
+          // A range with a class escape is just a list of atoms.
+          Merge(set, first);
+          Merge(set, last);
+          Merge(set, Single('-'));
+          continue;
+        }
+        uint8_t from = RangeBound(first);
+        uint8_t to = RangeBound(last);
+        if (from > to)
+          return Fail();
+        Add(set, from, to);
+      }
+      if (AtEnd())
+        return Fail();
+      ++position;
+
+      if (!matchCase)
+        set = FoldCase(set);
+      Merge(set, negatedEscapes);
+      return Node::Characters(isNegated ? Invert(set) : set);
+    }
+
+    bool ParseClassAtom(CharacterSet& set, bool& isClass, CharacterSet& negatedEscapes)
+    {
+      char c = Peek();
+      ++position;
+      isClass = false;
+      if (static_cast<uint8_t>(c) >= 0x80)
+        return false;
+      if (c != '\\')
+      {
+        set = Single(c);
+        return true;
+      }
+      if (AtEnd())
+        return false;
+      c = Peek();
+      if (c == 'b')
+      {
+        ++position;
+        set = Single('\b');
+        return true;
+      }
+      if (c >= '1' && c <= '9')
+        return false;
+      bool isNegated = false;
+      if (!ParseCharacterEscape(set, isNegated))
+        return false;
+      isClass = c == 'd' || c == 'D' || c == 'w' || c == 'W' || c == 's' || c == 'S';
+      if (isNegated)
+      {
+        Merge(negatedEscapes, Invert(set));
+        set = EmptySet();
+      }
+      return true;
+    }
+
+    static uint8_t RangeBound(const CharacterSet& set)
+    {
+      for (uint8_t code = 0; code < 128; ++code)
+      {
+        if (set.Contains(static_cast<char>(code)))
+          return code;
+      }
+      return 0;
+    }
+  };
+}
+
+PatternAutomatonPtr PatternAutomaton::FromFilterPattern(const std::string& text,
+  bool matchCase, size_t statesBudget)
+{
+  std::string pattern;
+  for (char c : text)
+  {
+    if (static_cast<uint8_t>(c) >= 0x80)
+      return PatternAutomatonPtr();
+    // Consecutive wildcards are collapsed.
+    if (c != '*' || pattern.empty() || pattern.back() != '*')
+      pattern.push_back(c);
+  }
+
+  Node root = Node::Make(Node::SEQUENCE);
+  size_t begin = 0;
+  size_t end = pattern.size();
+  bool isEndAnchored = false;
+  // An end anchor after a separator is ignored.
+  if (end >= 2 && pattern.compare(end - 2, 2, "^|") == 0)
+    --end;
+
+  if (pattern.compare(0, 2, "||") == 0)
+  {
+    // ^[\w\-]+:\/+(?!\/)(?:[^\/]+\.)?
+    CharacterSet schemeCharacters = WordCharacters();
+    Add(schemeCharacters, '-', '-');
+    CharacterSet notSlash = Invert(Single('/'));
+    Node subdomain = Node::Make(Node::SEQUENCE);
+    subdomain.children.push_back(Node::Repetition(Node::Characters(notSlash), 1, UNBOUNDED));
+    subdomain.children.push_back(Node::Characters(Single('.')));
+
+    root.children.push_back(Node::Assertion(Instruction::ASSERT_START));
+    root.children.push_back(Node::Repetition(Node::Characters(schemeCharacters), 1, UNBOUNDED));
+    root.children.push_back(Node::Characters(Single(':')));
+    root.children.push_back(Node::Repetition(Node::Characters(Single('/')), 1, UNBOUNDED));
+    root.children.push_back(Node::Assertion(Instruction::ASSERT_NO_SLASH_AHEAD));
+    root.children.push_back(Node::Repetition(std::move(subdomain), 0, 1));
+    begin = 2;
+  }
+  else if (pattern.compare(0, 1, "|") == 0)
+  {
+    root.children.push_back(Node::Assertion(Instruction::ASSERT_START));
+    begin = 1;
+  }
+  if (end > begin && pattern[end - 1] == '|')
+  {
+    isEndAnchored = true;
+    --end;
+  }
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    char c = pattern[i];
+    if (c == '*')
+      root.children.push_back(Node::Repetition(Node::Characters(AnyButLineTerminators()), 0, UNBOUNDED));
+    else if (c == '^')
+    {
+      Node separator = Node::Make(Node::ALTERNATIVES);
+      separator.children.push_back(Node::Characters(Separators()));
+      separator.children.push_back(Node::Assertion(Instruction::ASSERT_END));
+      root.children.push_back(std::move(separator));
+    }
+    else
+    {
+      CharacterSet set = Single(c);
+      root.children.push_back(Node::Characters(matchCase ? set : FoldCase(set)));
+    }
+  }
+  if (isEndAnchored)
+    root.children.push_back(Node::Assertion(Instruction::ASSERT_END));
+
+  return Compiler(statesBudget).Compile(root);
+}
+
+PatternAutomatonPtr PatternAutomaton::FromRegExp(const std::string& source,
+  bool matchCase, size_t statesBudget)
+{
+  Node root;
+  if (!RegExpParser(source, matchCase).Parse(root))
+    return PatternAutomatonPtr();
+  return Compiler(statesBudget).Compile(root);
+}
+
+PatternAutomaton::PatternAutomaton(std::vector<Instruction>&& program,
+                                   std::vector<CharacterSet>&& characterSets)
+  : program(std::move(program)), characterSets(std::move(characterSets))
+{
+}
+
+bool PatternAutomaton::Matches(const std::string& url) const
+{
+  thread_local MatchBuffers buffers;
+  return Matches(url, buffers);
+}
+
+bool PatternAutomaton::Matches(const std::string& url, MatchBuffers& buffers) const
+{
+  return Matches(program.data(), program.size(), characterSets.data(), url, buffers);
+}
+
+bool PatternAutomaton::Matches(const Instruction* program, size_t programSize,
+                               const CharacterSet* characterSets,
+                               const std::string& url, MatchBuffers& buffers)
+{
+  // Pike VM: all threads advance over the URL in lockstep, every state is
+  // added at most once per position.
+  std::vector<uint32_t>& threads = buffers.threads;
+  std::vector<uint32_t>& nextThreads = buffers.nextThreads;
+  std::vector<uint32_t>& stack = buffers.stack;
+  std::vector<size_t>& addedAt = buffers.addedAt;
+  threads.clear();
+  stack.clear();
+  if (addedAt.size() < programSize)
+    addedAt.resize(programSize, 0);
+  // Marks of previous calls are below the base, so they never equal the
+  // marks of this call.
+  if (buffers.positionBase > std::numeric_limits<size_t>::max() - url.size() - 1)
+  {
+    std::fill(addedAt.begin(), addedAt.end(), 0);
+    buffers.positionBase = 1;
+  }
+  size_t positionBase = buffers.positionBase;
+  buffers.positionBase += url.size() + 1;
+  bool isStartAnchored = program[0].type == Instruction::ASSERT_START;
+
+  // Follows the transitions which don't consume characters from `state`,
+  // returns `true` if the final state is reached.
+  auto addThread = [&](std::vector<uint32_t>& list, uint32_t state, size_t position)
+  {
+    stack.push_back(state);
+    while (!stack.empty())
+    {
+      uint32_t current = stack.back();
+      stack.pop_back();
+      if (addedAt[current] == positionBase + position)
+        continue;
+      addedAt[current] = positionBase + position;
+      const Instruction& instruction = program[current];
+      switch (instruction.type)
+      {
+      case Instruction::CHARACTER:
+        list.push_back(current);
+        break;
+      case Instruction::SPLIT:
+        stack.push_back(instruction.second);
+        stack.push_back(instruction.first);
+        break;
+      case Instruction::JUMP:
+        stack.push_back(instruction.first);
+        break;
+      case Instruction::ASSERT_START:
+        if (position == 0)
+          stack.push_back(current + 1);
+        break;
+      case Instruction::ASSERT_END:
+        if (position == url.size())
+          stack.push_back(current + 1);
+        break;
+      case Instruction::ASSERT_NO_SLASH_AHEAD:
+        if (position == url.size() || url[position] != '/')
+          stack.push_back(current + 1);
+        break;
+      case Instruction::MATCH:
+        stack.clear();
+        return true;
+      }
+    }
+    return false;
+  };
+
+  for (size_t position = 0; ; ++position)
+  {
+    if ((position == 0 || !isStartAnchored) && addThread(threads, 0, position))
+      return true;
+    if (position == url.size() || (isStartAnchored && threads.empty()))
+      return false;
+    nextThreads.clear();
+    for (uint32_t state : threads)
+    {
+      const Instruction& instruction = program[state];
+      if (characterSets[instruction.first].Contains(url[position]) &&
+          addThread(nextThreads, state + 1, position + 1))
+        return true;
+    }
+    threads.swap(nextThreads);
+  }
+}
+
+size_t PatternAutomaton::GetMemoryUsage() const
+{
+  return sizeof(*this) + program.capacity() * sizeof(Instruction) +
+    characterSets.capacity() * sizeof(CharacterSet);
+}
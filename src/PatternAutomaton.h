@@ -0,0 +1,148 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_PATTERN_AUTOMATON_H
+#define ADBLOCK_PLUS_PATTERN_AUTOMATON_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AdblockPlus
+{
+  class PatternAutomaton;
+  typedef std::shared_ptr<const PatternAutomaton> PatternAutomatonPtr;
+
+  /*
+   * Nondeterministic automaton compiled from a filter pattern with `*` and
+   * `^` or from a regular expression filter. It is simulated breadth-first,
+   * so matching takes time linear in the length of the URL for any pattern.
+   * Only ASCII URLs are supported.
+   */
+  class PatternAutomaton
+  {
+  public:
+    /*
+     * Compiles a filter pattern, i.e. the filter text without `@@` and
+     * options. Returns nullptr if the automaton would have more than
+     * `statesBudget` states.
+     */
+    static PatternAutomatonPtr FromFilterPattern(const std::string& pattern,
+      bool matchCase, size_t statesBudget);
+
+    /*
+     * Compiles the source of a regular expression filter, i.e. the pattern
+     * without the enclosing slashes. Returns nullptr if the expression uses
+     * backreferences, lookarounds, word boundaries or non-ASCII characters,
+     * or if the automaton would have more than `statesBudget` states.
+     */
+    static PatternAutomatonPtr FromRegExp(const std::string& source,
+      bool matchCase, size_t statesBudget);
+
+    /*
+     * State of the simulation which is kept between calls of `Matches()`,
+     * so they don't allocate once the buffers grew large enough. The
+     * buffers can be used with any automaton, but only by one call at
+     * a time.
+     */
+    struct MatchBuffers
+    {
+      std::vector<uint32_t> threads;
+      std::vector<uint32_t> nextThreads;
+      std::vector<uint32_t> stack;
+      // Marks the states added at the current position, offset by
+      // `positionBase` so that the marks don't need to be reset between
+      // calls.
+      std::vector<size_t> addedAt;
+      size_t positionBase = 1;
+    };
+
+    /*
+     * Checks whether the pattern occurs anywhere in `url` like
+     * `RegExp.prototype.test()` does, using the buffers of the calling
+     * thread.
+     */
+    bool Matches(const std::string& url) const;
+
+    bool Matches(const std::string& url, MatchBuffers& buffers) const;
+
+    size_t GetStatesNumber() const
+    {
+      return program.size();
+    }
+
+    size_t GetMemoryUsage() const;
+
+    struct CharacterSet
+    {
+      uint64_t bits[2];
+
+      bool Contains(char c) const
+      {
+        uint8_t code = static_cast<uint8_t>(c);
+        return code < 128 && (bits[code / 64] & (uint64_t(1) << (code % 64)));
+      }
+    };
+
+    struct Instruction
+    {
+      enum Type
+      {
+        CHARACTER,
+        SPLIT,
+        JUMP,
+        ASSERT_START,
+        ASSERT_END,
+        // Lookahead (?!\/) of the `||` anchor.
+        ASSERT_NO_SLASH_AHEAD,
+        MATCH
+      };
+
+      Type type;
+      // Successors for SPLIT and JUMP, the character set for CHARACTER.
+      uint32_t first;
+      uint32_t second;
+    };
+
+    PatternAutomaton(std::vector<Instruction>&& program,
+                     std::vector<CharacterSet>&& characterSets);
+
+    /*
+     * Simulates a program which isn't owned by an automaton, e.g. one
+     * stored in a compiled filter list. It must not be empty.
+     */
+    static bool Matches(const Instruction* program, size_t programSize,
+                        const CharacterSet* characterSets,
+                        const std::string& url, MatchBuffers& buffers);
+
+    const std::vector<Instruction>& GetProgram() const
+    {
+      return program;
+    }
+
+    const std::vector<CharacterSet>& GetCharacterSets() const
+    {
+      return characterSets;
+    }
+  private:
+    std::vector<Instruction> program;
+    std::vector<CharacterSet> characterSets;
+  };
+}
+
+#endif
@@ -50,12 +50,13 @@ Platform::~Platform()
 {
 }
 
-void Platform::SetUpJsEngine(const AppInfo& appInfo, std::unique_ptr<IV8IsolateProvider> isolate)
+void Platform::SetUpJsEngine(const AppInfo& appInfo, std::unique_ptr<IV8IsolateProvider> isolate,
+  bool useEventLoop)
 {
   std::lock_guard<std::mutex> lock(modulesMutex);
   if (jsEngine)
     return;
-  jsEngine = JsEngine::New(appInfo, *this, std::move(isolate));
+  jsEngine = JsEngine::New(appInfo, *this, std::move(isolate), useEventLoop);
 }
 
 JsEngine& Platform::GetJsEngine()
@@ -191,21 +192,33 @@ Scheduler DefaultPlatformBuilder::GetDefaultAsyncExecutor()
   return defaultScheduler;
 }
 
+DefaultPlatformBuilder::AsyncExecutorPtr DefaultPlatformBuilder::GetSharedAsyncExecutor()
+{
+  return sharedAsyncExecutor;
+}
+
 void DefaultPlatformBuilder::CreateDefaultTimer()
 {
   timer.reset(new DefaultTimer());
 }
 
-void DefaultPlatformBuilder::CreateDefaultFileSystem(const std::string& basePath)
+void DefaultPlatformBuilder::CreateDefaultFileSystem(const std::string& basePath,
+  const std::chrono::milliseconds& writeCoalescingWindow)
 {
-  fileSystem.reset(new DefaultFileSystem(GetDefaultAsyncExecutor(), std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync(basePath))));
+  fileSystem.reset(new DefaultFileSystem(GetDefaultAsyncExecutor(), std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync(basePath)), writeCoalescingWindow));
 }
 
 void DefaultPlatformBuilder::CreateDefaultWebRequest(std::unique_ptr<IWebRequestSync> webRequest)
 {
   if (!webRequest)
     webRequest.reset(new DefaultWebRequestSync());
-  this->webRequest.reset(new DefaultWebRequest(GetDefaultAsyncExecutor(), std::move(webRequest)));
+  auto sharedAsyncExecutor = this->sharedAsyncExecutor;
+  // Requests can block for a long time, so they have their own threads.
+  Scheduler webRequestScheduler = [sharedAsyncExecutor](const SchedulerTask& task)
+  {
+    sharedAsyncExecutor->Dispatch(task, AsyncExecutorLane::WebRequest);
+  };
+  this->webRequest.reset(new DefaultWebRequest(webRequestScheduler, std::move(webRequest)));
 }
 
 void DefaultPlatformBuilder::CreateDefaultLogSystem()
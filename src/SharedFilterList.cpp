@@ -0,0 +1,451 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <AdblockPlus/SharedFilterList.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define ADBLOCK_PLUS_HAVE_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "CompiledFilterList.h"
+#include "FilterIndex.h"
+
+using namespace AdblockPlus;
+
+// Content of the control segment. Readers map it read-only, which is fine
+// for loads of a lock-free atomic.
+struct AdblockPlus::SharedFilterListControlBlock
+{
+  char magic[4];
+  uint32_t formatVersion;
+  std::atomic<uint32_t> generation;
+};
+
+struct SharedFilterListMatcher::LoadedFilterList
+{
+  uint32_t generation;
+  // Read-only mapping of the segment which the view reads, nullptr if no
+  // filter list is loaded yet. A list which is kept for a new generation
+  // shares it. The pages are shared with all other processes mapping the
+  // segment.
+  std::shared_ptr<const void> segment;
+  CompiledFilterList::View view;
+};
+
+namespace
+{
+  static_assert(ATOMIC_INT_LOCK_FREE == 2,
+                "the generation is shared between processes");
+
+  const char CONTROL_MAGIC[4] = {'A', 'B', 'P', 'S'};
+  const uint32_t CONTROL_FORMAT_VERSION = 1;
+
+  class RuntimeErrorWithErrno : public std::runtime_error
+  {
+  public:
+    explicit RuntimeErrorWithErrno(const std::string& message)
+      : std::runtime_error(message + " (" + strerror(errno) + ")")
+    {
+    }
+  };
+
+  std::string GetControlSegmentName(const std::string& name)
+  {
+    if (name.empty() || name.find('/') != std::string::npos)
+      throw std::invalid_argument("Invalid shared filter list name: " + name);
+    return "/abp-" + name;
+  }
+
+  std::string GetFilterListSegmentName(const std::string& name, uint32_t generation)
+  {
+    return GetControlSegmentName(name) + "-" + std::to_string(generation);
+  }
+
+  // Generations wrap around, 0 is skipped since it means that nothing is
+  // published.
+  uint32_t GetNextGeneration(uint32_t generation)
+  {
+    return generation == UINT32_MAX ? 1 : generation + 1;
+  }
+
+  uint32_t GetPreviousGeneration(uint32_t generation)
+  {
+    return generation == 1 ? UINT32_MAX : generation - 1;
+  }
+
+  bool IsInitialized(const SharedFilterListControlBlock& controlBlock)
+  {
+    return std::memcmp(controlBlock.magic, CONTROL_MAGIC, sizeof(CONTROL_MAGIC)) == 0 &&
+      controlBlock.formatVersion == CONTROL_FORMAT_VERSION;
+  }
+
+  // A control segment which the publisher has just created is zero-filled
+  // until it initializes it.
+  bool IsZeroFilled(const SharedFilterListControlBlock& controlBlock)
+  {
+    static const char zeroMagic[sizeof(CONTROL_MAGIC)] = {};
+    return std::memcmp(controlBlock.magic, zeroMagic, sizeof(zeroMagic)) == 0 &&
+      controlBlock.formatVersion == 0 && controlBlock.generation.load() == 0;
+  }
+
+#ifdef ADBLOCK_PLUS_HAVE_SHARED_MEMORY
+  class FileDescriptor
+  {
+  public:
+    explicit FileDescriptor(int fd)
+      : fd(fd)
+    {
+    }
+
+    ~FileDescriptor()
+    {
+      if (fd >= 0)
+        close(fd);
+    }
+
+    int Get() const
+    {
+      return fd;
+    }
+  private:
+    int fd;
+  };
+
+  void* MapControlSegment(const std::string& name, bool isWritable, unsigned int mode)
+  {
+    std::string segmentName = GetControlSegmentName(name);
+    FileDescriptor fd(shm_open(segmentName.c_str(),
+      isWritable ? O_RDWR | O_CREAT : O_RDONLY, static_cast<mode_t>(mode)));
+    if (fd.Get() < 0)
+      throw RuntimeErrorWithErrno("Failed to open " + segmentName);
+    struct stat nativeStat;
+    if (fstat(fd.Get(), &nativeStat) < 0)
+      throw RuntimeErrorWithErrno("Failed to open " + segmentName);
+    // Only a new segment is resized, macOS can't resize a segment twice.
+    if (isWritable && nativeStat.st_size == 0)
+    {
+      if (ftruncate(fd.Get(), sizeof(SharedFilterListControlBlock)) < 0)
+        throw RuntimeErrorWithErrno("Failed to resize " + segmentName);
+      nativeStat.st_size = sizeof(SharedFilterListControlBlock);
+    }
+    // A segment which isn't resized yet can't be mapped, the publisher is
+    // still creating it.
+    if (static_cast<size_t>(nativeStat.st_size) < sizeof(SharedFilterListControlBlock))
+      throw std::runtime_error("Invalid shared filter list " + segmentName);
+    void* data = mmap(nullptr, sizeof(SharedFilterListControlBlock),
+      isWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd.Get(), 0);
+    if (data == MAP_FAILED)
+      throw RuntimeErrorWithErrno("Failed to map " + segmentName);
+    return data;
+  }
+
+  void UnmapControlSegment(const void* controlBlock)
+  {
+    munmap(const_cast<void*>(controlBlock), sizeof(SharedFilterListControlBlock));
+  }
+
+  void UnlinkSegment(const std::string& segmentName)
+  {
+    shm_unlink(segmentName.c_str());
+  }
+
+  void WriteFilterListSegment(const std::string& segmentName,
+                              const IFileSystem::IOBuffer& data, unsigned int mode)
+  {
+    // A segment left behind by a crashed publisher is replaced.
+    shm_unlink(segmentName.c_str());
+    FileDescriptor fd(shm_open(segmentName.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                               static_cast<mode_t>(mode)));
+    if (fd.Get() < 0)
+      throw RuntimeErrorWithErrno("Failed to create " + segmentName);
+    if (data.empty())
+      return;
+    // The segment is sized once and filled through a mapping, macOS
+    // supports neither write() nor resizing of shared memory.
+    void* segment = MAP_FAILED;
+    if (ftruncate(fd.Get(), static_cast<off_t>(data.size())) == 0)
+      segment = mmap(nullptr, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd.Get(), 0);
+    if (segment == MAP_FAILED)
+    {
+      RuntimeErrorWithErrno error("Failed to write to " + segmentName);
+      shm_unlink(segmentName.c_str());
+      throw error;
+    }
+    std::memcpy(segment, data.data(), data.size());
+    munmap(segment, data.size());
+  }
+
+  // Maps a filter list segment read-only, the mapping is removed with the
+  // last reference. Returns nullptr if the segment is gone already, i.e.
+  // the publisher has published two newer filter lists meanwhile. Unlinking
+  // it doesn't affect existing mappings, and the publisher doesn't modify
+  // it after publishing it.
+  std::shared_ptr<const void> MapFilterListSegment(const std::string& segmentName,
+                                                   size_t& size)
+  {
+    FileDescriptor fd(shm_open(segmentName.c_str(), O_RDONLY, 0));
+    if (fd.Get() < 0)
+      return nullptr;
+    struct stat nativeStat;
+    if (fstat(fd.Get(), &nativeStat) < 0 || nativeStat.st_size <= 0)
+      return nullptr;
+    size_t segmentSize = static_cast<size_t>(nativeStat.st_size);
+    void* data = mmap(nullptr, segmentSize, PROT_READ, MAP_SHARED, fd.Get(), 0);
+    if (data == MAP_FAILED)
+      return nullptr;
+    size = segmentSize;
+    return std::shared_ptr<const void>(data, [segmentSize](const void* data)
+    {
+      munmap(const_cast<void*>(data), segmentSize);
+    });
+  }
+#else
+  void* MapControlSegment(const std::string&, bool, unsigned int)
+  {
+    throw std::runtime_error("Shared filter lists are not supported on this platform");
+  }
+
+  void UnmapControlSegment(const void*)
+  {
+  }
+
+  void UnlinkSegment(const std::string&)
+  {
+  }
+
+  void WriteFilterListSegment(const std::string&, const IFileSystem::IOBuffer&, unsigned int)
+  {
+  }
+
+  std::shared_ptr<const void> MapFilterListSegment(const std::string&, size_t&)
+  {
+    return nullptr;
+  }
+#endif
+}
+
+SharedFilterListPublisher::SharedFilterListPublisher(const std::string& name,
+                                                     unsigned int mode)
+  : name(name), mode(mode),
+    controlBlock(static_cast<SharedFilterListControlBlock*>(MapControlSegment(name, true, mode)))
+{
+  // A new segment is zero-filled, which matchers treat like an initialized
+  // one without a published filter list. A restarted publisher continues
+  // with the generation it left.
+  if (!IsInitialized(*controlBlock))
+  {
+    controlBlock->generation.store(0);
+    controlBlock->formatVersion = CONTROL_FORMAT_VERSION;
+    std::memcpy(controlBlock->magic, CONTROL_MAGIC, sizeof(CONTROL_MAGIC));
+  }
+}
+
+SharedFilterListPublisher::~SharedFilterListPublisher()
+{
+  UnmapControlSegment(controlBlock);
+}
+
+uint32_t SharedFilterListPublisher::Publish(const IFileSystem::IOBuffer& compiledFilterList)
+{
+  uint32_t generation = GetNextGeneration(controlBlock->generation.load(std::memory_order_relaxed));
+  WriteFilterListSegment(GetFilterListSegmentName(name, generation), compiledFilterList, mode);
+  controlBlock->generation.store(generation, std::memory_order_release);
+
+  // Matchers which have just read the previous generation can still open
+  // its segment, older ones aren't needed anymore.
+  uint32_t oldGeneration = GetPreviousGeneration(GetPreviousGeneration(generation));
+  UnlinkSegment(GetFilterListSegmentName(name, oldGeneration));
+  return generation;
+}
+
+void SharedFilterListPublisher::Remove(const std::string& name)
+{
+  std::string segmentName = GetControlSegmentName(name);
+  void* data = nullptr;
+  try
+  {
+    data = MapControlSegment(name, false, 0);
+  }
+  catch (const std::runtime_error&)
+  {
+    return;
+  }
+  uint32_t generation = static_cast<SharedFilterListControlBlock*>(data)->generation.load();
+  UnmapControlSegment(data);
+  UnlinkSegment(segmentName);
+  if (generation)
+  {
+    UnlinkSegment(GetFilterListSegmentName(name, generation));
+    UnlinkSegment(GetFilterListSegmentName(name, GetPreviousGeneration(generation)));
+  }
+}
+
+SharedFilterListMatcher::SharedFilterListMatcher(const std::string& name)
+  : name(name),
+    controlBlock(static_cast<const SharedFilterListControlBlock*>(
+      MapControlSegment(name, false, 0))),
+    loadedFilterList(std::make_shared<LoadedFilterList>()),
+    isLoadRequested(false), isStopping(false)
+{
+  if (!IsInitialized(*controlBlock) && !IsZeroFilled(*controlBlock))
+  {
+    UnmapControlSegment(controlBlock);
+    throw std::runtime_error("Invalid shared filter list " + name);
+  }
+  // The current filter list is loaded right away, later ones by the loader
+  // thread.
+  LoadFilterList();
+  loaderThread = std::thread([this]
+  {
+    RunLoader();
+  });
+}
+
+SharedFilterListMatcher::~SharedFilterListMatcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(loaderMutex);
+    isStopping = true;
+    conditionVariable.notify_all();
+  }
+  loaderThread.join();
+  UnmapControlSegment(controlBlock);
+}
+
+bool SharedFilterListMatcher::IsLoaded() const
+{
+  // The control block may have been zero-filled when the matcher was
+  // created, the publisher initializes it before it publishes anything.
+  return std::atomic_load(&loadedFilterList)->generation ==
+    controlBlock->generation.load(std::memory_order_acquire) ||
+    !IsInitialized(*controlBlock);
+}
+
+void SharedFilterListMatcher::RequestLoad() const
+{
+  if (isLoadRequested.exchange(true))
+    return;
+  std::lock_guard<std::mutex> lock(loaderMutex);
+  conditionVariable.notify_all();
+}
+
+void SharedFilterListMatcher::RunLoader()
+{
+  std::unique_lock<std::mutex> lock(loaderMutex);
+  while (true)
+  {
+    conditionVariable.wait(lock, [this]
+    {
+      return isStopping || isLoadRequested.load();
+    });
+    if (isStopping)
+      return;
+    isLoadRequested.store(false);
+    lock.unlock();
+    LoadFilterList();
+    lock.lock();
+    conditionVariable.notify_all();
+  }
+}
+
+void SharedFilterListMatcher::LoadFilterList()
+{
+  LoadedFilterListPtr filterList = std::atomic_load(&loadedFilterList);
+  uint32_t generation = controlBlock->generation.load(std::memory_order_acquire);
+  if (generation == filterList->generation || !IsInitialized(*controlBlock))
+    return;
+  size_t size = 0;
+  auto segment = MapFilterListSegment(GetFilterListSegmentName(name, generation), size);
+  if (!segment)
+  {
+    // The publisher may have replaced the segment meanwhile, so its latest
+    // filter list is tried once more.
+    uint32_t latestGeneration = controlBlock->generation.load(std::memory_order_acquire);
+    if (latestGeneration != generation)
+    {
+      generation = latestGeneration;
+      segment = MapFilterListSegment(GetFilterListSegmentName(name, generation), size);
+    }
+  }
+
+  // A filter list which can't be read is skipped, the previous one is kept
+  // until the next one is published.
+  auto newFilterList = std::make_shared<LoadedFilterList>();
+  newFilterList->generation = generation;
+  if (segment && CompiledFilterList::View::Open(static_cast<const uint8_t*>(segment.get()),
+                                                size, newFilterList->view))
+    newFilterList->segment = std::move(segment);
+  else
+  {
+    newFilterList->segment = filterList->segment;
+    newFilterList->view = filterList->view;
+  }
+  std::atomic_store(&loadedFilterList, LoadedFilterListPtr(std::move(newFilterList)));
+}
+
+SharedFilterListMatcher::MatchResult SharedFilterListMatcher::Matches(
+  const std::string& url, FilterEngine::ContentTypeMask contentTypeMask,
+  const std::string& documentUrl, std::string& filterText) const
+{
+  LoadedFilterListPtr filterList = std::atomic_load(&loadedFilterList);
+  if (controlBlock->generation.load(std::memory_order_relaxed) != filterList->generation)
+    RequestLoad();
+  if (!filterList->segment)
+    return NO_MATCH;
+  switch (filterList->view.Match(url, static_cast<uint32_t>(contentTypeMask),
+                                 documentUrl, filterText))
+  {
+  case FilterIndex::NO_MATCH:
+    return NO_MATCH;
+  case FilterIndex::MATCH:
+    return MATCH;
+  case FilterIndex::UNKNOWN:
+    break;
+  }
+  return UNKNOWN;
+}
+
+uint32_t SharedFilterListMatcher::GetGeneration() const
+{
+  return std::atomic_load(&loadedFilterList)->generation;
+}
+
+uint32_t SharedFilterListMatcher::WaitForFilterList(
+  const std::chrono::milliseconds& timeout) const
+{
+  std::unique_lock<std::mutex> lock(loaderMutex);
+  if (!IsLoaded())
+  {
+    isLoadRequested.store(true);
+    conditionVariable.notify_all();
+    conditionVariable.wait_for(lock, timeout, [this]
+    {
+      return IsLoaded();
+    });
+  }
+  return GetGeneration();
+}
@@ -0,0 +1,190 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AdblockPlus/ThreadPool.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  // Allows a task to dispatch further tasks into the queue of the worker
+  // running it.
+  thread_local const ThreadPool* currentThreadPool = nullptr;
+  thread_local size_t currentWorkerIndex = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadsNumber)
+  : nextWorkerIndex(0), parkedWorkers(0), shouldThreadsStop(false)
+  , queueDepth(0), maxQueueDepth(0), executedTasks(0), stolenTasks(0)
+{
+  if (threadsNumber == 0)
+    threadsNumber = 1;
+  for (size_t i = 0; i < threadsNumber; ++i)
+    workers.emplace_back(new Worker());
+  for (size_t i = 0; i < threadsNumber; ++i)
+  {
+    workers[i]->thread = std::thread([this, i]
+    {
+      ThreadFunc(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  shouldThreadsStop = true;
+  for (auto& worker : workers)
+  {
+    {
+      // a worker checks the flag while holding its mutex before parking.
+      std::lock_guard<std::mutex> lock(worker->mutex);
+    }
+    worker->conditionVariable.notify_one();
+  }
+  for (auto& worker : workers)
+    worker->thread.join();
+}
+
+void ThreadPool::Dispatch(const std::function<void()>& call)
+{
+  if (!call)
+    return;
+  size_t workerIndex = currentThreadPool == this ? currentWorkerIndex :
+    nextWorkerIndex++ % workers.size();
+  // Counted before the task is queued, so taking it never makes the depth
+  // negative.
+  size_t depth = ++queueDepth;
+  size_t maxDepth = maxQueueDepth;
+  while (depth > maxDepth && !maxQueueDepth.compare_exchange_weak(maxDepth, depth))
+  {
+  }
+  auto& worker = *workers[workerIndex];
+  bool isWorkerParked;
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(call);
+    isWorkerParked = worker.isParked;
+  }
+  if (isWorkerParked)
+    worker.conditionVariable.notify_one();
+  else if (parkedWorkers > 0)
+    NotifyParkedWorker(workerIndex);
+}
+
+ThreadPool::Metrics ThreadPool::GetMetrics() const
+{
+  Metrics metrics;
+  metrics.queueDepth = queueDepth;
+  metrics.maxQueueDepth = maxQueueDepth;
+  metrics.executedTasks = executedTasks;
+  metrics.stolenTasks = stolenTasks;
+  return metrics;
+}
+
+std::function<void()> ThreadPool::TakeTask(size_t workerIndex)
+{
+  {
+    auto& worker = *workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty())
+    {
+      auto task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      --queueDepth;
+      return task;
+    }
+  }
+  for (size_t i = 1; i < workers.size(); ++i)
+  {
+    auto& victim = *workers[(workerIndex + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      auto task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      --queueDepth;
+      ++stolenTasks;
+      return task;
+    }
+  }
+  return std::function<void()>();
+}
+
+void ThreadPool::NotifyParkedWorker(size_t busyWorkerIndex)
+{
+  for (size_t i = 1; i < workers.size(); ++i)
+  {
+    auto& worker = *workers[(busyWorkerIndex + i) % workers.size()];
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (!worker.isParked || worker.isNotified)
+        continue;
+      worker.isNotified = true;
+    }
+    worker.conditionVariable.notify_one();
+    return;
+  }
+}
+
+void ThreadPool::ThreadFunc(size_t workerIndex)
+{
+  currentThreadPool = this;
+  currentWorkerIndex = workerIndex;
+  auto& worker = *workers[workerIndex];
+  while (true)
+  {
+    auto task = TakeTask(workerIndex);
+    if (!task)
+    {
+      // The worker is announced as parked before it looks for tasks once
+      // more, so a task dispatched to a busy worker meanwhile is either found
+      // or wakes this worker.
+      {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.isParked = true;
+      }
+      ++parkedWorkers;
+      task = TakeTask(workerIndex);
+      std::unique_lock<std::mutex> lock(worker.mutex);
+      if (!task && worker.tasks.empty())
+      {
+        // Tasks left in the queues of other workers are executed by them
+        // before stopping.
+        if (shouldThreadsStop)
+          return;
+        worker.conditionVariable.wait(lock, [this, &worker]()->bool
+        {
+          return worker.isNotified || !worker.tasks.empty() || shouldThreadsStop;
+        });
+      }
+      worker.isParked = false;
+      worker.isNotified = false;
+      --parkedWorkers;
+      if (!task)
+        continue;
+    }
+
+    try
+    {
+      task();
+    }
+    catch (...)
+    {
+      // do nothing, but the thread will be alive.
+    }
+    ++executedTasks;
+  }
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADBLOCK_PLUS_URL_TOKENIZER_H
+#define ADBLOCK_PLUS_URL_TOKENIZER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ADBLOCK_PLUS_URL_TOKENIZER_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace AdblockPlus
+{
+  /*
+   * Splits URLs into keyword candidates the way the JavaScript matcher does,
+   * i.e. into lower-cased runs of at least three characters from [a-z0-9%],
+   * and hashes them with 64-bit FNV-1a in the same pass. Characters are
+   * classified a block at a time with SSE2 where available, which every
+   * x86-64 target has. The benchmark in test/UrlTokenizer.cpp compares it
+   * with a per-character loop, run it with
+   * --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+   */
+  namespace UrlTokenizer
+  {
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+    const size_t MIN_KEYWORD_LENGTH = 3;
+
+    const size_t BLOCK_SIZE = 16;
+
+    struct BlockMasks
+    {
+      // Bit i is set if character i belongs to the class.
+      uint32_t keywordCharacters;
+      uint32_t nonAsciiCharacters;
+    };
+
+    inline size_t CountTrailingZeros(uint32_t value)
+    {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, value);
+      return index;
+#else
+      return __builtin_ctz(value);
+#endif
+    }
+
+    // Returns the lower-cased character or '\0' if it can't be part of
+    // a keyword.
+    inline char ToKeywordCharacter(char c)
+    {
+      if (c >= 'A' && c <= 'Z')
+        return static_cast<char>(c - 'A' + 'a');
+      if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%')
+        return c;
+      return '\0';
+    }
+
+    inline BlockMasks ClassifyCharacters(const char* characters, size_t length,
+                                         char* lowered)
+    {
+      BlockMasks masks = {0, 0};
+      for (size_t i = 0; i < length; ++i)
+      {
+        char c = ToKeywordCharacter(characters[i]);
+        lowered[i] = c;
+        if (c)
+          masks.keywordCharacters |= uint32_t(1) << i;
+        if (static_cast<uint8_t>(characters[i]) >= 0x80)
+          masks.nonAsciiCharacters |= uint32_t(1) << i;
+      }
+      return masks;
+    }
+
+#if defined(ADBLOCK_PLUS_URL_TOKENIZER_SSE2)
+    inline __m128i IsInRange(__m128i block, char first, char last)
+    {
+      // Bytes are compared as signed, so non-ASCII characters are never in
+      // an ASCII range.
+      return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(first - 1)),
+                           _mm_cmplt_epi8(block, _mm_set1_epi8(last + 1)));
+    }
+
+    inline BlockMasks ClassifyBlock(const char* characters, char* lowered)
+    {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(characters));
+      __m128i upperCase = IsInRange(block, 'A', 'Z');
+      __m128i lowerCased = _mm_add_epi8(block,
+        _mm_and_si128(upperCase, _mm_set1_epi8('a' - 'A')));
+      __m128i keywordCharacters = _mm_or_si128(
+        _mm_or_si128(IsInRange(lowerCased, 'a', 'z'), IsInRange(block, '0', '9')),
+        _mm_cmpeq_epi8(block, _mm_set1_epi8('%')));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lowered), lowerCased);
+      BlockMasks masks;
+      masks.keywordCharacters = static_cast<uint32_t>(_mm_movemask_epi8(keywordCharacters));
+      masks.nonAsciiCharacters = static_cast<uint32_t>(_mm_movemask_epi8(block));
+      return masks;
+    }
+#else
+    inline BlockMasks ClassifyBlock(const char* characters, char* lowered)
+    {
+      return ClassifyCharacters(characters, BLOCK_SIZE, lowered);
+    }
+#endif
+
+    inline uint64_t HashKeyword(const std::string& keyword)
+    {
+      // Keywords are lower-cased like the tokens of URLs.
+      uint64_t hash = FNV_OFFSET_BASIS;
+      for (char c : keyword)
+      {
+        if (c >= 'A' && c <= 'Z')
+          c = static_cast<char>(c - 'A' + 'a');
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+      }
+      return hash;
+    }
+
+    /*
+     * Calls `callback` with the hash of every keyword candidate of `url`,
+     * stops early if `callback` returns `false`. Nothing is allocated.
+     * Returns `false` if `url` contains non-ASCII characters, JavaScript
+     * lower-cases some of them to keyword characters.
+     */
+    template<typename Callback>
+    bool ForEachKeywordHash(const std::string& url, Callback&& callback)
+    {
+      uint64_t hash = FNV_OFFSET_BASIS;
+      size_t length = 0;
+      char lowered[BLOCK_SIZE];
+      for (size_t offset = 0; offset < url.size(); offset += BLOCK_SIZE)
+      {
+        size_t blockLength = std::min(BLOCK_SIZE, url.size() - offset);
+        BlockMasks masks = blockLength == BLOCK_SIZE ?
+          ClassifyBlock(url.data() + offset, lowered) :
+          ClassifyCharacters(url.data() + offset, blockLength, lowered);
+        if (masks.nonAsciiCharacters)
+          return false;
+
+        // Runs of separators and of keyword characters are found with bit
+        // scans, tokens can continue in the next block.
+        size_t position = 0;
+        while (position < blockLength)
+        {
+          uint32_t rest = masks.keywordCharacters >> position;
+          if (!(rest & 1))
+          {
+            if (length >= MIN_KEYWORD_LENGTH && !callback(hash))
+              return true;
+            hash = FNV_OFFSET_BASIS;
+            length = 0;
+            if (!rest)
+              break;
+            position += CountTrailingZeros(rest);
+            continue;
+          }
+          size_t runLength = ~rest ? CountTrailingZeros(~rest) : 32;
+          size_t runEnd = std::min(blockLength, position + runLength);
+          length += runEnd - position;
+          for (; position < runEnd; ++position)
+            hash = (hash ^ static_cast<uint8_t>(lowered[position])) * FNV_PRIME;
+        }
+      }
+      if (length >= MIN_KEYWORD_LENGTH)
+        callback(hash);
+      return true;
+    }
+  }
+}
+
+#endif
@@ -15,6 +15,7 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <memory>
 #include <stdexcept>
 
 #ifdef _WIN32
@@ -26,6 +27,79 @@
 
 using namespace AdblockPlus;
 
+namespace
+{
+  // It does not pay off to let v8 reference small strings.
+  const size_t minExternalStringLength = 16 * 1024;
+
+  // Owns the characters of a string referenced by v8, v8 deletes the object
+  // when the string is garbage collected.
+  class ExternalOneByteString : public v8::String::ExternalOneByteStringResource
+  {
+  public:
+    explicit ExternalOneByteString(std::string&& value)
+      : value(std::move(value))
+    {
+    }
+
+    const char* data() const override
+    {
+      return value.data();
+    }
+
+    size_t length() const override
+    {
+      return value.length();
+    }
+  private:
+    std::string value;
+  };
+
+  // Keeps a read-only buffer, e.g. a memory mapped file, alive while v8
+  // references its content.
+  class ExternalOneByteBuffer : public v8::String::ExternalOneByteStringResource
+  {
+  public:
+    explicit ExternalOneByteBuffer(const IFileSystem::ReadOnlyBufferPtr& buffer)
+      : buffer(buffer)
+    {
+    }
+
+    const char* data() const override
+    {
+      return reinterpret_cast<const char*>(buffer->Data());
+    }
+
+    size_t length() const override
+    {
+      return buffer->Size();
+    }
+  private:
+    IFileSystem::ReadOnlyBufferPtr buffer;
+  };
+
+  bool IsAscii(const char* data, size_t length)
+  {
+    // No early exit, it allows the compiler to vectorize the loop.
+    unsigned char bits = 0;
+    for (size_t i = 0; i < length; ++i)
+      bits |= static_cast<unsigned char>(data[i]);
+    return bits < 0x80;
+  }
+
+  template<typename Resource>
+  v8::Local<v8::String> NewExternalString(v8::Isolate* isolate, std::unique_ptr<Resource> resource)
+  {
+    v8::Local<v8::String> result;
+    if (!v8::String::NewExternalOneByte(isolate, resource.get()).ToLocal(&result))
+      return v8::String::NewFromUtf8(isolate, resource->data(),
+        v8::String::NewStringType::kNormalString, resource->length());
+    // v8 owns the resource now.
+    resource.release();
+    return result;
+  }
+}
+
 void Utils::CheckTryCatch(v8::Isolate* isolate, const v8::TryCatch& tryCatch)
 {
   if (tryCatch.HasCaught())
@@ -63,6 +137,25 @@ v8::Local<v8::String> Utils::StringBufferToV8String(v8::Isolate* isolate, const
     v8::String::NewStringType::kNormalString, str.size());
 }
 
+v8::Local<v8::String> Utils::ToV8ExternalString(v8::Isolate* isolate, std::string&& str)
+{
+  if (str.length() < minExternalStringLength || !IsAscii(str.data(), str.length()))
+    return ToV8String(isolate, str);
+  return NewExternalString(isolate, std::unique_ptr<ExternalOneByteString>(
+    new ExternalOneByteString(std::move(str))));
+}
+
+v8::Local<v8::String> Utils::ReadOnlyBufferToV8String(v8::Isolate* isolate,
+  const IFileSystem::ReadOnlyBufferPtr& buffer)
+{
+  const char* data = reinterpret_cast<const char*>(buffer->Data());
+  if (buffer->Size() < minExternalStringLength || !IsAscii(data, buffer->Size()))
+    return v8::String::NewFromUtf8(isolate, data,
+      v8::String::NewStringType::kNormalString, buffer->Size());
+  return NewExternalString(isolate, std::unique_ptr<ExternalOneByteBuffer>(
+    new ExternalOneByteBuffer(buffer)));
+}
+
 void Utils::ThrowExceptionInJS(v8::Isolate* isolate, const std::string& str)
 {
   isolate->ThrowException(Utils::ToV8String(isolate, str));
@@ -58,6 +58,20 @@ namespace AdblockPlus
     StringBuffer StringBufferFromV8String(v8::Isolate* isolate, const v8::Local<v8::Value>& value);
     v8::Local<v8::String> ToV8String(v8::Isolate* isolate, const std::string& str);
     v8::Local<v8::String> StringBufferToV8String(v8::Isolate* isolate, const StringBuffer& bytes);
+
+    /*
+     * Hands the content of `str` over to v8 without copying it, v8 frees the
+     * buffer when the string is garbage collected. Short strings and strings
+     * containing non-ASCII characters are copied as by `ToV8String`.
+     */
+    v8::Local<v8::String> ToV8ExternalString(v8::Isolate* isolate, std::string&& str);
+
+    /*
+     * Same as `ToV8ExternalString` but v8 keeps a reference to `buffer`
+     * instead of taking over a string.
+     */
+    v8::Local<v8::String> ReadOnlyBufferToV8String(v8::Isolate* isolate,
+      const IFileSystem::ReadOnlyBufferPtr& buffer);
     void ThrowExceptionInJS(v8::Isolate* isolate, const std::string& str);
 
     // Code for templated function has to be in a header file, can't be in .cpp
@@ -18,6 +18,7 @@
 #include <map>
 #include <AdblockPlus/IWebRequest.h>
 
+#include "JsBinding.h"
 #include "JsContext.h"
 #include "Utils.h"
 #include "WebRequestJsObject.h"
@@ -25,84 +26,71 @@
 
 using namespace AdblockPlus;
 
-void JsEngine::ScheduleWebRequest(const v8::FunctionCallbackInfo<v8::Value>& arguments)
+namespace
 {
-  AdblockPlus::JsEnginePtr jsEngine = AdblockPlus::JsEngine::FromArguments(arguments);
-  AdblockPlus::JsValueList converted = jsEngine->ConvertArguments(arguments);
-  if (converted.size() != 3u)
-    throw std::runtime_error("GET requires exactly 3 arguments");
-
-  auto url = converted[0].AsString();
-  if (!url.length())
-    throw std::runtime_error("Invalid string passed as first argument to GET");
-
-  AdblockPlus::HeaderList headers;
+  void GETCallback(JsEngine& jsEngine, std::string url,
+    v8::Local<v8::Object> headersObject, v8::Local<v8::Function> callback)
   {
-    const AdblockPlus::JsValue& headersObj = converted[1];
-    if (!headersObj.IsObject())
-      throw std::runtime_error("Second argument to GET must be an object");
+    if (!url.length())
+      throw std::runtime_error("Invalid string passed as first argument to GET");
 
-    std::vector<std::string> properties = headersObj.GetOwnPropertyNames();
-    for (const auto& header : properties)
+    AdblockPlus::HeaderList headers;
     {
-      std::string headerValue = headersObj.GetProperty(header).AsString();
-      if (header.length() && headerValue.length())
-        headers.push_back(std::pair<std::string, std::string>(header, headerValue));
+      v8::Isolate* isolate = jsEngine.GetIsolate();
+      v8::Local<v8::Array> properties = headersObject->GetOwnPropertyNames();
+      for (uint32_t i = 0; i < properties->Length(); ++i)
+      {
+        v8::Local<v8::Value> header = properties->Get(i);
+        std::string headerName = Utils::FromV8String(isolate, header);
+        std::string headerValue = Utils::FromV8String(isolate, headersObject->Get(header));
+        if (headerName.length() && headerValue.length())
+          headers.push_back(std::pair<std::string, std::string>(headerName, headerValue));
+      }
     }
-  }
-
-  if (!converted[2].IsFunction())
-    throw std::runtime_error("Third argument to GET must be a function");
 
-  auto paramsID = jsEngine->StoreJsValues(converted);
-  std::weak_ptr<JsEngine> weakJsEngine = jsEngine;
-  auto getCallback = [weakJsEngine, paramsID](const ServerResponse& response)
-  {
-    auto jsEngine = weakJsEngine.lock();
-    if (!jsEngine)
-      return;
-    auto webRequestParams = jsEngine->TakeJsValues(paramsID);
-
-    AdblockPlus::JsContext context(*jsEngine);
+    auto callbackID = jsEngine.StoreJsValues({jsEngine.NewValue(callback)});
+    std::weak_ptr<JsEngine> weakJsEngine = jsEngine.shared_from_this();
+    auto getCallback = [weakJsEngine, callbackID](const ServerResponse& response)
+    {
+      auto jsEngine = weakJsEngine.lock();
+      if (!jsEngine)
+        return;
+      auto webRequestParams = jsEngine->TakeJsValues(callbackID);
 
-    auto resultObject = jsEngine->NewObject();
-    resultObject.SetProperty("status", response.status);
-    resultObject.SetProperty("responseStatus", response.responseStatus);
-    resultObject.SetProperty("responseText", response.responseText);
+      AdblockPlus::JsContext context(*jsEngine);
 
-    auto headersObject = jsEngine->NewObject();
-    for (const auto& header : response.responseHeaders)
-    {
-      headersObject.SetProperty(header.first, header.second);
-    }
-    resultObject.SetProperty("responseHeaders", headersObject);
+      auto resultObject = jsEngine->NewObject();
+      resultObject.SetProperty("status", response.status);
+      resultObject.SetProperty("responseStatus", response.responseStatus);
+      // The body of a subscription can be several megabytes, it is copied only
+      // once here and then referenced by v8 instead of being copied into the
+      // JS heap.
+      auto isolate = jsEngine->GetIsolate();
+      resultObject.UnwrapValue().As<v8::Object>()->Set(
+        Utils::ToV8String(isolate, "responseText"),
+        Utils::ToV8ExternalString(isolate, std::string(response.responseText)));
 
-    webRequestParams[2].Call(resultObject);
-  };
-  jsEngine->GetPlatform().WithWebRequest(
-    [url, headers, getCallback](IWebRequest& webRequest)
-    {
-      webRequest.GET(url, headers, getCallback);
-    });
-}
+      auto headersObject = jsEngine->NewObject();
+      for (const auto& header : response.responseHeaders)
+      {
+        headersObject.SetProperty(header.first, header.second);
+      }
+      resultObject.SetProperty("responseHeaders", headersObject);
 
-namespace
-{
-  void GETCallback(const v8::FunctionCallbackInfo<v8::Value>& arguments)
-  {
-    try
-    {
-      AdblockPlus::JsEngine::ScheduleWebRequest(arguments);
-    } catch (const std::exception& e)
-    {
-      return AdblockPlus::Utils::ThrowExceptionInJS(arguments.GetIsolate(), e.what());
-    }
+      webRequestParams[0].Call(resultObject);
+      context.RunImmediateTasks();
+    };
+    jsEngine.WithWebRequest(
+      [url, headers, getCallback](IWebRequest& webRequest)
+      {
+        webRequest.GET(url, headers, getCallback);
+      });
   }
 }
 
 AdblockPlus::JsValue& AdblockPlus::WebRequestJsObject::Setup(
     AdblockPlus::JsEngine& jsEngine, AdblockPlus::JsValue& obj)
 {
-  obj.SetProperty("GET", jsEngine.NewCallback(::GETCallback));
+  obj.SetProperty("GET", jsEngine.NewCallback(JS_BINDING(::GETCallback), "GET"));
   return obj;
 }
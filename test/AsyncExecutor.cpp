@@ -15,9 +15,11 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <future>
 #include <gtest/gtest.h>
 #include <AdblockPlus/AsyncExecutor.h>
+#include <AdblockPlus/SynchronizedCollection.h>
 
 using namespace AdblockPlus;
 
@@ -101,6 +103,25 @@ struct BaseAsyncExecutorTestTraits<AsyncExecutor>
   }
 };
 
+template<>
+struct BaseAsyncExecutorTestTraits<ThreadPool>
+{
+  class Executor : public ThreadPool
+  {
+  public:
+    Executor()
+      : ThreadPool(4)
+    {
+    }
+  };
+  typedef BaseAsyncExecutorTestTraits<AsyncExecutor>::PayloadResults PayloadResults;
+
+  static void Dispatch(typename BaseAsyncExecutorTest<ThreadPool>::Executor& executor, std::function<void()> call)
+  {
+    executor.Dispatch(std::move(call));
+  }
+};
+
 template<typename Executor>
 void BaseAsyncExecutorTest<Executor>::MultithreadedCallsTest()
 {
@@ -211,6 +232,32 @@ namespace
     MultithreadedCallsTest();
   }
 
+  TEST(ActiveObjectPostTest, MoveOnlyCall)
+  {
+    std::unique_ptr<int> value(new int(42));
+    std::promise<int> result;
+    ActiveObject activeObject;
+    activeObject.Post([value = std::move(value), &result]
+    {
+      result.set_value(*value);
+    });
+    EXPECT_EQ(42, result.get_future().get());
+  }
+
+  TEST(ActiveObjectPostTest, EmptyCall)
+  {
+    bool isCalled = false;
+    {
+      ActiveObject activeObject;
+      activeObject.Post(ActiveObject::Call());
+      activeObject.Post([&isCalled]
+      {
+        isCalled = true;
+      });
+    }
+    EXPECT_TRUE(isCalled);
+  }
+
 
   typedef BaseAsyncExecutorTest<AsyncExecutor> AsyncExecutorTest;
 
@@ -233,4 +280,109 @@ namespace
   {
     MultithreadedCallsTest();
   }
+
+
+  typedef BaseAsyncExecutorTest<ThreadPool> ThreadPoolTest;
+
+  INSTANTIATE_TEST_CASE_P(DifferentProducersNumber1,
+    ThreadPoolTest,
+    MultithreadedCallsGenerator1,
+    humanReadbleParams);
+
+  INSTANTIATE_TEST_CASE_P(DifferentProducersNumber2,
+    ThreadPoolTest,
+    MultithreadedCallsGenerator2,
+    humanReadbleParams);
+
+  INSTANTIATE_TEST_CASE_P(DifferentProducersNumber3,
+    ThreadPoolTest,
+    MultithreadedCallsGenerator3,
+    humanReadbleParams);
+
+  TEST_P(ThreadPoolTest, MultithreadedCalls)
+  {
+    MultithreadedCallsTest();
+  }
+
+  TEST(ThreadPoolMetricsTest, QueueDepth)
+  {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future();
+    std::atomic<uint32_t> executed(0);
+    {
+      ThreadPool pool(2);
+      for (int i = 0; i < 10; ++i)
+      {
+        pool.Dispatch([released, &executed]
+        {
+          released.wait();
+          ++executed;
+        });
+      }
+      // Both workers are blocked, so at least 8 tasks are waiting.
+      auto metrics = pool.GetMetrics();
+      EXPECT_LE(8u, metrics.queueDepth);
+      EXPECT_LE(8u, metrics.maxQueueDepth);
+      release.set_value();
+    }
+    // The destructor waits for all dispatched tasks.
+    EXPECT_EQ(10u, executed);
+  }
+
+  TEST(ThreadPoolMetricsTest, TasksDispatchedFromWorker)
+  {
+    std::atomic<uint32_t> executed(0);
+    {
+      ThreadPool pool(3);
+      std::promise<void> done;
+      pool.Dispatch([&pool, &executed, &done]
+      {
+        for (int i = 0; i < 100; ++i)
+          pool.Dispatch([&executed] { ++executed; });
+        done.set_value();
+      });
+      done.get_future().wait();
+    }
+    EXPECT_EQ(100u, executed);
+  }
+
+  TEST(ThreadPoolMetricsTest, IdleWorkerStealsTask)
+  {
+    ThreadPool pool(2);
+    std::promise<void> done;
+    std::future_status status = std::future_status::deferred;
+    std::promise<void> finished;
+    pool.Dispatch([&pool, &done, &status, &finished]
+    {
+      // The task is queued for this worker, which is busy until the task is
+      // done, so only the idle worker can run it.
+      pool.Dispatch([&done] { done.set_value(); });
+      status = done.get_future().wait_for(std::chrono::seconds(5));
+      finished.set_value();
+    });
+    finished.get_future().wait();
+    EXPECT_EQ(std::future_status::ready, status);
+    EXPECT_EQ(1u, pool.GetMetrics().stolenTasks);
+  }
+
+  TEST(OptionalAsyncExecutorTest, LanesAreIndependent)
+  {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future();
+    OptionalAsyncExecutor executor(1, 1);
+    executor.Dispatch([released] { released.wait(); }, AsyncExecutorLane::WebRequest);
+    std::promise<void> done;
+    executor.Dispatch([&done] { done.set_value(); });
+    // The blocked web request lane does not hold back the default lane.
+    done.get_future().wait();
+    // The task is counted once it returns, which is after it has signaled.
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (executor.GetMetrics(AsyncExecutorLane::Default).executedTasks == 0 &&
+           std::chrono::steady_clock::now() < timeout)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(1u, executor.GetMetrics(AsyncExecutorLane::Default).executedTasks);
+    release.set_value();
+    executor.Invalidate();
+    EXPECT_EQ(0u, executor.GetMetrics(AsyncExecutorLane::WebRequest).executedTasks);
+  }
 }
\ No newline at end of file
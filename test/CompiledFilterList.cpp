@@ -0,0 +1,284 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <AdblockPlus/CompiledFilterListMatcher.h>
+#include "../src/CompiledFilterList.h"
+
+using AdblockPlus::FilterEngine;
+using AdblockPlus::FilterIndex;
+namespace CompiledFilterList = AdblockPlus::CompiledFilterList;
+
+namespace
+{
+  const FilterEngine::ContentTypeMask OTHER = FilterEngine::CONTENT_TYPE_OTHER;
+  const FilterEngine::ContentTypeMask SCRIPT = FilterEngine::CONTENT_TYPE_SCRIPT;
+  const FilterEngine::ContentTypeMask IMAGE = FilterEngine::CONTENT_TYPE_IMAGE;
+  const FilterEngine::ContentTypeMask STYLESHEET = FilterEngine::CONTENT_TYPE_STYLESHEET;
+  const size_t PATTERN_STATES_BUDGET = 512;
+
+  CompiledFilterList::Filters CreateFilters()
+  {
+    CompiledFilterList::Filters filters;
+    auto add = [&filters](const std::string& text, const std::string& keyword,
+                          FilterEngine::ContentTypeMask contentTypeMask)
+    {
+      FilterIndex::IndexedFilter filter;
+      filter.keyword = keyword;
+      filter.contentTypeMask = contentTypeMask;
+      filter.isException = text.compare(0, 2, "@@") == 0;
+      filters.emplace_back(text, filter);
+    };
+    add("/banner.", "banner",
+        static_cast<FilterEngine::ContentTypeMask>(IMAGE | SCRIPT));
+    add("||ads.example.com^", "ads", SCRIPT);
+    add("@@||example.org^$image", "example", IMAGE);
+    add("/ad/*/top.", "top", IMAGE);
+    add("/\\/track\\?id=[0-9]+/", "", IMAGE);
+    add("movie.swf|", "movie", static_cast<FilterEngine::ContentTypeMask>(IMAGE | SCRIPT));
+    add("/pixel$domain=example.com|~sub.example.org", "pixel", IMAGE);
+    add("@@/pixel$domain=news.site.com", "pixel", IMAGE);
+    add("/adserver/$match-case", "adserver", IMAGE);
+    // Filters which are left to the JavaScript matcher.
+    add("||tracker.net^$third-party", "tracker", IMAGE);
+    add("$other,third-party", "", OTHER);
+    // Only the first filter with the same text is kept.
+    add("/banner.", "banner", STYLESHEET);
+    return filters;
+  }
+
+  CompiledFilterList::Header ReadHeader(const AdblockPlus::IFileSystem::IOBuffer& data)
+  {
+    CompiledFilterList::Header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    return header;
+  }
+
+  // Overwrites a field of a record of an image.
+  template<typename T>
+  void Corrupt(AdblockPlus::IFileSystem::IOBuffer& data, CompiledFilterList::Section section,
+               size_t recordSize, size_t record, size_t fieldOffset, T value)
+  {
+    size_t offset = ReadHeader(data).sections[section].offset + record * recordSize + fieldOffset;
+    ASSERT_LE(offset + sizeof(value), data.size());
+    std::memcpy(data.data() + offset, &value, sizeof(value));
+  }
+
+  // Holds the content at an odd address, like a file mapped at an offset.
+  class MisalignedBuffer : public AdblockPlus::IFileSystem::IReadOnlyBuffer
+  {
+  public:
+    explicit MisalignedBuffer(const AdblockPlus::IFileSystem::IOBuffer& content)
+      : buffer(content.size() + 1)
+    {
+      std::copy(content.begin(), content.end(), buffer.begin() + 1);
+    }
+
+    const uint8_t* Data() const override
+    {
+      return buffer.data() + 1;
+    }
+
+    size_t Size() const override
+    {
+      return buffer.size() - 1;
+    }
+  private:
+    AdblockPlus::IFileSystem::IOBuffer buffer;
+  };
+
+  bool Open(const AdblockPlus::IFileSystem::IOBuffer& data)
+  {
+    CompiledFilterList::View view;
+    return CompiledFilterList::View::Open(data.data(), data.size(), view);
+  }
+}
+
+TEST(CompiledFilterListTest, MatchesLikeFilterIndex)
+{
+  auto filters = CreateFilters();
+  auto data = CompiledFilterList::Write(filters, PATTERN_STATES_BUDGET);
+  CompiledFilterList::View view;
+  ASSERT_TRUE(CompiledFilterList::View::Open(data.data(), data.size(), view));
+
+  FilterIndex filterIndex(PATTERN_STATES_BUDGET);
+  FilterIndex::Changes changes;
+  changes.added.assign(filters.begin(), filters.end() - 1);
+  filterIndex.Update(std::move(changes));
+  auto snapshot = filterIndex.GetSnapshot();
+
+  const std::string urls[] = {
+    "http://example.com/banner.gif",
+    "http://example.com/BANNER.gif",
+    "https://ads.example.com/x.js",
+    "https://ads.example.com.evil.net/x.js",
+    "http://example.org/ad/banner/top.png",
+    "http://example.org/ad/top.png",
+    "http://x.com/track?id=12",
+    "http://x.com/track?id=x",
+    "http://x.com/movie.swf",
+    "http://x.com/movie.swf?x",
+    "http://x.com/pixel",
+    "http://x.com/adserver/",
+    "http://x.com/AdServer/",
+    "http://tracker.net/",
+    "http://x.com/p\xC3\xA4ge/banner.gif",
+    ""
+  };
+  const std::string documentUrls[] = {
+    "",
+    "http://example.com/",
+    "http://sub.example.org/",
+    "http://news.site.com/",
+    "http://b\xC3\xBC" "cher.de/"
+  };
+  const FilterEngine::ContentTypeMask contentTypeMasks[] = {OTHER, SCRIPT, IMAGE, STYLESHEET};
+  for (const auto& url : urls)
+  {
+    for (const auto& documentUrl : documentUrls)
+    {
+      for (auto contentTypeMask : contentTypeMasks)
+      {
+        std::string expectedFilter;
+        std::string filter;
+        auto expected = snapshot->Match(url, contentTypeMask, documentUrl, expectedFilter);
+        auto result = view.Match(url, contentTypeMask, documentUrl, filter);
+        EXPECT_EQ(expected, result) << url << " " << documentUrl << " " << contentTypeMask;
+        if (expected == FilterIndex::MATCH && result == FilterIndex::MATCH)
+        {
+          EXPECT_EQ(expectedFilter, filter) << url << " " << documentUrl;
+        }
+      }
+    }
+  }
+
+  std::string filterText;
+  EXPECT_EQ(FilterIndex::MATCH, view.Match("http://x.com/pixel", IMAGE,
+                                           "http://news.site.com/", filterText));
+  EXPECT_EQ("@@/pixel$domain=news.site.com", filterText);
+  EXPECT_EQ(FilterIndex::NO_MATCH, view.Match("http://x.com/banner.css", STYLESHEET,
+                                              "", filterText));
+}
+
+TEST(CompiledFilterListTest, EmptyList)
+{
+  auto data = CompiledFilterList::Write(CompiledFilterList::Filters(), PATTERN_STATES_BUDGET);
+  CompiledFilterList::View view;
+  ASSERT_TRUE(CompiledFilterList::View::Open(data.data(), data.size(), view));
+  std::string filterText;
+  EXPECT_EQ(FilterIndex::NO_MATCH, view.Match("http://example.com/", IMAGE, "", filterText));
+}
+
+TEST(CompiledFilterListTest, OtherDataIsRejected)
+{
+  auto data = CompiledFilterList::Write(CreateFilters(), PATTERN_STATES_BUDGET);
+  ASSERT_TRUE(Open(data));
+  const auto& strings = ReadHeader(data).sections[CompiledFilterList::STRINGS];
+  for (size_t size = 0; size < strings.offset + strings.count; ++size)
+  {
+    CompiledFilterList::View view;
+    EXPECT_FALSE(CompiledFilterList::View::Open(data.data(), size, view)) << size;
+  }
+
+  auto otherVersion = data;
+  uint32_t version = CompiledFilterList::FORMAT_VERSION + 1;
+  std::memcpy(otherVersion.data() + offsetof(CompiledFilterList::Header, formatVersion),
+              &version, sizeof(version));
+  EXPECT_FALSE(Open(otherVersion));
+
+  auto otherByteOrder = data;
+  std::swap(otherByteOrder[offsetof(CompiledFilterList::Header, byteOrderMark)],
+            otherByteOrder[offsetof(CompiledFilterList::Header, byteOrderMark) + 3]);
+  EXPECT_FALSE(Open(otherByteOrder));
+
+  // Sections have to be aligned.
+  AdblockPlus::IFileSystem::IOBuffer misaligned(data.size() + 1);
+  std::memcpy(misaligned.data() + 1, data.data(), data.size());
+  CompiledFilterList::View view;
+  EXPECT_FALSE(CompiledFilterList::View::Open(misaligned.data() + 1, data.size(), view));
+
+  std::string text = "[Adblock Plus 2.0]\n/banner.\n";
+  EXPECT_FALSE(CompiledFilterList::View::Open(reinterpret_cast<const uint8_t*>(text.data()),
+                                              text.size(), view));
+}
+
+TEST(CompiledFilterListTest, CorruptedListsAreRejected)
+{
+  auto data = CompiledFilterList::Write(CreateFilters(), PATTERN_STATES_BUDGET);
+  typedef AdblockPlus::AhoCorasickAutomaton::State State;
+  typedef AdblockPlus::PatternAutomaton::Instruction Instruction;
+
+  auto outOfBounds = data;
+  Corrupt(outOfBounds, CompiledFilterList::FILTERS, sizeof(CompiledFilterList::FilterRecord),
+          0, offsetof(CompiledFilterList::FilterRecord, text) + sizeof(uint32_t),
+          uint32_t(0x7FFFFFFF));
+  EXPECT_FALSE(Open(outOfBounds));
+
+  auto sectionOutOfBounds = data;
+  uint32_t offset = static_cast<uint32_t>(data.size() + 8);
+  std::memcpy(sectionOutOfBounds.data() + offsetof(CompiledFilterList::Header, sections) +
+              CompiledFilterList::INSTRUCTIONS * sizeof(CompiledFilterList::SectionReference),
+              &offset, sizeof(offset));
+  EXPECT_FALSE(Open(sectionOutOfBounds));
+
+  // A failure link to the state itself would never terminate.
+  auto failureLoop = data;
+  ASSERT_GT(ReadHeader(data).sections[CompiledFilterList::LITERAL_STATES].count, 1u);
+  Corrupt(failureLoop, CompiledFilterList::LITERAL_STATES, sizeof(State), 1,
+          offsetof(State, failure), uint32_t(1));
+  EXPECT_FALSE(Open(failureLoop));
+
+  auto invalidSuccessor = data;
+  Corrupt(invalidSuccessor, CompiledFilterList::INSTRUCTIONS, sizeof(Instruction), 0,
+          offsetof(Instruction, first), uint32_t(0xFFFF));
+  Corrupt(invalidSuccessor, CompiledFilterList::INSTRUCTIONS, sizeof(Instruction), 0,
+          offsetof(Instruction, type), uint32_t(Instruction::JUMP));
+  EXPECT_FALSE(Open(invalidSuccessor));
+
+  auto invalidInstruction = data;
+  Corrupt(invalidInstruction, CompiledFilterList::INSTRUCTIONS, sizeof(Instruction), 0,
+          offsetof(Instruction, type), uint32_t(Instruction::MATCH + 1));
+  EXPECT_FALSE(Open(invalidInstruction));
+
+  // The first filter is a literal one, so it has no program to run.
+  auto literalPatternFilter = data;
+  Corrupt(literalPatternFilter, CompiledFilterList::PATTERN_KEYWORDS,
+          sizeof(CompiledFilterList::PatternKeywordRecord), 0,
+          offsetof(CompiledFilterList::PatternKeywordRecord, filter), uint32_t(0));
+  EXPECT_FALSE(Open(literalPatternFilter));
+}
+
+TEST(CompiledFilterListTest, MatcherAcceptsMisalignedLists)
+{
+  using AdblockPlus::CompiledFilterListMatcher;
+  auto data = CompiledFilterList::Write(CreateFilters(), PATTERN_STATES_BUDGET);
+  CompiledFilterListMatcher matcher(std::make_shared<MisalignedBuffer>(data));
+  std::string filterText;
+  EXPECT_EQ(CompiledFilterListMatcher::MATCH, matcher.Matches("http://x.com/movie.swf",
+    IMAGE, "", filterText));
+  EXPECT_EQ("movie.swf|", filterText);
+  EXPECT_EQ(CompiledFilterListMatcher::UNKNOWN, matcher.Matches("http://tracker.net/",
+    IMAGE, "", filterText));
+
+  data.resize(data.size() / 2);
+  EXPECT_THROW(CompiledFilterListMatcher(std::make_shared<MisalignedBuffer>(data)),
+               std::invalid_argument);
+}
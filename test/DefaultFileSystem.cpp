@@ -15,13 +15,24 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
+#include <cstdio>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <sstream>
 #include <AdblockPlus.h>
+#include <AdblockPlus/AsyncExecutor.h>
 #include <gtest/gtest.h>
 #include "../src/DefaultFileSystem.h"
 #include "BaseJsTest.h"
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using AdblockPlus::IFileSystem;
 using AdblockPlus::FileSystemPtr;
 using AdblockPlus::SchedulerTask;
@@ -244,3 +255,474 @@ TEST_F(DefaultFileSystemTest, WriteMoveStatRemove)
   PumpTask();
   EXPECT_TRUE(hasStatRemovedFileRun);
 }
+
+TEST_F(DefaultFileSystemTest, WriteReadBufferRemove)
+{
+  // the first one is read into memory, the second one is memory mapped.
+  for (const auto& content : {std::string("foo"),
+    std::string(DefaultFileSystemSync::defaultMinMappedFileSize + 1, 'a')})
+  {
+    WriteString(content);
+
+    bool hasReadRun = false;
+    bool hasErrorRun = false;
+    fileSystem->ReadBuffer(testFileName,
+      [&content, &hasReadRun](const IFileSystem::ReadOnlyBufferPtr& buffer)
+      {
+        ASSERT_EQ(content.size(), buffer->Size());
+        const char* data = reinterpret_cast<const char*>(buffer->Data());
+        EXPECT_EQ(content, std::string(data, data + buffer->Size()));
+        hasReadRun = true;
+      }, [&hasErrorRun](const std::string& error)
+      {
+        hasErrorRun = true;
+      });
+    EXPECT_FALSE(hasReadRun);
+    PumpTask();
+    EXPECT_TRUE(hasReadRun);
+    EXPECT_FALSE(hasErrorRun);
+  }
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty());
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+}
+
+TEST_F(DefaultFileSystemTest, MappedBufferSurvivesOverwrite)
+{
+  const std::string content(DefaultFileSystemSync::defaultMinMappedFileSize, 'a');
+  WriteString(content);
+
+  IFileSystem::ReadOnlyBufferPtr buffer;
+  fileSystem->ReadBuffer(testFileName,
+    [&buffer](const IFileSystem::ReadOnlyBufferPtr& content)
+    {
+      buffer = content;
+    }, [](const std::string& error)
+    {
+      FAIL() << error;
+    });
+  PumpTask();
+  ASSERT_TRUE(buffer);
+
+  WriteString("foo");
+  const char* data = reinterpret_cast<const char*>(buffer->Data());
+  EXPECT_EQ(content, std::string(data, data + buffer->Size()));
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty());
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+}
+
+#ifndef _WIN32
+TEST(DefaultFileSystemSyncTest, WriteKeepsModeAndFollowsSymlinks)
+{
+  DefaultFileSystemSync fileSystem("");
+  const std::string targetFileName = testFileName + "-target";
+  const std::string linkFileName = testFileName + "-link";
+  struct stat nativeStat;
+
+  // New files get the mode restricted by the umask.
+  mode_t previousMask = umask(027);
+  fileSystem.Write(targetFileName, IFileSystem::IOBuffer{'f', 'o', 'o'});
+  umask(previousMask);
+  ASSERT_EQ(0, stat(targetFileName.c_str(), &nativeStat));
+  EXPECT_EQ(0640u, nativeStat.st_mode & 07777);
+
+  // Existing files keep their mode.
+  ASSERT_EQ(0, chmod(targetFileName.c_str(), 0600));
+  fileSystem.Write(targetFileName, IFileSystem::IOBuffer{'b', 'a', 'r'});
+  ASSERT_EQ(0, stat(targetFileName.c_str(), &nativeStat));
+  EXPECT_EQ(0600u, nativeStat.st_mode & 07777);
+
+  // Symbolic links stay in place, the file they point to is replaced.
+  ASSERT_EQ(0, symlink(targetFileName.c_str(), linkFileName.c_str()));
+  fileSystem.Write(linkFileName, IFileSystem::IOBuffer{'b', 'a', 'z'});
+  ASSERT_EQ(0, lstat(linkFileName.c_str(), &nativeStat));
+  EXPECT_TRUE(S_ISLNK(nativeStat.st_mode));
+  EXPECT_EQ((IFileSystem::IOBuffer{'b', 'a', 'z'}), fileSystem.Read(targetFileName));
+
+  fileSystem.Remove(linkFileName);
+  fileSystem.Remove(targetFileName);
+}
+#endif
+
+TEST_F(DefaultFileSystemTest, ReadBufferNonExistingFile)
+{
+  bool hasReadRun = false;
+  std::string error;
+  fileSystem->ReadBuffer(testFileName + "-missing",
+    [&hasReadRun](const IFileSystem::ReadOnlyBufferPtr&)
+    {
+      hasReadRun = true;
+    }, [&error](const std::string& e)
+    {
+      error = e;
+    });
+  PumpTask();
+  EXPECT_FALSE(hasReadRun);
+  EXPECT_FALSE(error.empty());
+}
+
+TEST_F(DefaultFileSystemTest, ReadChunks)
+{
+  std::string content;
+  for (size_t i = 0; content.size() < 2 * DefaultFileSystemSync::readChunkSize + 1; ++i)
+    content += std::to_string(i) + "\n";
+  WriteString(content);
+
+  std::string readContent;
+  size_t chunkCount = 0;
+  bool hasEndRun = false;
+  fileSystem->ReadChunks(testFileName,
+    [&readContent, &chunkCount](const uint8_t* data, size_t size)
+    {
+      EXPECT_GE(static_cast<size_t>(DefaultFileSystemSync::readChunkSize), size);
+      readContent.append(reinterpret_cast<const char*>(data), size);
+      ++chunkCount;
+    }, [&hasEndRun]
+    {
+      hasEndRun = true;
+    }, [](const std::string& error)
+    {
+      FAIL() << error;
+    });
+  PumpTask();
+  EXPECT_TRUE(hasEndRun);
+  EXPECT_EQ(3u, chunkCount);
+  EXPECT_EQ(content, readContent);
+
+  std::string error;
+  hasEndRun = false;
+  fileSystem->ReadChunks(testFileName, [](const uint8_t*, size_t)
+    {
+      throw std::runtime_error("chunk-error");
+    }, [&hasEndRun]
+    {
+      hasEndRun = true;
+    }, [&error](const std::string& e)
+    {
+      error = e;
+    });
+  PumpTask();
+  EXPECT_FALSE(hasEndRun);
+  EXPECT_EQ("chunk-error", error);
+}
+
+TEST_F(DefaultFileSystemTest, OpenForWrite)
+{
+  WriteString("foo");
+
+  // The file stays unchanged until the writer commits.
+  for (bool commit : {false, true})
+  {
+    IFileSystem::FileWriterPtr writer;
+    fileSystem->OpenForWrite(testFileName,
+      [&writer](const IFileSystem::FileWriterPtr& openedWriter, const std::string& error)
+      {
+        EXPECT_TRUE(error.empty()) << error;
+        writer = openedWriter;
+      });
+    PumpTask();
+    ASSERT_TRUE(writer);
+
+    for (std::string chunk : {"bar\n", "baz\n"})
+    {
+      bool hasAppendRun = false;
+      writer->Append(IFileSystem::IOBuffer(chunk.cbegin(), chunk.cend()),
+        [&hasAppendRun](const std::string& error)
+        {
+          EXPECT_TRUE(error.empty()) << error;
+          hasAppendRun = true;
+        });
+      PumpTask();
+      EXPECT_TRUE(hasAppendRun);
+    }
+
+    if (commit)
+    {
+      bool hasCommitRun = false;
+      writer->Commit([&hasCommitRun](const std::string& error)
+        {
+          EXPECT_TRUE(error.empty()) << error;
+          hasCommitRun = true;
+        });
+      PumpTask();
+      EXPECT_TRUE(hasCommitRun);
+    }
+    writer.reset();
+
+    std::string content;
+    fileSystem->Read(testFileName, [&content](IFileSystem::IOBuffer&& data)
+      {
+        content.assign(data.cbegin(), data.cend());
+      }, [](const std::string& error)
+      {
+        FAIL() << error;
+      });
+    PumpTask();
+    EXPECT_EQ(commit ? "bar\nbaz\n" : "foo", content);
+  }
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty());
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+}
+
+TEST_F(DefaultFileSystemTest, Append)
+{
+  for (std::string chunk : {"foo\n", "bar\n"})
+  {
+    bool hasAppendRun = false;
+    fileSystem->Append(testFileName, IFileSystem::IOBuffer(chunk.cbegin(), chunk.cend()),
+      [&hasAppendRun](const std::string& error)
+      {
+        EXPECT_TRUE(error.empty()) << error;
+        hasAppendRun = true;
+      });
+    PumpTask();
+    EXPECT_TRUE(hasAppendRun);
+  }
+
+  std::string content;
+  fileSystem->Read(testFileName, [&content](IFileSystem::IOBuffer&& data)
+    {
+      content.assign(data.cbegin(), data.cend());
+    }, [](const std::string& error)
+    {
+      FAIL() << error;
+    });
+  PumpTask();
+  EXPECT_EQ("foo\nbar\n", content);
+
+  bool hasRemoveRun = false;
+  fileSystem->Remove(testFileName, [&hasRemoveRun](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty());
+    hasRemoveRun = true;
+  });
+  PumpTask();
+  EXPECT_TRUE(hasRemoveRun);
+}
+
+namespace
+{
+  class CoalescingDefaultFileSystemTest : public DefaultFileSystemTest
+  {
+  public:
+    void SetUp() override
+    {
+      CreateFileSystem(std::chrono::milliseconds(50));
+    }
+
+    void TearDown() override
+    {
+      fileSystem.reset();
+      std::remove(testFileName.c_str());
+    }
+  protected:
+    // Callbacks of flushed writes are scheduled by the flush thread.
+    std::mutex tasksMutex;
+
+    void CreateFileSystem(const std::chrono::milliseconds& writeCoalescingWindow)
+    {
+      fileSystem.reset(new DefaultFileSystem([this](const SchedulerTask& task)
+        {
+          std::lock_guard<std::mutex> lock(tasksMutex);
+          fileSystemTasks.emplace_back(task);
+        }, std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync("")),
+        writeCoalescingWindow));
+    }
+
+    void RunTasks()
+    {
+      std::list<SchedulerTask> tasks;
+      {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.swap(fileSystemTasks);
+      }
+      for (const auto& task : tasks)
+        task();
+    }
+
+    // Runs scheduled tasks until the condition is met, returns false if it
+    // isn't met within a few seconds.
+    bool RunTasksUntil(const std::function<bool()>& condition)
+    {
+      auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (!condition())
+      {
+        if (std::chrono::steady_clock::now() > timeout)
+          return false;
+        RunTasks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return true;
+    }
+
+    void Write(const std::string& content, const IFileSystem::Callback& callback)
+    {
+      fileSystem->Write(testFileName,
+        IFileSystem::IOBuffer(content.cbegin(), content.cend()), callback);
+    }
+
+    std::string ReadFromDisk()
+    {
+      auto content = DefaultFileSystemSync("").Read(testFileName);
+      return std::string(content.cbegin(), content.cend());
+    }
+  };
+}
+
+TEST_F(CoalescingDefaultFileSystemTest, WritesAreCollapsed)
+{
+  int callbackCount = 0;
+  auto callback = [&callbackCount](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty()) << error;
+    ++callbackCount;
+  };
+  Write("foo", callback);
+  Write("bar", callback);
+
+  // the pending content is visible before it is written.
+  std::string content;
+  fileSystem->Read(testFileName, [&content](IFileSystem::IOBuffer&& data)
+    {
+      content.assign(data.cbegin(), data.cend());
+    }, [](const std::string& error)
+    {
+      FAIL() << error;
+    });
+  bool exists = false;
+  fileSystem->Stat(testFileName, [&exists](const IFileSystem::StatResult& result, const std::string& error)
+    {
+      EXPECT_TRUE(error.empty()) << error;
+      exists = result.exists;
+    });
+  RunTasks();
+  EXPECT_EQ("bar", content);
+  EXPECT_TRUE(exists);
+
+  ASSERT_TRUE(RunTasksUntil([&callbackCount]
+    {
+      return callbackCount == 2;
+    }));
+  EXPECT_EQ("bar", ReadFromDisk());
+}
+
+TEST_F(CoalescingDefaultFileSystemTest, StreamedWritesAreCollapsed)
+{
+  CreateFileSystem(std::chrono::hours(1));
+  int callbackCount = 0;
+  auto callback = [&callbackCount](const std::string& error)
+  {
+    EXPECT_TRUE(error.empty()) << error;
+    ++callbackCount;
+  };
+  Write("foo", callback);
+
+  IFileSystem::FileWriterPtr writer;
+  fileSystem->OpenForWrite(testFileName,
+    [&writer](const IFileSystem::FileWriterPtr& openedWriter, const std::string& error)
+    {
+      EXPECT_TRUE(error.empty()) << error;
+      writer = openedWriter;
+    });
+  RunTasks();
+  ASSERT_TRUE(writer);
+  for (std::string chunk : {"bar\n", "baz\n"})
+    writer->Append(IFileSystem::IOBuffer(chunk.cbegin(), chunk.cend()), callback);
+  writer->Commit(callback);
+  writer.reset();
+  RunTasks();
+
+  // neither write has reached the disk, the committed content is pending.
+  EXPECT_ANY_THROW(ReadFromDisk());
+  std::string content;
+  fileSystem->Read(testFileName, [&content](IFileSystem::IOBuffer&& data)
+    {
+      content.assign(data.cbegin(), data.cend());
+    }, [](const std::string& error)
+    {
+      FAIL() << error;
+    });
+  RunTasks();
+  EXPECT_EQ("bar\nbaz\n", content);
+
+  fileSystem.reset();
+  RunTasks();
+  EXPECT_EQ("bar\nbaz\n", ReadFromDisk());
+  EXPECT_EQ(4, callbackCount);
+}
+
+TEST_F(CoalescingDefaultFileSystemTest, PendingWritesAreFlushedOnDestruction)
+{
+  CreateFileSystem(std::chrono::hours(1));
+  bool hasWriteRun = false;
+  Write("foo", [&hasWriteRun](const std::string& error)
+    {
+      EXPECT_TRUE(error.empty()) << error;
+      hasWriteRun = true;
+    });
+  fileSystem.reset();
+  EXPECT_EQ("foo", ReadFromDisk());
+  // the callback isn't called by the destructor.
+  EXPECT_FALSE(hasWriteRun);
+  RunTasks();
+  EXPECT_TRUE(hasWriteRun);
+}
+
+TEST_F(CoalescingDefaultFileSystemTest, CallbacksAreDroppedAfterInvalidation)
+{
+  auto asyncExecutor = std::make_shared<OptionalAsyncExecutor>(1, 1);
+  fileSystem.reset(new DefaultFileSystem([asyncExecutor](const SchedulerTask& task)
+    {
+      asyncExecutor->Dispatch(task);
+    }, std::unique_ptr<DefaultFileSystemSync>(new DefaultFileSystemSync("")),
+    std::chrono::hours(1)));
+  std::atomic<bool> hasWriteRun(false);
+  Write("foo", [&hasWriteRun](const std::string&)
+    {
+      hasWriteRun = true;
+    });
+  asyncExecutor->Invalidate();
+  fileSystem.reset();
+  EXPECT_EQ("foo", ReadFromDisk());
+  EXPECT_FALSE(hasWriteRun);
+}
+
+TEST_F(CoalescingDefaultFileSystemTest, RemoveFlushesPendingWrite)
+{
+  CreateFileSystem(std::chrono::hours(1));
+  bool hasWriteRun = false;
+  Write("foo", [&hasWriteRun](const std::string& error)
+    {
+      hasWriteRun = true;
+    });
+  std::string removeError = "not called";
+  fileSystem->Remove(testFileName, [&removeError](const std::string& error)
+    {
+      removeError = error;
+    });
+  RunTasks();
+  RunTasks();
+  EXPECT_TRUE(hasWriteRun);
+  EXPECT_EQ("", removeError);
+  EXPECT_ANY_THROW(ReadFromDisk());
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../src/DefaultTimer.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class DefaultTimerTest : public ::testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      timer.reset(new DefaultTimer());
+    }
+
+    std::unique_ptr<ITimer> timer;
+  };
+
+  // Keeps the callbacks until they are fired manually.
+  class ManualTimer : public ITimer
+  {
+  public:
+    void SetTimer(const std::chrono::milliseconds& /*timeout*/, const TimerCallback& timerCallback) override
+    {
+      callbacks.push_back(timerCallback);
+    }
+
+    std::vector<TimerCallback> callbacks;
+  };
+}
+
+TEST_F(DefaultTimerTest, TimersFireInOrder)
+{
+  std::mutex mutex;
+  std::vector<int> fired;
+  std::promise<void> done;
+  auto addTimer = [this, &mutex, &fired](int id, int timeout)
+  {
+    timer->SetTimer(std::chrono::milliseconds(timeout), [id, &mutex, &fired]
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      fired.push_back(id);
+    });
+  };
+  addTimer(3, 30);
+  addTimer(1, 10);
+  addTimer(4, 31);
+  addTimer(2, 10);
+  timer->SetTimer(std::chrono::milliseconds(50), [&done]
+  {
+    done.set_value();
+  });
+  done.get_future().wait();
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(std::vector<int>({1, 2, 3, 4}), fired);
+}
+
+TEST_F(DefaultTimerTest, TimerDoesNotFireEarly)
+{
+  std::promise<std::chrono::steady_clock::time_point> firedAt;
+  auto start = std::chrono::steady_clock::now();
+  timer->SetTimer(std::chrono::milliseconds(25), [&firedAt]
+  {
+    firedAt.set_value(std::chrono::steady_clock::now());
+  });
+  EXPECT_LE(std::chrono::milliseconds(25), firedAt.get_future().get() - start);
+}
+
+TEST_F(DefaultTimerTest, CancelReleasesCallback)
+{
+  auto payload = std::make_shared<int>(0);
+  std::atomic<bool> isFired(false);
+  auto cancel = timer->SetCancelableTimer(std::chrono::milliseconds(20), [payload, &isFired]
+  {
+    isFired = true;
+  });
+  EXPECT_EQ(2, payload.use_count());
+  cancel();
+  EXPECT_TRUE(payload.unique());
+
+  std::promise<void> done;
+  timer->SetTimer(std::chrono::milliseconds(40), [&done]
+  {
+    done.set_value();
+  });
+  done.get_future().wait();
+  EXPECT_FALSE(isFired);
+  // no effect after the destruction of the timer
+  timer.reset();
+  cancel();
+}
+
+TEST_F(DefaultTimerTest, ManyTimers)
+{
+  const int timersNumber = 100000;
+  std::atomic<int> firedNumber(0);
+  std::vector<ITimer::CancelTimerCallback> cancels;
+  for (int i = 0; i < timersNumber; ++i)
+  {
+    timer->SetTimer(std::chrono::milliseconds(i % 100), [&firedNumber]
+    {
+      ++firedNumber;
+    });
+    // far away timers which are never fired
+    cancels.push_back(timer->SetCancelableTimer(std::chrono::hours(1 + i % 1000), []
+    {
+    }));
+  }
+  for (auto& cancel : cancels)
+    cancel();
+  std::promise<void> done;
+  timer->SetTimer(std::chrono::milliseconds(200), [&done]
+  {
+    done.set_value();
+  });
+  done.get_future().wait();
+  EXPECT_EQ(timersNumber, firedNumber);
+}
+
+TEST(ITimerTest, DefaultCancelableTimer)
+{
+  ManualTimer timer;
+  auto payload = std::make_shared<int>(0);
+  int firedNumber = 0;
+  auto cancel = timer.SetCancelableTimer(std::chrono::milliseconds(0), [payload, &firedNumber]
+  {
+    ++firedNumber;
+  });
+  timer.SetCancelableTimer(std::chrono::milliseconds(0), [&firedNumber]
+  {
+    ++firedNumber;
+  });
+  ASSERT_EQ(2u, timer.callbacks.size());
+  cancel();
+  EXPECT_TRUE(payload.unique());
+  for (auto& callback : timer.callbacks)
+    callback();
+  EXPECT_EQ(1, firedNumber);
+}
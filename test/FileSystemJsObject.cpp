@@ -15,6 +15,7 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <sstream>
 #include "BaseJsTest.h"
 #include "../src/Thread.h"
@@ -36,8 +37,10 @@ namespace
     mutable std::string statFile;
     bool statExists;
     int statLastModified;
+    // If not zero then ReadChunks passes the content in chunks of this size.
+    size_t readChunkSize;
 
-    MockFileSystem() : success(true)
+    MockFileSystem() : success(true), readChunkSize(0)
     {
     }
 
@@ -56,6 +59,26 @@ namespace
         errorCallback("Unable to read " + fileName);
     }
 
+    void ReadChunks(const std::string& fileName,
+                    const ReadChunkCallback& chunkCallback,
+                    const ReadEndCallback& endCallback,
+                    const Callback& errorCallback) const override
+    {
+      if (readChunkSize == 0 || !success)
+        return IFileSystem::ReadChunks(fileName, chunkCallback, endCallback, errorCallback);
+      try
+      {
+        for (size_t offset = 0; offset < contentToRead.size(); offset += readChunkSize)
+          chunkCallback(contentToRead.data() + offset,
+            std::min(readChunkSize, contentToRead.size() - offset));
+        endCallback();
+      }
+      catch (const std::exception& ex)
+      {
+        errorCallback(ex.what());
+      }
+    }
+
     void Write(const std::string& fileName, const IOBuffer& data,
                const Callback& callback) override
     {
@@ -149,6 +172,19 @@ TEST_F(FileSystemJsObjectTest, ReadIllegalArguments)
   ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.read('', '')"));
 }
 
+TEST_F(FileSystemJsObjectTest, IllegalArgumentsErrorMessages)
+{
+  auto& jsEngine = GetJsEngine();
+  EXPECT_EQ("_fileSystem.read requires 3 parameters",
+    jsEngine.Evaluate("try { _fileSystem.read('') } catch (e) { e }").AsString());
+  EXPECT_EQ("Third argument to _fileSystem.write must be a function",
+    jsEngine.Evaluate("try { _fileSystem.write('', '', '') } catch (e) { e }").AsString());
+  EXPECT_EQ("_fileSystem.readFromFile requires 4 or 5 parameters",
+    jsEngine.Evaluate("try { _fileSystem.readFromFile('') } catch (e) { e }").AsString());
+  EXPECT_EQ("Fifth argument to _fileSystem.readFromFile must be a non-negative number",
+    jsEngine.Evaluate("try { _fileSystem.readFromFile('', () => {}, () => {}, () => {}, -1) } catch (e) { e }").AsString());
+}
+
 TEST_F(FileSystemJsObjectTest, ReadError)
 {
   mockFileSystem->success = false;
@@ -181,6 +217,68 @@ TEST_F(FileSystemJsObjectTest, WriteError)
   ASSERT_NE("", GetJsEngine().Evaluate("error").AsString());
 }
 
+TEST_F(FileSystemJsObjectTest, Append)
+{
+  mockFileSystem->statExists = true;
+  mockFileSystem->contentToRead = AdblockPlus::IFileSystem::IOBuffer{'f', 'o', 'o'};
+  GetJsEngine().Evaluate("let error = true; _fileSystem.append('foo', 'bar', function(e) {error = e})");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ((AdblockPlus::IFileSystem::IOBuffer{'f', 'o', 'o', 'b', 'a', 'r'}),
+            mockFileSystem->lastWrittenContent);
+  ASSERT_TRUE(GetJsEngine().Evaluate("error").IsUndefined());
+}
+
+TEST_F(FileSystemJsObjectTest, AppendToNonExistingFile)
+{
+  mockFileSystem->statExists = false;
+  GetJsEngine().Evaluate("let error = true; _fileSystem.append('foo', 'bar', function(e) {error = e})");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ((AdblockPlus::IFileSystem::IOBuffer{'b', 'a', 'r'}),
+            mockFileSystem->lastWrittenContent);
+  ASSERT_TRUE(GetJsEngine().Evaluate("error").IsUndefined());
+}
+
+TEST_F(FileSystemJsObjectTest, AppendError)
+{
+  mockFileSystem->success = false;
+  GetJsEngine().Evaluate("let error = true; _fileSystem.append('foo', 'bar', function(e) {error = e})");
+  ASSERT_NE("", GetJsEngine().Evaluate("error").AsString());
+}
+
+TEST_F(FileSystemJsObjectTest, WriteChunks)
+{
+  GetJsEngine().Evaluate(R"js(
+let chunks = ["foo", "bar"];
+let error = true;
+_fileSystem.writeChunks('foo', () => chunks.shift(), function(e) {error = e});
+)js");
+  ASSERT_EQ("foo", mockFileSystem->lastWrittenFile);
+  ASSERT_EQ((AdblockPlus::IFileSystem::IOBuffer{'f', 'o', 'o', 'b', 'a', 'r'}),
+            mockFileSystem->lastWrittenContent);
+  ASSERT_TRUE(GetJsEngine().Evaluate("error").IsUndefined());
+}
+
+TEST_F(FileSystemJsObjectTest, WriteChunksIllegalArguments)
+{
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.writeChunks()"));
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("_fileSystem.writeChunks('', '', function() {})"));
+}
+
+TEST_F(FileSystemJsObjectTest, WriteChunksError)
+{
+  GetJsEngine().Evaluate(R"js(
+let error = true;
+_fileSystem.writeChunks('foo', () => { throw new Error("chunk-error"); },
+  function(e) {error = e});
+)js");
+  ASSERT_TRUE(mockFileSystem->lastWrittenFile.empty());
+  ASSERT_NE(std::string::npos, GetJsEngine().Evaluate("error").AsString().find("chunk-error"));
+
+  mockFileSystem->success = false;
+  GetJsEngine().Evaluate("error = true; _fileSystem.writeChunks('foo', () => null, function(e) {error = e})");
+  ASSERT_NE("", GetJsEngine().Evaluate("error").AsString());
+}
+
 TEST_F(FileSystemJsObjectTest, Move)
 {
   GetJsEngine().Evaluate("let error = true; _fileSystem.move('foo', 'bar', function(e) {error = e})");
@@ -362,6 +460,100 @@ TEST_F(FileSystemJsObject_ReadFromFileTest, Lines)
     {"first", "second", "third"});
 }
 
+TEST_F(FileSystemJsObject_ReadFromFileTest, LinesAcrossChunks)
+{
+  for (size_t chunkSize : {1, 2, 3, 5})
+  {
+    mockFileSystem->readChunkSize = chunkSize;
+    readFromFile_Lines({}, {""});
+    readFromFile_Lines({"\n\r\n"}, {""});
+    readFromFile_Lines({"line"}, {"line"});
+
+    readFromFile_Lines(
+      "first\n"
+      "second\r\n"
+      "third\r\n"
+      "\r\n"
+      "\n"
+      "last",
+      {"first", "second", "third", "last"});
+
+    readFromFile_Lines(
+      "\n"
+      "first\n"
+      "second\r\n"
+      "third\r\n",
+      {"first", "second", "third"});
+  }
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, LinesLongerThanOneBlock)
+{
+  // Line ends are searched for a block of 16 bytes at a time, the lengths
+  // around multiples of it cover the remainder of each search.
+  Lines lines;
+  for (size_t length : {15, 16, 17, 31, 32, 33, 100})
+    lines.emplace_back(length, static_cast<char>('a' + lines.size()));
+  for (const char* lineBreak : {"\r", "\r\n"})
+  {
+    std::string content;
+    for (const auto& line : lines)
+      content += line + lineBreak;
+    for (size_t chunkSize : {0, 7, 40})
+    {
+      mockFileSystem->readChunkSize = chunkSize;
+      readFromFile_Lines(content, lines);
+    }
+  }
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, ManyLinesWithCarriageReturns)
+{
+  // A file with \r line breaks in a single chunk, splitting it must not scan
+  // the rest of the chunk for every line.
+  Lines lines;
+  std::string content;
+  for (int i = 0; i < 50000; ++i)
+  {
+    lines.emplace_back("line number " + std::to_string(i));
+    content += lines.back() + "\r";
+  }
+  readFromFile_Lines(content, lines);
+}
+
+TEST_F(FileSystemJsObject_ReadFromFileTest, LineBatches)
+{
+  std::string content = "1\n2\r\n3\n\n4\n5";
+  mockFileSystem->contentToRead.assign(content.begin(), content.end());
+
+  for (size_t chunkSize : {0, 3})
+  {
+    mockFileSystem->readChunkSize = chunkSize;
+    std::vector<std::string> batches;
+    auto& jsEngine = GetJsEngine();
+    jsEngine.SetEventCallback("onLines", [&batches](JsValueList&& jsArgs)
+    {
+      ASSERT_EQ(1u, jsArgs.size());
+      batches.emplace_back(jsArgs[0].AsString());
+    });
+    jsEngine.Evaluate(R"js(_fileSystem.readFromFile("foo",
+  (lines) => _triggerEvent("onLines", lines.join(",")),
+  () => {}, () => {}, 2);
+)js");
+    std::string lines;
+    for (const auto& batch : batches)
+    {
+      EXPECT_GE(1u, std::count(batch.begin(), batch.end(), ','));
+      lines += (lines.empty() ? "" : ",") + batch;
+    }
+    EXPECT_EQ("1,2,3,4,5", lines);
+    if (chunkSize == 0)
+    {
+      EXPECT_EQ(std::vector<std::string>({"1,2", "3,4", "5"}), batches);
+    }
+  }
+}
+
 TEST_F(FileSystemJsObject_ReadFromFileTest, ProcessLineThrowsException)
 {
   std::string content = "1\n2\n3";
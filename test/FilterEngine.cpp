@@ -16,6 +16,7 @@
  */
 
 #include "BaseJsTest.h"
+#include <AdblockPlus/CompiledFilterListMatcher.h>
 #include <AdblockPlus/DefaultLogSystem.h>
 #include <thread>
 #include <condition_variable>
@@ -74,8 +75,9 @@ namespace
 
   class FilterEngineWithInMemoryFS : public BaseJsTest
   {
-    LazyFileSystem* fileSystem;
   protected:
+    LazyFileSystem* fileSystem;
+
     void InitPlatformAndAppInfo(const AppInfo& appInfo = AppInfo())
     {
       ThrowingPlatformCreationParameters platformParams;
@@ -578,6 +580,206 @@ TEST_F(FilterEngineTest, SetRemoveFilterChangeCallback)
   EXPECT_EQ(1, timesCalled);
 }
 
+TEST_F(FilterEngineTest, FilterChangeBatchCallback)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto generation = filterEngine.GetFiltersGeneration();
+  std::vector<FilterChangeBatch> batches;
+  filterEngine.SetFilterChangeBatchCallback([&batches](FilterChangeBatch&& batch)
+  {
+    batches.push_back(std::move(batch));
+  });
+  GetJsEngine().Evaluate("API.addFilterToList(API.getFilterFromText('foo'));"
+    "API.addFilterToList(API.getFilterFromText('bar'))");
+  ASSERT_EQ(1u, batches.size());
+  EXPECT_EQ(2u, batches[0].GetActionCounts().at("filter.added"));
+  EXPECT_FALSE(batches[0].GetSubscriptionUrls().empty());
+  EXPECT_EQ(generation + 1, batches[0].GetGeneration());
+  std::vector<std::string> addedFilters;
+  for (const auto& change : batches[0].GetChanges())
+  {
+    if (change.first == "filter.added")
+      addedFilters.push_back(change.second.GetProperty("text").AsString());
+  }
+  EXPECT_EQ((std::vector<std::string>{"foo", "bar"}), addedFilters);
+
+  filterEngine.GetFilter("foo").RemoveFromList();
+  ASSERT_EQ(2u, batches.size());
+  EXPECT_EQ(1u, batches[1].GetActionCounts().at("filter.removed"));
+  EXPECT_EQ(generation + 2, batches[1].GetGeneration());
+
+  filterEngine.RemoveFilterChangeBatchCallback();
+  filterEngine.GetFilter("bar").RemoveFromList();
+  EXPECT_EQ(2u, batches.size());
+}
+
+TEST_F(FilterEngineTest, FiltersGeneration)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto generation = filterEngine.GetFiltersGeneration();
+  GetJsEngine().Evaluate("API.addFilterToList(API.getFilterFromText('foo'));"
+    "API.addFilterToList(API.getFilterFromText('bar'))");
+  EXPECT_EQ(generation + 1, filterEngine.GetFiltersGeneration());
+  filterEngine.GetFilter("foo").RemoveFromList();
+  EXPECT_EQ(generation + 2, filterEngine.GetFiltersGeneration());
+}
+
+TEST_F(FilterEngineTest, WaitForFiltersChange)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto generation = filterEngine.GetFiltersGeneration();
+  EXPECT_EQ(generation, filterEngine.WaitForFiltersChange(generation, std::chrono::milliseconds(1)));
+
+  uint64_t newGeneration = generation;
+  std::thread waiter([&filterEngine, generation, &newGeneration]
+  {
+    newGeneration = filterEngine.WaitForFiltersChange(generation, std::chrono::seconds(10));
+  });
+  filterEngine.GetFilter("foo").AddToList();
+  waiter.join();
+  EXPECT_EQ(generation + 1, newGeneration);
+}
+
+TEST_F(FilterEngineTest, MatchesFollowsCompleteFilterChanges)
+{
+  auto& filterEngine = GetFilterEngine();
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  auto filter = filterEngine.GetFilter("adbanner.gif$font");
+  filter.AddToList();
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_MEDIA, ""));
+
+  filter.SetProperty("disabled", true);
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  filter.SetProperty("disabled", false);
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  filter.RemoveFromList();
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+}
+
+TEST_F(FilterEngineTest, FilterIndexMemoryUsage)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto memoryUsage = filterEngine.GetFilterIndexMemoryUsage();
+  std::string prefix = "/banner-of-a-long-filter-list-";
+  for (int i = 0; i < 300; ++i)
+    filterEngine.GetFilter(prefix + std::to_string(i) + ".gif").AddToList();
+  // At least the filter texts and the literals are stored.
+  EXPECT_GE(filterEngine.GetFilterIndexMemoryUsage() - memoryUsage,
+            300 * 2 * (prefix.size() + 4));
+  for (int i = 0; i < 300; i += 7)
+  {
+    std::string filterText = prefix + std::to_string(i) + ".gif";
+    auto filter = filterEngine.Matches("http://example.org" + filterText,
+      AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "");
+    ASSERT_TRUE(filter) << filterText;
+    EXPECT_EQ(filterText, filter->GetProperty("text").AsString());
+  }
+  EXPECT_FALSE(filterEngine.Matches("http://example.org" + prefix + "300.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, ""));
+  EXPECT_FALSE(filterEngine.Matches("http://example.org" + prefix + "42.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_SCRIPT, ""));
+}
+
+TEST_F(FilterEngineTest, CompileFilterList)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto compiledFilterList = filterEngine.CompileFilterList(
+    "[Adblock Plus 2.0]\n! Comment\n/banner.\r\n@@||example.org^$image\n"
+    "example.com##.ad\n/banner.\n");
+  // Compiling doesn't change the filters of the engine.
+  EXPECT_FALSE(filterEngine.Matches("http://example.com/banner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, ""));
+
+  CompiledFilterListMatcher matcher(std::make_shared<IFileSystem::ReadOnlyIOBuffer>(
+    std::move(compiledFilterList)));
+  std::string filterText;
+  EXPECT_EQ(CompiledFilterListMatcher::MATCH, matcher.Matches("http://example.com/banner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "", filterText));
+  EXPECT_EQ("/banner.", filterText);
+  EXPECT_EQ(CompiledFilterListMatcher::MATCH, matcher.Matches("http://example.org/banner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "", filterText));
+  EXPECT_EQ("@@||example.org^$image", filterText);
+  EXPECT_EQ(CompiledFilterListMatcher::MATCH, matcher.Matches("http://example.org/banner.js",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_SCRIPT, "", filterText));
+  EXPECT_EQ("/banner.", filterText);
+  EXPECT_EQ(CompiledFilterListMatcher::NO_MATCH, matcher.Matches("http://example.com/ad.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "", filterText));
+
+  EXPECT_THROW(CompiledFilterListMatcher(std::make_shared<IFileSystem::ReadOnlyIOBuffer>(
+    IFileSystem::IOBuffer(3, 'x'))), std::invalid_argument);
+}
+
+TEST_F(FilterEngineTest, CompileActiveFilters)
+{
+  auto& filterEngine = GetFilterEngine();
+  filterEngine.GetFilter("/banner.").AddToList();
+  filterEngine.GetFilter("example.com##.ad").AddToList();
+  auto disabledFilter = filterEngine.GetFilter("/advert.");
+  disabledFilter.AddToList();
+  disabledFilter.SetProperty("disabled", true);
+
+  CompiledFilterListMatcher matcher(std::make_shared<IFileSystem::ReadOnlyIOBuffer>(
+    filterEngine.CompileActiveFilters()));
+  std::string filterText;
+  EXPECT_EQ(CompiledFilterListMatcher::MATCH, matcher.Matches("http://example.com/banner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "", filterText));
+  EXPECT_EQ("/banner.", filterText);
+  EXPECT_EQ(CompiledFilterListMatcher::NO_MATCH, matcher.Matches("http://example.com/advert.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_IMAGE, "", filterText));
+}
+
+TEST_F(FilterEngineTest, MatchesFollowsSubscriptionChanges)
+{
+  auto& filterEngine = GetFilterEngine();
+  auto subscription = filterEngine.GetSubscription("https://example.org/list.txt");
+  subscription.AddToList();
+  auto setSubscriptionFilters = [this](const std::string& filters)
+  {
+    GetJsEngine().Evaluate(
+      "(function()"
+      "{"
+      "  let {Filter} = require('filterClasses');"
+      "  let {FilterStorage} = require('filterStorage');"
+      "  let {Subscription} = require('subscriptionClasses');"
+      "  FilterStorage.updateSubscriptionFilters("
+      "    Subscription.fromURL('https://example.org/list.txt'),"
+      "    [" + filters + "].map(text => Filter.fromText(text)));"
+      "})();");
+  };
+
+  setSubscriptionFilters("'adbanner.gif$font'");
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  subscription.SetDisabled(true);
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  subscription.SetDisabled(false);
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  setSubscriptionFilters("'adframe.html$font'");
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adbanner.gif",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+  EXPECT_TRUE(filterEngine.Matches("http://example.org/adframe.html",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+
+  subscription.RemoveFromList();
+  EXPECT_FALSE(filterEngine.Matches("http://example.org/adframe.html",
+    AdblockPlus::FilterEngine::CONTENT_TYPE_FONT, ""));
+}
+
 TEST_F(FilterEngineTest, DocumentWhitelisting)
 {
   auto& filterEngine = GetFilterEngine();
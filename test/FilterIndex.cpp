@@ -0,0 +1,389 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <gtest/gtest.h>
+#include "../src/FilterIndex.h"
+
+using AdblockPlus::FilterEngine;
+using AdblockPlus::FilterIndex;
+
+namespace
+{
+  const FilterEngine::ContentTypeMask IMAGE = FilterEngine::CONTENT_TYPE_IMAGE;
+  const FilterEngine::ContentTypeMask SCRIPT = FilterEngine::CONTENT_TYPE_SCRIPT;
+  const size_t PATTERN_STATES_BUDGET = 512;
+
+  FilterIndex::IndexedFilter CreateFilter(const std::string& keyword,
+    FilterEngine::ContentTypeMask contentTypeMask, bool isException = false)
+  {
+    FilterIndex::IndexedFilter filter;
+    filter.keyword = keyword;
+    filter.contentTypeMask = contentTypeMask;
+    filter.isException = isException;
+    return filter;
+  }
+
+  class FilterIndexTest : public ::testing::Test
+  {
+  protected:
+    FilterIndex filterIndex;
+
+    FilterIndexTest()
+      : filterIndex(PATTERN_STATES_BUDGET)
+    {
+    }
+
+    void Add(const std::string& text, const std::string& keyword,
+      FilterEngine::ContentTypeMask contentTypeMask = IMAGE)
+    {
+      FilterIndex::Changes changes;
+      changes.added.emplace_back(text, CreateFilter(keyword, contentTypeMask,
+                                                    text.compare(0, 2, "@@") == 0));
+      filterIndex.Update(std::move(changes));
+    }
+
+    void Remove(const std::string& text)
+    {
+      FilterIndex::Changes changes;
+      changes.removed.push_back(text);
+      filterIndex.Update(std::move(changes));
+    }
+
+    FilterIndex::MatchResult Match(const std::string& url,
+      FilterEngine::ContentTypeMask contentTypeMask = IMAGE,
+      const std::string& documentUrl = "")
+    {
+      std::string filterText;
+      return filterIndex.GetSnapshot()->Match(url, contentTypeMask, documentUrl, filterText);
+    }
+
+    std::string GetMatchingFilter(const std::string& url,
+      FilterEngine::ContentTypeMask contentTypeMask = IMAGE,
+      const std::string& documentUrl = "")
+    {
+      std::string filterText;
+      EXPECT_EQ(FilterIndex::MATCH, filterIndex.GetSnapshot()->Match(url,
+        contentTypeMask, documentUrl, filterText)) << url;
+      return filterText;
+    }
+  };
+}
+
+TEST_F(FilterIndexTest, EmptyIndexMatchesNothing)
+{
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanner.gif"));
+}
+
+TEST_F(FilterIndexTest, KeywordsOfJsFiltersAreMatchedAgainstUrlTokens)
+{
+  Add("/adbanner.$third-party", "adbanner");
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/adbanner.gif"));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/ADBanner.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanners.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/banner.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanner.gif", SCRIPT));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/adbanner.gif", SCRIPT | IMAGE));
+}
+
+TEST_F(FilterIndexTest, JsFiltersWithoutKeywordMatchEverything)
+{
+  Add("/^https?:\\/\\/ad/$third-party", "");
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/", FilterEngine::CONTENT_TYPE_FONT));
+  Remove("/^https?:\\/\\/ad/$third-party");
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/"));
+}
+
+TEST_F(FilterIndexTest, NonAsciiUrlsAreLeftToJs)
+{
+  Add("/adbanner.$third-party", "adbanner");
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/\xE2\x84\xAA"));
+  Remove("/adbanner.$third-party");
+  Add("/adbanner.", "adbanner");
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/\xE2\x84\xAA"));
+}
+
+TEST_F(FilterIndexTest, RemovedKeywordsAreNotMatched)
+{
+  Add("/adbanner.$third-party", "adbanner");
+  Add("/adbanner.$script,third-party", "adbanner", SCRIPT);
+  Add("/tracker.$third-party", "tracker");
+  Remove("/adbanner.$third-party");
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanner.gif"));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/adbanner.gif", SCRIPT));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/tracker.gif"));
+}
+
+TEST_F(FilterIndexTest, PublishedSnapshotsAreImmutable)
+{
+  Add("/adbanner.", "adbanner");
+  auto snapshot = filterIndex.GetSnapshot();
+  Remove("/adbanner.");
+  Add("/tracker.$third-party", "tracker");
+  std::string filterText;
+  EXPECT_EQ(FilterIndex::MATCH, snapshot->Match("http://example.com/adbanner.gif",
+                                                IMAGE, "", filterText));
+  EXPECT_EQ(FilterIndex::NO_MATCH, snapshot->Match("http://example.com/tracker.gif",
+                                                   IMAGE, "", filterText));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanner.gif"));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/tracker.gif"));
+}
+
+TEST_F(FilterIndexTest, ManyKeywords)
+{
+  FilterIndex::Changes changes;
+  for (int i = 0; i < 10000; ++i)
+  {
+    std::string keyword = "keyword" + std::to_string(i);
+    changes.added.emplace_back("/" + keyword + "/$third-party", CreateFilter(keyword, IMAGE));
+  }
+  filterIndex.Update(std::move(changes));
+
+  for (int i = 0; i < 10000; ++i)
+    EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/keyword" + std::to_string(i) + "/"));
+
+  int falsePositives = 0;
+  for (int i = 0; i < 10000; ++i)
+  {
+    if (Match("http://example.com/token" + std::to_string(i) + "/") != FilterIndex::NO_MATCH)
+      ++falsePositives;
+  }
+  // Both tokens of the URL are checked, one of them is "com".
+  EXPECT_LT(falsePositives, 500);
+}
+
+TEST_F(FilterIndexTest, LiteralFilters)
+{
+  Add("/adbanner.", "adbanner");
+  Add("@@/adbanner.gif", "adbanner");
+  Add("-ad-300x250.$script", "300x250", SCRIPT);
+  EXPECT_EQ("/adbanner.", GetMatchingFilter("http://example.com/ADBANNER.png"));
+  EXPECT_EQ("@@/adbanner.gif", GetMatchingFilter("http://example.com/adbanner.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/adbanner.png", SCRIPT));
+  EXPECT_EQ("-ad-300x250.$script", GetMatchingFilter("http://example.com/x-ad-300x250.js", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/x-ad-300x250.js"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/banner.png"));
+}
+
+TEST_F(FilterIndexTest, LiteralFilterAnchors)
+{
+  Add("|http://start.", "start");
+  Add(".gif|", "gif");
+  Add("||ads.example.com^", "example");
+  Add("/sep^", "sep");
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://start.example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("https://x.com/?http://start."));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/a.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/a.gif?x"));
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://ads.example.com/"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("https://www.ads.example.com:8080/x"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://ads.example.com"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://badads.example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://ads.example.community/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ads.example.com/"));
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/sep?"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/sep"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/sep.png"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/sep-x"));
+}
+
+TEST_F(FilterIndexTest, LiteralFiltersWithDomains)
+{
+  Add("/banner.$domain=example.com|~www.example.com", "banner");
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.gif", IMAGE, ""));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/banner.gif", IMAGE, "http://example.com/"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/banner.gif", IMAGE, "https://user@sub.EXAMPLE.com.:80/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.gif", IMAGE, "http://www.example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.gif", IMAGE, "http://example.org/"));
+
+  Add("@@/banner.$domain=~example.org", "banner");
+  EXPECT_EQ("@@/banner.$domain=~example.org",
+    GetMatchingFilter("http://x.com/banner.gif", IMAGE, "http://example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.gif", IMAGE, "http://example.org/"));
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://x.com/banner.gif", IMAGE, "http://\xC3\xA4.com/"));
+}
+
+TEST_F(FilterIndexTest, UnsupportedFiltersAreLeftToJs)
+{
+  const char* filters[] = {
+    "/adbanner.$third-party", "/adbanner.$sitekey=abc", "/adbanner.$domain=",
+    "/adbanner.$~domain=example.com", "/adbanner$domain=a$b", "/ad(?=banner)/",
+    "/(ad)banner\\1/", "/\\bad\\b/"
+  };
+  for (const auto& filter : filters)
+  {
+    Add(filter, "");
+    EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://example.com/")) << filter;
+    Remove(filter);
+    EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://example.com/")) << filter;
+  }
+}
+
+TEST_F(FilterIndexTest, LiteralFiltersAreMergedAndRemoved)
+{
+  for (int round = 0; round < 3; ++round)
+  {
+    FilterIndex::Changes changes;
+    for (int i = 0; i < 1000; ++i)
+    {
+      std::string text = "/literal" + std::to_string(round * 1000 + i) + ".";
+      changes.added.emplace_back(text, CreateFilter("", IMAGE));
+    }
+    filterIndex.Update(std::move(changes));
+  }
+  auto memoryUsage = filterIndex.GetSnapshot()->GetMemoryUsage();
+
+  for (int i = 0; i < 3000; i += 2)
+    Remove("/literal" + std::to_string(i) + ".");
+  Add("/added.", "added");
+
+  for (int i = 0; i < 3000; ++i)
+  {
+    std::string url = "http://example.com/literal" + std::to_string(i) + ".gif";
+    EXPECT_EQ(i % 2 ? FilterIndex::MATCH : FilterIndex::NO_MATCH, Match(url)) << url;
+  }
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://example.com/added.gif"));
+  EXPECT_GT(memoryUsage, 3000u * 10);
+}
+
+TEST_F(FilterIndexTest, MemoryUsageIncludesStringsAndDomains)
+{
+  auto memoryUsage = filterIndex.GetSnapshot()->GetMemoryUsage();
+  std::string literal(1000, 'a');
+  std::string text = "/" + literal + ".$domain=";
+  for (int i = 0; i < 100; ++i)
+    text += (i ? "|" : "") + std::string("domain-number-") + std::to_string(i) + ".example.com";
+  Add(text, "");
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/" + literal + ".gif", IMAGE,
+                                      "http://domain-number-42.example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/" + literal + ".gif", IMAGE,
+                                         "http://example.com/"));
+  // The filter text and the literal, and a node and a string per domain.
+  EXPECT_GE(filterIndex.GetSnapshot()->GetMemoryUsage() - memoryUsage,
+            text.size() + literal.size() + 100 * (sizeof(void*) + 30));
+}
+
+TEST_F(FilterIndexTest, WildcardFilters)
+{
+  Add("/ad*banner.", "");
+  Add("||ads.*.com^*/track", "track");
+  Add("|http://*/keyword^", "keyword", SCRIPT);
+
+  EXPECT_EQ("/ad*banner.", GetMatchingFilter("http://x.com/AD/top/banner.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.ad"));
+
+  EXPECT_EQ("||ads.*.com^*/track", GetMatchingFilter("http://ads.foo.com/x/track"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("https://www.ads.foo.com:80/track?"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ads.foo.com/track"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://ads.foo.community/track"));
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/keyword?", SCRIPT));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/keyword", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/keywords", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("https://x.com/keyword", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/keyword"));
+
+  Add("@@||ads.*/keyword|$script", "keyword", SCRIPT);
+  EXPECT_EQ("@@||ads.*/keyword|$script", GetMatchingFilter("http://ads.x.com/keyword", SCRIPT));
+  EXPECT_EQ("|http://*/keyword^", GetMatchingFilter("http://x.com/keyword", SCRIPT));
+}
+
+TEST_F(FilterIndexTest, RegExpFilters)
+{
+  Add("/\\/ad[0-9]{2,3}x\\d+\\./", "");
+  Add("/^https?:\\/\\/(?:www\\.)?track(er|ing)\\.example\\//$script", "", SCRIPT);
+  Add("/\\.swf$/", "");
+
+  EXPECT_EQ("/\\/ad[0-9]{2,3}x\\d+\\./", GetMatchingFilter("http://x.com/AD300x250.png"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ad3x2.png"));
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("https://www.tracking.example/a.js", SCRIPT));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://tracker.example/", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/?https://tracker.example/", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("https://www.tracking.example/a.png"));
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/movie.swf"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/movie.swf?x"));
+}
+
+TEST_F(FilterIndexTest, RegExpFiltersWithEndAnchorAndOptions)
+{
+  Add("/ads$/$script", "", SCRIPT);
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/ads", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ads/x.js", SCRIPT));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ads", IMAGE));
+  Remove("/ads$/$script");
+
+  Add("/ads$/$script,domain=example.com", "", SCRIPT);
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/ads", SCRIPT, "http://example.com/"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ads", SCRIPT, "http://example.org/"));
+  Remove("/ads$/$script,domain=example.com");
+
+  // The options are found, but third-party isn't supported natively.
+  Add("/ads$/$script,third-party", "", SCRIPT);
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://x.com/ads", SCRIPT));
+  Remove("/ads$/$script,third-party");
+
+  // Both `$` could start the options.
+  Add("/ads$domain=example.com$script", "", SCRIPT);
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://x.com/ads", SCRIPT));
+}
+
+TEST_F(FilterIndexTest, MatchCaseFilters)
+{
+  Add("/Banner.$match-case", "banner");
+  Add("/AD[0-9]/$match-case", "");
+  Add("/Popup.$~match-case", "popup");
+
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/Banner.gif"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/banner.gif"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/AD1"));
+  EXPECT_EQ(FilterIndex::NO_MATCH, Match("http://x.com/ad1"));
+  EXPECT_EQ(FilterIndex::MATCH, Match("http://x.com/popup.gif"));
+}
+
+TEST_F(FilterIndexTest, PatternStatesBudget)
+{
+  // "/a*b" has seven states, "/ad*banner." fourteen.
+  FilterIndex smallIndex(8);
+  FilterIndex::Changes changes;
+  changes.added.emplace_back("/a*b", CreateFilter("", IMAGE));
+  changes.added.emplace_back("/ad*banner.", CreateFilter("", SCRIPT));
+  smallIndex.Update(std::move(changes));
+  std::string filterText;
+  EXPECT_EQ(FilterIndex::MATCH, smallIndex.GetSnapshot()->Match("http://x.com/ab",
+    IMAGE, "", filterText));
+  EXPECT_EQ(FilterIndex::UNKNOWN, smallIndex.GetSnapshot()->Match("http://x.com/ab",
+    SCRIPT, "", filterText));
+
+  FilterIndex disabledIndex(0);
+  changes = FilterIndex::Changes();
+  changes.added.emplace_back("/a*b", CreateFilter("", IMAGE));
+  changes.added.emplace_back("/ab.", CreateFilter("", SCRIPT));
+  disabledIndex.Update(std::move(changes));
+  EXPECT_EQ(FilterIndex::UNKNOWN, disabledIndex.GetSnapshot()->Match("http://x.com/ab",
+    IMAGE, "", filterText));
+  EXPECT_EQ(FilterIndex::MATCH, disabledIndex.GetSnapshot()->Match("http://x.com/ab.js",
+    SCRIPT, "", filterText));
+
+  Add("/a{1000}/", "");
+  EXPECT_EQ(FilterIndex::UNKNOWN, Match("http://x.com/"));
+}
@@ -62,4 +62,58 @@ TEST_F(GlobalJsObjectTest, SetMultipleTimeouts)
   GetJsEngine().Evaluate("setTimeout(function(s) {foo.push('2');}, 150)");
   AdblockPlus::Sleep(200);
   ASSERT_EQ("1,2", GetJsEngine().Evaluate("foo").AsString());
-}
\ No newline at end of file
+}
+
+TEST_F(GlobalJsObjectTest, ClearTimeout)
+{
+  GetJsEngine().Evaluate("let foo = []");
+  GetJsEngine().Evaluate("let id = setTimeout(function() {foo.push('1');}, 100)");
+  GetJsEngine().Evaluate("setTimeout(function() {foo.push('2');}, 100)");
+  ASSERT_TRUE(GetJsEngine().Evaluate("typeof id == 'number' && id > 0").AsBool());
+  GetJsEngine().Evaluate("clearTimeout(id)");
+  // unknown and invalid IDs are ignored
+  GetJsEngine().Evaluate("clearTimeout(id); clearTimeout(-1); clearTimeout()");
+  AdblockPlus::Sleep(200);
+  ASSERT_EQ("2", GetJsEngine().Evaluate("foo").AsString());
+}
+
+TEST_F(GlobalJsObjectTest, SetInterval)
+{
+  GetJsEngine().Evaluate("let foo = []; let id = setInterval(function(s) {"
+    "foo.push(s); if (foo.length == 3) clearInterval(id);}, 20, 'a')");
+  AdblockPlus::Sleep(200);
+  ASSERT_EQ("a,a,a", GetJsEngine().Evaluate("foo").AsString());
+}
+
+TEST_F(GlobalJsObjectTest, SetIntervalWithInvalidArgs)
+{
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("setInterval()"));
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("setInterval('', 1)"));
+}
+
+TEST_F(GlobalJsObjectTest, SetImmediate)
+{
+  GetJsEngine().Evaluate("let foo = []; setImmediate(function(s) {foo.push(s);}, 'b'); foo.push('a')");
+  // executed at the end of the call above
+  ASSERT_EQ("a,b", GetJsEngine().Evaluate("foo").AsString());
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("setImmediate()"));
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate("setImmediate('')"));
+}
+
+TEST_F(GlobalJsObjectTest, SetImmediateBeforeException)
+{
+  GetJsEngine().Evaluate("var foo = [];");
+  ASSERT_ANY_THROW(GetJsEngine().Evaluate(
+    "setImmediate(function() {foo.push('b');}); throw new Error('a')"));
+  // not run while the exception propagates, but once the lock is taken again
+  AdblockPlus::Sleep(100);
+  ASSERT_EQ("b", GetJsEngine().Evaluate("foo").AsString());
+}
+
+TEST_F(GlobalJsObjectTest, SetImmediateFromImmediateTask)
+{
+  GetJsEngine().Evaluate("let foo = []; let push = function() {"
+    "foo.push(foo.length); if (foo.length < 3) setImmediate(push);}; setImmediate(push)");
+  AdblockPlus::Sleep(100);
+  ASSERT_EQ("0,1,2", GetJsEngine().Evaluate("foo").AsString());
+}
@@ -0,0 +1,211 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BaseJsTest.h"
+
+using namespace AdblockPlus;
+
+namespace
+{
+  class IOTest : public BaseJsTest
+  {
+  protected:
+    void SetUp() override
+    {
+      InMemoryFileSystem* fileSystem;
+      ThrowingPlatformCreationParameters platformParams;
+      platformParams.logSystem.reset(new LazyLogSystem());
+      platformParams.timer.reset(new NoopTimer());
+      platformParams.fileSystem.reset(fileSystem = new InMemoryFileSystem());
+      platformParams.webRequest.reset(new NoopWebRequest());
+      platform.reset(new Platform(std::move(platformParams)));
+      ::CreateFilterEngine(*fileSystem, *platform);
+    }
+
+    // The file system runs its tasks immediately, so the promise returned by
+    // the expression is settled once Evaluate returns.
+    std::string Await(const std::string& promise)
+    {
+      GetJsEngine().Evaluate("var ioResult = 'pending'; (" + promise + ").then("
+        "() => ioResult = 'done', error => ioResult = 'error: ' + error);");
+      return GetJsEngine().Evaluate("ioResult").AsString();
+    }
+
+    void WriteLines(const std::string& fileName, const std::string& lines)
+    {
+      ASSERT_EQ("done", Await("require('io').IO.writeToFile('" + fileName +
+        "', " + lines + ")"));
+    }
+
+    std::string ReadLines(const std::string& fileName)
+    {
+      GetJsEngine().Evaluate("var ioLines = [];");
+      EXPECT_EQ("done", Await("require('io').IO.readFromFile('" + fileName +
+        "', line => ioLines.push(line))"));
+      return GetJsEngine().Evaluate("ioLines.join('|')").AsString();
+    }
+
+    bool FileExists(const std::string& fileName)
+    {
+      GetJsEngine().Evaluate("var ioExists;");
+      EXPECT_EQ("done", Await("require('io').IO.statFile('" + fileName +
+        "').then(result => ioExists = result.exists)"));
+      return GetJsEngine().Evaluate("ioExists").AsBool();
+    }
+
+    std::string ReadFile(const std::string& fileName)
+    {
+      GetJsEngine().Evaluate("var ioContent;");
+      EXPECT_EQ("done", Await("new Promise((resolve, reject) => "
+        "_fileSystem.read('" + fileName + "', resolve, reject))"
+        ".then(result => ioContent = result.content)"));
+      return GetJsEngine().Evaluate("ioContent").AsString();
+    }
+
+    void WriteFile(const std::string& fileName, const std::string& content)
+    {
+      GetJsEngine().SetGlobalProperty("ioContent",
+        GetJsEngine().NewValue(content));
+      ASSERT_EQ("done", Await("new Promise((resolve, reject) => "
+        "_fileSystem.write('" + fileName + "', ioContent, "
+        "error => error ? reject(error) : resolve()))"));
+    }
+  };
+}
+
+TEST_F(IOTest, ChangesAreAppendedToJournal)
+{
+  WriteLines("test.ini", "['[Subscription]', 'url=foo', 'a', 'b', 'c']");
+  EXPECT_FALSE(FileExists("test.ini.journal"));
+  std::string snapshot = ReadFile("test.ini");
+
+  WriteLines("test.ini", "['[Subscription]', 'url=foo', 'a', 'x', 'c', 'd']");
+  EXPECT_TRUE(FileExists("test.ini.journal"));
+  EXPECT_EQ(snapshot, ReadFile("test.ini"));
+  EXPECT_EQ("[Subscription]|url=foo|a|x|c|d", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, JournalIsReplayedInOrder)
+{
+  WriteLines("test.ini", "['a', 'b', 'c', 'd']");
+  WriteLines("test.ini", "['a', 'c', 'd', 'e']");
+  WriteLines("test.ini", "['x', 'a', 'c', 'y']");
+  WriteLines("test.ini", "['x', 'a', '', 'c', 'y', 'z']");
+  EXPECT_TRUE(FileExists("test.ini.journal"));
+  EXPECT_EQ("x|a|c|y|z", ReadLines("test.ini"));
+
+  // A change after reading the file is appended to the same journal.
+  WriteLines("test.ini", "['a', 'c', 'y', 'z']");
+  EXPECT_EQ("a|c|y|z", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, UnchangedFileIsNotWritten)
+{
+  WriteLines("test.ini", "['a', 'b']");
+  WriteLines("test.ini", "['a', 'b']");
+  EXPECT_FALSE(FileExists("test.ini.journal"));
+  EXPECT_EQ("a|b", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, JournalIsCompacted)
+{
+  WriteLines("test.ini", "['a', 'b']");
+  std::string lastLine;
+  int writeCount = 0;
+  do
+  {
+    lastLine = "c" + std::to_string(writeCount++);
+    WriteLines("test.ini", "['a', 'b', '" + lastLine + "']");
+  } while (FileExists("test.ini.journal") && writeCount < 1000);
+  ASSERT_FALSE(FileExists("test.ini.journal"));
+  EXPECT_LT(2, writeCount);
+  EXPECT_EQ("a\nb\n" + lastLine + "\n", ReadFile("test.ini"));
+  EXPECT_EQ("a|b|" + lastLine, ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, TornTrailingChangeIsDropped)
+{
+  WriteLines("test.ini", "['a', 'b', 'c']");
+  WriteLines("test.ini", "['a', 'x', 'c']");
+  WriteLines("test.ini", "['a', 'x', 'c', 'y']");
+
+  // Cut off the line which completes the last change.
+  std::string journal = ReadFile("test.ini.journal");
+  ASSERT_EQ('\n', journal.back());
+  journal.resize(journal.rfind('\n', journal.size() - 2) + 1);
+  WriteFile("test.ini.journal", journal);
+  EXPECT_EQ("a|x|c", ReadLines("test.ini"));
+
+  // The next write replaces the snapshot and removes the broken journal.
+  WriteLines("test.ini", "['a', 'x', 'c', 'z']");
+  EXPECT_FALSE(FileExists("test.ini.journal"));
+  EXPECT_EQ("a|x|c|z", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, LargeChangeIsStreamedIntoJournal)
+{
+  WriteLines("test.ini", "['a', 'b']");
+  WriteLines("test.ini",
+    "Array.from({length: 20000}, (value, i) => 'line' + i).concat('b')");
+  // The file is compacted after a streamed change, reading the streamed
+  // lines back from the journal.
+  EXPECT_FALSE(FileExists("test.ini.journal"));
+  GetJsEngine().Evaluate("var ioLines = [];");
+  ASSERT_EQ("done", Await("require('io').IO.readFromFile('test.ini', "
+    "line => ioLines.push(line))"));
+  EXPECT_EQ(20001, GetJsEngine().Evaluate("ioLines.length").AsInt());
+  EXPECT_EQ("line19999|b",
+    GetJsEngine().Evaluate("ioLines.slice(-2).join('|')").AsString());
+
+  WriteLines("test.ini", "['a', 'b']");
+  EXPECT_TRUE(FileExists("test.ini.journal"));
+  EXPECT_EQ("a|b", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, JournalOfOtherSnapshotIsDropped)
+{
+  WriteLines("test.ini", "['a', 'b', 'c']");
+  WriteLines("test.ini", "['a', 'x', 'c']");
+  ASSERT_TRUE(FileExists("test.ini.journal"));
+
+  // A new snapshot was written but the old journal wasn't removed, e.g.
+  // because the process was killed.
+  WriteFile("test.ini", "a\nb\nd\n");
+  EXPECT_EQ("a|b|d", ReadLines("test.ini"));
+
+  WriteLines("test.ini", "['a', 'b', 'd', 'e']");
+  EXPECT_FALSE(FileExists("test.ini.journal"));
+  EXPECT_EQ("a|b|d|e", ReadLines("test.ini"));
+}
+
+TEST_F(IOTest, JournalIsCopiedAndRenamedWithFile)
+{
+  WriteLines("test.ini", "['a', 'b']");
+  WriteLines("test.ini", "['a', 'c']");
+  ASSERT_EQ("done", Await("require('io').IO.copyFile('test.ini', 'copy.ini')"));
+  EXPECT_EQ("a|c", ReadLines("copy.ini"));
+
+  ASSERT_EQ("done",
+    Await("require('io').IO.renameFile('copy.ini', 'renamed.ini')"));
+  EXPECT_FALSE(FileExists("copy.ini"));
+  EXPECT_FALSE(FileExists("copy.ini.journal"));
+  EXPECT_EQ("a|c", ReadLines("renamed.ini"));
+
+  ASSERT_EQ("done", Await("require('io').IO.removeFile('renamed.ini')"));
+  EXPECT_FALSE(FileExists("renamed.ini"));
+  EXPECT_FALSE(FileExists("renamed.ini.journal"));
+}
@@ -15,14 +15,90 @@
  * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <stdexcept>
 #include "BaseJsTest.h"
+#include "../src/DefaultTimer.h"
 
 using namespace AdblockPlus;
 
 namespace
 {
   typedef BaseJsTest JsEngineTest;
+
+  class JsEngineWithEventLoopTest : public BaseJsTest
+  {
+  protected:
+    void SetUp() override
+    {
+      ThrowingPlatformCreationParameters params;
+      params.timer.reset(new DefaultTimer());
+      platform.reset(new Platform(std::move(params)));
+      platform->SetUpJsEngine(AppInfo(), nullptr, /*useEventLoop*/ true);
+    }
+  };
+
+  // Reads the content in chunks in its own thread.
+  class ChunkedFileSystem : public LazyFileSystem
+  {
+  public:
+    std::string content;
+    size_t chunkSize = 1;
+
+    void ReadChunks(const std::string& fileName, const ReadChunkCallback& chunkCallback,
+                    const ReadEndCallback& endCallback, const Callback& errorCallback) const override
+    {
+      auto content = this->content;
+      auto chunkSize = this->chunkSize;
+      std::thread([content, chunkSize, chunkCallback, endCallback, errorCallback]
+      {
+        try
+        {
+          for (size_t offset = 0; offset < content.size(); offset += chunkSize)
+          {
+            auto chunk = reinterpret_cast<const uint8_t*>(content.data()) + offset;
+            chunkCallback(chunk, std::min(chunkSize, content.size() - offset));
+          }
+          endCallback();
+        }
+        catch (const std::exception& e)
+        {
+          errorCallback(e.what());
+        }
+      }).detach();
+    }
+  };
+
+  class JsEngineWithEventLoopReadTest : public BaseJsTest
+  {
+  protected:
+    ChunkedFileSystem* fileSystem;
+
+    void SetUp() override
+    {
+      ThrowingPlatformCreationParameters params;
+      params.logSystem.reset(new LazyLogSystem());
+      params.timer.reset(new DefaultTimer());
+      params.fileSystem.reset(fileSystem = new ChunkedFileSystem());
+      platform.reset(new Platform(std::move(params)));
+      platform->SetUpJsEngine(AppInfo(), nullptr, /*useEventLoop*/ true);
+    }
+
+    std::string ReadFromFile(const std::string& listener)
+    {
+      GetJsEngine().Evaluate("var readResult; _fileSystem.readFromFile('foo', " +
+        listener + ", () => readResult = 'resolved', "
+        "error => readResult = 'rejected: ' + error);");
+      for (int i = 0; i < 500; i++)
+      {
+        auto result = GetJsEngine().Evaluate("readResult");
+        if (!result.IsUndefined())
+          return result.AsString();
+        AdblockPlus::Sleep(10);
+      }
+      return "timeout";
+    }
+  };
 }
 
 TEST_F(JsEngineTest, Evaluate)
@@ -160,6 +236,132 @@ TEST_F(JsEngineTest, EventCallbacks)
   ASSERT_FALSE(callbackCalled);
 }
 
+TEST_F(JsEngineTest, EventIDs)
+{
+  auto& jsEngine = GetJsEngine();
+  auto fooID = jsEngine.GetEventID("foo");
+  EXPECT_EQ(fooID, jsEngine.GetEventID("foo"));
+  EXPECT_NE(fooID, jsEngine.GetEventID("bar"));
+  EXPECT_EQ(fooID, jsEngine.Evaluate("_getEventID('foo')").AsInt());
+
+  int callsNumber = 0;
+  JsValueList callbackParams;
+  jsEngine.SetEventCallback(fooID, [&callsNumber, &callbackParams](JsValueList&& params)
+  {
+    ++callsNumber;
+    callbackParams = move(params);
+  });
+  jsEngine.Evaluate("_triggerEvent(_getEventID('foo'), 1)");
+  jsEngine.Evaluate("_triggerEvent('foo', 2)");
+  jsEngine.TriggerEvent(fooID, {jsEngine.NewValue(3)});
+  EXPECT_EQ(3, callsNumber);
+  ASSERT_EQ(1u, callbackParams.size());
+  EXPECT_EQ(3, callbackParams[0].AsInt());
+
+  jsEngine.RemoveEventCallback("foo");
+  jsEngine.TriggerEvent(fooID, JsValueList());
+  EXPECT_EQ(3, callsNumber);
+}
+
+TEST_F(JsEngineTest, UnknownEventNamesAreNotInterned)
+{
+  auto& jsEngine = GetJsEngine();
+  auto fooID = jsEngine.GetEventID("foo");
+  jsEngine.TriggerEvent("unknown", JsValueList());
+  jsEngine.Evaluate("_triggerEvent('unknown')");
+  jsEngine.RemoveEventCallback("unknown");
+  EXPECT_EQ(fooID + 1, jsEngine.GetEventID("bar"));
+}
+
+TEST_F(JsEngineTest, EventCallbackRemovesItself)
+{
+  auto& jsEngine = GetJsEngine();
+  auto fooID = jsEngine.GetEventID("foo");
+  auto callsNumber = std::make_shared<int>(0);
+  jsEngine.SetEventCallback(fooID, [&jsEngine, fooID, callsNumber](JsValueList&&)
+  {
+    ++*callsNumber;
+    jsEngine.RemoveEventCallback(fooID);
+    // the callback is still alive until it returns
+    ++*callsNumber;
+  });
+  jsEngine.Evaluate("_triggerEvent('foo'); _triggerEvent('foo')");
+  EXPECT_EQ(2, *callsNumber);
+  // the removed callback is destroyed after the event
+  EXPECT_EQ(1, callsNumber.use_count());
+}
+
+TEST_F(JsEngineTest, TriggerEventWithoutParameters)
+{
+  EXPECT_EQ("_triggerEvent requires at least 1 parameter",
+    GetJsEngine().Evaluate("try { _triggerEvent() } catch (e) { e }").AsString());
+}
+
+TEST_F(JsEngineTest, StoreAndTakeJsValues)
+{
+  auto& jsEngine = GetJsEngine();
+  JsValueList values;
+  for (int i = 0; i < 5; ++i)
+    values.push_back(jsEngine.NewValue(i));
+  auto id = jsEngine.StoreJsValues(values);
+  auto emptyID = jsEngine.StoreJsValues(JsValueList());
+
+  auto storedValues = jsEngine.GetJsValues(id);
+  ASSERT_EQ(5u, storedValues.size());
+  storedValues = jsEngine.TakeJsValues(id);
+  ASSERT_EQ(5u, storedValues.size());
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(i, storedValues[i].AsInt());
+  EXPECT_TRUE(jsEngine.TakeJsValues(emptyID).empty());
+}
+
+TEST_F(JsEngineTest, TakenJsValuesIDIsRejected)
+{
+  auto& jsEngine = GetJsEngine();
+  auto id = jsEngine.StoreJsValues({jsEngine.NewValue("foo")});
+  jsEngine.TakeJsValues(id);
+  EXPECT_THROW(jsEngine.GetJsValues(id), std::runtime_error);
+  EXPECT_THROW(jsEngine.TakeJsValues(id), std::runtime_error);
+
+  // the slot is reused but the old ID still does not refer to it
+  auto newID = jsEngine.StoreJsValues({jsEngine.NewValue("bar")});
+  EXPECT_THROW(jsEngine.TakeJsValues(id), std::runtime_error);
+  auto values = jsEngine.TakeJsValues(newID);
+  ASSERT_EQ(1u, values.size());
+  EXPECT_EQ("bar", values[0].AsString());
+}
+
+TEST_F(JsEngineTest, ConcurrentlyTakenJsValuesAreTakenOnce)
+{
+  auto& jsEngine = GetJsEngine();
+  std::vector<JsEngine::JsWeakValuesID> ids;
+  for (int i = 0; i < 100; ++i)
+    ids.push_back(jsEngine.StoreJsValues({jsEngine.NewValue(i)}));
+
+  std::atomic<int> takenNumber(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back([&jsEngine, &ids, &takenNumber]
+    {
+      for (const auto& id : ids)
+      {
+        try
+        {
+          jsEngine.TakeJsValues(id);
+          ++takenNumber;
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(100, takenNumber);
+}
+
 TEST(NewJsEngineTest, GlobalPropertyTest)
 {
   Platform platform{ThrowingPlatformCreationParameters()};
@@ -198,3 +400,49 @@ TEST(NewJsEngineTest, DISABLED_32bitsOnly_MemoryLeak_NoLeak)
     JsEngine::New(AppInfo(), platform);
   }
 }
+
+TEST_F(JsEngineWithEventLoopTest, EvaluateAndCall)
+{
+  auto func = GetJsEngine().Evaluate("(function(s) { return s + 'bar'; })");
+  ASSERT_TRUE(func.IsFunction());
+  ASSERT_EQ("foobar", func.Call(GetJsEngine().NewValue("foo")).AsString());
+  ASSERT_THROW(GetJsEngine().Evaluate("doesnotexist()"), std::runtime_error);
+}
+
+TEST_F(JsEngineWithEventLoopTest, JsIsExecutedInEventLoopThread)
+{
+  std::mutex mutex;
+  std::vector<std::thread::id> threadIDs;
+  GetJsEngine().SetEventCallback("event", [&mutex, &threadIDs](JsValueList&& params)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    threadIDs.push_back(std::this_thread::get_id());
+  });
+  GetJsEngine().Evaluate("_triggerEvent('event'); setTimeout(() => _triggerEvent('event'), 10)");
+  AdblockPlus::Sleep(100);
+  std::lock_guard<std::mutex> lock(mutex);
+  ASSERT_EQ(2u, threadIDs.size());
+  EXPECT_NE(std::this_thread::get_id(), threadIDs[0]);
+  EXPECT_EQ(threadIDs[0], threadIDs[1]);
+}
+
+TEST_F(JsEngineWithEventLoopReadTest, LargeFileIsReadWithBoundedQueue)
+{
+  for (int i = 0; i < 100000; i++)
+    fileSystem->content += "line" + std::to_string(i) + "\n";
+  fileSystem->chunkSize = 4096;
+  GetJsEngine().Evaluate("var lineCount = 0;");
+  ASSERT_EQ("resolved", ReadFromFile("() => lineCount++"));
+  EXPECT_EQ(100000, GetJsEngine().Evaluate("lineCount").AsInt());
+}
+
+TEST_F(JsEngineWithEventLoopReadTest, ListenerErrorRejects)
+{
+  fileSystem->content = "foo\nbar\nbaz\n";
+  GetJsEngine().Evaluate("var callCount = 0;");
+  auto result = ReadFromFile("() => { callCount++; throw new Error('listener error'); }");
+  EXPECT_EQ(0u, result.find("rejected: ")) << result;
+  EXPECT_NE(std::string::npos, result.find("listener error")) << result;
+  AdblockPlus::Sleep(50);
+  EXPECT_EQ(1, GetJsEngine().Evaluate("callCount").AsInt());
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <AdblockPlus/MpscQueue.h>
+
+using namespace AdblockPlus;
+
+namespace
+{
+  typedef MpscQueue<std::unique_ptr<int>> Queue;
+}
+
+TEST(MpscQueueTest, Empty)
+{
+  Queue queue;
+  std::unique_ptr<int> value;
+  EXPECT_FALSE(queue.TryPop(value));
+}
+
+TEST(MpscQueueTest, FifoOrder)
+{
+  Queue queue;
+  for (int i = 0; i < 3; ++i)
+    queue.Push(std::unique_ptr<int>(new int(i)));
+  queue.Wait();
+  std::unique_ptr<int> value;
+  for (int i = 0; i < 3; ++i)
+  {
+    ASSERT_TRUE(queue.TryPop(value));
+    ASSERT_TRUE(value);
+    EXPECT_EQ(i, *value);
+  }
+  EXPECT_FALSE(queue.TryPop(value));
+}
+
+TEST(MpscQueueTest, ValuesAreReleasedWithQueue)
+{
+  std::shared_ptr<int> value = std::make_shared<int>(0);
+  {
+    MpscQueue<std::shared_ptr<int>> queue;
+    queue.Push(value);
+    queue.Push(value);
+    std::shared_ptr<int> popped;
+    ASSERT_TRUE(queue.TryPop(popped));
+    EXPECT_EQ(3, value.use_count());
+  }
+  EXPECT_TRUE(value.unique());
+}
+
+TEST(MpscQueueTest, MultipleProducers)
+{
+  const int producersNumber = 4;
+  const int producerValuesNumber = 10000;
+  Queue queue;
+  std::vector<std::thread> producers;
+  for (int producer = 0; producer < producersNumber; ++producer)
+  {
+    producers.emplace_back([&queue, producer, producerValuesNumber]
+    {
+      for (int i = 0; i < producerValuesNumber; ++i)
+        queue.Push(std::unique_ptr<int>(new int(producer * producerValuesNumber + i)));
+    });
+  }
+  // Values of each producer come in the order they are pushed.
+  std::vector<int> lastValues(producersNumber, -1);
+  int poppedNumber = 0;
+  std::unique_ptr<int> value;
+  while (poppedNumber < producersNumber * producerValuesNumber)
+  {
+    queue.Wait();
+    while (queue.TryPop(value))
+    {
+      int producer = *value / producerValuesNumber;
+      EXPECT_LT(lastValues[producer], *value);
+      lastValues[producer] = *value;
+      ++poppedNumber;
+    }
+  }
+  for (auto& producer : producers)
+    producer.join();
+  EXPECT_FALSE(queue.TryPop(value));
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../src/PatternAutomaton.h"
+
+using AdblockPlus::PatternAutomaton;
+
+namespace
+{
+  const size_t STATES_BUDGET = 1000;
+
+  // Converts a filter pattern to a regular expression like
+  // RegExpFilter.prototype.regexp does.
+  std::string FilterPatternToRegExp(const std::string& pattern)
+  {
+    std::string source = std::regex_replace(pattern, std::regex("\\*+"), "*");
+    source = std::regex_replace(source, std::regex("\\^\\|$"), "^");
+    source = std::regex_replace(source, std::regex("[^a-zA-Z0-9_]"), "\\$&");
+    source = std::regex_replace(source, std::regex("\\\\\\*"), ".*");
+    source = std::regex_replace(source, std::regex("\\\\\\^"),
+      "(?:[\\x00-\\x24\\x26-\\x2C\\x2F\\x3A-\\x40\\x5B-\\x5E\\x60\\x7B-\\x7F]|$$)");
+    source = std::regex_replace(source, std::regex("^\\\\\\|\\\\\\|"),
+      "^[\\w\\-]+:\\/+(?!\\/)(?:[^\\/]+\\.)?");
+    source = std::regex_replace(source, std::regex("^\\\\\\|"), "^");
+    source = std::regex_replace(source, std::regex("\\\\\\|$"), "$$");
+    return source;
+  }
+
+  std::vector<std::string> GetUrls()
+  {
+    std::vector<std::string> urls = {
+      "", "http://example.com/", "https://www.ads.example.com:8080/ad300x250.png?x=1",
+      "http://ads.example.com", "http://x.com/ads.example.com/", "http://ads.example.community/",
+      "http:///ads.example.com/", "ws://a.b.ads.example.com/", "http://x.com/AD_Banner.GIF",
+      "http://tracker.example/t.js?v=123", "https://www.tracking.example/a.js",
+      "http://x.com/?https://tracker.example/", "http://x.com/aabbccdd", "http://x.com/a%2Fb",
+      "http://x.com/path\nnext", "http://x.com/{x}", "AbC", "xxy", "a-z", "[]^_`"
+    };
+    const char characters[] = "aAbBcCdxyz09./:-_?=%^|[]{}\n";
+    std::srand(1);
+    for (int i = 0; i < 2000; ++i)
+    {
+      std::string url;
+      for (int length = std::rand() % 16; length > 0; --length)
+        url.push_back(characters[std::rand() % (sizeof(characters) - 1)]);
+      urls.push_back(url);
+    }
+    return urls;
+  }
+
+  void ExpectSameMatches(const PatternAutomaton& automaton, const std::string& source,
+                         bool matchCase)
+  {
+    auto flags = std::regex::ECMAScript;
+    if (!matchCase)
+      flags |= std::regex::icase;
+    std::regex reference(source, flags);
+    for (const auto& url : GetUrls())
+      EXPECT_EQ(std::regex_search(url, reference), automaton.Matches(url)) << source << " " << url;
+  }
+}
+
+TEST(PatternAutomatonTest, RegExpMatchesLikeJavaScript)
+{
+  const char* sources[] = {
+    "ad[0-9]{2,3}x\\d+\\.", "^https?:\\/\\/(?:www\\.)?track(er|ing)\\.", "\\.(gif|png)$",
+    "[^a-z]ads?[_-]", "a.*b.*c", "(a|ab)(c|bcd)(d*)", "x{2,}y?", "x{2}y??", "[\\w-]+\\.js\\?v=\\d{1,4}",
+    "[\\W]", "[^\\W_]{5}", "\\x41\\u0042c", "[a-]z", "[Z-a]", "[^\\d.]{3}$",
+    "\\s|\\S\\n", "(?:)", "a|", "((a*)*b)+", "^$", "\\/\\.\\?", "[\\s\\D]x", "c$|^a", "[]", "[^]"
+  };
+  for (const char* source : sources)
+  {
+    for (bool matchCase : {false, true})
+    {
+      auto automaton = PatternAutomaton::FromRegExp(source, matchCase, STATES_BUDGET);
+      ASSERT_TRUE(automaton) << source;
+      ExpectSameMatches(*automaton, source, matchCase);
+    }
+  }
+}
+
+TEST(PatternAutomatonTest, InvalidQuantifiersAndEscapesAreLiterals)
+{
+  // std::regex doesn't implement these web compatibility extensions.
+  auto automaton = PatternAutomaton::FromRegExp("^\\xz{x{,2}x{a}$", false, STATES_BUDGET);
+  ASSERT_TRUE(automaton);
+  EXPECT_TRUE(automaton->Matches("xz{x{,2}x{a}"));
+  EXPECT_TRUE(automaton->Matches("XZ{X{,2}X{A}"));
+  EXPECT_FALSE(automaton->Matches("xz{x{,2}xa"));
+}
+
+TEST(PatternAutomatonTest, FilterPatternMatchesLikeJavaScript)
+{
+  const char* patterns[] = {
+    "/ad*banner.", "||ads.example.com^", "|http://*.js|", "^ad^", "a*b^|", "||x^*y", "|",
+    "||", "**x**", "x|", "A*B", "||example.com", "|http://x.com/^", "%2F", "a^^b", "?x=*&"
+  };
+  for (const char* pattern : patterns)
+  {
+    for (bool matchCase : {false, true})
+    {
+      auto automaton = PatternAutomaton::FromFilterPattern(pattern, matchCase, STATES_BUDGET);
+      ASSERT_TRUE(automaton) << pattern;
+      ExpectSameMatches(*automaton, FilterPatternToRegExp(pattern), matchCase);
+    }
+  }
+}
+
+TEST(PatternAutomatonTest, UnsupportedRegExps)
+{
+  const char* sources[] = {
+    "a(?=b)", "a(?!b)", "(?<=a)b", "(a)\\1", "\\bad", "a\\B", "\\cA", "*a", "a**", "(a", "a)",
+    "[z-a]", "\\u00e4", "\xC3\xA4", "x{2,1}", "{2}", "^*", "[a", "a\\"
+  };
+  for (const char* source : sources)
+    EXPECT_FALSE(PatternAutomaton::FromRegExp(source, false, STATES_BUDGET)) << source;
+}
+
+TEST(PatternAutomatonTest, StatesBudget)
+{
+  EXPECT_FALSE(PatternAutomaton::FromRegExp("a{100}", false, 100));
+  auto automaton = PatternAutomaton::FromRegExp("a{100}", false, 101);
+  ASSERT_TRUE(automaton);
+  EXPECT_EQ(101u, automaton->GetStatesNumber());
+  EXPECT_TRUE(automaton->Matches(std::string(100, 'A')));
+  EXPECT_FALSE(automaton->Matches(std::string(99, 'a')));
+
+  EXPECT_FALSE(PatternAutomaton::FromRegExp("(a{1000}){1000}", false, STATES_BUDGET));
+  EXPECT_FALSE(PatternAutomaton::FromFilterPattern("a*b", false, 0));
+}
+
+TEST(PatternAutomatonTest, MatchingTimeIsLinear)
+{
+  // Takes exponential time with a backtracking matcher.
+  auto automaton = PatternAutomaton::FromRegExp("(a|aa)*(a|aa)*(a|aa)*b", false, STATES_BUDGET);
+  ASSERT_TRUE(automaton);
+  EXPECT_FALSE(automaton->Matches(std::string(100000, 'a')));
+  EXPECT_TRUE(automaton->Matches(std::string(100000, 'a') + "b"));
+}
+
+TEST(PatternAutomatonTest, BuffersAreSharedBetweenAutomata)
+{
+  const char* sources[] = {"a.*b", "^x{2,5}y$", "(ab|cd)+[0-9]", "[^/]+\\.js"};
+  std::vector<std::shared_ptr<const PatternAutomaton>> automata;
+  for (const char* source : sources)
+  {
+    automata.push_back(PatternAutomaton::FromRegExp(source, false, STATES_BUDGET));
+    ASSERT_TRUE(automata.back()) << source;
+  }
+  PatternAutomaton::MatchBuffers sharedBuffers;
+  for (const auto& url : GetUrls())
+  {
+    for (size_t i = 0; i < automata.size(); ++i)
+    {
+      PatternAutomaton::MatchBuffers buffers;
+      EXPECT_EQ(automata[i]->Matches(url, buffers), automata[i]->Matches(url, sharedBuffers))
+        << sources[i] << " " << url;
+    }
+  }
+
+  // The marks of earlier calls are dropped once their offset would overflow.
+  sharedBuffers.positionBase = std::numeric_limits<size_t>::max() - 3;
+  EXPECT_TRUE(automata[0]->Matches("xaxbx", sharedBuffers));
+  EXPECT_TRUE(automata[0]->Matches("xaxbx", sharedBuffers));
+  EXPECT_FALSE(automata[0]->Matches("xbxax", sharedBuffers));
+}
@@ -0,0 +1,305 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <gtest/gtest.h>
+#include <AdblockPlus/SharedFilterList.h>
+#include "../src/CompiledFilterList.h"
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using AdblockPlus::FilterEngine;
+using AdblockPlus::FilterIndex;
+using AdblockPlus::SharedFilterListMatcher;
+using AdblockPlus::SharedFilterListPublisher;
+namespace CompiledFilterList = AdblockPlus::CompiledFilterList;
+
+namespace
+{
+  AdblockPlus::IFileSystem::IOBuffer CompileFilters(const std::vector<std::string>& texts)
+  {
+    CompiledFilterList::Filters filters;
+    for (const auto& text : texts)
+    {
+      FilterIndex::IndexedFilter filter;
+      filter.isException = text.compare(0, 2, "@@") == 0;
+      filter.keyword = filter.isException ? text.substr(2) : text;
+      filter.contentTypeMask = FilterEngine::CONTENT_TYPE_IMAGE;
+      filters.emplace_back(text, filter);
+    }
+    return CompiledFilterList::Write(filters, 512);
+  }
+
+  const std::chrono::seconds TIMEOUT(10);
+
+  // The control block holds the magic, the format version and the
+  // generation, 32 bit each.
+  const size_t CONTROL_BLOCK_SIZE = 12;
+
+  std::string GetSegmentName(const std::string& name)
+  {
+    return "/abp-" + name;
+  }
+
+  std::string GetSegmentName(const std::string& name, uint32_t generation)
+  {
+    return GetSegmentName(name) + "-" + std::to_string(generation);
+  }
+
+  // Returns the permissions of a segment, -1 if it doesn't exist.
+  int GetSegmentMode(const std::string& segmentName)
+  {
+    int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return -1;
+    struct stat nativeStat;
+    int mode = fstat(fd, &nativeStat) < 0 ? -1 : static_cast<int>(nativeStat.st_mode & 0777);
+    close(fd);
+    return mode;
+  }
+
+  // Creates a zero-filled control segment, like a publisher does before it
+  // initializes it, or changes the generation of an existing one.
+  void WriteControlSegment(const std::string& name, bool isCreated, uint32_t generation)
+  {
+    std::string segmentName = GetSegmentName(name);
+    int fd = shm_open(segmentName.c_str(), O_RDWR | (isCreated ? O_CREAT : 0), 0600);
+    ASSERT_GE(fd, 0);
+    if (isCreated)
+    {
+      ASSERT_EQ(0, ftruncate(fd, CONTROL_BLOCK_SIZE));
+    }
+    void* data = mmap(nullptr, CONTROL_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(MAP_FAILED, data);
+    if (!isCreated)
+      static_cast<uint32_t*>(data)[2] = generation;
+    munmap(data, CONTROL_BLOCK_SIZE);
+  }
+
+  class SharedFilterListTest : public ::testing::Test
+  {
+  protected:
+    std::string name;
+
+    void SetUp() override
+    {
+      name = "test-" + std::to_string(getpid());
+      SharedFilterListPublisher::Remove(name);
+    }
+
+    void TearDown() override
+    {
+      SharedFilterListPublisher::Remove(name);
+    }
+
+    SharedFilterListMatcher::MatchResult Match(const SharedFilterListMatcher& matcher,
+                                               const std::string& url,
+                                               std::string& filterText)
+    {
+      return matcher.Matches(url, FilterEngine::CONTENT_TYPE_IMAGE,
+                             "http://example.com/", filterText);
+    }
+  };
+}
+
+TEST_F(SharedFilterListTest, PublishedFiltersAreMatched)
+{
+  SharedFilterListPublisher publisher(name);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  EXPECT_EQ(SharedFilterListMatcher::NO_MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+  EXPECT_EQ(0u, matcher.GetGeneration());
+
+  EXPECT_EQ(1u, publisher.Publish(CompileFilters({"banner", "@@bannerok"})));
+  EXPECT_EQ(1u, matcher.WaitForFilterList(TIMEOUT));
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+  EXPECT_EQ("banner", filterText);
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/bannerok.png", filterText));
+  EXPECT_EQ("@@bannerok", filterText);
+  EXPECT_EQ(SharedFilterListMatcher::NO_MATCH,
+            Match(matcher, "http://example.com/image.png", filterText));
+  EXPECT_EQ(1u, matcher.GetGeneration());
+}
+
+TEST_F(SharedFilterListTest, MatchersSwitchToNewFilterLists)
+{
+  SharedFilterListPublisher publisher(name);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  publisher.Publish(CompileFilters({"banner"}));
+  matcher.WaitForFilterList(TIMEOUT);
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+
+  // Older segments are removed, matchers skip to the latest filter list.
+  publisher.Publish(CompileFilters({"advert"}));
+  publisher.Publish(CompileFilters({"tracker"}));
+  EXPECT_EQ(4u, publisher.Publish(CompileFilters({"tracker"})));
+  EXPECT_EQ(4u, matcher.WaitForFilterList(TIMEOUT));
+  EXPECT_EQ(SharedFilterListMatcher::NO_MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/tracker.png", filterText));
+
+  // A new matcher loads the current filter list as well.
+  SharedFilterListMatcher newMatcher(name);
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(newMatcher, "http://example.com/tracker.png", filterText));
+}
+
+TEST_F(SharedFilterListTest, MatchersLoadNewFilterListsInBackground)
+{
+  SharedFilterListPublisher publisher(name);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  publisher.Publish(CompileFilters({"banner"}));
+  auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+  while (Match(matcher, "http://example.com/banner.png", filterText) !=
+         SharedFilterListMatcher::MATCH &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(1u, matcher.GetGeneration());
+  EXPECT_EQ("banner", filterText);
+}
+
+TEST_F(SharedFilterListTest, RestartedPublisherContinuesGeneration)
+{
+  {
+    SharedFilterListPublisher publisher(name);
+    publisher.Publish(CompileFilters({"banner"}));
+  }
+  SharedFilterListPublisher publisher(name);
+  EXPECT_EQ(2u, publisher.Publish(CompileFilters({"advert"})));
+}
+
+TEST_F(SharedFilterListTest, InvalidFilterListIsSkipped)
+{
+  SharedFilterListPublisher publisher(name);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  publisher.Publish(CompileFilters({"banner"}));
+  matcher.WaitForFilterList(TIMEOUT);
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+  publisher.Publish(AdblockPlus::IFileSystem::IOBuffer{'A', 'B', 'P'});
+  EXPECT_EQ(2u, matcher.WaitForFilterList(TIMEOUT));
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+}
+
+TEST_F(SharedFilterListTest, RemovedFilterListCantBeOpened)
+{
+  {
+    SharedFilterListPublisher publisher(name);
+    publisher.Publish(CompileFilters({"banner"}));
+  }
+  SharedFilterListPublisher::Remove(name);
+  EXPECT_THROW(SharedFilterListMatcher matcher(name), std::runtime_error);
+}
+
+TEST_F(SharedFilterListTest, ZeroFilledControlSegmentHasNoFilterList)
+{
+  WriteControlSegment(name, true, 0);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  EXPECT_EQ(SharedFilterListMatcher::NO_MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+  EXPECT_EQ(0u, matcher.GetGeneration());
+
+  SharedFilterListPublisher publisher(name);
+  publisher.Publish(CompileFilters({"banner"}));
+  EXPECT_EQ(1u, matcher.WaitForFilterList(TIMEOUT));
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/banner.png", filterText));
+}
+
+TEST_F(SharedFilterListTest, SegmentsAreCreatedWithMode)
+{
+  SharedFilterListPublisher publisher(name, 0600);
+  publisher.Publish(CompileFilters({"banner"}));
+  EXPECT_EQ(0600, GetSegmentMode(GetSegmentName(name)));
+  EXPECT_EQ(0600, GetSegmentMode(GetSegmentName(name, 1)));
+}
+
+TEST_F(SharedFilterListTest, GenerationWrapsAround)
+{
+  SharedFilterListPublisher publisher(name);
+  WriteControlSegment(name, false, UINT32_MAX - 2);
+  SharedFilterListMatcher matcher(name);
+  std::string filterText;
+  EXPECT_EQ(UINT32_MAX - 1, publisher.Publish(CompileFilters({"banner"})));
+  EXPECT_EQ(UINT32_MAX, publisher.Publish(CompileFilters({"banner"})));
+  EXPECT_EQ(1u, publisher.Publish(CompileFilters({"advert"})));
+  EXPECT_EQ(-1, GetSegmentMode(GetSegmentName(name, UINT32_MAX - 1)));
+  EXPECT_EQ(2u, publisher.Publish(CompileFilters({"tracker"})));
+  EXPECT_EQ(-1, GetSegmentMode(GetSegmentName(name, UINT32_MAX)));
+  EXPECT_NE(-1, GetSegmentMode(GetSegmentName(name, 1)));
+  EXPECT_EQ(2u, matcher.WaitForFilterList(TIMEOUT));
+  EXPECT_EQ(SharedFilterListMatcher::MATCH,
+            Match(matcher, "http://example.com/tracker.png", filterText));
+
+  SharedFilterListPublisher::Remove(name);
+  EXPECT_EQ(-1, GetSegmentMode(GetSegmentName(name, 1)));
+  EXPECT_EQ(-1, GetSegmentMode(GetSegmentName(name, 2)));
+}
+
+#ifdef __linux__
+TEST_F(SharedFilterListTest, FilterListIsMappedInPlace)
+{
+  auto isMapped = [this]()
+  {
+    std::string path = "/dev/shm" + GetSegmentName(name, 1);
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line))
+    {
+      if (line.size() >= path.size() &&
+          line.compare(line.size() - path.size(), path.size(), path) == 0)
+        return true;
+    }
+    return false;
+  };
+
+  SharedFilterListPublisher publisher(name);
+  publisher.Publish(CompileFilters({"banner"}));
+  EXPECT_FALSE(isMapped());
+  {
+    SharedFilterListMatcher matcher(name);
+    EXPECT_EQ(1u, matcher.GetGeneration());
+    EXPECT_TRUE(isMapped());
+  }
+  EXPECT_FALSE(isMapped());
+}
+#endif
+
+TEST_F(SharedFilterListTest, InvalidNamesAreRejected)
+{
+  EXPECT_THROW(SharedFilterListPublisher publisher(""), std::invalid_argument);
+  EXPECT_THROW(SharedFilterListPublisher publisher("a/b"), std::invalid_argument);
+}
+#endif
@@ -0,0 +1,220 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <regex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../src/UrlTokenizer.h"
+
+namespace UrlTokenizer = AdblockPlus::UrlTokenizer;
+
+namespace
+{
+  // Keyword candidates as extracted by the JavaScript matcher:
+  // location.toLowerCase().match(/[a-z0-9%]{3,}/g)
+  std::vector<uint64_t> GetExpectedHashes(std::string url)
+  {
+    for (auto& c : url)
+    {
+      if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+    }
+    std::vector<uint64_t> hashes;
+    std::regex keywordRegex("[a-z0-9%]{3,}");
+    for (std::sregex_iterator it(url.begin(), url.end(), keywordRegex), end; it != end; ++it)
+      hashes.push_back(UrlTokenizer::HashKeyword(it->str()));
+    return hashes;
+  }
+
+  std::vector<uint64_t> GetHashes(const std::string& url)
+  {
+    std::vector<uint64_t> hashes;
+    EXPECT_TRUE(UrlTokenizer::ForEachKeywordHash(url, [&hashes](uint64_t hash)
+    {
+      hashes.push_back(hash);
+      return true;
+    }));
+    return hashes;
+  }
+
+  // Request URLs as seen by a browser loading a few news and shopping sites,
+  // with the identifiers replaced.
+  const char* BENCHMARK_CORPUS[] = {
+    "https://www.example-news.com/",
+    "https://www.example-news.com/static/css/main.4f6a2c1e.chunk.css",
+    "https://www.example-news.com/static/js/vendor.8b1d3e7f.chunk.js",
+    "https://cdn.example-news.com/images/2019/04/12/world/12climate-1/12climate-1-superJumbo.jpg?quality=90&auto=webp",
+    "https://fonts.googleapis.com/css?family=Roboto:300,400,500,700&display=swap",
+    "https://fonts.gstatic.com/s/roboto/v20/KFOmCnqEu92Fr1Mu4mxKKTU1Kg.woff2",
+    "https://www.google-analytics.com/analytics.js",
+    "https://www.google-analytics.com/collect?v=1&_v=j79&a=1187654321&t=pageview&_s=1&dl=https%3A%2F%2Fwww.example-news.com%2F&ul=en-us&de=UTF-8&dt=Example%20News&sd=24-bit&sr=1920x1080&vp=1903x969&je=0&_u=QACAAEAB~&jid=&gjid=&cid=123456789.1555012345&tid=UA-1234567-1&_gid=987654321.1555012345&z=1357924680",
+    "https://securepubads.g.doubleclick.net/tag/js/gpt.js",
+    "https://securepubads.g.doubleclick.net/gampad/ads?gdfp_req=1&pvsid=1234567890123456&correlator=9876543210987654&output=ldjh&impl=fifs&adsid=NT&iu_parent=1234567%2Fexample&enc_prev_ius=%2F0%2F1%2C%2F0%2F1&prev_iu_szs=300x250%7C300x600%2C728x90%7C970x250&fluid=height&ifi=1&sfv=1-0-33",
+    "https://tpc.googlesyndication.com/safeframe/1-0-33/html/container.html",
+    "https://pagead2.googlesyndication.com/pagead/show_ads_impl_fy2019.js",
+    "https://ad.doubleclick.net/ddm/trackimp/N1234.123456EXAMPLE/B12345678.123456789;dc_trk_aid=123456789;dc_trk_cid=987654321;ord=1555012345?",
+    "https://connect.facebook.net/en_US/fbevents.js",
+    "https://www.facebook.com/tr/?id=123456789012345&ev=PageView&dl=https%3A%2F%2Fwww.example-news.com%2F&rl=&if=false&ts=1555012345678&sw=1920&sh=1080&v=2.8.45&r=stable&ec=0&o=30&it=1555012345000&coo=false",
+    "https://static.chartbeat.com/js/chartbeat.js",
+    "https://ping.chartbeat.net/ping?h=example-news.com&p=%2F&u=DkMyZBDmR3vBBfdQr&d=example-news.com&g=12345&g0=Homepage&n=1&f=00001&c=0.43&x=0&m=0&y=4325&o=1903&w=969&j=45&R=1&W=0&I=0&E=0&e=0&r=&b=1234&t=BqZlMdCk9dO3Kq2mLB3z7vxB1Dn3Y&V=112&i=Example%20News&tz=-120&sn=1&sv=DkMyZBDmR3vBBfdQr&sd=1&im=0&_",
+    "https://sb.scorecardresearch.com/beacon.js",
+    "https://sb.scorecardresearch.com/p?c1=2&c2=1234567&ns_site=example-news&name=homepage&ns__t=1555012345678&ns_c=UTF-8&c8=Example%20News&c7=https%3A%2F%2Fwww.example-news.com%2F&c9=",
+    "https://www.example-shop.com/product/12345678/USB-C-Charger-65W-GaN?ref=sr_1_3&qid=1555012345&keywords=usb+c+charger",
+    "https://images-na.example-shop.com/images/I/71abcdEFGHL._AC_SX679_.jpg",
+    "https://images-na.example-shop.com/images/I/41XYZabcdeL._AC_US40_.jpg",
+    "https://m.example-shop.com/api/v2/recommendations?asin=B07ABCDEFG&widget=similar&count=12&locale=en_US",
+    "https://fls-na.example-shop.com/1/batch/1/OE/",
+    "https://aax-us-east.example-shop-adsystem.com/e/loi/imp?b=JBvPCLlE0pHpP4v9lc2zDaoAAAFqDz1fOAEAAAH2AQBOL0EgICAgICAgICAgICBOL0EgICAgICAgICAgICAyJvEB",
+    "https://c.example-shop-adsystem.com/aax2/apstag.js",
+    "https://cdn.cookielaw.org/consent/0123abcd-4567-89ef-0123-456789abcdef/otSDKStub.js",
+    "https://geolocation.onetrust.com/cookieconsentpub/v1/geo/location",
+    "https://www.youtube.com/embed/dQw4w9WgXcQ?enablejsapi=1&origin=https%3A%2F%2Fwww.example-news.com",
+    "https://i.ytimg.com/vi/dQw4w9WgXcQ/hqdefault.jpg",
+    "https://static.doubleclick.net/instream/ad_status.js",
+    "https://api.example-news.com/graphql?operationName=LatestHeadlines&variables=%7B%22first%22%3A20%2C%22section%22%3A%22world%22%7D",
+    "https://bat.bing.com/action/0?ti=1234567&Ver=2&mid=0f1e2d3c-4b5a-6978-8796-a5b4c3d2e1f0&evt=pageLoad&sid=1&lt=2345&pi=0&lg=en-US&sw=1920&sh=1080&sc=24&tl=Example%20News&p=https%3A%2F%2Fwww.example-news.com%2F&r=&msclkid=N",
+    "https://s.pinimg.com/ct/core.js",
+    "https://ct.pinterest.com/v3/?tid=2612345678901&event=init&ad=%7B%22loc%22%3A%22https%3A%2F%2Fwww.example-shop.com%2F%22%7D&cb=1555012345678",
+  };
+
+  // The keyword candidates found by a plain per-character loop, for
+  // comparing the block-wise classification with.
+  template<typename Callback>
+  void ForEachKeywordHashPerCharacter(const std::string& url, Callback&& callback)
+  {
+    uint64_t hash = UrlTokenizer::FNV_OFFSET_BASIS;
+    size_t length = 0;
+    for (char c : url)
+    {
+      c = UrlTokenizer::ToKeywordCharacter(c);
+      if (c)
+      {
+        hash = (hash ^ static_cast<uint8_t>(c)) * UrlTokenizer::FNV_PRIME;
+        ++length;
+        continue;
+      }
+      if (length >= UrlTokenizer::MIN_KEYWORD_LENGTH)
+        callback(hash);
+      hash = UrlTokenizer::FNV_OFFSET_BASIS;
+      length = 0;
+    }
+    if (length >= UrlTokenizer::MIN_KEYWORD_LENGTH)
+      callback(hash);
+  }
+
+  template<typename Tokenize>
+  uint64_t TimeTokenizing(const std::string& name, const std::vector<std::string>& urls,
+                          Tokenize&& tokenize)
+  {
+    const int rounds = 2000;
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+      for (const auto& url : urls)
+      {
+        tokenize(url, [&checksum](uint64_t hash)
+        {
+          checksum += hash;
+          return true;
+        });
+      }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << std::chrono::duration_cast<std::chrono::nanoseconds>(
+      elapsed).count() / (rounds * urls.size()) << " ns per URL" << std::endl;
+    return checksum;
+  }
+}
+
+TEST(UrlTokenizerTest, TokensFollowJsKeywordRules)
+{
+  std::string urls[] = {
+    "",
+    "ab",
+    "abc",
+    "http://example.com/",
+    "HTTPS://WWW.Example.COM/Path/To/AdBanner.GIF?Query=1%20x&ab=cd",
+    "http://ads.example.org/a/b/c/d/serve.php?zone=123456789012345678901234567890&s=300x250",
+    "http://example.com/%%%/_/abc_def/ghi-jkl/mno.pqr/~stu/[vwx]/{yz0}/`12`/@34@/",
+    "http://example.com/abcdefghijklmnopqrstuvwxyz0123456789%ABCDEFGHIJKLMNOPQRSTUVWXYZ",
+    "http://example.com/" + std::string(64, 'a') + "/" + std::string(31, 'B') + "/",
+  };
+  for (const auto& url : urls)
+    EXPECT_EQ(GetExpectedHashes(url), GetHashes(url)) << url;
+}
+
+TEST(UrlTokenizerTest, RandomUrls)
+{
+  const std::string alphabet = "aZ09%/.:?&=_-~@[]`{}^|AzbY";
+  std::srand(0);
+  for (int i = 0; i < 1000; ++i)
+  {
+    std::string url(std::rand() % 100, ' ');
+    for (auto& c : url)
+      c = alphabet[std::rand() % alphabet.size()];
+    EXPECT_EQ(GetExpectedHashes(url), GetHashes(url)) << url;
+  }
+}
+
+TEST(UrlTokenizerTest, NonAsciiUrlsAreRejected)
+{
+  EXPECT_FALSE(UrlTokenizer::ForEachKeywordHash("http://example.com/\xE2\x84\xAA",
+    [](uint64_t)
+    {
+      return true;
+    }));
+  EXPECT_FALSE(UrlTokenizer::ForEachKeywordHash(
+    "http://example.com/abcdefghijklmnopqrstuvwxyz/\xC3\xA4",
+    [](uint64_t)
+    {
+      return true;
+    }));
+}
+
+TEST(UrlTokenizerTest, CallbackStopsTokenizing)
+{
+  int calls = 0;
+  EXPECT_TRUE(UrlTokenizer::ForEachKeywordHash("http://example.com/foo/bar",
+    [&calls](uint64_t)
+    {
+      return ++calls < 2;
+    }));
+  EXPECT_EQ(2, calls);
+}
+
+// Not a correctness test, prints the time taken per URL of the corpus.
+TEST(UrlTokenizerTest, DISABLED_Benchmark)
+{
+  std::vector<std::string> urls(std::begin(BENCHMARK_CORPUS), std::end(BENCHMARK_CORPUS));
+  uint64_t perCharacter = TimeTokenizing("per character", urls,
+    [](const std::string& url, auto&& callback)
+    {
+      ForEachKeywordHashPerCharacter(url, callback);
+    });
+  uint64_t blockWise = TimeTokenizing("block-wise", urls,
+    [](const std::string& url, auto&& callback)
+    {
+      UrlTokenizer::ForEachKeywordHash(url, callback);
+    });
+  EXPECT_EQ(perCharacter, blockWise);
+}
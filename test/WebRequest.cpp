@@ -174,6 +174,26 @@ TEST_F(MockWebRequestTest, SuccessfulRequest)
   ASSERT_EQ("{\"Foo\":\"Bar\"}", jsEngine.Evaluate("JSON.stringify(foo.responseHeaders)").AsString());
 }
 
+TEST_F(MockWebRequestTest, LargeResponseText)
+{
+  auto& jsEngine = GetJsEngine();
+  std::string url = "http://example.com/" + std::string(100 * 1024, 'a');
+  jsEngine.Evaluate("let foo; _webRequest.GET('" + url + "', {}, function(result) {foo = result;} )");
+  ProcessPendingWebRequests();
+  ASSERT_EQ(url.length() + 1, static_cast<size_t>(jsEngine.Evaluate("foo.responseText.length").AsInt()));
+  ASSERT_EQ(url + "\n", jsEngine.Evaluate("foo.responseText").AsString());
+}
+
+TEST_F(MockWebRequestTest, LargeNonAsciiResponseText)
+{
+  auto& jsEngine = GetJsEngine();
+  std::string url = "http://example.com/" + std::string(100 * 1024, 'a');
+  jsEngine.Evaluate("let foo; _webRequest.GET('" + url + "', {X: '\\u00e4'}, function(result) {foo = result;} )");
+  ProcessPendingWebRequests();
+  ASSERT_EQ(url + "\nX\n\xc3\xa4", jsEngine.Evaluate("foo.responseText").AsString());
+  ASSERT_EQ("\xc3\xa4", jsEngine.Evaluate("foo.responseText.substr(-1)").AsString());
+}
+
 #if defined(HAVE_CURL) || defined(_WIN32)
 TEST_F(DefaultWebRequestTest, RealWebRequest)
 {